@@ -4,7 +4,7 @@
 
 find_package(PkgConfig)
 pkg_check_modules(PURPLE REQUIRED "purple >= 2.7.0")
-pkg_check_modules(GLIB2 REQUIRED "glib-2.0 >= 2.16.0")
+pkg_check_modules(GLIB2 REQUIRED "glib-2.0 >= 2.16.0" "gthread-2.0 >= 2.16.0")
 # extaction plugin requires a newer version of glib, check if it's available
 pkg_check_modules(GLIB232 QUIET "glib-2.0 >= 2.32.0")
 if (NOT GLIB232_FOUND)
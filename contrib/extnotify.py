@@ -3,44 +3,33 @@
 """
 This script processes events generated by the extaction plugin and displays
 notifications of these events on the screen.
+
+The script can be executed for every event with the event described in the
+environment variables, or it can run in the worker mode of the plugin and read
+the events from its standard input.
 """
 
 import os
 import sys
 import base64
 import cgi
+import json
 import pynotify
 
-def main():
-    # make the parameters saved in enviromental variables easier accessible
-    try:
-        event_type = os.environ['EVENT_TYPE']
-        # this script can handle only the msg type
-        if event_type != 'msg':
-            sys.exit(1)
-
-        #event_network = os.environ['EVENT_NETWORK']
-        #event_local_user = os.environ['EVENT_LOCAL_USER']
-        event_remote_user = os.environ['EVENT_REMOTE_USER']
-        event_message = os.environ['EVENT_MESSAGE']
-        #event_message_html = os.environ['EVENT_MESSAGE_HTML']
-    except KeyError:
-        # some necessary parameters are missing
-        sys.exit(1)
-
-    if not pynotify.init('Extaction-plugin handler'):
-        sys.exit(1)
-
-    title = 'Message from %s:' % event_remote_user
-    # event_message is in UTF-8, decode it to Unicode, then select first 256
+def notify(remote_user, message, icon_encoded, count):
+    # the plugin merges messages that arrive shortly after each other
+    if count > 1:
+        title = '%d messages from %s, the latest:' % (count, remote_user)
+    else:
+        title = 'Message from %s:' % remote_user
+    # message is in UTF-8, decode it to Unicode, then select first 256
     # characters and encode them back to UTF-8
-    body = event_message.decode('utf-8')[0:256].encode('utf-8')
+    body = message.decode('utf-8')[0:256].encode('utf-8')
     # and escape the '&', '<', '>' characters
     body = cgi.escape(body)
     n = pynotify.Notification(title, body)
-    if os.environ.has_key('EVENT_REMOTE_USER_ICON'):
+    if icon_encoded:
         # the icon is encoded in base64, decode it first
-        icon_encoded = os.environ['EVENT_REMOTE_USER_ICON']
         icon_decoded = base64.b64decode(icon_encoded)
 
         # create a pixbuf loader
@@ -56,6 +45,58 @@ def main():
     # get the notification on the screen
     n.show()
 
+def process_stream():
+    # every line is one event encoded in JSON
+    for line in iter(sys.stdin.readline, ''):
+        try:
+            event = json.loads(line)
+        except ValueError:
+            continue
+
+        # this script can handle only the msg type
+        if event.get('type') != 'msg':
+            continue
+        try:
+            notify(event['remote_user'].encode('utf-8'),
+                   event['message'].encode('utf-8'),
+                   event.get('remote_user_icon'), event.get('count', 1))
+        except KeyError:
+            # some necessary parameters are missing
+            continue
+
+def main():
+    # make the parameters saved in enviromental variables easier accessible
+    try:
+        event_type = os.environ['EVENT_TYPE']
+    except KeyError:
+        sys.exit(1)
+
+    if not pynotify.init('Extaction-plugin handler'):
+        sys.exit(1)
+
+    if event_type == 'stream':
+        process_stream()
+        pynotify.uninit()
+        return
+
+    # this script can handle only the msg type
+    if event_type != 'msg':
+        sys.exit(1)
+
+    try:
+        #event_network = os.environ['EVENT_NETWORK']
+        #event_local_user = os.environ['EVENT_LOCAL_USER']
+        event_remote_user = os.environ['EVENT_REMOTE_USER']
+        event_message = os.environ['EVENT_MESSAGE']
+        #event_message_html = os.environ['EVENT_MESSAGE_HTML']
+    except KeyError:
+        # some necessary parameters are missing
+        sys.exit(1)
+
+    notify(event_remote_user, event_message,
+           os.environ.get('EVENT_REMOTE_USER_ICON'),
+           int(os.environ.get('EVENT_COUNT', '1')))
+
     pynotify.uninit()
 
 if __name__ == '__main__':
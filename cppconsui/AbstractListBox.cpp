@@ -39,7 +39,8 @@ AbstractListBox::AbstractListBox(int w, int h)
 Button *AbstractListBox::insertItem(size_t pos, const char *title,
     const sigc::slot<void, Button&>& callback)
 {
-  Button *b = new Button(Curses::onscreen_width(title), 1, title);
+  Button *b = new Button(0, 1, title);
+  b->setWidth(b->getTextRun().getWidth());
   b->signal_activate.connect(callback);
   insertWidget(pos, *b);
   return b;
@@ -48,7 +49,8 @@ Button *AbstractListBox::insertItem(size_t pos, const char *title,
 Button *AbstractListBox::appendItem(const char *title,
     const sigc::slot<void, Button&>& callback)
 {
-  Button *b = new Button(Curses::onscreen_width(title), 1, title);
+  Button *b = new Button(0, 1, title);
+  b->setWidth(b->getTextRun().getWidth());
   b->signal_activate.connect(callback);
   appendWidget(*b);
   return b;
@@ -32,9 +32,7 @@ namespace CppConsUI
 {
 
 Button::Button(int w, int h, const char *text_, int flags_, bool masked_)
-: Widget(w, h), flags(flags_), text(NULL), text_width(0), text_height(0)
-, value(NULL), value_width(0), unit(NULL) , unit_width(0), right(NULL)
-, right_width(0), masked(masked_)
+: Widget(w, h), flags(flags_), masked(masked_)
 {
   setText(text_);
 
@@ -43,9 +41,7 @@ Button::Button(int w, int h, const char *text_, int flags_, bool masked_)
 }
 
 Button::Button(const char *text_, int flags_, bool masked_)
-: Widget(AUTOSIZE, AUTOSIZE), flags(flags_), text(NULL), text_width(0)
-, text_height(0), value(NULL), value_width(0), unit(NULL), unit_width(0)
-, right(NULL), right_width(0), masked(masked_)
+: Widget(AUTOSIZE, AUTOSIZE), flags(flags_), masked(masked_)
 {
   setText(text_);
 
@@ -55,9 +51,7 @@ Button::Button(const char *text_, int flags_, bool masked_)
 
 Button::Button(int w, int h, int flags_, const char *text_,
     const char *value_, const char *unit_, const char *right_, bool masked_)
-: Widget(w, h), flags(flags_), text(NULL), text_width(0), text_height(0)
-, value(NULL), value_width(0), unit(NULL), unit_width(0), right(NULL)
-, right_width(0), masked(masked_)
+: Widget(w, h), flags(flags_), masked(masked_)
 {
   setText(text_);
   setValue(value_);
@@ -70,9 +64,7 @@ Button::Button(int w, int h, int flags_, const char *text_,
 
 Button::Button(int flags_, const char *text_, const char *value_,
     const char *unit_, const char *right_, bool masked_)
-: Widget(AUTOSIZE, AUTOSIZE), flags(flags_), text(NULL), text_width(0)
-, text_height(0), value(NULL), value_width(0), unit(NULL), unit_width(0)
-, right(NULL), right_width(0), masked(masked_)
+: Widget(AUTOSIZE, AUTOSIZE), flags(flags_), masked(masked_)
 {
   setText(text_);
   setValue(value_);
@@ -83,14 +75,6 @@ Button::Button(int flags_, const char *text_, const char *value_,
   declareBindables();
 }
 
-Button::~Button()
-{
-  g_free(text);
-  g_free(value);
-  g_free(unit);
-  g_free(right);
-}
-
 void Button::draw()
 {
   proceedUpdateArea();
@@ -109,29 +93,18 @@ void Button::draw()
   int realh = area->getmaxy();
 
   // print text
+  int text_width = text.getWidth();
+  int text_height = text.getLinesCount();
   area->fill(attrs, 0, 0, text_width, realh);
-  int y = 0;
-  const char *start, *end;
-  start = end = text;
-  while (*end) {
-    if (*end == '\n') {
-      if (y >= realh)
-        break;
-
-      area->mvaddstring(0, y, realw, start, end);
-      y++;
-      start = end + 1;
-    }
-    end++;
-  }
-  if (y < realh)
-    area->mvaddstring(0, y, realw, start, end);
+  for (int y = 0; y < text_height && y < realh; y++)
+    text.draw(*area, 0, y, realw, y);
 
   int l = text_width;
   int h = (text_height - 1) / 2;
 
   // print value
   if (flags & FLAG_VALUE) {
+    int value_width = value.getWidth();
     area->fill(attrs, l, 0, value_width + 2, realh);
     if (h < realh) {
       l += area->mvaddstring(l, h, realw - l, ": ");
@@ -142,31 +115,33 @@ void Button::draw()
           l += area->mvaddstring(l, h, realw - l, "*");
       }
       else
-        l += area->mvaddstring(l, h, realw - l, value);
+        l += value.draw(*area, l, h, realw - l);
     }
   }
 
   // print unit text
-  if (flags & FLAG_UNIT && unit) {
-    area->fill(attrs, l, 0, unit_width + 1, realh);
+  if (flags & FLAG_UNIT && unit.getBytes()) {
+    area->fill(attrs, l, 0, unit.getWidth() + 1, realh);
     if (h < realh) {
       l += area->mvaddstring(l, h, realw - l, " ");
-      l += area->mvaddstring(l, h, realw - l, unit);
+      l += unit.draw(*area, l, h, realw - l);
     }
   }
 
   area->attroff(attrs);
 
   // print right area text
-  if (flags & FLAG_RIGHT && right && h < realh) {
-    const char *cur = right;
-    int width = right_width;
-    while (width > realw - l - 1) {
-      width -= Curses::onscreen_width(g_utf8_get_char(cur));
-      cur = g_utf8_next_char(cur);
-    }
-    area->mvaddstring(realw - width, h, cur);
-  }
+  if (flags & FLAG_RIGHT && right.getBytes() && h < realh)
+    right.drawTail(*area, l + 1, h, realw - l - 1);
+}
+
+bool Button::processMouse(const MouseEvent& event)
+{
+  if (!event.isClick() || !has_focus)
+    return Widget::processMouse(event);
+
+  actionActivate();
+  return true;
 }
 
 void Button::setFlags(int new_flags)
@@ -189,68 +164,34 @@ void Button::setMasked(bool new_masked)
 
 void Button::setText(const char *new_text)
 {
-  g_free(text);
-
-  text = g_strdup(new_text ? new_text : "");
-
-  // update text_width, text_height and wish height
-  text_width = 0;
-  text_height = 1;
-
-  const char *start, *end;
-  start = end = text;
-  int w;
-  while (*end) {
-    if (*end == '\n') {
-      w = Curses::onscreen_width(start, end);
-      if (w > text_width)
-        text_width = w;
-      text_height++;
-      start = end + 1;
-    }
-    end++;
-  }
-  w = Curses::onscreen_width(start, end);
-  if (w > text_width)
-    text_width = w;
-  setWishHeight(text_height);
-
+  text = TextRun(new_text);
+  setWishHeight(text.getLinesCount());
   redraw();
 }
 
 void Button::setValue(const char *new_value)
 {
-  g_free(value);
-
-  value = g_strdup(new_value ? new_value : "");
-  value_width = Curses::onscreen_width(value);
+  value = TextRun(new_value);
   redraw();
 }
 
 void Button::setValue(int new_value)
 {
-  g_free(value);
-
-  value = g_strdup_printf("%d", new_value);
-  value_width = Curses::onscreen_width(value);
+  char *str = g_strdup_printf("%d", new_value);
+  value = TextRun(str);
+  g_free(str);
   redraw();
 }
 
 void Button::setUnit(const char *new_unit)
 {
-  g_free(unit);
-
-  unit = g_strdup(new_unit ? new_unit : "");
-  unit_width = Curses::onscreen_width(unit);
+  unit = TextRun(new_unit);
   redraw();
 }
 
 void Button::setRight(const char *new_right)
 {
-  g_free(right);
-
-  right = g_strdup(new_right ? new_right : "");
-  right_width = Curses::onscreen_width(right);
+  right = TextRun(new_right);
   redraw();
 }
 
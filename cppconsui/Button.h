@@ -29,6 +29,7 @@
 #ifndef __BUTTON_H__
 #define __BUTTON_H__
 
+#include "TextRun.h"
 #include "Widget.h"
 
 namespace CppConsUI
@@ -60,10 +61,15 @@ public:
   Button(int flags_, const char *text_ = NULL, const char *value_ = NULL,
       const char *unit_ = NULL, const char *right_ = NULL,
       bool masked_ = false);
-  virtual ~Button();
+  virtual ~Button() {}
 
   // Widget
   virtual void draw();
+  /**
+   * The first click focuses the button, a click on the focused button
+   * activates it.
+   */
+  virtual bool processMouse(const MouseEvent& event);
 
   virtual void setFlags(int new_flags);
   virtual int getFlags() const { return flags; }
@@ -75,17 +81,21 @@ public:
   /**
    * Returns previously set text.
    */
-  virtual const char *getText() const { return text; }
+  virtual const char *getText() const { return text.getText(); }
+  /**
+   * Returns the text with its precomputed metrics.
+   */
+  virtual const TextRun& getTextRun() const { return text; }
 
   virtual void setValue(const char *new_value);
   virtual void setValue(int new_value);
-  virtual const char *getValue() const { return value; }
+  virtual const char *getValue() const { return value.getText(); }
 
   virtual void setUnit(const char *new_unit);
-  virtual const char *getUnit() const { return unit; }
+  virtual const char *getUnit() const { return unit.getText(); }
 
   virtual void setRight(const char *new_right);
-  virtual const char *getRight() const { return right; }
+  virtual const char *getRight() const { return right.getText(); }
 
   virtual void setMasked(bool new_masked);
   virtual bool isMasked() const { return masked; }
@@ -97,15 +107,10 @@ public:
 
 protected:
   int flags;
-  char *text;
-  int text_width;
-  int text_height;
-  char *value;
-  int value_width;
-  char *unit;
-  int unit_width;
-  char *right;
-  int right_width;
+  TextRun text;
+  TextRun value;
+  TextRun unit;
+  TextRun right;
   bool masked;
 
 private:
@@ -78,7 +78,7 @@ void ColorPicker::setText(const char *new_text)
 {
   label->setText(new_text);
   if (new_text)
-    label->setWidth(Curses::onscreen_width(new_text) + 1);
+    label->setWidth(label->getTextRun().getWidth() + 1);
   else
     label->setWidth(0);
 }
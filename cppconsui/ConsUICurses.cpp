@@ -165,6 +165,17 @@ int Window::mvaddstring(int x, int y, const char *str, const char *end)
   return printed;
 }
 
+int Window::mvaddwstring(int x, int y, const wchar_t *str, size_t n)
+{
+  g_assert(str);
+
+  if (!n)
+    return OK;
+
+  wmove(p->win, y, x);
+  return waddnwstr(p->win, str, n);
+}
+
 int Window::mvaddchar(int x, int y, gunichar uc)
 {
   wmove(p->win, y, x);
@@ -316,38 +327,27 @@ int Window::printChar(gunichar uc)
    * @todo Error checking (setcchar).
    */
 
-  if (uc >= 0x7f && uc < 0xa0) {
-    // filter out C1 (8-bit) control characters
-    waddch(p->win, '?');
-    return 1;
+  // tab character
+  if (uc == '\t') {
+    int w = onscreen_width(uc);
+    for (int i = 0; i < w; i++)
+      waddch(p->win, ' ');
+    return w;
   }
 
-  // get a unicode character from the next few bytes
+  // invalid utf-8 sequence
+  if (!(uc = printable_char(uc)))
+    return 0;
+
   wchar_t wch[2];
   cchar_t cc;
 
   wch[0] = uc;
   wch[1] = L'\0';
 
-  // invalid utf-8 sequence
-  if (wch[0] < 0)
-    return 0;
-
-  // tab character
-  if (wch[0] == '\t') {
-    int w = onscreen_width(wch[0]);
-    for (int i = 0; i < w; i++)
-      waddch(p->win, ' ');
-    return w;
-  }
-
-  // control char symbols
-  if (wch[0] < 32)
-    wch[0] = 0x2400 + wch[0];
-
   setcchar(&cc, wch, A_NORMAL, 0, NULL);
   wadd_wch(p->win, &cc);
-  return onscreen_width(wch[0]);
+  return onscreen_width(uc);
 }
 
 Window::Window()
@@ -517,6 +517,23 @@ int onscreen_width(gunichar uc, int w)
   return g_unichar_iswide(uc) ? 2 : 1;
 }
 
+gunichar printable_char(gunichar uc)
+{
+  // filter out C1 (8-bit) control characters
+  if (uc >= 0x7f && uc < 0xa0)
+    return '?';
+
+  // invalid utf-8 sequence
+  if (static_cast<wchar_t>(uc) < 0)
+    return 0;
+
+  // control char symbols
+  if (uc < 32 && uc != '\t')
+    return 0x2400 + uc;
+
+  return uc;
+}
+
 const Stats *get_stats()
 {
   return &stats;
@@ -85,6 +85,11 @@ public:
   int mvaddstring(int x, int y, const char *str);
   int mvaddstring(int x, int y, int w, const char *str, const char *end);
   int mvaddstring(int x, int y, const char *str, const char *end);
+  /**
+   * Adds n characters that are already converted by printable_char(), the
+   * string is handed to curses as it is.
+   */
+  int mvaddwstring(int x, int y, const wchar_t *str, size_t n);
 
   int mvaddchar(int x, int y, gunichar uc);
 
@@ -174,6 +179,13 @@ int resizeterm(int lines, int columns);
 
 int onscreen_width(const char *start, const char *end = NULL);
 int onscreen_width(gunichar uc, int w = 0);
+/**
+ * Returns the character that is printed in place of a given one. Control
+ * characters are replaced by their symbols and 0 is returned for an invalid
+ * character. Tabs are returned as they are, they have to be expanded by the
+ * caller.
+ */
+gunichar printable_char(gunichar uc);
 
 const Stats *get_stats();
 void reset_stats();
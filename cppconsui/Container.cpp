@@ -54,6 +54,15 @@ void Container::updateArea()
   Widget::updateArea();
 }
 
+void Container::releaseArea()
+{
+  // subpads of children have to be deleted before the pad of this container
+  for (Children::iterator i = children.begin(); i != children.end(); i++)
+    i->widget->releaseArea();
+
+  Widget::releaseArea();
+}
+
 void Container::draw()
 {
   proceedUpdateArea();
@@ -109,6 +118,18 @@ void Container::ungrabFocus()
     focus_child->ungrabFocus();
 }
 
+bool Container::processMouse(const MouseEvent& event)
+{
+  Widget *child = getChildAt(event.x, event.y);
+  if (child) {
+    Point origin = getChildOrigin(*child);
+    if (child->processMouse(event.translated(-origin.x, -origin.y)))
+      return true;
+  }
+
+  return Widget::processMouse(event);
+}
+
 void Container::setParent(Container& parent)
 {
   /* The parent will take care about focus changing and focus chain caching
@@ -118,6 +139,17 @@ void Container::setParent(Container& parent)
   Widget::setParent(parent);
 }
 
+bool Container::resolveColorScheme()
+{
+  if (!Widget::resolveColorScheme())
+    return false;
+
+  // children that don't have their own color scheme inherit the new one
+  for (Children::iterator i = children.begin(); i != children.end(); i++)
+    i->widget->resolveColorScheme();
+  return true;
+}
+
 void Container::addWidget(Widget& widget, int x, int y)
 {
   insertWidget(children.size(), widget, x, y);
@@ -442,6 +474,29 @@ Point Container::getAbsolutePosition(const Widget& child) const
   return Point(p.getX() + child.getLeft(), p.getY() + child.getTop());
 }
 
+Widget *Container::getChildAt(int x, int y)
+{
+  // later children are drawn over the earlier ones
+  for (Children::reverse_iterator i = children.rbegin();
+      i != children.rend(); i++) {
+    Widget *widget = i->widget;
+    if (!widget->isVisible())
+      continue;
+
+    Point origin = getChildOrigin(*widget);
+    if (x >= origin.x && y >= origin.y
+        && x < origin.x + widget->getRealWidth()
+        && y < origin.y + widget->getRealHeight())
+      return widget;
+  }
+  return NULL;
+}
+
+Point Container::getChildOrigin(const Widget& child) const
+{
+  return Point(child.getLeft(), child.getTop());
+}
+
 Curses::Window *Container::getSubPad(const Widget& child, int begin_x,
     int begin_y, int ncols, int nlines)
 {
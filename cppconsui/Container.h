@@ -86,13 +86,16 @@ public:
 
   // Widget
   virtual void updateArea();
+  virtual void releaseArea();
   virtual void draw();
   virtual Widget *getFocusWidget();
   virtual void cleanFocus();
   virtual bool restoreFocus();
   virtual bool grabFocus();
   virtual void ungrabFocus();
+  virtual bool processMouse(const MouseEvent& event);
   virtual void setParent(Container& parent);
+  virtual bool resolveColorScheme();
 
   /**
    * Adds a widget to the children list. The Container takes ownership of the
@@ -170,6 +173,17 @@ public:
       const Widget& child) const;
   virtual Point getAbsolutePosition(const Widget& child) const;
 
+  /**
+   * Returns a visible child that occupies a given position or NULL. The
+   * position is in the coordinates of this container, children positions are
+   * taken from their areas as they were set up by the last draw.
+   */
+  virtual Widget *getChildAt(int x, int y);
+  /**
+   * Returns a position of the child area in this container.
+   */
+  virtual Point getChildOrigin(const Widget& child) const;
+
   /**
    * Returns a subpad of current widget with given coordinates.
    */
@@ -24,13 +24,21 @@
 #include "ColorScheme.h"
 #include "KeyConfig.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <signal.h>
 #include <termios.h>
 #include <unistd.h>
 #include "gettext.h"
 
+/* Initial and maximal size of the libtermkey input buffer. The buffer is
+ * doubled every time a single read fills it completely. */
+#define INPUT_BUFFER_MIN 1024
+#define INPUT_BUFFER_MAX (64 * 1024)
+
 namespace CppConsUI
 {
 
@@ -223,6 +231,17 @@ FreeWindow *CoreManager::getTopWindow()
   return dynamic_cast<FreeWindow*>(input_child);
 }
 
+void CoreManager::setMouseEnabled(bool enabled)
+{
+  if (enabled == mouse_enabled)
+    return;
+
+  // X10 compatible reporting of button presses and releases
+  fputs(enabled ? "\033[?1000h" : "\033[?1000l", stdout);
+  fflush(stdout);
+  mouse_enabled = enabled;
+}
+
 void CoreManager::enableResizing()
 {
   onScreenResized();
@@ -261,6 +280,59 @@ void CoreManager::redraw()
   }
 }
 
+void CoreManager::resetInputLatencyStats()
+{
+  memset(&input_latency_stats, 0, sizeof(input_latency_stats));
+}
+
+void CoreManager::resetInputBatchStats()
+{
+  memset(&input_batch_stats, 0, sizeof(input_batch_stats));
+  if (tk)
+    input_batch_stats.buffer_size = termkey_get_buffer_size(tk);
+}
+
+bool CoreManager::saveInputStats(const char *filename, GError **err) const
+{
+  g_assert(filename);
+
+  const InputLatencyStats *stats = &input_latency_stats;
+  GString *out = g_string_new(NULL);
+
+  g_string_append_printf(out, "# samples: %u\n", stats->samples);
+  if (stats->samples) {
+    g_string_append_printf(out, "# average: %" G_GINT64_FORMAT "us\n",
+        stats->total / stats->samples);
+    g_string_append_printf(out, "# max: %" G_GINT64_FORMAT "us\n",
+        stats->max);
+  }
+  g_string_append(out, "# from_us to_us count\n");
+  for (int i = 0; i < InputLatencyStats::BUCKETS_NUM; i++)
+    g_string_append_printf(out, "%lu %lu %u\n", i ? 1UL << i : 0UL,
+        (1UL << (i + 1)) - 1, stats->buckets[i]);
+
+  const InputBatchStats *batch_stats = &input_batch_stats;
+  g_string_append_printf(out, "\n# batches: %u\n", batch_stats->batches);
+  if (batch_stats->batches) {
+    g_string_append_printf(out, "# keys: %u, average: %.2f, max: %u\n",
+        batch_stats->keys,
+        static_cast<double>(batch_stats->keys) / batch_stats->batches,
+        batch_stats->max_keys);
+    g_string_append_printf(out, "# reads: %u, bytes: %lu\n",
+        batch_stats->reads, static_cast<unsigned long>(batch_stats->bytes));
+  }
+  g_string_append_printf(out, "# buffer size: %lu\n",
+      static_cast<unsigned long>(batch_stats->buffer_size));
+  g_string_append(out, "# from_keys to_keys count\n");
+  for (int i = 0; i < InputBatchStats::BUCKETS_NUM; i++)
+    g_string_append_printf(out, "%lu %lu %u\n", i ? 1UL << i : 0UL,
+        (1UL << (i + 1)) - 1, batch_stats->buckets[i]);
+
+  bool res = g_file_set_contents(filename, out->str, out->len, err);
+  g_string_free(out, TRUE);
+  return res;
+}
+
 sigc::connection CoreManager::timeoutConnect(const sigc::slot<bool>& slot,
     unsigned interval, int priority)
 {
@@ -291,9 +363,13 @@ sigc::connection CoreManager::timeoutOnceConnect(const sigc::slot<void>& slot,
 CoreManager::CoreManager()
 : top_input_processor(NULL), io_input_channel(NULL), io_input_channel_id(0)
 , resize_channel(NULL), resize_channel_id(0), pipe_valid(false), tk(NULL)
-, utf8(false), gmainloop(NULL), redraw_pending(false), resize_pending(false)
+, utf8(false), mouse_enabled(false), gmainloop(NULL), redraw_pending(false)
+, resize_pending(false)
 {
+  resetInputLatencyStats();
+
   initInput();
+  resetInputBatchStats();
 
   /**
    * @todo Check the return value. Throw an exception if we can't init curses.
@@ -311,6 +387,7 @@ CoreManager::~CoreManager()
   // destroy the main loop
   g_main_loop_unref(gmainloop);
 
+  setMouseEnabled(false);
   finalizeInput();
 
   /* Close all windows, work with a copy of the windows vector because the
@@ -356,6 +433,10 @@ bool CoreManager::processInput(const TermKeyKey& key)
   if (top_input_processor && top_input_processor->processInput(key))
     return true;
 
+  // mouse events are delivered by position instead of the focus chain
+  if (key.type == TERMKEY_TYPE_MOUSE)
+    return processMouseInput(key);
+
   return InputProcessor::processInput(key);
 }
 
@@ -374,8 +455,68 @@ gboolean CoreManager::io_input(GIOChannel * /*source*/, GIOCondition /*cond*/)
   if (io_input_timeout_conn.connected())
     io_input_timeout_conn.disconnect();
 
-  termkey_advisereadable(tk);
+  // all keys decoded during this wakeup arrived at the same time
+  gint64 stamp = getMonotonicTime();
 
+  /* Drain everything that is available. The buffer is decoded after every
+   * read so the next read can reuse it. */
+  TermKeyResult ret = TERMKEY_RES_NONE;
+  unsigned reads = 0;
+  size_t bytes = 0;
+  while (true) {
+    if (!termkey_get_buffer_remaining(tk))
+      growInputBuffer();
+
+    size_t space = termkey_get_buffer_remaining(tk);
+    if (termkey_advisereadable(tk) != TERMKEY_RES_AGAIN)
+      break;
+
+    size_t len = space - termkey_get_buffer_remaining(tk);
+    reads++;
+    bytes += len;
+
+    ret = decodeInput();
+
+    /* A short read means that there is nothing more to read at the moment,
+     * a full one means the buffer is too small for the current load. */
+    if (len < space)
+      break;
+    growInputBuffer();
+    if (!isInputReadable())
+      break;
+  }
+
+  // process the whole batch
+  for (InputKeys::iterator i = input_batch.begin(); i != input_batch.end();
+      i++)
+    processStampedInput(*i, stamp);
+  addInputBatchSample(input_batch.size(), reads, bytes);
+  input_batch.clear();
+
+  // display the result of the batch at once
+  draw();
+
+  if (ret == TERMKEY_RES_AGAIN) {
+    int wait = termkey_get_waittime(tk);
+    io_input_timeout_conn = timeoutOnceConnect(sigc::mem_fun(this,
+          &CoreManager::io_input_timeout), wait);
+  }
+
+  return TRUE;
+}
+
+void CoreManager::io_input_timeout()
+{
+  TermKeyKey key;
+  if (termkey_getkey_force(tk, &key) == TERMKEY_RES_KEY) {
+    /* This should happen only for Esc key, so no need to do locale->utf8
+     * conversion. */
+    processStampedInput(key, getMonotonicTime());
+  }
+}
+
+TermKeyResult CoreManager::decodeInput()
+{
   TermKeyKey key;
   TermKeyResult ret;
   while ((ret = termkey_getkey(tk, &key)) == TERMKEY_RES_KEY) {
@@ -397,25 +538,165 @@ gboolean CoreManager::io_input(GIOChannel * /*source*/, GIOCondition /*cond*/)
       key.code.codepoint = g_utf8_get_char(key.utf8);
     }
 
-    processInput(key);
-  }
-  if (ret == TERMKEY_RES_AGAIN) {
-    int wait = termkey_get_waittime(tk);
-    io_input_timeout_conn = timeoutOnceConnect(sigc::mem_fun(this,
-          &CoreManager::io_input_timeout), wait);
+    input_batch.push_back(key);
   }
 
-  return TRUE;
+  return ret;
 }
 
-void CoreManager::io_input_timeout()
+bool CoreManager::isInputReadable() const
 {
-  TermKeyKey key;
-  if (termkey_getkey_force(tk, &key) == TERMKEY_RES_KEY) {
-    /* This should happen only for Esc key, so no need to do locale->utf8
-     * conversion. */
-    processInput(key);
+  struct pollfd fds;
+  fds.fd = STDIN_FILENO;
+  fds.events = POLLIN;
+  fds.revents = 0;
+
+  int res;
+  do
+    res = poll(&fds, 1, 0);
+  while (res < 0 && errno == EINTR);
+
+  return res > 0 && (fds.revents & POLLIN);
+}
+
+void CoreManager::growInputBuffer()
+{
+  size_t size = termkey_get_buffer_size(tk);
+  if (size >= INPUT_BUFFER_MAX)
+    return;
+
+  size = MIN(size * 2, INPUT_BUFFER_MAX);
+  if (termkey_set_buffer_size(tk, size))
+    input_batch_stats.buffer_size = size;
+}
+
+void CoreManager::addInputBatchSample(size_t keys, unsigned reads,
+    size_t bytes)
+{
+  int bucket = 0;
+  while (bucket < InputBatchStats::BUCKETS_NUM - 1 && keys >> (bucket + 1))
+    bucket++;
+
+  input_batch_stats.buckets[bucket]++;
+  input_batch_stats.batches++;
+  input_batch_stats.keys += keys;
+  if (keys > input_batch_stats.max_keys)
+    input_batch_stats.max_keys = keys;
+  input_batch_stats.reads += reads;
+  input_batch_stats.bytes += bytes;
+}
+
+gint64 CoreManager::getMonotonicTime()
+{
+#if GLIB_CHECK_VERSION(2, 28, 0)
+  return g_get_monotonic_time();
+#else
+  GTimeVal tv;
+  g_get_current_time(&tv);
+  return static_cast<gint64>(tv.tv_sec) * G_USEC_PER_SEC + tv.tv_usec;
+#endif // GLIB_CHECK_VERSION(2, 28, 0)
+}
+
+void CoreManager::processStampedInput(const TermKeyKey& key, gint64 stamp)
+{
+  processInput(key);
+
+  /* Keys that do not change anything on the screen are not interesting, the
+   * latency of other keys is measured when the frame is displayed. */
+  if (redraw_pending)
+    input_stamps.push_back(stamp);
+}
+
+bool CoreManager::processMouseInput(const TermKeyKey& key)
+{
+  TermKeyMouseEvent ev;
+  int button, line, col;
+  if (termkey_interpret_mouse(tk, &key, &ev, &button, &line, &col)
+      != TERMKEY_RES_KEY)
+    return false;
+
+  MouseEvent::Type type;
+  switch (ev) {
+    case TERMKEY_MOUSE_PRESS:
+      type = MouseEvent::PRESS;
+      break;
+    case TERMKEY_MOUSE_DRAG:
+      type = MouseEvent::DRAG;
+      break;
+    case TERMKEY_MOUSE_RELEASE:
+      type = MouseEvent::RELEASE;
+      break;
+    default:
+      return false;
   }
+
+  // libtermkey buttons 4 and 5 are the wheel
+  MouseEvent::Button btn = MouseEvent::BUTTON_NONE;
+  if (button >= MouseEvent::BUTTON_LEFT
+      && button <= MouseEvent::BUTTON_WHEEL_DOWN)
+    btn = static_cast<MouseEvent::Button>(button);
+
+  // libtermkey reports positions starting from 1
+  int x = col - 1;
+  int y = line - 1;
+
+  FreeWindow *win = getWindowAt(x, y);
+  FreeWindow *top = getTopWindow();
+
+  // top windows (dialogs, menus) are modal
+  if (top && top->getType() == FreeWindow::TYPE_TOP && win != top)
+    return true;
+
+  if (!win)
+    return false;
+
+  // a press raises the window
+  if (type == MouseEvent::PRESS && win != top
+      && win->getType() == FreeWindow::TYPE_NORMAL)
+    win->show();
+
+  Point origin = win->getAbsolutePosition();
+  return win->processMouse(MouseEvent(type, btn, x - origin.x,
+        y - origin.y));
+}
+
+FreeWindow *CoreManager::getWindowAt(int x, int y)
+{
+  // top -> normal -> non-focusable, the reverse of the drawing order
+  const FreeWindow::Type types[] = {FreeWindow::TYPE_TOP,
+    FreeWindow::TYPE_NORMAL, FreeWindow::TYPE_NON_FOCUSABLE};
+
+  for (size_t t = 0; t < G_N_ELEMENTS(types); t++)
+    for (Windows::reverse_iterator i = windows.rbegin(); i != windows.rend();
+        i++) {
+      FreeWindow *win = *i;
+      if (win->getType() != types[t])
+        continue;
+
+      Point origin = win->getAbsolutePosition();
+      if (x >= origin.x && y >= origin.y
+          && x < origin.x + win->getRealWidth()
+          && y < origin.y + win->getRealHeight())
+        return win;
+    }
+  return NULL;
+}
+
+void CoreManager::addInputLatencySample(gint64 latency)
+{
+  if (latency < 0)
+    latency = 0;
+
+  int bucket = 0;
+  while (bucket < InputLatencyStats::BUCKETS_NUM - 1
+      && latency >> (bucket + 1))
+    bucket++;
+
+  input_latency_stats.buckets[bucket]++;
+  input_latency_stats.samples++;
+  input_latency_stats.total += latency;
+  if (latency > input_latency_stats.max)
+    input_latency_stats.max = latency;
 }
 
 gboolean CoreManager::resize_input(GIOChannel *source, GIOCondition /*cond*/)
@@ -442,6 +723,7 @@ void CoreManager::initInput()
     exit(1);
   }
   termkey_set_canonflags(tk, TERMKEY_CANON_DELBS);
+  termkey_set_buffer_size(tk, INPUT_BUFFER_MIN);
   utf8 = g_get_charset(NULL);
 
   io_input_channel = g_io_channel_unix_new(STDIN_FILENO);
@@ -542,6 +824,15 @@ void CoreManager::draw()
   // copy virtual ncurses screen to the physical screen
   Curses::doupdate();
 
+  // the effect of all stamped keys is visible now
+  if (!input_stamps.empty()) {
+    gint64 now = getMonotonicTime();
+    for (InputStamps::iterator i = input_stamps.begin();
+        i != input_stamps.end(); i++)
+      addInputLatencySample(now - *i);
+    input_stamps.clear();
+  }
+
 #if defined(DEBUG) && GLIB_MAJOR_VERSION >= 2 && GLIB_MINOR_VERSION >= 28
   const Curses::Stats *stats = Curses::get_stats();
   gint64 tdiff = g_get_monotonic_time() - t1;
@@ -70,6 +70,13 @@ public:
   void disableResizing();
   void onScreenResized();
 
+  /**
+   * Turns terminal mouse reporting on or off. Mouse events are delivered to
+   * the window and the widget under the mouse pointer.
+   */
+  void setMouseEnabled(bool enabled);
+  bool isMouseEnabled() const { return mouse_enabled; }
+
   void setTopInputProcessor(InputProcessor& top)
     { top_input_processor = &top; }
   InputProcessor *getTopInputProcessor()
@@ -77,6 +84,73 @@ public:
 
   void redraw();
 
+  /**
+   * Input-to-screen latency histogram. Every key is timestamped when it is
+   * read from the terminal and its latency is measured when the first frame
+   * drawn after processing the key is copied to the physical screen.
+   */
+  struct InputLatencyStats
+  {
+    static const int BUCKETS_NUM = 24;
+
+    /**
+     * Bucket i holds the number of keys with latency in the <2^i, 2^(i+1))
+     * microseconds range, the first bucket includes also zero latency.
+     */
+    unsigned buckets[BUCKETS_NUM];
+    unsigned samples;
+    gint64 total;
+    gint64 max;
+  };
+
+  const InputLatencyStats *getInputLatencyStats() const
+    { return &input_latency_stats; }
+  void resetInputLatencyStats();
+
+  /**
+   * Input batch statistics. All data available on the standard input are
+   * read during one wakeup and keys decoded from them are processed as one
+   * batch followed by a single redraw.
+   */
+  struct InputBatchStats
+  {
+    static const int BUCKETS_NUM = 12;
+
+    /**
+     * Bucket i holds the number of batches with the number of keys in the
+     * <2^i, 2^(i+1)) range, the first bucket includes also empty batches.
+     */
+    unsigned buckets[BUCKETS_NUM];
+    unsigned batches;
+    unsigned keys;
+    unsigned max_keys;
+    /**
+     * Number of read() calls and the number of bytes read.
+     */
+    unsigned reads;
+    size_t bytes;
+    /**
+     * Current size of the input buffer.
+     */
+    size_t buffer_size;
+  };
+
+  const InputBatchStats *getInputBatchStats() const
+    { return &input_batch_stats; }
+  void resetInputBatchStats();
+
+  /**
+   * Writes the input latency and batch size histograms in a text form into
+   * a given file.
+   */
+  bool saveInputStats(const char *filename, GError **err) const;
+
+  /**
+   * Returns time in microseconds that is not affected by changes of the
+   * system clock.
+   */
+  static gint64 getMonotonicTime();
+
   sigc::connection timeoutConnect(const sigc::slot<bool>& slot,
       unsigned interval, int priority = G_PRIORITY_DEFAULT);
   sigc::connection timeoutOnceConnect(const sigc::slot<void>& slot,
@@ -91,6 +165,8 @@ protected:
 
 private:
   typedef std::vector<FreeWindow*> Windows;
+  typedef std::vector<gint64> InputStamps;
+  typedef std::vector<TermKeyKey> InputKeys;
 
   Windows windows;
 
@@ -106,12 +182,25 @@ private:
 
   TermKey *tk;
   bool utf8;
+  bool mouse_enabled;
 
   GMainLoop *gmainloop;
 
   bool redraw_pending;
   bool resize_pending;
 
+  /**
+   * Arrival times of processed keys that wait for a frame to be displayed.
+   */
+  InputStamps input_stamps;
+  InputLatencyStats input_latency_stats;
+
+  /**
+   * Keys decoded during the current wakeup.
+   */
+  InputKeys input_batch;
+  InputBatchStats input_batch_stats;
+
   static CoreManager *my_instance;
 
   CoreManager();
@@ -149,6 +238,30 @@ private:
   gboolean io_input(GIOChannel *source, GIOCondition cond);
   void io_input_timeout();
 
+  /**
+   * Decodes all complete keys in the libtermkey buffer and appends them to
+   * the input batch. Returns the result of the last termkey_getkey() call.
+   */
+  TermKeyResult decodeInput();
+  bool isInputReadable() const;
+  void growInputBuffer();
+  void addInputBatchSample(size_t keys, unsigned reads, size_t bytes);
+
+  /**
+   * Processes a key that arrived at a given time and remembers the arrival
+   * time if the key caused a redraw.
+   */
+  void processStampedInput(const TermKeyKey& key, gint64 stamp);
+  /**
+   * Delivers a mouse event to the window under the mouse pointer.
+   */
+  bool processMouseInput(const TermKeyKey& key);
+  /**
+   * Returns the window that is displayed at a given screen position.
+   */
+  FreeWindow *getWindowAt(int x, int y);
+  void addInputLatencySample(gint64 latency);
+
   static gboolean resize_input_(GIOChannel *source, GIOCondition cond,
       gpointer data)
     { return reinterpret_cast<CoreManager*>(data)->resize_input(source,
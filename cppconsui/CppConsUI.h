@@ -92,6 +92,73 @@ protected:
 private:
 };
 
+/**
+ * Mouse event. The position is relative to the widget that processes the
+ * event.
+ */
+class MouseEvent: public Point
+{
+public:
+  enum Type {
+    PRESS,
+    DRAG,
+    RELEASE
+  };
+
+  enum Button {
+    BUTTON_NONE,
+    BUTTON_LEFT,
+    BUTTON_MIDDLE,
+    BUTTON_RIGHT,
+    BUTTON_WHEEL_UP,
+    BUTTON_WHEEL_DOWN
+  };
+
+  /**
+   * Number of lines scrolled by one wheel step.
+   */
+  enum { WHEEL_STEP = 3 };
+
+  MouseEvent(Type type_, Button button_, int x, int y)
+    : Point(x, y), type(type_), button(button_) {}
+
+  Type getType() const { return type; }
+  Button getButton() const { return button; }
+
+  /**
+   * Returns true if this is a left button press.
+   */
+  bool isClick() const { return type == PRESS && button == BUTTON_LEFT; }
+  /**
+   * Returns a number of lines to scroll, negative values scroll up. Zero is
+   * returned if this isn't a wheel event.
+   */
+  int getWheelDelta() const;
+
+  /**
+   * Returns the same event with a position moved by a given offset.
+   */
+  MouseEvent translated(int dx, int dy) const
+    { return MouseEvent(type, button, x + dx, y + dy); }
+
+protected:
+  Type type;
+  Button button;
+
+private:
+};
+
+inline int MouseEvent::getWheelDelta() const
+{
+  if (type != PRESS)
+    return 0;
+  if (button == BUTTON_WHEEL_UP)
+    return -WHEEL_STEP;
+  if (button == BUTTON_WHEEL_DOWN)
+    return WHEEL_STEP;
+  return 0;
+}
+
 } // namespace CppConsUI
 
 #endif // __CPPCONSUI_H__
@@ -91,6 +91,14 @@ void FreeWindow::draw()
   realwindow->noutrefresh();
 }
 
+void FreeWindow::releaseArea()
+{
+  Container::releaseArea();
+
+  delete realwindow;
+  realwindow = NULL;
+}
+
 void FreeWindow::setVisibility(bool visible)
 {
   visible ? show() : hide();
@@ -51,6 +51,7 @@ public:
   virtual void moveResizeRect(const Rect &rect)
     { moveResize(rect.x, rect.y, rect.width, rect.height); }
   virtual void draw();
+  virtual void releaseArea();
   virtual void setVisibility(bool visible);
   virtual bool isVisibleRecursive() const { return isVisible(); }
   virtual int getLeft() const { return win_x; }
@@ -50,10 +50,16 @@ bool KeyConfig::bindKey(const char *context, const char *action,
   if (!res || res[0])
     return false;
 
-  binds[context][tkey] = action;
+  bindKey(context, action, tkey);
   return true;
 }
 
+void KeyConfig::bindKey(const char *context, const char *action,
+    const TermKeyKey& key)
+{
+  binds[context][key] = action;
+}
+
 const KeyConfig::KeyBindContext *KeyConfig::getKeyBinds(
     const char *context) const
 {
@@ -139,6 +145,8 @@ void KeyConfig::loadDefaultKeyConfig()
   bindKey("textentry", "backspace", "Backspace");
 
   bindKey("textentry", "delete-word-end", "Ctrl-Delete");
+  bindKey("textentry", "undo", "Ctrl-_");
+  bindKey("textentry", "redo", "Ctrl-y");
   /// @todo enable
   /*
   bindKey("textentry", "toggle-overwrite", "Insert");
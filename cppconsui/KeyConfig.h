@@ -84,6 +84,11 @@ public:
    * Binds a key to an action (in a given context).
    */
   bool bindKey(const char *context, const char *action, const char *key);
+  /**
+   * Binds an already parsed key to an action (in a given context).
+   */
+  void bindKey(const char *context, const char *action,
+      const TermKeyKey& key);
 
   /**
    * Returns all key binds.
@@ -32,22 +32,17 @@ namespace CppConsUI
 {
 
 Label::Label(int w, int h, const char *text_)
-: Widget(w, h), text(NULL)
+: Widget(w, h)
 {
   setText(text_);
 }
 
 Label::Label(const char *text_)
-: Widget(AUTOSIZE, AUTOSIZE), text(NULL)
+: Widget(AUTOSIZE, AUTOSIZE)
 {
   setText(text_);
 }
 
-Label::~Label()
-{
-  g_free(text);
-}
-
 void Label::draw()
 {
   proceedUpdateArea();
@@ -61,40 +56,22 @@ void Label::draw()
   int realw = area->getmaxx();
   int realh = area->getmaxy();
 
-  // print text
+  // print text, long lines wrap
   int y = 0;
-  const char *start, *end;
-  start = end = text;
-  int p;
-  while (*end) {
-    if (*end == '\n') {
-      if (y >= realh)
-        break;
-
-      p = area->mvaddstring(0, y, realw * (realh - y), start, end);
-      y += (p / realw) + 1;
-      start = end + 1;
-    }
-    end++;
+  for (size_t i = 0; i < text.getLinesCount() && y < realh; i++) {
+    int p = text.draw(*area, 0, y, realw * (realh - y), i);
+    y += (p / realw) + 1;
   }
-  if (y < realh)
-    area->mvaddstring(0, y, realw * (realh - y), start, end);
 
   area->attroff(attrs);
 }
 
 void Label::setText(const char *new_text)
 {
-  g_free(text);
-
-  text = g_strdup(new_text ? new_text : "");
+  text = TextRun(new_text);
 
   // update wish height
-  int h = 1;
-  for (const char *cur = text; *cur; cur++)
-    if (*cur == '\n')
-      h++;
-  setWishHeight(h);
+  setWishHeight(text.getLinesCount());
 
   redraw();
 }
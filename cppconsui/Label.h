@@ -29,6 +29,7 @@
 #ifndef __LABEL_H__
 #define __LABEL_H__
 
+#include "TextRun.h"
 #include "Widget.h"
 
 namespace CppConsUI
@@ -43,7 +44,7 @@ class Label
 public:
   Label(int w, int h, const char *text_ = NULL);
   explicit Label(const char *text_ = NULL);
-  virtual ~Label();
+  virtual ~Label() {}
 
   // Widget
   virtual void draw();
@@ -55,10 +56,14 @@ public:
   /**
    * Returns a current label text.
    */
-  virtual const char *getText() const { return text; }
+  virtual const char *getText() const { return text.getText(); }
+  /**
+   * Returns the label text with its precomputed metrics.
+   */
+  virtual const TextRun& getTextRun() const { return text; }
 
 protected:
-  char *text;
+  TextRun text;
 
 private:
   Label(const Label&);
@@ -66,6 +66,7 @@ void ListBox::draw()
       autosize_height_extra = space % autosize_children;
     }
     autosize_extra.clear();
+    child_rows.clear();
 
     int y = 0;
     for (Children::iterator i = children.begin(); i != children.end(); i++) {
@@ -87,6 +88,8 @@ void ListBox::draw()
       }
 
       widget->move(0, y);
+      if (h > 0)
+        child_rows.push_back(ChildRow(y, h, *widget));
       y += h;
     }
     reposition_widgets = false;
@@ -107,6 +110,19 @@ void ListBox::draw()
   AbstractListBox::draw();
 }
 
+bool ListBox::processMouse(const MouseEvent& event)
+{
+  int old_ypos = scroll_ypos;
+  if (!AbstractListBox::processMouse(event))
+    return false;
+
+  /* The focused child is always made visible when the list is drawn, so the
+   * focus has to follow the scrolled view. */
+  if (scroll_ypos != old_ypos)
+    focusVisibleChild(scroll_ypos > old_ypos);
+  return true;
+}
+
 HorizontalLine *ListBox::insertSeparator(size_t pos)
 {
   HorizontalLine *l = new HorizontalLine(AUTOSIZE);
@@ -146,6 +162,33 @@ void ListBox::appendWidget(Widget& widget)
   insertWidget(children.size(), widget);
 }
 
+Widget *ListBox::getChildAt(int x, int y)
+{
+  /* Fall back to the generic search if the children were moved since the
+   * last draw. */
+  if (reposition_widgets)
+    return AbstractListBox::getChildAt(x, y);
+
+  // find the last row that starts at or before y
+  size_t lo = 0;
+  size_t hi = child_rows.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (child_rows[mid].top <= y)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (!lo)
+    return NULL;
+
+  const ChildRow& row = child_rows[lo - 1];
+  if (y >= row.top + row.height || x < 0
+      || x >= row.widget->getRealWidth())
+    return NULL;
+  return row.widget;
+}
+
 Curses::Window *ListBox::getSubPad(const Widget& child, int begin_x,
     int begin_y, int ncols, int nlines)
 {
@@ -206,6 +249,36 @@ void ListBox::updateScrollHeight()
   setScrollHeight(MAX(realh, children_height));
 }
 
+void ListBox::focusVisibleChild(bool down)
+{
+  if (!focus_child || !screen_area || reposition_widgets)
+    return;
+
+  int view_top = scroll_ypos;
+  int view_bottom = scroll_ypos + screen_area->getmaxy();
+  int top = focus_child->getTop();
+  int h = focus_child->getRealHeight();
+  if (top >= view_top && top + h <= view_bottom)
+    return;
+
+  /* Give the focus to the first child that fits into the view when
+   * scrolling down or to the last one when scrolling up. */
+  if (down) {
+    for (ChildRows::iterator i = child_rows.begin(); i != child_rows.end();
+        i++)
+      if (i->top >= view_top && i->top + i->height <= view_bottom
+          && i->widget->grabFocus())
+        return;
+  }
+  else {
+    for (ChildRows::reverse_iterator i = child_rows.rbegin();
+        i != child_rows.rend(); i++)
+      if (i->top >= view_top && i->top + i->height <= view_bottom
+          && i->widget->grabFocus())
+        return;
+  }
+}
+
 } // namespace CppConsUI
 
 /* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
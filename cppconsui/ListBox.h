@@ -48,6 +48,7 @@ public:
 
   // Widget
   virtual void draw();
+  virtual bool processMouse(const MouseEvent& event);
 
   // AbstractListBox
   virtual HorizontalLine *insertSeparator(size_t pos);
@@ -56,6 +57,7 @@ public:
   virtual void appendWidget(Widget& widget);
 
   // Container
+  virtual Widget *getChildAt(int x, int y);
   virtual Curses::Window *getSubPad(const Widget& child, int begin_x,
       int begin_y, int ncols, int nlines);
 
@@ -64,11 +66,31 @@ public:
   sigc::signal<void, ListBox&, int> signal_children_height_change;
 
 protected:
+  /**
+   * Position of a visible child as it was placed by the last draw.
+   */
+  struct ChildRow
+  {
+    int top;
+    int height;
+    Widget *widget;
+
+    ChildRow(int top_, int height_, Widget& widget_)
+      : top(top_), height(height_), widget(&widget_) {}
+  };
+  typedef std::vector<ChildRow> ChildRows;
+
   int children_height;
   int autosize_children;
   int autosize_height;
   std::set<const Widget*> autosize_extra;
   bool reposition_widgets;
+  /**
+   * Visible children sorted by their position, used to find a child at
+   * a given position without checking all children. The cache is valid only
+   * if reposition_widgets is false.
+   */
+  ChildRows child_rows;
 
   // Container
   virtual void onChildMoveResize(Widget& activator, const Rect& oldsize,
@@ -76,6 +98,11 @@ protected:
   virtual void onChildVisible(Widget& activator, bool visible);
 
   virtual void updateScrollHeight();
+  /**
+   * Moves the focus to a child inside the visible area if the focused child
+   * was scrolled out of the view.
+   */
+  virtual void focusVisibleChild(bool down);
 
 private:
   ListBox(const ListBox&);
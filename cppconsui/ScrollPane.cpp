@@ -48,6 +48,15 @@ void ScrollPane::draw()
   drawEx(true);
 }
 
+void ScrollPane::releaseArea()
+{
+  Container::releaseArea();
+
+  delete screen_area;
+  screen_area = NULL;
+  update_screen_area = true;
+}
+
 int ScrollPane::getRealWidth() const
 {
   if (!screen_area)
@@ -62,6 +71,20 @@ int ScrollPane::getRealHeight() const
   return screen_area->getmaxy();
 }
 
+bool ScrollPane::processMouse(const MouseEvent& event)
+{
+  // children are placed in the virtual (scrolled) area
+  if (Container::processMouse(event.translated(scroll_xpos, scroll_ypos)))
+    return true;
+
+  int delta = event.getWheelDelta();
+  if (!delta)
+    return false;
+
+  adjustScroll(scroll_xpos, scroll_ypos + delta);
+  return true;
+}
+
 Point ScrollPane::getRelativePosition(const Container& ref,
     const Widget& child) const
 {
@@ -46,8 +46,10 @@ public:
 
   // Widget
   virtual void draw();
+  virtual void releaseArea();
   virtual int getRealWidth() const;
   virtual int getRealHeight() const;
+  virtual bool processMouse(const MouseEvent& event);
 
   // Container
   virtual Point getRelativePosition(const Container& ref,
@@ -32,11 +32,15 @@
 
 #include "TextEdit.h"
 
+#include "CoreManager.h"
+
 #include <algorithm>
 #include <string.h>
 
-// gap expand size when the gap becomes filled
-#define GAP_SIZE_EXPAND 4096
+// minimal size of the buffer, it's large enough for most messages
+#define BUFFER_SIZE_MIN 512
+// delay in milliseconds after which an oversized buffer is trimmed
+#define BUFFER_TRIM_DELAY 10000
 
 namespace CppConsUI
 {
@@ -45,8 +49,10 @@ TextEdit::TextEdit(int w, int h, const char *text_, int flags_,
     bool single_line, bool accept_tabs_, bool masked_)
 : Widget(w, h), flags(flags_), editable(true), overwrite_mode(false)
 , single_line_mode(single_line), accept_tabs(accept_tabs_), masked(masked_)
-, buffer(NULL), screen_lines_dirty(false)
+, buffer(NULL), bufend(NULL), replaying(false), screen_lines_dirty(false)
+, draw_view_top(0), draw_height(0), draw_lines_dirty(true)
 {
+  memset(&buffer_stats, 0, sizeof(buffer_stats));
   setText(text_);
 
   can_focus = true;
@@ -55,6 +61,7 @@ TextEdit::TextEdit(int w, int h, const char *text_, int flags_,
 
 TextEdit::~TextEdit()
 {
+  trim_conn.disconnect();
   g_free(buffer);
 }
 
@@ -106,29 +113,12 @@ void TextEdit::draw()
   area->attron(attrs);
 
   int realh = area->getmaxy();
-  ScreenLines::iterator i;
-  int j;
-  for (i = screen_lines.begin() + view_top, j = 0; i != screen_lines.end()
-      && j < realh; i++, j++) {
-    const char *p = i->start;
-    int w = 0;
-    for (size_t k = 0; k < i->length && *p != '\n'; k++) {
-      if (masked)
-        w += area->mvaddchar(w, j, '*');
-      else {
-        gunichar uc = g_utf8_get_char(p);
-        if (uc == '\t') {
-          int t = onScreenWidth(uc, w);
-          for (int l = 0; l < t; l++)
-            area->mvaddchar(w + l, j, ' ');
-          w += t;
-        }
-        else
-          w += area->mvaddchar(w, j, uc);
-      }
-      p = nextChar(p);
-    }
-  }
+  if (draw_lines_dirty || draw_view_top != view_top || draw_height != realh)
+    updateDrawLines(realh);
+  for (size_t j = 0; j + 1 < draw_lines.size(); j++)
+    if (draw_lines[j + 1] > draw_lines[j])
+      area->mvaddwstring(0, j, &draw_chars[draw_lines[j]],
+          draw_lines[j + 1] - draw_lines[j]);
 
   area->attroff(attrs);
 
@@ -149,13 +139,20 @@ void TextEdit::setText(const char *new_text)
 
   // XXX should the text be validated (FLAG_*)?
   size_t size = strlen(new_text);
-  initBuffer(size + GAP_SIZE_EXPAND);
+  initBuffer(MAX(static_cast<size_t>(bufend - buffer),
+        size + BUFFER_SIZE_MIN));
   insertTextAtCursor(new_text, size);
+  journal.clear();
+  scheduleTrim();
 }
 
 void TextEdit::clear()
 {
-  initBuffer(GAP_SIZE_EXPAND);
+  /* Keep the buffer so sending a few long messages in a row doesn't
+   * reallocate it every time, an oversized buffer is trimmed later. */
+  initBuffer(MAX(static_cast<size_t>(bufend - buffer), BUFFER_SIZE_MIN));
+  journal.clear();
+  scheduleTrim();
   redraw();
 }
 
@@ -163,21 +160,94 @@ const char *TextEdit::getText() const
 {
   g_assert(gapend > gapstart);
 
-  screen_lines_dirty = true;
+  moveGapToEnd();
+  *gapstart = '\0';
 
-  // move gap to the end
-  bool point_after_gap = point >= gapend;
+  return buffer;
+}
 
-  // '-1' so the last '\n' is still in the end of the buffer
-  g_memmove(gapstart, gapend, bufend - gapend - 1);
-  if (point_after_gap)
-    point -= gapend - gapstart;
-  gapstart += bufend - gapend - 1;
+// returns the size that trimBuffer() shrinks a buffer with used bytes to
+static size_t trimmed_size(size_t used)
+{
+  size_t size = BUFFER_SIZE_MIN;
+  while (size < 2 * used)
+    size *= 2;
+  return size;
+}
+
+void TextEdit::trimBuffer()
+{
+  trim_conn.disconnect();
+
+  size_t size = bufend - buffer;
+  size_t used = size - (gapend - gapstart);
+  size_t new_size = trimmed_size(used);
+  if (new_size >= size)
+    return;
+
+  // move the text to the start of the buffer and cut off the end of the gap
+  moveGapToEnd();
+
+  const char *origbuffer = buffer;
+  buffer = g_renew(char, buffer, new_size);
+
+  point += buffer - origbuffer;
+  gapstart += buffer - origbuffer;
+  bufend = buffer + new_size;
   gapend = bufend - 1;
+  *gapend = '\n';
 
-  *gapstart = '\0';
+  buffer_stats.trims++;
+}
 
-  return buffer;
+bool TextEdit::undo()
+{
+  if (!editable)
+    return false;
+
+  UndoJournal::Delta delta;
+  if (!journal.undo(delta))
+    return false;
+
+  replaying = true;
+  moveCursorToPosition(delta.pos);
+  if (delta.type == UndoJournal::TYPE_INSERT)
+    deleteCharsFromCursor(delta.chars);
+  else {
+    insertTextAtCursor(delta.text, delta.bytes);
+    // the cursor was in front of a text deleted by the delete key
+    if (!delta.backward)
+      moveCursorToPosition(delta.pos);
+  }
+  replaying = false;
+  return true;
+}
+
+bool TextEdit::redo()
+{
+  if (!editable)
+    return false;
+
+  UndoJournal::Delta delta;
+  if (!journal.redo(delta))
+    return false;
+
+  replaying = true;
+  moveCursorToPosition(delta.pos);
+  if (delta.type == UndoJournal::TYPE_INSERT)
+    insertTextAtCursor(delta.text, delta.bytes);
+  else
+    deleteCharsFromCursor(delta.chars);
+  replaying = false;
+  return true;
+}
+
+TextEdit::BufferStats TextEdit::getBufferStats() const
+{
+  BufferStats stats = buffer_stats;
+  stats.capacity = bufend - buffer;
+  stats.used = stats.capacity - (gapend - gapstart);
+  return stats;
 }
 
 void TextEdit::setFlags(int new_flags, bool revalidate)
@@ -257,10 +327,15 @@ bool TextEdit::CmpScreenLineEnd::operator()(ScreenLine& sline,
 
 void TextEdit::initBuffer(size_t size)
 {
-  g_assert(size > 0);
-
-  g_free(buffer);
-  buffer = g_new(char, size);
+  g_assert(size > 1);
+
+  if (static_cast<size_t>(bufend - buffer) != size) {
+    g_free(buffer);
+    buffer = g_new(char, size);
+    buffer_stats.reallocs++;
+    if (size > buffer_stats.max_capacity)
+      buffer_stats.max_capacity = size;
+  }
 
   current_pos = 0;
   point = gapstart = buffer;
@@ -289,10 +364,15 @@ size_t TextEdit::getGapSize() const
 
 void TextEdit::expandGap(size_t size)
 {
-  if (size <= getGapSize())
+  size_t gap_size = getGapSize();
+  if (size <= gap_size)
     return;
 
-  size += GAP_SIZE_EXPAND;
+  size_t capacity = bufend - buffer;
+  size_t new_capacity = MAX(2 * capacity, BUFFER_SIZE_MIN);
+  while (new_capacity - capacity + gap_size < size)
+    new_capacity *= 2;
+  size = new_capacity - capacity;
 
   const char *origbuffer = buffer;
   bool point_after_gap = point >= gapend;
@@ -313,6 +393,10 @@ void TextEdit::expandGap(size_t size)
   }
   gapend += size;
   bufend += size;
+
+  buffer_stats.reallocs++;
+  if (new_capacity > buffer_stats.max_capacity)
+    buffer_stats.max_capacity = new_capacity;
 }
 
 void TextEdit::moveGapToCursor()
@@ -342,6 +426,35 @@ void TextEdit::moveGapToCursor()
   }
 }
 
+void TextEdit::moveGapToEnd() const
+{
+  screen_lines_dirty = true;
+
+  bool point_after_gap = point >= gapend;
+
+  // '-1' so the last '\n' is still in the end of the buffer
+  g_memmove(gapstart, gapend, bufend - gapend - 1);
+  if (point_after_gap)
+    point -= gapend - gapstart;
+  gapstart += bufend - gapend - 1;
+  gapend = bufend - 1;
+}
+
+void TextEdit::scheduleTrim()
+{
+  size_t size = bufend - buffer;
+  if (size <= trimmed_size(size - (gapend - gapstart)))
+    return;
+
+  // CoreManager doesn't exist if the widget is used outside of a program
+  if (!COREMANAGER)
+    return;
+
+  trim_conn.disconnect();
+  trim_conn = COREMANAGER->timeoutOnceConnect(sigc::mem_fun(this,
+        &TextEdit::trimBuffer), BUFFER_TRIM_DELAY);
+}
+
 char *TextEdit::getTextStart() const
 {
   if (buffer == gapstart)
@@ -469,6 +582,7 @@ char *TextEdit::getScreenLine(const char *text, int max_width,
 void TextEdit::updateScreenLines()
 {
   screen_lines.clear();
+  draw_lines_dirty = true;
 
   int realw;
   if (!area || (realw = area->getmaxx()) <= 1)
@@ -490,6 +604,8 @@ void TextEdit::updateScreenLines(const char *begin, const char *end)
   g_assert(begin);
   g_assert(end);
 
+  draw_lines_dirty = true;
+
   int realw;
   if (!area || (realw = area->getmaxx()) <= 1)
     return;
@@ -568,6 +684,44 @@ void TextEdit::assertUpdatedScreenLines()
   screen_lines_dirty = false;
 }
 
+void TextEdit::updateDrawLines(int realh)
+{
+  draw_chars.clear();
+  draw_lines.clear();
+  draw_view_top = view_top;
+  draw_height = realh;
+  draw_lines_dirty = false;
+
+  ScreenLines::iterator i;
+  int j;
+  for (i = screen_lines.begin() + view_top, j = 0; i != screen_lines.end()
+      && j < realh; i++, j++) {
+    draw_lines.push_back(draw_chars.size());
+    const char *p = i->start;
+    int w = 0;
+    for (size_t k = 0; k < i->length && *p != '\n'; k++) {
+      if (masked) {
+        draw_chars.push_back('*');
+        w++;
+      }
+      else {
+        gunichar uc = g_utf8_get_char(p);
+        if (uc == '\t') {
+          int t = onScreenWidth(uc, w);
+          draw_chars.insert(draw_chars.end(), t, ' ');
+          w += t;
+        }
+        else if ((uc = Curses::printable_char(uc))) {
+          draw_chars.push_back(uc);
+          w += Curses::onscreen_width(uc);
+        }
+      }
+      p = nextChar(p);
+    }
+  }
+  draw_lines.push_back(draw_chars.size());
+}
+
 void TextEdit::updateScreenCursor()
 {
   size_t acu_length = 0;
@@ -620,6 +774,8 @@ void TextEdit::insertTextAtCursor(const char *new_text, size_t new_text_bytes)
   }
 
   size_t n_chars = g_utf8_strlen(new_text, new_text_bytes);
+  if (!replaying)
+    journal.recordInsert(current_pos, new_text, new_text_bytes, n_chars);
   text_length += n_chars;
   current_pos += n_chars;
 
@@ -666,36 +822,59 @@ void TextEdit::deleteFromCursor(DeleteType type, Direction dir)
       g_assert_not_reached();
   }
 
-  if (count) {
-    const char *min = gapstart;
-    const char *max = gapend;
-    moveGapToCursor();
+  deleteCharsFromCursor(count);
+}
 
-    while (count > 0) {
-      gapend = nextChar(gapend);
-      text_length--;
-      count--;
-    }
+void TextEdit::deleteCharsFromCursor(int count)
+{
+  if (!count)
+    return;
 
-    while (count < 0) {
-      gapstart = prevChar(gapstart);
-      current_pos--;
-      text_length--;
-      count++;
-    }
-    point = gapstart;
+  assertUpdatedScreenLines();
 
-    updateScreenLines(MIN(min, gapstart), MAX(max, gapend));
-    updateScreenCursor();
-    redraw();
+  const char *min = gapstart;
+  const char *max = gapend;
+  moveGapToCursor();
+
+  // the deleted bytes stay in the buffer until the gap is filled again
+  const char *del_start = gapstart;
+  const char *del_end = gapend;
+  size_t chars = ABS(count);
+
+  while (count > 0) {
+    gapend = nextChar(gapend);
+    text_length--;
+    count--;
+  }
+
+  while (count < 0) {
+    gapstart = prevChar(gapstart);
+    current_pos--;
+    text_length--;
+    count++;
+  }
+  point = gapstart;
 
-    signal_text_change(*this);
+  if (!replaying) {
+    if (gapend > del_end)
+      journal.recordDelete(current_pos, del_end, gapend - del_end, chars,
+          false);
+    else
+      journal.recordDelete(current_pos, gapstart, del_start - gapstart,
+          chars, true);
   }
+
+  updateScreenLines(MIN(min, gapstart), MAX(max, gapend));
+  updateScreenCursor();
+  redraw();
+
+  signal_text_change(*this);
 }
 
 void TextEdit::moveCursor(CursorMovement step, Direction dir)
 {
   assertUpdatedScreenLines();
+  journal.breakGroup();
 
   size_t old_pos = current_pos;
   switch (step) {
@@ -775,6 +954,25 @@ void TextEdit::moveCursor(CursorMovement step, Direction dir)
   redraw();
 }
 
+void TextEdit::moveCursorToPosition(size_t pos)
+{
+  g_assert(pos <= text_length);
+
+  assertUpdatedScreenLines();
+
+  while (current_pos > pos) {
+    point = prevChar(point);
+    current_pos--;
+  }
+  while (current_pos < pos) {
+    point = nextChar(point);
+    current_pos++;
+  }
+
+  updateScreenCursor();
+  redraw();
+}
+
 void TextEdit::toggleOverwrite()
 {
   overwrite_mode = !overwrite_mode;
@@ -862,6 +1060,16 @@ void TextEdit::actionToggleOverwrite()
   toggleOverwrite();
 }
 
+void TextEdit::actionUndo()
+{
+  undo();
+}
+
+void TextEdit::actionRedo()
+{
+  redo();
+}
+
 void TextEdit::declareBindables()
 {
   // cursor movement
@@ -916,6 +1124,13 @@ void TextEdit::declareBindables()
       sigc::bind(sigc::mem_fun(this, &TextEdit::actionDelete),
         DELETE_WORD_ENDS, DIR_BACK), InputProcessor::BINDABLE_NORMAL);
 
+  // history
+  declareBindable("textentry", "undo", sigc::mem_fun(this,
+        &TextEdit::actionUndo), InputProcessor::BINDABLE_NORMAL);
+
+  declareBindable("textentry", "redo", sigc::mem_fun(this,
+        &TextEdit::actionRedo), InputProcessor::BINDABLE_NORMAL);
+
   declareBindable("textentry", "newline",
       sigc::bind(sigc::mem_fun(this, static_cast<void (TextEdit::*)
           (const char*)>(&TextEdit::insertTextAtCursor)), "\n"),
@@ -28,9 +28,11 @@
 #ifndef __TEXTEDIT_H__
 #define __TEXTEDIT_H__
 
+#include "UndoJournal.h"
 #include "Widget.h"
 
 #include <deque>
+#include <vector>
 
 namespace CppConsUI
 {
@@ -46,6 +48,19 @@ public:
     FLAG_NOPUNCTUATION = 1 << 3
   };
 
+  struct BufferStats
+  {
+    // allocated size of the gap buffer in bytes
+    size_t capacity;
+    // bytes of the buffer occupied by the text
+    size_t used;
+    size_t max_capacity;
+    // number of buffer allocations, including growing of the gap
+    unsigned reallocs;
+    // number of times the buffer was shrunk by trimBuffer()
+    unsigned trims;
+  };
+
   TextEdit(int w, int h, const char *text_ = NULL, int flags_ = 0,
       bool single_line = false, bool accept_tabs_ = true,
       bool masked_ = false);
@@ -72,6 +87,27 @@ public:
 
   virtual size_t getTextLength() const { return text_length; }
 
+  /**
+   * Reverts the last edit. Returns false if there is nothing to undo.
+   */
+  virtual bool undo();
+  /**
+   * Applies the last undone edit again. Returns false if there is nothing
+   * to redo.
+   */
+  virtual bool redo();
+
+  /**
+   * Shrinks the buffer so that it holds the text with a reasonable room to
+   * grow. It's called automatically when the widget has been idle for a
+   * while after clear().
+   */
+  virtual void trimBuffer();
+  /**
+   * Returns capacity and usage of the gap buffer.
+   */
+  virtual BufferStats getBufferStats() const;
+
   virtual void setFlags(int new_flags, bool revalidate = true);
   virtual int getFlags() const { return flags; }
 
@@ -192,12 +228,53 @@ protected:
    */
   size_t text_length;
 
+  /**
+   * Statistics of the buffer, only the counters and max_capacity are kept
+   * up to date, the rest is filled in by getBufferStats().
+   */
+  BufferStats buffer_stats;
+  sigc::connection trim_conn;
+
+  /**
+   * History of edits, setText() and clear() start a new one.
+   */
+  UndoJournal journal;
+  /**
+   * An edit from the journal is being applied, so it mustn't be recorded.
+   */
+  bool replaying;
+
   mutable bool screen_lines_dirty;
 
+  /**
+   * Visible screen lines converted to the form that is handed to curses.
+   * They are rebuilt only when the screen lines or the view change, other
+   * redraws just copy them. draw_lines holds the start of every line in
+   * draw_chars followed by the end of the last line.
+   */
+  std::vector<wchar_t> draw_chars;
+  std::vector<size_t> draw_lines;
+  size_t draw_view_top;
+  int draw_height;
+  bool draw_lines_dirty;
+
+  /**
+   * Empties the buffer and makes sure it has a given size, the current
+   * buffer is reused if it has the size already.
+   */
   virtual void initBuffer(size_t size);
   virtual size_t getGapSize() const;
+  /**
+   * Makes the gap at least size bytes large. The buffer grows
+   * geometrically so inserting a long text is amortized to a linear time.
+   */
   virtual void expandGap(size_t size);
   virtual void moveGapToCursor();
+  virtual void moveGapToEnd() const;
+  /**
+   * Schedules trimBuffer() if the buffer is larger than needed.
+   */
+  virtual void scheduleTrim();
 
   virtual char *getTextStart() const;
   virtual char *prevChar(const char *p) const;
@@ -221,6 +298,10 @@ protected:
    */
   virtual void updateScreenLines(const char *begin, const char *end);
   virtual void assertUpdatedScreenLines();
+  /**
+   * Converts realh screen lines starting at view_top for drawing.
+   */
+  virtual void updateDrawLines(int realh);
 
   /**
    * Recalculates screen cursor position based on current_pos and
@@ -236,7 +317,16 @@ protected:
       size_t new_text_bytes);
   virtual void insertTextAtCursor(const char *new_text);
   virtual void deleteFromCursor(DeleteType type, Direction dir);
+  /**
+   * Deletes count characters after the cursor, or -count characters before
+   * the cursor if count is negative.
+   */
+  virtual void deleteCharsFromCursor(int count);
   virtual void moveCursor(CursorMovement step, Direction dir);
+  /**
+   * Moves the cursor to a given character position.
+   */
+  virtual void moveCursorToPosition(size_t pos);
 
   virtual void toggleOverwrite();
 
@@ -250,6 +340,8 @@ private:
   void actionMoveCursor(CursorMovement step, Direction dir);
   void actionDelete(DeleteType type, Direction dir);
   void actionToggleOverwrite();
+  void actionUndo();
+  void actionRedo();
 
   void declareBindables();
 };
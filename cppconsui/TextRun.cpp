@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file
+ * TextRun class implementation.
+ *
+ * @ingroup cppconsui
+ */
+
+#include "TextRun.h"
+
+namespace CppConsUI
+{
+
+TextRun::TextRun(const char *text_)
+: text(text_ ? text_ : ""), length(0), width(0)
+{
+  const char *start = text.c_str();
+  Line line;
+  line.offset = 0;
+  line.start = 0;
+  line.width = 0;
+
+  const char *p = start;
+  while (*p) {
+    if (*p == '\n') {
+      line.end = chars.size();
+      lines.push_back(line);
+      if (line.width > width)
+        width = line.width;
+
+      length++;
+      p++;
+      line.offset = p - start;
+      line.start = chars.size();
+      line.width = 0;
+      continue;
+    }
+
+    gunichar uc = Curses::printable_char(g_utf8_get_char(p));
+    p = g_utf8_find_next_char(p, NULL);
+    length++;
+
+    if (uc == '\t') {
+      // expand the tab the same way Curses::Window::mvaddstring() does
+      int w = Curses::onscreen_width(uc);
+      chars.insert(chars.end(), w, ' ');
+      widths.insert(widths.end(), w, 1);
+      line.width += w;
+    }
+    else if (uc) {
+      int w = Curses::onscreen_width(uc);
+      chars.push_back(uc);
+      widths.push_back(w);
+      line.width += w;
+    }
+  }
+
+  line.end = chars.size();
+  lines.push_back(line);
+  if (line.width > width)
+    width = line.width;
+}
+
+int TextRun::draw(Curses::Window& area, int x, int y, int w,
+    size_t line) const
+{
+  g_assert(line < lines.size());
+
+  const Line& l = lines[line];
+  size_t end = l.end;
+  int printed = l.width;
+  if (printed > w) {
+    end = l.start;
+    printed = 0;
+    while (printed < w && end < l.end)
+      printed += widths[end++];
+  }
+
+  if (end > l.start)
+    area.mvaddwstring(x, y, &chars[l.start], end - l.start);
+  return printed;
+}
+
+int TextRun::drawTail(Curses::Window& area, int x, int y, int w,
+    size_t line) const
+{
+  g_assert(line < lines.size());
+
+  const Line& l = lines[line];
+  size_t start = l.start;
+  int printed = l.width;
+  while (printed > w && start < l.end)
+    printed -= widths[start++];
+
+  if (start < l.end)
+    area.mvaddwstring(x + w - printed, y, &chars[start], l.end - start);
+  return printed;
+}
+
+} // namespace CppConsUI
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
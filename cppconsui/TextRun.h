@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file
+ * TextRun class.
+ *
+ * @ingroup cppconsui
+ */
+
+#ifndef __TEXTRUN_H__
+#define __TEXTRUN_H__
+
+#include "ConsUICurses.h"
+
+#include <string>
+#include <vector>
+
+namespace CppConsUI
+{
+
+/**
+ * Immutable text prepared for printing. The UTF-8 text is decoded only once
+ * when the run is created. The run then keeps the characters in the form
+ * that is handed to curses together with their on-screen widths, and the
+ * byte offset, character range and width of every line. Printing a line is
+ * a single copy into the curses window.
+ */
+class TextRun
+{
+public:
+  explicit TextRun(const char *text_ = NULL);
+
+  /**
+   * Returns the original text.
+   */
+  const char *getText() const { return text.c_str(); }
+  /**
+   * Returns the length of the text in bytes.
+   */
+  size_t getBytes() const { return text.size(); }
+  /**
+   * Returns the number of characters.
+   */
+  size_t getLength() const { return length; }
+  /**
+   * Returns the on-screen width of the widest line.
+   */
+  int getWidth() const { return width; }
+
+  size_t getLinesCount() const { return lines.size(); }
+  /**
+   * Returns the offset of the first byte of a given line in the text.
+   */
+  size_t getLineOffset(size_t line) const { return lines[line].offset; }
+  int getLineWidth(size_t line) const { return lines[line].width; }
+
+  /**
+   * Prints a line at a given position. Characters are printed as long as
+   * fewer than w cells are used. Returns the number of printed cells.
+   */
+  int draw(Curses::Window& area, int x, int y, int w, size_t line = 0)
+    const;
+  /**
+   * Prints the longest end of a line that fits into w cells, the end is
+   * aligned to the right edge of the w cells wide box at a given position.
+   * Returns the number of printed cells.
+   */
+  int drawTail(Curses::Window& area, int x, int y, int w, size_t line = 0)
+    const;
+
+protected:
+
+private:
+  struct Line
+  {
+    // offset of the line in the text
+    size_t offset;
+    // range of the line in chars and widths
+    size_t start;
+    size_t end;
+    int width;
+  };
+
+  typedef std::vector<wchar_t> Chars;
+  typedef std::vector<unsigned char> Widths;
+  typedef std::vector<Line> Lines;
+
+  std::string text;
+  size_t length;
+  int width;
+  // printable characters, tabs are expanded to spaces
+  Chars chars;
+  Widths widths;
+  Lines lines;
+};
+
+} // namespace CppConsUI
+
+#endif // __TEXTRUN_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -27,12 +27,24 @@
 
 #include "TextView.h"
 
+#include "CoreManager.h"
+
+#include <algorithm>
+
+/* Lines are searched in slices of at most this many microseconds, so the
+ * search doesn't delay the input. */
+#define FIND_SLICE_TIME 5000
+// number of lines searched between checks of the slice time
+#define FIND_SLICE_LINES 256
+
 namespace CppConsUI
 {
 
 TextView::TextView(int w, int h, bool autoscroll_, bool scrollbar_)
 : Widget(w, h), view_top(0), autoscroll(autoscroll_)
-, autoscroll_suspended(false), scrollbar(scrollbar_)
+, autoscroll_suspended(false), scrollbar(scrollbar_), scroll_line(NULL)
+, find_text(NULL), find_text_length(0), find_matches_num(0), find_pos(0)
+, find_line(NULL), find_span(0), find_jump(false)
 {
   can_focus = true;
   declareBindables();
@@ -40,6 +52,8 @@ TextView::TextView(int w, int h, bool autoscroll_, bool scrollbar_)
 
 TextView::~TextView()
 {
+  find_conn.disconnect();
+  g_free(find_text);
   clear();
 }
 
@@ -59,6 +73,16 @@ void TextView::draw()
 
   area->erase();
 
+  if (scroll_line) {
+    for (size_t i = 0; i < screen_lines.size(); i++)
+      if (screen_lines[i].parent == scroll_line) {
+        view_top = i;
+        autoscroll_suspended = true;
+        break;
+      }
+    scroll_line = NULL;
+  }
+
   if (screen_lines.size() <= static_cast<unsigned>(realh)) {
     view_top = 0;
     autoscroll_suspended = false;
@@ -71,13 +95,15 @@ void TextView::draw()
     view_top = screen_lines.size() - realh;
 
   int attrs = getColorPair("textview", "text");
+  int highlight_attrs = getColorPair("textview", "highlight")
+    | Curses::Attr::REVERSE;
   area->attron(attrs);
 
   ScreenLines::iterator i;
   int j;
   for (i = screen_lines.begin() + view_top, j = 0; i != screen_lines.end()
       && j < realh; i++, j++) {
-    int attrs2 = 0;
+    int attrs2 = attrs;
     if (i->parent->color) {
       char color[32];
       int w = g_snprintf(color, sizeof(color), "color%d", i->parent->color);
@@ -87,9 +113,38 @@ void TextView::draw()
       area->attron(attrs2);
     }
 
+    // matches of the searched text in this line
+    const Spans *spans = NULL;
+    if (!find_matches.empty()) {
+      FindMatches::const_iterator m = find_matches.find(i->parent);
+      if (m != find_matches.end())
+        spans = &m->second;
+    }
+    size_t s = 0;
+    int cur_attrs = attrs2;
+
     const char *p = i->text;
     int w = 0;
     for (int k = 0; k < i->length; k++) {
+      if (spans) {
+        size_t offset = p - i->parent->text;
+        while (s < spans->size()
+            && (*spans)[s].start + (*spans)[s].length <= offset)
+          s++;
+
+        int new_attrs = attrs2;
+        if (s < spans->size() && (*spans)[s].start <= offset) {
+          new_attrs = highlight_attrs;
+          if (i->parent == find_line && s == find_span)
+            new_attrs |= Curses::Attr::BOLD;
+        }
+        if (new_attrs != cur_attrs) {
+          area->attroff(cur_attrs);
+          area->attron(new_attrs);
+          cur_attrs = new_attrs;
+        }
+      }
+
       gunichar uc = g_utf8_get_char(p);
       if (uc == '\t') {
         int t = Curses::onscreen_width(uc, w);
@@ -102,8 +157,8 @@ void TextView::draw()
       p = g_utf8_next_char(p);
     }
 
-    if (i->parent->color) {
-      area->attroff(attrs2);
+    if (cur_attrs != attrs) {
+      area->attroff(cur_attrs);
       area->attron(attrs);
     }
   }
@@ -171,6 +226,16 @@ void TextView::draw()
   */
 }
 
+bool TextView::processMouse(const MouseEvent& event)
+{
+  int delta = event.getWheelDelta();
+  if (!delta)
+    return Widget::processMouse(event);
+
+  scroll(delta);
+  return true;
+}
+
 void TextView::append(const char *text, int color)
 {
   insert(lines.size(), text, color);
@@ -210,6 +275,18 @@ void TextView::insert(size_t line_num, const char *text, int color)
   for (size_t i = line_num, advice = 0; i < cur_line_num; i++)
     advice = updateScreenLines(i, advice);
 
+  if (find_text) {
+    if (line_num < find_pos) {
+      // the new lines are searched together with the rest
+      find_pos += cur_line_num - line_num;
+    }
+    else {
+      // the part after find_pos is already searched
+      for (size_t i = line_num; i < cur_line_num; i++)
+        findLine(*lines[i]);
+    }
+  }
+
   redraw();
 }
 
@@ -218,6 +295,11 @@ void TextView::erase(size_t line_num)
   g_assert(line_num < lines.size());
 
   eraseScreenLines(line_num, 0);
+  if (lines[line_num] == scroll_line)
+    scroll_line = NULL;
+  forgetLine(line_num);
+  if (line_num < find_pos)
+    find_pos--;
   delete lines[line_num];
   lines.erase(lines.begin() + line_num);
 
@@ -233,8 +315,16 @@ void TextView::erase(size_t start_line, size_t end_line)
   size_t advice = 0;
   for (size_t i = start_line; i < end_line; i++)
     advice = eraseScreenLines(i, advice);
-  for (size_t i = start_line; i < end_line; i++)
+  for (size_t i = start_line; i < end_line; i++) {
+    if (lines[i] == scroll_line)
+      scroll_line = NULL;
+    forgetLine(i);
     delete lines[i];
+  }
+  if (end_line <= find_pos)
+    find_pos -= end_line - start_line;
+  else if (start_line < find_pos)
+    find_pos = start_line;
   lines.erase(lines.begin() + start_line, lines.begin() + end_line);
 
   redraw();
@@ -244,9 +334,18 @@ void TextView::clear()
 {
   for (Lines::iterator i = lines.begin(); i != lines.end(); i++)
     delete *i;
-  lines.clear();
 
-  screen_lines.clear();
+  // swap with empty containers to really release the memory
+  Lines().swap(lines);
+  ScreenLines().swap(screen_lines);
+  scroll_line = NULL;
+
+  // keep the searched text, only forget the matches
+  find_conn.disconnect();
+  find_matches.clear();
+  find_matches_num = 0;
+  find_pos = 0;
+  find_line = NULL;
 
   redraw();
 }
@@ -263,6 +362,101 @@ size_t TextView::getLinesNumber() const
   return lines.size();
 }
 
+void TextView::scrollToLine(size_t line_num)
+{
+  g_assert(line_num < lines.size());
+
+  scroll_line = lines[line_num];
+  redraw();
+}
+
+void TextView::setFindText(const char *text)
+{
+  find_conn.disconnect();
+  g_free(find_text);
+  find_text = NULL;
+  find_text_length = 0;
+  find_matches.clear();
+  find_matches_num = 0;
+  find_pos = 0;
+  find_line = NULL;
+  find_jump = false;
+
+  if (text && *text) {
+    find_text = g_utf8_to_ucs4_fast(text, -1, &find_text_length);
+    for (glong i = 0; i < find_text_length; i++)
+      find_text[i] = g_unichar_tolower(find_text[i]);
+
+    find_pos = lines.size();
+    find_jump = true;
+    if (find_pos)
+      find_conn = COREMANAGER->timeoutConnect(sigc::mem_fun(this,
+            &TextView::findStep), 0, G_PRIORITY_LOW);
+  }
+
+  signal_find_update(*this);
+  redraw();
+}
+
+bool TextView::findNext(int direction)
+{
+  if (find_matches.empty())
+    return false;
+
+  size_t line_num;
+  if (find_line) {
+    const Spans& spans = find_matches.find(find_line)->second;
+    if (direction > 0 && find_span + 1 < spans.size()) {
+      showMatch(*find_line, find_span + 1);
+      return true;
+    }
+    if (direction < 0 && find_span > 0) {
+      showMatch(*find_line, find_span - 1);
+      return true;
+    }
+
+    // continue with the adjacent line
+    line_num = std::find(lines.begin(), lines.end(), find_line)
+      - lines.begin();
+    if (direction < 0) {
+      if (!line_num)
+        return false;
+      line_num--;
+    }
+    else
+      line_num++;
+  }
+  else {
+    // start in the visible part of the view
+    if (!area || screen_lines.empty())
+      return false;
+
+    size_t screen_line = MIN(view_top, screen_lines.size() - 1);
+    if (direction < 0)
+      screen_line = MIN(view_top + area->getmaxy(), screen_lines.size()) - 1;
+    line_num = std::find(lines.begin(), lines.end(),
+        screen_lines[screen_line].parent) - lines.begin();
+  }
+
+  while (line_num < lines.size()) {
+    FindMatches::const_iterator i = find_matches.find(lines[line_num]);
+    if (i != find_matches.end()) {
+      showMatch(*lines[line_num], direction < 0 ? i->second.size() - 1 : 0);
+      return true;
+    }
+
+    if (direction < 0) {
+      if (!line_num)
+        break;
+      line_num--;
+    }
+    else
+      line_num++;
+  }
+
+  return false;
+}
+
 void TextView::setAutoScroll(bool new_autoscroll)
 {
   if (new_autoscroll == autoscroll)
@@ -453,7 +647,71 @@ size_t TextView::eraseScreenLines(size_t line_num, size_t start,
   return i;
 }
 
-void TextView::actionScroll(int direction)
+void TextView::findLine(const Line& line)
+{
+  Spans spans;
+  const char *p = line.text;
+  while (*p) {
+    const char *q = p;
+    glong i = 0;
+    while (i < find_text_length && *q
+        && g_unichar_tolower(g_utf8_get_char(q)) == find_text[i]) {
+      q = g_utf8_next_char(q);
+      i++;
+    }
+
+    if (i == find_text_length) {
+      spans.push_back(Span(p - line.text, q - p));
+      p = q;
+    }
+    else
+      p = g_utf8_next_char(p);
+  }
+
+  if (spans.empty())
+    return;
+
+  find_matches_num += spans.size();
+  find_matches[&line].swap(spans);
+}
+
+void TextView::forgetLine(size_t line_num)
+{
+  FindMatches::iterator i = find_matches.find(lines[line_num]);
+  if (i == find_matches.end())
+    return;
+
+  find_matches_num -= i->second.size();
+  find_matches.erase(i);
+  if (find_line == lines[line_num])
+    find_line = NULL;
+}
+
+void TextView::showMatch(const Line& line, size_t span)
+{
+  find_line = &line;
+  find_span = span;
+
+  size_t start = find_matches.find(&line)->second[span].start;
+  for (size_t i = 0; i < screen_lines.size(); i++) {
+    if (screen_lines[i].parent != &line)
+      continue;
+
+    // the match can be on a later screen line of the same line
+    while (i + 1 < screen_lines.size() && screen_lines[i + 1].parent == &line
+        && static_cast<size_t>(screen_lines[i + 1].text - line.text)
+        <= start)
+      i++;
+
+    view_top = i;
+    autoscroll_suspended = true;
+    break;
+  }
+
+  redraw();
+}
+
+void TextView::scroll(int lines)
 {
   if (!area)
     return;
@@ -463,8 +721,8 @@ void TextView::actionScroll(int direction)
   if (screen_lines.size() <= static_cast<unsigned>(realh))
     return;
 
-  unsigned s = abs(direction) * ((realh + 1) / 2);
-  if (direction < 0) {
+  unsigned s = abs(lines);
+  if (lines < 0) {
     if (view_top < s)
       view_top = 0;
     else
@@ -481,6 +739,38 @@ void TextView::actionScroll(int direction)
   redraw();
 }
 
+bool TextView::findStep()
+{
+  gint64 end = CoreManager::getMonotonicTime() + FIND_SLICE_TIME;
+  size_t matches = find_matches_num;
+
+  for (size_t n = 1; find_pos > 0; n++) {
+    find_pos--;
+    findLine(*lines[find_pos]);
+
+    if (!(n % FIND_SLICE_LINES) && CoreManager::getMonotonicTime() >= end)
+      break;
+  }
+
+  if (find_matches_num != matches) {
+    if (find_jump && findNext(-1))
+      find_jump = false;
+    else
+      redraw();
+  }
+
+  signal_find_update(*this);
+  return find_pos > 0;
+}
+
+void TextView::actionScroll(int direction)
+{
+  if (!area)
+    return;
+
+  scroll(direction * ((area->getmaxy() + 1) / 2));
+}
+
 void TextView::declareBindables()
 {
   declareBindable("textview", "scroll-up",
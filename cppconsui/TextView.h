@@ -31,6 +31,8 @@
 #include "Widget.h"
 
 #include <deque>
+#include <map>
+#include <vector>
 
 namespace CppConsUI
 {
@@ -47,6 +49,7 @@ public:
 
   // Widget
   virtual void draw();
+  virtual bool processMouse(const MouseEvent& event);
 
   /**
    * Appends text after the last line.
@@ -80,6 +83,11 @@ public:
    * Returns count of all lines.
    */
   virtual size_t getLinesNumber() const;
+  /**
+   * Scrolls the view so that a specified line is at the top. Autoscroll is
+   * suspended until the user scrolls to the bottom again.
+   */
+  virtual void scrollToLine(size_t line_num);
 
   virtual void setAutoScroll(bool new_autoscroll);
   virtual bool hasAutoScroll() const { return autoscroll; }
@@ -87,6 +95,27 @@ public:
   virtual void setScrollBar(bool new_scrollbar);
   virtual bool hasScrollBar() const { return scrollbar; }
 
+  /**
+   * Highlights all occurrences of a text, ignoring case. Lines are searched
+   * from the bottom in time-sliced chunks on the main loop so even a long
+   * view doesn't block the input, signal_find_update is emitted as the
+   * search progresses. The view is scrolled to the first match found. NULL
+   * or an empty text ends the search.
+   */
+  virtual void setFindText(const char *text);
+  /**
+   * Scrolls the view to the next (direction > 0) or the previous (direction
+   * < 0) match. Returns false if there isn't any.
+   */
+  virtual bool findNext(int direction);
+  /**
+   * Returns the number of matches found so far.
+   */
+  virtual size_t getFindMatchesNumber() const { return find_matches_num; }
+  virtual bool isFindRunning() const { return find_pos > 0; }
+
+  sigc::signal<void, TextView&> signal_find_update;
+
 protected:
   /**
    * Struct Line saves a real line. All text added into TextView is split on
@@ -132,8 +161,30 @@ protected:
     ScreenLine(Line &parent_, const char *text_, int length_);
   };
 
+  /**
+   * Part of a line that matches the searched text.
+   */
+  struct Span
+  {
+    /**
+     * Offset in bytes from the start of the parent's text.
+     */
+    size_t start;
+    /**
+     * Length in bytes.
+     */
+    size_t length;
+
+    Span(size_t start_, size_t length_) : start(start_), length(length_) {}
+  };
+
   typedef std::deque<Line*> Lines;
   typedef std::deque<ScreenLine> ScreenLines;
+  typedef std::vector<Span> Spans;
+  /**
+   * Matches of the searched text, only lines with a match have an entry.
+   */
+  typedef std::map<const Line*, Spans> FindMatches;
 
   size_t view_top;
   bool autoscroll;
@@ -149,6 +200,35 @@ protected:
    */
   ScreenLines screen_lines;
 
+  /**
+   * Line that should be scrolled to the top of the view, the scroll is done
+   * by the next draw() when screen lines are up to date.
+   */
+  Line *scroll_line;
+
+  /**
+   * Searched text converted to lowercase characters, NULL if there isn't
+   * any search.
+   */
+  gunichar *find_text;
+  glong find_text_length;
+  FindMatches find_matches;
+  size_t find_matches_num;
+  /**
+   * Lines before this position haven't been searched yet.
+   */
+  size_t find_pos;
+  /**
+   * The current match, find_line is NULL if there isn't any.
+   */
+  const Line *find_line;
+  size_t find_span;
+  /**
+   * The view is scrolled to the first match found.
+   */
+  bool find_jump;
+  sigc::connection find_conn;
+
   virtual const char *proceedLine(const char *text, int area_width,
       int *res_length) const;
   /**
@@ -163,10 +243,34 @@ protected:
   virtual size_t eraseScreenLines(size_t line_num, size_t start = 0,
       size_t *deleted = NULL);
 
+  /**
+   * Finds all matches of the searched text in a line.
+   */
+  virtual void findLine(const Line& line);
+  /**
+   * Forgets matches of a line that is being removed.
+   */
+  virtual void forgetLine(size_t line_num);
+  /**
+   * Scrolls the view so a given match is at the top.
+   */
+  virtual void showMatch(const Line& line, size_t span);
+
 private:
   TextView(const TextView &);
   TextView& operator=(const TextView&);
 
+  /**
+   * Scrolls the view by a given number of lines.
+   */
+  void scroll(int lines);
+
+  /**
+   * Searches a chunk of lines, called repeatedly from the main loop until
+   * all lines are searched.
+   */
+  bool findStep();
+
   void actionScroll(int direction);
 
   void declareBindables();
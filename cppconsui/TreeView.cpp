@@ -84,6 +84,7 @@ void TreeView::draw()
 
   area->fill(getColorPair("container", "background"));
 
+  drawn_rows.clear();
   drawNode(thetree.begin(), 0);
 
   // make sure that currently focused widget is visible
@@ -120,6 +121,37 @@ bool TreeView::grabFocus()
   return false;
 }
 
+bool TreeView::processMouse(const MouseEvent& event)
+{
+  if (event.isClick()) {
+    int x = event.x + scroll_xpos;
+    int y = event.y + scroll_ypos;
+    if (y >= 0 && static_cast<size_t>(y) < drawn_rows.size()) {
+      const DrawnRow& row = drawn_rows[y];
+      if (row.marker >= 0 && x >= row.marker && x < row.marker + 3) {
+        toggleCollapsed(row.node);
+        return true;
+      }
+
+      // let the node widget handle the click first
+      if (ScrollPane::processMouse(event))
+        return true;
+
+      // click outside the node widget selects the node
+      row.node->widget->grabFocus();
+      return true;
+    }
+  }
+
+  int old_ypos = scroll_ypos;
+  if (!ScrollPane::processMouse(event))
+    return false;
+
+  if (scroll_ypos != old_ypos)
+    focusVisibleNode(scroll_ypos > old_ypos);
+  return true;
+}
+
 void TreeView::clear()
 {
   TheTree::pre_order_iterator root = thetree.begin();
@@ -131,6 +163,18 @@ void TreeView::clear()
   g_assert(!getScrollHeight());
 }
 
+Widget *TreeView::getChildAt(int x, int y)
+{
+  if (y < 0 || static_cast<size_t>(y) >= drawn_rows.size())
+    return NULL;
+
+  Widget *widget = drawn_rows[y].node->widget;
+  int left = widget->getLeft();
+  if (x < left || x >= left + widget->getRealWidth())
+    return NULL;
+  return widget;
+}
+
 bool TreeView::isWidgetVisible(const Widget& child) const
 {
   if (!parent || !visible)
@@ -330,6 +374,8 @@ void TreeView::deleteNode(NodeReference node, bool keepchildren)
     removeWidget(*node->widget);
 
   thetree.erase(node);
+  // the drawn rows can reference erased nodes
+  drawn_rows.clear();
   setScrollHeight(getScrollHeight() - shrink);
   redraw();
 }
@@ -430,6 +476,18 @@ int TreeView::drawNode(SiblingIterator node, int top)
     if (h == AUTOSIZE)
       h = 1;
     height += h;
+
+    /* Remember the lines of this node, the "[+]" marker is drawn by the
+     * parent node in front of the widget. */
+    if (drawn_rows.size() == static_cast<size_t>(top)) {
+      int marker = -1;
+      if (node->style == STYLE_NORMAL && isNodeOpenable(node))
+        marker = depthoffset - 1;
+      for (int k = 0; k < h; k++) {
+        drawn_rows.push_back(DrawnRow(node, marker));
+        marker = -1;
+      }
+    }
   }
 
   if (!node->collapsed && isNodeOpenable(node)) {
@@ -537,6 +595,33 @@ void TreeView::fixFocus()
   }
 }
 
+void TreeView::focusVisibleNode(bool down)
+{
+  if (!focus_child || !screen_area)
+    return;
+
+  int view_top = scroll_ypos;
+  int view_bottom = MIN(scroll_ypos + screen_area->getmaxy(),
+      static_cast<int>(drawn_rows.size()));
+  int top = focus_child->getTop();
+  int h = focus_child->getRealHeight();
+  if (top >= view_top && top + h <= view_bottom)
+    return;
+
+  /* Give the focus to the first node in the view when scrolling down or to
+   * the last one when scrolling up. */
+  if (down) {
+    for (int y = view_top; y < view_bottom; y++)
+      if (drawn_rows[y].node->widget->grabFocus())
+        return;
+  }
+  else {
+    for (int y = view_bottom - 1; y >= view_top; y--)
+      if (drawn_rows[y].node->widget->grabFocus())
+        return;
+  }
+}
+
 TreeView::NodeReference TreeView::findNode(const Widget& child) const
 {
   /// @todo Speed up this algorithm.
@@ -74,9 +74,11 @@ public:
   virtual void draw();
   virtual void cleanFocus();
   virtual bool grabFocus();
+  virtual bool processMouse(const MouseEvent& event);
 
   // Container
   virtual void clear();
+  virtual Widget *getChildAt(int x, int y);
   virtual bool isWidgetVisible(const Widget& widget) const;
   virtual bool setFocusChild(Widget& child);
   virtual void getFocusChain(FocusChain& focus_chain,
@@ -201,8 +203,29 @@ protected:
     Widget *widget;
   };
 
+  /**
+   * On-screen line as it was drawn by the last draw.
+   */
+  struct DrawnRow
+  {
+    NodeReference node;
+    /**
+     * Position of the "[+]" marker or -1 if the line doesn't have one.
+     */
+    int marker;
+
+    DrawnRow(NodeReference node_, int marker_)
+      : node(node_), marker(marker_) {}
+  };
+  typedef std::vector<DrawnRow> DrawnRows;
+
   TheTree thetree;
   NodeReference focus_node;
+  /**
+   * Nodes indexed by their line in the virtual area, this allows to find
+   * a node at a given position without walking the tree.
+   */
+  DrawnRows drawn_rows;
 
   // Container
   using ScrollPane::addWidget;
@@ -215,6 +238,11 @@ protected:
   virtual TreeNode addNode(Widget& widget);
 
   virtual void fixFocus();
+  /**
+   * Moves the focus to a node inside the visible area if the focused node was
+   * scrolled out of the view.
+   */
+  virtual void focusVisibleNode(bool down);
 
   virtual NodeReference findNode(const Widget& child) const;
 
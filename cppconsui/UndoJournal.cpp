@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file
+ * UndoJournal class implementation.
+ *
+ * @ingroup cppconsui
+ */
+
+#include "UndoJournal.h"
+
+namespace CppConsUI
+{
+
+UndoJournal::UndoJournal(size_t max_bytes_)
+: max_bytes(max_bytes_), current(0), grouping(false)
+{
+}
+
+void UndoJournal::recordInsert(size_t pos, const char *text, size_t bytes,
+    size_t chars)
+{
+  g_assert(text);
+
+  forgetRedo();
+
+  // extend the current word by a typed character
+  if (grouping && chars == 1 && !records.empty()) {
+    Record& last = records.back();
+    if (last.type == TYPE_INSERT && pos == last.pos + last.chars
+        && !isWordBoundary(arena.data() + last.offset, last.bytes, text)) {
+      arena.append(text, bytes);
+      last.chars += chars;
+      last.bytes += bytes;
+      trim();
+      return;
+    }
+  }
+
+  addRecord(TYPE_INSERT, false, pos, text, bytes, chars);
+}
+
+void UndoJournal::recordDelete(size_t pos, const char *text, size_t bytes,
+    size_t chars, bool backward)
+{
+  g_assert(text);
+
+  forgetRedo();
+
+  if (grouping && chars == 1 && !records.empty()) {
+    Record& last = records.back();
+    const char *last_text = arena.data() + last.offset;
+    if (last.type == TYPE_DELETE && last.backward == backward) {
+      if (backward && pos + chars == last.pos
+          && !isWordBoundary(text, bytes, last_text)) {
+        arena.insert(last.offset, text, bytes);
+        last.pos = pos;
+        last.chars += chars;
+        last.bytes += bytes;
+        trim();
+        return;
+      }
+      if (!backward && pos == last.pos
+          && !isWordBoundary(last_text, last.bytes, text)) {
+        arena.append(text, bytes);
+        last.chars += chars;
+        last.bytes += bytes;
+        trim();
+        return;
+      }
+    }
+  }
+
+  addRecord(TYPE_DELETE, backward, pos, text, bytes, chars);
+}
+
+bool UndoJournal::undo(Delta& delta)
+{
+  if (!current)
+    return false;
+
+  fillDelta(records[--current], delta);
+  grouping = false;
+  return true;
+}
+
+bool UndoJournal::redo(Delta& delta)
+{
+  if (current == records.size())
+    return false;
+
+  fillDelta(records[current++], delta);
+  grouping = false;
+  return true;
+}
+
+void UndoJournal::clear()
+{
+  records.clear();
+  std::string().swap(arena);
+  current = 0;
+  grouping = false;
+}
+
+size_t UndoJournal::getMemoryUsage() const
+{
+  return arena.capacity() + records.size() * sizeof(Record);
+}
+
+void UndoJournal::forgetRedo()
+{
+  if (current == records.size())
+    return;
+
+  records.erase(records.begin() + current, records.end());
+  // texts of the records are stored in order without any holes
+  arena.resize(current ? records.back().offset + records.back().bytes : 0);
+  grouping = false;
+}
+
+void UndoJournal::addRecord(Type type, bool backward, size_t pos,
+    const char *text, size_t bytes, size_t chars)
+{
+  Record record;
+  record.type = type;
+  record.backward = backward;
+  record.pos = pos;
+  record.chars = chars;
+  record.offset = arena.size();
+  record.bytes = bytes;
+
+  arena.append(text, bytes);
+  records.push_back(record);
+  current = records.size();
+
+  // only single keystrokes are grouped, a pasted text is a delta of its own
+  grouping = chars == 1;
+
+  trim();
+}
+
+void UndoJournal::trim()
+{
+  if (arena.size() <= max_bytes)
+    return;
+
+  /* Drop the oldest records until a quarter of the arena is free so the
+   * arena isn't moved after every following edit. */
+  size_t keep = max_bytes / 4 * 3;
+  size_t dropped = 0;
+  while (!records.empty() && arena.size() - dropped > keep) {
+    dropped += records.front().bytes;
+    records.pop_front();
+    g_assert(current > 0);
+    current--;
+  }
+
+  if (records.empty()) {
+    std::string().swap(arena);
+    grouping = false;
+    return;
+  }
+
+  arena.erase(0, dropped);
+  for (Records::iterator i = records.begin(); i != records.end(); i++)
+    i->offset -= dropped;
+}
+
+void UndoJournal::fillDelta(const Record& record, Delta& delta) const
+{
+  delta.type = record.type;
+  delta.backward = record.backward;
+  delta.pos = record.pos;
+  delta.chars = record.chars;
+  delta.text = arena.data() + record.offset;
+  delta.bytes = record.bytes;
+}
+
+bool UndoJournal::isWordBoundary(const char *first, size_t first_bytes,
+    const char *second)
+{
+  if (!first_bytes)
+    return false;
+
+  gunichar last = g_utf8_get_char(g_utf8_prev_char(first + first_bytes));
+  return g_unichar_isspace(last) && !g_unichar_isspace(
+      g_utf8_get_char(second));
+}
+
+} // namespace CppConsUI
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file
+ * UndoJournal class.
+ *
+ * @ingroup cppconsui
+ */
+
+#ifndef __UNDOJOURNAL_H__
+#define __UNDOJOURNAL_H__
+
+#include <glib.h>
+
+#include <deque>
+#include <string>
+
+namespace CppConsUI
+{
+
+/**
+ * History of edits of a text. Every edit is stored as a delta, that is the
+ * position and the inserted or deleted bytes, so undoing an edit costs only
+ * the size of the edit. Texts of all deltas are kept one after another in a
+ * single arena. Consecutive keystrokes are grouped into words and the oldest
+ * deltas are dropped when the arena grows over a given size.
+ */
+class UndoJournal
+{
+public:
+  enum Type {
+    TYPE_INSERT,
+    TYPE_DELETE
+  };
+
+  struct Delta
+  {
+    Type type;
+    /**
+     * The text was deleted backwards (by the backspace key), only set for
+     * TYPE_DELETE.
+     */
+    bool backward;
+    /**
+     * Character position of the edit, the deleted text started there.
+     */
+    size_t pos;
+    /**
+     * Length of the text in characters.
+     */
+    size_t chars;
+    /**
+     * The text, it's valid only until the journal is changed.
+     */
+    const char *text;
+    size_t bytes;
+  };
+
+  explicit UndoJournal(size_t max_bytes_ = 65536);
+
+  /**
+   * Records that a text was inserted at a given position. All edits that
+   * were undone are forgotten.
+   */
+  void recordInsert(size_t pos, const char *text, size_t bytes,
+      size_t chars);
+  /**
+   * Records that a text was deleted, the text started at a given position.
+   */
+  void recordDelete(size_t pos, const char *text, size_t bytes,
+      size_t chars, bool backward);
+  /**
+   * Makes the next edit start a new delta, it's called when the cursor is
+   * moved.
+   */
+  void breakGroup() { grouping = false; }
+
+  /**
+   * Returns the last edit that should be reverted. The caller reverts it.
+   */
+  bool undo(Delta& delta);
+  /**
+   * Returns the last undone edit that should be applied again.
+   */
+  bool redo(Delta& delta);
+  bool canUndo() const { return current > 0; }
+  bool canRedo() const { return current < records.size(); }
+
+  /**
+   * Forgets all edits.
+   */
+  void clear();
+
+  /**
+   * Returns the number of bytes allocated by the journal.
+   */
+  size_t getMemoryUsage() const;
+
+protected:
+
+private:
+  struct Record
+  {
+    Type type;
+    bool backward;
+    size_t pos;
+    size_t chars;
+    // offset of the text in the arena
+    size_t offset;
+    size_t bytes;
+  };
+
+  typedef std::deque<Record> Records;
+
+  Records records;
+  std::string arena;
+  size_t max_bytes;
+  // number of records that can be undone, the rest can be redone
+  size_t current;
+  // the last record can be extended by the next keystroke
+  bool grouping;
+
+  UndoJournal(const UndoJournal&);
+  UndoJournal& operator=(const UndoJournal&);
+
+  void forgetRedo();
+  void addRecord(Type type, bool backward, size_t pos, const char *text,
+      size_t bytes, size_t chars);
+  void trim();
+  void fillDelta(const Record& record, Delta& delta) const;
+
+  /**
+   * Returns true if a word ends between the first and the second text, a
+   * word consists of non-space characters followed by spaces.
+   */
+  static bool isWordBoundary(const char *first, size_t first_bytes,
+      const char *second);
+};
+
+} // namespace CppConsUI
+
+#endif // __UNDOJOURNAL_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -38,6 +38,7 @@ Widget::Widget(int w, int h)
 : xpos(UNSET), ypos(UNSET), width(w), height(h), wish_width(AUTOSIZE)
 , wish_height(AUTOSIZE), can_focus(false), has_focus(false), visible(true)
 , area(NULL), update_area(false), parent(NULL), color_scheme(NULL)
+, resolved_color_scheme(NULL)
 {
 }
 
@@ -46,7 +47,6 @@ Widget::~Widget()
   setVisibility(false);
 
   delete area;
-  g_free(color_scheme);
 }
 
 void Widget::moveResize(int newx, int newy, int neww, int newh)
@@ -72,6 +72,13 @@ void Widget::updateArea()
   redraw();
 }
 
+void Widget::releaseArea()
+{
+  delete area;
+  area = NULL;
+  update_area = true;
+}
+
 Widget *Widget::getFocusWidget()
 {
   if (can_focus)
@@ -121,6 +128,15 @@ bool Widget::grabFocus()
   return false;
 }
 
+bool Widget::processMouse(const MouseEvent& event)
+{
+  if (!event.isClick() || !can_focus)
+    return false;
+
+  grabFocus();
+  return true;
+}
+
 void Widget::setVisibility(bool new_visible)
 {
   if (new_visible == visible)
@@ -166,6 +182,7 @@ void Widget::setParent(Container& parent)
   g_assert(!this->parent);
 
   this->parent = &parent;
+  resolveColorScheme();
 
   this->parent->updateFocusChain();
 
@@ -261,20 +278,26 @@ int Widget::getWishHeight() const
 
 void Widget::setColorScheme(const char *new_color_scheme)
 {
-  g_free(color_scheme);
+  const char *scheme = g_intern_string(new_color_scheme);
+  if (scheme == color_scheme)
+    return;
 
-  color_scheme = g_strdup(new_color_scheme);
-  redraw();
+  color_scheme = scheme;
+  if (resolveColorScheme())
+    redraw();
 }
 
-const char *Widget::getColorScheme() const
+bool Widget::resolveColorScheme()
 {
-  if (color_scheme)
-    return color_scheme;
-  else if (parent)
-    return parent->getColorScheme();
+  const char *scheme = color_scheme;
+  if (!scheme && parent)
+    scheme = parent->getColorScheme();
 
-  return NULL;
+  if (scheme == resolved_color_scheme)
+    return false;
+
+  resolved_color_scheme = scheme;
+  return true;
 }
 
 void Widget::proceedUpdateArea()
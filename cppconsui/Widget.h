@@ -59,6 +59,12 @@ public:
    * whenever the coordinates of the widget change.
    */
   virtual void updateArea();
+  /**
+   * Deletes the @ref area (and any other curses windows and pads owned by the
+   * widget) to save memory. The area is recreated when the widget is drawn
+   * next time.
+   */
+  virtual void releaseArea();
   /**
    * The draw() method does the actual drawing on a (virtual) area of the
    * screen. The @ref CoreManager singleton calls draw() on all on-screen
@@ -89,6 +95,12 @@ public:
    * successful if the widget is visible and all predecessors are visible too.
    */
   virtual bool grabFocus();
+  /**
+   * Processes a mouse event, the event position is relative to the widget.
+   * The default implementation gives the focus to the widget when it is
+   * clicked. Returns true if the event was handled.
+   */
+  virtual bool processMouse(const MouseEvent& event);
 
   virtual bool canFocus() const { return can_focus; }
   virtual bool hasFocus() const { return has_focus; }
@@ -166,8 +178,24 @@ public:
    */
   virtual int getWishHeight() const;
 
+  /**
+   * Sets the color scheme of the widget, NULL means that the color scheme of
+   * the parent is used. The name is interned so comparing color schemes is
+   * only a pointer comparison.
+   */
   virtual void setColorScheme(const char *new_color_scheme);
-  virtual const char *getColorScheme() const;
+  /**
+   * Returns the interned name of the color scheme that is in effect for the
+   * widget.
+   */
+  virtual const char *getColorScheme() const
+    { return resolved_color_scheme; }
+  /**
+   * Updates the color scheme that is in effect after the color scheme of the
+   * widget or of some predecessor changed. Returns true if the effective
+   * color scheme is different.
+   */
+  virtual bool resolveColorScheme();
 
   sigc::signal<void, Widget&, const Rect&, const Rect&> signal_moveresize;
   sigc::signal<void, Widget&, const Size&, const Size&>
@@ -215,9 +243,15 @@ protected:
    */
   Container *parent;
   /**
-   * Color scheme.
+   * Interned color scheme set by setColorScheme().
+   */
+  const char *color_scheme;
+  /**
+   * Color scheme that is in effect, either the own one or the one of the
+   * closest predecessor that has it set. It's cached so drawing doesn't
+   * have to walk up the parent chain.
    */
-  char *color_scheme;
+  const char *resolved_color_scheme;
 
   virtual void proceedUpdateArea();
 
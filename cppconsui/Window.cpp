@@ -79,6 +79,13 @@ Point Window::getAbsolutePosition(const Widget& child) const
   return Point(win_x + child.getLeft() + 1, win_y + child.getTop() + 1);
 }
 
+Point Window::getChildOrigin(const Widget& child) const
+{
+  if (&child == panel)
+    return Point(0, 0);
+  return Point(child.getLeft() + 1, child.getTop() + 1);
+}
+
 Curses::Window *Window::getSubPad(const Widget &child, int begin_x,
     int begin_y, int ncols, int nlines)
 {
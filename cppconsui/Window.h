@@ -57,6 +57,7 @@ public:
   virtual Point getAbsolutePosition(const Container& ref,
       const Widget& child) const;
   virtual Point getAbsolutePosition(const Widget& child) const;
+  virtual Point getChildOrigin(const Widget& child) const;
   virtual Curses::Window *getSubPad(const Widget &child, int begin_x,
       int begin_y, int ncols, int nlines);
 
@@ -410,6 +410,38 @@ int termkey_get_waittime(TermKey *tk)
   return tk->waittime;
 }
 
+size_t termkey_get_buffer_size(TermKey *tk)
+{
+  return tk->buffsize;
+}
+
+int termkey_set_buffer_size(TermKey *tk, size_t size)
+{
+  // Pending input has to fit into the new buffer
+  if(size < tk->buffcount)
+    return 0;
+
+  if(tk->buffstart) {
+    memmove(tk->buffer, tk->buffer + tk->buffstart, tk->buffcount);
+    tk->buffstart = 0;
+  }
+
+  unsigned char *buffer = realloc(tk->buffer, size);
+  if(!buffer)
+    return 0;
+
+  tk->buffer = buffer;
+  tk->buffsize = size;
+  return 1;
+}
+
+size_t termkey_get_buffer_remaining(TermKey *tk)
+{
+  /* Return the total number of free bytes in the buffer, because that's what
+   * is available to the user. */
+  return tk->buffsize - tk->buffcount;
+}
+
 int termkey_get_canonflags(TermKey *tk)
 {
   return tk->canonflags;
@@ -953,11 +985,22 @@ void termkey_pushinput(TermKey *tk, const unsigned char *input, size_t inputlen)
 
 TermKeyResult termkey_advisereadable(TermKey *tk)
 {
-  unsigned char buffer[64]; // Smaller than the default size
   ssize_t len;
 
+  // Read straight into the free space at the end of the buffer
+  if(tk->buffstart) {
+    memmove(tk->buffer, tk->buffer + tk->buffstart, tk->buffcount);
+    tk->buffstart = 0;
+  }
+
+  /* Not expecting it ever to be greater but doesn't hurt to handle that */
+  if(tk->buffcount >= tk->buffsize) {
+    errno = ENOMEM;
+    return TERMKEY_RES_ERROR;
+  }
+
 retry:
-  len = read(tk->fd, buffer, sizeof buffer);
+  len = read(tk->fd, tk->buffer + tk->buffcount, tk->buffsize - tk->buffcount);
 
   if(len == -1) {
     if(errno == EAGAIN)
@@ -972,7 +1015,7 @@ retry:
     return TERMKEY_RES_NONE;
   }
   else {
-    termkey_pushinput(tk, buffer, len);
+    tk->buffcount += len;
     return TERMKEY_RES_AGAIN;
   }
 }
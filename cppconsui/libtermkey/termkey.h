@@ -168,6 +168,11 @@ void termkey_set_flags(TermKey *tk, int newflags);
 int  termkey_get_waittime(TermKey *tk);
 void termkey_set_waittime(TermKey *tk, int msec);
 
+size_t termkey_get_buffer_size(TermKey *tk);
+int    termkey_set_buffer_size(TermKey *tk, size_t size);
+
+size_t termkey_get_buffer_remaining(TermKey *tk);
+
 int  termkey_get_canonflags(TermKey *tk);
 void termkey_set_canonflags(TermKey *tk, int);
 
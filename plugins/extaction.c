@@ -24,10 +24,21 @@
  * When an event such as received-im-msg, or buddy-signed-on occurs this
  * plugin asynchronously executes a user-defined external program.
  *
+ * Normally the program is executed for every event and the event is described
+ * in its environment variables. In the worker mode the program is started
+ * only once and events are written to its standard input, one JSON object per
+ * line. The worker is restarted when it exits.
+ *
  * An example how to use this plugin can be found in contrib/extnotify.py.
  *
- * TODO Add support for more kinds of events, currently only received-im-msg
- * and received-chat-msg actions are supported.
+ * Events of one conversation that arrive within a short window are merged
+ * into a single event which carries their count and the latest message, and
+ * the number of events per conversation and minute is limited. The
+ * buddy-signed-on and buddy-signed-off events are merged per account.
+ *
+ * TODO Add support for more kinds of events, currently only received-im-msg,
+ * received-chat-msg, buddy-signed-on and buddy-signed-off actions are
+ * supported.
  *
  * Note: This plugin requires glib 2.32 because it relies on the
  * g_environ_setenv() function which isn't available in earlier glib versions.
@@ -35,63 +46,379 @@
 
 #define PURPLE_PLUGINS
 
+#include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <libpurple/purple.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #define DEFAULT_TEXT_DOMAIN PACKAGE_NAME
 #include "gettext.h"
 
 #define PLUGIN_ID "core-cim_pack-ext_action"
 #define PLUGIN_PREF "/plugins/core/cim_pack-extaction"
 #define PLUGIN_PREF_COMMAND PLUGIN_PREF "/command"
+#define PLUGIN_PREF_WORKER PLUGIN_PREF "/worker"
+#define PLUGIN_PREF_QUEUE_SIZE PLUGIN_PREF "/queue_size"
+#define PLUGIN_PREF_BATCH_WINDOW PLUGIN_PREF "/batch_window"
+#define PLUGIN_PREF_RATE_LIMIT PLUGIN_PREF "/rate_limit"
+
+/* Delay in seconds before a dead worker is started again. It doubles up to
+ * the maximum every time the worker dies shortly after it was started. */
+#define WORKER_RESTART_DELAY 1
+#define WORKER_RESTART_DELAY_MAX 64
+// a worker that ran at least this many seconds is considered healthy
+#define WORKER_HEALTHY_TIME 60
+// number of events a conversation can emit at once before it's rate limited
+#define RATE_LIMIT_BURST 3
 
 #define UNUSED(x) (void)(x)
 
+typedef struct {
+  GPid pid;
+  // standard input of the worker, -1 if it isn't running
+  int fd;
+  guint write_watch;
+  guint restart_timer;
+  guint restart_delay;
+  time_t start_time;
+
+  // GString records waiting for the worker
+  GQueue *records;
+  // bytes of the first record that were already written
+  gsize written;
+  // records dropped since the last queued one
+  guint dropped;
+
+  gulong sent_total;
+  gulong dropped_total;
+  guint restarts;
+} Worker;
+
+typedef struct {
+  // one of the event type names, not owned
+  const char *type;
+  char *protocol;
+  char *local;
+  char *remote;
+  char *icon_encoded;
+  // NULL for events that aren't messages
+  char *message;
+  char *message_html;
+  // number of events merged into this one
+  guint count;
+} Event;
+
+typedef struct {
+  char *key;
+  // event waiting for the end of the batch window or for the rate limit
+  Event *event;
+  guint timer;
+  // token bucket of the rate limit
+  double tokens;
+  gint64 updated;
+} Batch;
+
 static PurplePlugin *ea_plugin = NULL;
+static Worker worker;
+// batches of conversations that notified recently
+static GHashTable *batches = NULL;
+// base64 encoded buddy icons, the key is built by icon_cache_key()
+static GHashTable *icon_cache = NULL;
 
-static void on_new_message(PurpleAccount *account, const char *remote,
-    const char *message)
+static void worker_flush(void);
+
+static char *icon_cache_key(PurpleBuddy *buddy)
+{
+  PurpleAccount *account = purple_buddy_get_account(buddy);
+  return g_strconcat(purple_account_get_protocol_id(account), "\n",
+      purple_account_get_username(account), "\n", purple_buddy_get_name(buddy),
+      NULL);
+}
+
+static const char *get_icon_encoded(PurpleBuddy *buddy)
+{
+  PurpleBuddyIcon *icon = purple_buddy_get_icon(buddy);
+  if (!icon)
+    return NULL;
+
+  char *key = icon_cache_key(buddy);
+  char *encoded = g_hash_table_lookup(icon_cache, key);
+  if (encoded) {
+    g_free(key);
+    return encoded;
+  }
+
+  size_t len;
+  gconstpointer data = purple_buddy_icon_get_data(icon, &len);
+  encoded = g_base64_encode(data, len);
+  // the table takes ownership of the key
+  g_hash_table_insert(icon_cache, key, encoded);
+  return encoded;
+}
+
+static void on_buddy_icon_changed(PurpleBuddy *buddy, gpointer data)
+{
+  UNUSED(data);
+
+  char *key = icon_cache_key(buddy);
+  g_hash_table_remove(icon_cache, key);
+  g_free(key);
+}
+
+static void json_append_member(GString *record, const char *name,
+    const char *value)
+{
+  g_string_append_printf(record, ",\"%s\":\"", name);
+  for (const char *p = value; *p; p++) {
+    unsigned char c = *p;
+    switch (c) {
+      case '"':
+        g_string_append(record, "\\\"");
+        break;
+      case '\\':
+        g_string_append(record, "\\\\");
+        break;
+      case '\n':
+        g_string_append(record, "\\n");
+        break;
+      case '\r':
+        g_string_append(record, "\\r");
+        break;
+      case '\t':
+        g_string_append(record, "\\t");
+        break;
+      default:
+        if (c < 0x20)
+          g_string_append_printf(record, "\\u%04x", c);
+        else
+          g_string_append_c(record, c);
+    }
+  }
+  g_string_append_c(record, '"');
+}
+
+static void worker_close(void)
+{
+  if (worker.write_watch) {
+    g_source_remove(worker.write_watch);
+    worker.write_watch = 0;
+  }
+  if (worker.fd >= 0) {
+    close(worker.fd);
+    worker.fd = -1;
+  }
+  // a new worker gets the whole record again
+  worker.written = 0;
+}
+
+static void worker_stop(void)
+{
+  // closing the standard input tells the worker to exit, it's reaped by
+  // on_worker_exit()
+  worker_close();
+  worker.pid = 0;
+  if (worker.restart_timer) {
+    g_source_remove(worker.restart_timer);
+    worker.restart_timer = 0;
+  }
+}
+
+static gboolean on_worker_restart(gpointer data);
+
+static void on_worker_exit(GPid pid, gint status, gpointer data)
+{
+  UNUSED(data);
+
+  g_spawn_close_pid(pid);
+
+  // ignore workers that were stopped
+  if (pid != worker.pid)
+    return;
+
+  worker_close();
+  worker.pid = 0;
+
+  if (time(NULL) - worker.start_time >= WORKER_HEALTHY_TIME)
+    worker.restart_delay = WORKER_RESTART_DELAY;
+
+  purple_debug_warning("extaction",
+      "worker exited with status %d, restarting in %u s\n", status,
+      worker.restart_delay);
+  worker.restart_timer = g_timeout_add_seconds(worker.restart_delay,
+      on_worker_restart, NULL);
+  worker.restart_delay = MIN(worker.restart_delay * 2,
+      WORKER_RESTART_DELAY_MAX);
+}
+
+static void worker_start(void)
 {
   const char *command = purple_prefs_get_path(PLUGIN_PREF_COMMAND);
+  if (!command || !command[0] || !purple_prefs_get_bool(PLUGIN_PREF_WORKER))
+    return;
 
-  // the command should be never NULL
-  g_return_if_fail(command);
+  char *argv[2];
+  argv[0] = g_strdup(command);
+  argv[1] = NULL;
+
+  // let the program know that the events come from its standard input
+  char **envp = g_get_environ();
+  envp = g_environ_setenv(envp, "EVENT_TYPE", "stream", TRUE);
+
+  GError *err = NULL;
+  GPid pid;
+  int fd;
+  gboolean res = g_spawn_async_with_pipes(NULL, argv, envp,
+      G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD
+      | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL,
+      &pid, &fd, NULL, NULL, &err);
+  g_free(argv[0]);
+  g_strfreev(envp);
 
-  if (!command[0]) {
-    // no command is set
+  if (!res) {
+    purple_debug_error("extaction", "%s", err->message);
+    g_clear_error(&err);
     return;
   }
 
-  const char *protocol = purple_account_get_protocol_name(account);
-  char *local = g_strdup(purple_normalize(account,
-        purple_account_get_username(account)));
-  char *nohtml = purple_markup_strip_html(message);
-  PurpleBuddy *buddy = purple_find_buddy(account, remote);
-  char *icon_encoded = NULL;
-  if (buddy) {
-    // get buddy alias and icon
-    remote = purple_buddy_get_alias(buddy);
-    PurpleBuddyIcon *icon = purple_buddy_get_icon(buddy);
-    if (icon) {
-      size_t len;
-      gconstpointer data = purple_buddy_icon_get_data(icon, &len);
-      icon_encoded = g_base64_encode(data, len);
+  // writes must never block the main loop
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  worker.pid = pid;
+  worker.fd = fd;
+  worker.start_time = time(NULL);
+  g_child_watch_add(pid, on_worker_exit, NULL);
+
+  worker_flush();
+}
+
+static gboolean on_worker_restart(gpointer data)
+{
+  UNUSED(data);
+
+  worker.restart_timer = 0;
+  worker.restarts++;
+  worker_start();
+  return FALSE;
+}
+
+static gboolean on_worker_writable(GIOChannel *source, GIOCondition cond,
+    gpointer data)
+{
+  UNUSED(source);
+  UNUSED(cond);
+  UNUSED(data);
+
+  worker.write_watch = 0;
+  worker_flush();
+  return FALSE;
+}
+
+static void worker_flush(void)
+{
+  while (worker.fd >= 0 && !g_queue_is_empty(worker.records)) {
+    GString *record = g_queue_peek_head(worker.records);
+    ssize_t res = write(worker.fd, record->str + worker.written,
+        record->len - worker.written);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // the worker is busy, continue when it reads some data
+        if (!worker.write_watch) {
+          GIOChannel *channel = g_io_channel_unix_new(worker.fd);
+          worker.write_watch = g_io_add_watch(channel,
+              G_IO_OUT | G_IO_ERR | G_IO_HUP, on_worker_writable, NULL);
+          g_io_channel_unref(channel);
+        }
+        return;
+      }
+
+      // the worker is gone, on_worker_exit() starts a new one
+      purple_debug_error("extaction", "writing to worker failed: %s\n",
+          g_strerror(errno));
+      worker_close();
+      return;
     }
+
+    worker.written += res;
+    if (worker.written == record->len) {
+      g_string_free(g_queue_pop_head(worker.records), TRUE);
+      worker.written = 0;
+      worker.sent_total++;
+    }
+  }
+}
+
+static void worker_queue(const Event *event)
+{
+  int size = purple_prefs_get_int(PLUGIN_PREF_QUEUE_SIZE);
+  if (size < 1)
+    size = 1;
+
+  /* The queue is full when the worker can't keep up or it isn't running.
+   * Old events are dropped first, with the exception of the record that is
+   * partially written. */
+  while (g_queue_get_length(worker.records) >= (guint)size) {
+    guint n = worker.written ? 1 : 0;
+    if (n >= g_queue_get_length(worker.records))
+      break;
+    g_string_free(g_queue_pop_nth(worker.records, n), TRUE);
+    worker.dropped++;
+    worker.dropped_total++;
   }
 
+  // the type names don't need to be escaped
+  GString *record = g_string_new(NULL);
+  g_string_printf(record, "{\"type\":\"%s\"", event->type);
+  json_append_member(record, "network", event->protocol);
+  json_append_member(record, "local_user", event->local);
+  json_append_member(record, "remote_user", event->remote);
+  if (event->icon_encoded)
+    json_append_member(record, "remote_user_icon", event->icon_encoded);
+  if (event->message) {
+    json_append_member(record, "message", event->message);
+    json_append_member(record, "message_html", event->message_html);
+  }
+  g_string_append_printf(record, ",\"count\":%u", event->count);
+  // tell the worker how many events it missed
+  if (worker.dropped) {
+    g_string_append_printf(record, ",\"dropped\":%u", worker.dropped);
+    worker.dropped = 0;
+  }
+  g_string_append(record, "}\n");
+
+  g_queue_push_tail(worker.records, record);
+  worker_flush();
+}
+
+static void spawn_command(const Event *event)
+{
+  const char *command = purple_prefs_get_path(PLUGIN_PREF_COMMAND);
+
   char *argv[2];
   argv[0] = g_strdup(command);
   argv[1] = NULL;
 
+  char *count = g_strdup_printf("%u", event->count);
+
   // prepare child's environment variables
   char **envp = g_get_environ();
-  envp = g_environ_setenv(envp, "EVENT_TYPE", "msg", TRUE);
-  envp = g_environ_setenv(envp, "EVENT_NETWORK", protocol, TRUE);
-  envp = g_environ_setenv(envp, "EVENT_LOCAL_USER", local, TRUE);
-  envp = g_environ_setenv(envp, "EVENT_REMOTE_USER", remote, TRUE);
-  if (icon_encoded)
-    envp = g_environ_setenv(envp, "EVENT_REMOTE_USER_ICON", icon_encoded, TRUE);
-  envp = g_environ_setenv(envp, "EVENT_MESSAGE", nohtml, TRUE);
-  envp = g_environ_setenv(envp, "EVENT_MESSAGE_HTML", message, TRUE);
+  envp = g_environ_setenv(envp, "EVENT_TYPE", event->type, TRUE);
+  envp = g_environ_setenv(envp, "EVENT_NETWORK", event->protocol, TRUE);
+  envp = g_environ_setenv(envp, "EVENT_LOCAL_USER", event->local, TRUE);
+  envp = g_environ_setenv(envp, "EVENT_REMOTE_USER", event->remote, TRUE);
+  if (event->icon_encoded)
+    envp = g_environ_setenv(envp, "EVENT_REMOTE_USER_ICON",
+        event->icon_encoded, TRUE);
+  if (event->message) {
+    envp = g_environ_setenv(envp, "EVENT_MESSAGE", event->message, TRUE);
+    envp = g_environ_setenv(envp, "EVENT_MESSAGE_HTML", event->message_html,
+        TRUE);
+  }
+  envp = g_environ_setenv(envp, "EVENT_COUNT", count, TRUE);
 
   // spawn the command
   GError *err = NULL;
@@ -105,10 +432,176 @@ static void on_new_message(PurpleAccount *account, const char *remote,
   // free all resources
   g_free(argv[0]);
   g_strfreev(envp);
+  g_free(count);
+}
 
-  g_free(local);
-  g_free(nohtml);
-  g_free(icon_encoded);
+static void event_free(Event *event)
+{
+  g_free(event->protocol);
+  g_free(event->local);
+  g_free(event->remote);
+  g_free(event->icon_encoded);
+  g_free(event->message);
+  g_free(event->message_html);
+  g_free(event);
+}
+
+static void batch_free(gpointer data)
+{
+  Batch *batch = data;
+
+  if (batch->timer)
+    g_source_remove(batch->timer);
+  if (batch->event)
+    event_free(batch->event);
+  g_free(batch);
+}
+
+static gboolean on_batch_timer(gpointer data);
+
+static void batch_set_timer(Batch *batch, gint64 delay)
+{
+  if (batch->timer)
+    g_source_remove(batch->timer);
+  // round up so the timer never fires before the delay passes
+  batch->timer = g_timeout_add((delay + 999) / 1000, on_batch_timer, batch);
+}
+
+static void batch_flush(Batch *batch)
+{
+  int rate = purple_prefs_get_int(PLUGIN_PREF_RATE_LIMIT);
+  gint64 now = g_get_monotonic_time();
+
+  if (rate > 0) {
+    // refill the bucket for the time that passed since the last update
+    batch->tokens = MIN(RATE_LIMIT_BURST, batch->tokens
+        + (double)(now - batch->updated) * rate / G_USEC_PER_SEC / 60);
+    batch->updated = now;
+
+    if (batch->tokens < 1) {
+      // keep collecting events until the conversation may notify again
+      batch_set_timer(batch,
+          (1 - batch->tokens) * G_USEC_PER_SEC * 60 / rate);
+      return;
+    }
+    batch->tokens -= 1;
+  }
+
+  Event *event = batch->event;
+  batch->event = NULL;
+  if (purple_prefs_get_bool(PLUGIN_PREF_WORKER))
+    worker_queue(event);
+  else
+    spawn_command(event);
+  event_free(event);
+
+  if (rate > 0) {
+    /* Keep the batch only until the bucket is full again, a new batch would
+     * start in the same state. */
+    batch_set_timer(batch, (RATE_LIMIT_BURST - batch->tokens)
+        * G_USEC_PER_SEC * 60 / rate);
+  }
+  else
+    g_hash_table_remove(batches, batch->key);
+}
+
+static gboolean on_batch_timer(gpointer data)
+{
+  Batch *batch = data;
+
+  batch->timer = 0;
+  if (batch->event)
+    batch_flush(batch);
+  else
+    g_hash_table_remove(batches, batch->key);
+  return FALSE;
+}
+
+/* Passes an event to the batch of its conversation. The first event opens
+ * the batch and the events that arrive before the batch window closes are
+ * merged into it. The merged event counts them and carries the details of
+ * the latest one. */
+static void add_event(const char *key, Event *event)
+{
+  Batch *batch = g_hash_table_lookup(batches, key);
+  if (!batch) {
+    batch = g_new(Batch, 1);
+    batch->key = g_strdup(key);
+    batch->event = NULL;
+    batch->timer = 0;
+    batch->tokens = RATE_LIMIT_BURST;
+    batch->updated = g_get_monotonic_time();
+    // the table takes ownership of the key
+    g_hash_table_insert(batches, batch->key, batch);
+  }
+
+  if (batch->event) {
+    // the batch is waiting for its window or the rate limit
+    event->count += batch->event->count;
+    event_free(batch->event);
+    batch->event = event;
+    return;
+  }
+
+  batch->event = event;
+  int window = purple_prefs_get_int(PLUGIN_PREF_BATCH_WINDOW);
+  if (window > 0)
+    batch_set_timer(batch, (gint64)window * 1000);
+  else
+    batch_flush(batch);
+}
+
+static gboolean command_is_set(void)
+{
+  const char *command = purple_prefs_get_path(PLUGIN_PREF_COMMAND);
+
+  // the command should be never NULL
+  g_return_val_if_fail(command, FALSE);
+
+  return command[0] != '\0';
+}
+
+static Event *event_new(const char *type, PurpleAccount *account,
+    const char *remote)
+{
+  Event *event = g_new(Event, 1);
+  event->type = type;
+  event->protocol = g_strdup(purple_account_get_protocol_name(account));
+  event->local = g_strdup(purple_normalize(account,
+        purple_account_get_username(account)));
+  event->icon_encoded = NULL;
+  event->message = NULL;
+  event->message_html = NULL;
+  event->count = 1;
+
+  PurpleBuddy *buddy = purple_find_buddy(account, remote);
+  if (buddy) {
+    // get buddy alias and icon
+    remote = purple_buddy_get_alias(buddy);
+    event->icon_encoded = g_strdup(get_icon_encoded(buddy));
+  }
+  event->remote = g_strdup(remote);
+
+  return event;
+}
+
+static char *conversation_key(const char *type, PurpleAccount *account,
+    const char *name)
+{
+  return g_strconcat(type, "\n", purple_account_get_protocol_id(account),
+      "\n", purple_account_get_username(account), "\n", name, NULL);
+}
+
+static void on_new_message(PurpleAccount *account, const char *remote,
+    const char *key, const char *message)
+{
+  if (!command_is_set())
+    return;
+
+  Event *event = event_new("msg", account, remote);
+  event->message = purple_markup_strip_html(message);
+  event->message_html = g_strdup(message);
+  add_event(key, event);
 }
 
 static void on_new_im_message(PurpleAccount *account, const char *name,
@@ -119,24 +612,92 @@ static void on_new_im_message(PurpleAccount *account, const char *name,
   UNUSED(flags);
   UNUSED(data);
 
-  on_new_message(account, name, message);
+  char *key = conversation_key("msg", account,
+      purple_normalize(account, name));
+  on_new_message(account, name, key, message);
+  g_free(key);
 }
 
 static void on_new_chat_message(PurpleAccount *account, const char *who,
     const char *message, PurpleConversation *conv, PurpleMessageFlags flags,
     gpointer data)
 {
-  UNUSED(conv);
   UNUSED(flags);
   UNUSED(data);
 
-  on_new_message(account, who, message);
+  // messages in a chat room are batched together
+  char *key = conversation_key("msg", account,
+      purple_conversation_get_name(conv));
+  on_new_message(account, who, key, message);
+  g_free(key);
+}
+
+static void on_buddy_status_event(PurpleBuddy *buddy, const char *type)
+{
+  if (!command_is_set())
+    return;
+
+  /* A whole buddy list signs on when an account connects, so the events are
+   * batched per account rather than per buddy. */
+  PurpleAccount *account = purple_buddy_get_account(buddy);
+  Event *event = event_new(type, account, purple_buddy_get_name(buddy));
+  char *key = conversation_key(type, account, "");
+  add_event(key, event);
+  g_free(key);
+}
+
+static void on_buddy_signed_on(PurpleBuddy *buddy, gpointer data)
+{
+  UNUSED(data);
+
+  on_buddy_status_event(buddy, "buddy-signed-on");
+}
+
+static void on_buddy_signed_off(PurpleBuddy *buddy, gpointer data)
+{
+  UNUSED(data);
+
+  on_buddy_status_event(buddy, "buddy-signed-off");
+}
+
+static void on_worker_pref_change(const char *name, PurplePrefType type,
+    gconstpointer val, gpointer data)
+{
+  UNUSED(name);
+  UNUSED(type);
+  UNUSED(val);
+  UNUSED(data);
+
+  worker_stop();
+  worker.restart_delay = WORKER_RESTART_DELAY;
+  worker_start();
 }
 
 static gboolean plugin_load(PurplePlugin *plugin)
 {
   ea_plugin = plugin;
 
+  worker.pid = 0;
+  worker.fd = -1;
+  worker.write_watch = 0;
+  worker.restart_timer = 0;
+  worker.restart_delay = WORKER_RESTART_DELAY;
+  worker.records = g_queue_new();
+  worker.written = 0;
+  worker.dropped = 0;
+  worker.sent_total = 0;
+  worker.dropped_total = 0;
+  worker.restarts = 0;
+  icon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  batches = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      batch_free);
+
+  purple_prefs_connect_callback(plugin, PLUGIN_PREF_COMMAND,
+      on_worker_pref_change, NULL);
+  purple_prefs_connect_callback(plugin, PLUGIN_PREF_WORKER,
+      on_worker_pref_change, NULL);
+  worker_start();
+
   void *conv_handle = purple_conversations_get_handle();
 
   // connect callbacks
@@ -146,6 +707,17 @@ static gboolean plugin_load(PurplePlugin *plugin)
   purple_signal_connect(conv_handle, "received-chat-msg", plugin,
       PURPLE_CALLBACK(on_new_chat_message), NULL);
 
+  void *blist_handle = purple_blist_get_handle();
+
+  purple_signal_connect(blist_handle, "buddy-signed-on", plugin,
+      PURPLE_CALLBACK(on_buddy_signed_on), NULL);
+
+  purple_signal_connect(blist_handle, "buddy-signed-off", plugin,
+      PURPLE_CALLBACK(on_buddy_signed_off), NULL);
+
+  purple_signal_connect(blist_handle, "buddy-icon-changed", plugin,
+      PURPLE_CALLBACK(on_buddy_icon_changed), NULL);
+
   return TRUE;
 }
 
@@ -153,6 +725,27 @@ static gboolean plugin_unload(PurplePlugin *plugin)
 {
   // disconnect callbacks
   purple_signals_disconnect_by_handle(plugin);
+  purple_prefs_disconnect_by_handle(plugin);
+
+  if (worker.sent_total || worker.dropped_total || worker.restarts)
+    purple_debug_info("extaction",
+        "worker statistics: %lu events sent, %lu dropped, %u restarts\n",
+        worker.sent_total, worker.dropped_total, worker.restarts);
+
+  // events waiting in batches are dropped
+  g_hash_table_destroy(batches);
+  batches = NULL;
+
+  worker_stop();
+  GString *record;
+  while ((record = g_queue_pop_head(worker.records)))
+    g_string_free(record, TRUE);
+  g_queue_free(worker.records);
+  worker.records = NULL;
+
+  g_hash_table_destroy(icon_cache);
+  icon_cache = NULL;
+
   return TRUE;
 }
 
@@ -167,6 +760,26 @@ static PurplePluginPrefFrame *plugin_get_pref_frame(PurplePlugin *plugin)
       PLUGIN_PREF_COMMAND, _("Command"));
   purple_plugin_pref_frame_add(frame, pref);
 
+  pref = purple_plugin_pref_new_with_name_and_label(PLUGIN_PREF_WORKER,
+      _("Keep the command running and pass it events on standard input"));
+  purple_plugin_pref_frame_add(frame, pref);
+
+  pref = purple_plugin_pref_new_with_name_and_label(PLUGIN_PREF_QUEUE_SIZE,
+      _("Maximum number of events waiting for the command"));
+  purple_plugin_pref_set_bounds(pref, 1, 65536);
+  purple_plugin_pref_frame_add(frame, pref);
+
+  pref = purple_plugin_pref_new_with_name_and_label(PLUGIN_PREF_BATCH_WINDOW,
+      _("Time in milliseconds to collect events of one conversation"));
+  purple_plugin_pref_set_bounds(pref, 0, 60000);
+  purple_plugin_pref_frame_add(frame, pref);
+
+  pref = purple_plugin_pref_new_with_name_and_label(PLUGIN_PREF_RATE_LIMIT,
+      _("Maximum number of events per minute for one conversation "
+        "(0 means no limit)"));
+  purple_plugin_pref_set_bounds(pref, 0, 600);
+  purple_plugin_pref_frame_add(frame, pref);
+
   return frame;
 }
 
@@ -216,6 +829,10 @@ static void init_plugin(PurplePlugin *plugin)
 
   purple_prefs_add_none(PLUGIN_PREF);
   purple_prefs_add_path(PLUGIN_PREF_COMMAND, "");
+  purple_prefs_add_bool(PLUGIN_PREF_WORKER, FALSE);
+  purple_prefs_add_int(PLUGIN_PREF_QUEUE_SIZE, 256);
+  purple_prefs_add_int(PLUGIN_PREF_BATCH_WINDOW, 1000);
+  purple_prefs_add_int(PLUGIN_PREF_RATE_LIMIT, 10);
 }
 
 PURPLE_INIT_PLUGIN(extaction, init_plugin, info)
@@ -455,6 +455,18 @@ BuddyListBuddy::BuddyContextMenu::BuddyContextMenu(
 
   appendItem(_("Information..."), sigc::mem_fun(this,
         &BuddyContextMenu::onInformation));
+
+  PurpleBuddy *buddy = parent_buddy->getPurpleBuddy();
+  PurpleConnection *gc = purple_account_get_connection(
+      purple_buddy_get_account(buddy));
+  PurplePluginProtocolInfo *prpl_info = NULL;
+  if (gc)
+    prpl_info = PURPLE_PLUGIN_PROTOCOL_INFO(purple_connection_get_prpl(gc));
+  if (prpl_info && prpl_info->send_file && (!prpl_info->can_receive_file
+        || prpl_info->can_receive_file(gc, purple_buddy_get_name(buddy))))
+    appendItem(_("Send file..."), sigc::mem_fun(this,
+          &BuddyContextMenu::onSendFile));
+
   appendItem(_("Alias..."), sigc::mem_fun(this,
         &BuddyContextMenu::onChangeAlias));
   appendItem(_("Delete..."), sigc::mem_fun(this,
@@ -467,6 +479,14 @@ void BuddyListBuddy::BuddyContextMenu::onInformation(Button& /*activator*/)
   close();
 }
 
+void BuddyListBuddy::BuddyContextMenu::onSendFile(Button& /*activator*/)
+{
+  PurpleBuddy *buddy = parent_buddy->getPurpleBuddy();
+  serv_send_file(purple_account_get_connection(
+        purple_buddy_get_account(buddy)), purple_buddy_get_name(buddy), NULL);
+  close();
+}
+
 void BuddyListBuddy::BuddyContextMenu::changeAliasResponseHandler(
     CppConsUI::InputDialog& activator,
     CppConsUI::AbstractDialog::ResponseType response)
@@ -557,13 +577,9 @@ BuddyListBuddy::BuddyListBuddy(PurpleBlistNode *node_)
 
 void BuddyListBuddy::updateColorScheme()
 {
-  char *new_scheme;
-
   switch (BUDDYLIST->getColorizationMode()) {
     case BuddyList::COLOR_BY_STATUS:
-      new_scheme = Utils::getColorSchemeString("buddylistbuddy", buddy);
-      setColorScheme(new_scheme);
-      g_free(new_scheme);
+      setColorScheme(Utils::getColorSchemeString("buddylistbuddy", buddy));
       break;
     default:
       // note: COLOR_BY_ACCOUNT case is handled by BuddyListBuddy::draw()
@@ -963,15 +979,13 @@ BuddyListContact::BuddyListContact(PurpleBlistNode *node_)
 
 void BuddyListContact::updateColorScheme()
 {
-  char *new_scheme;
   PurpleBuddy *buddy;
 
   switch (BUDDYLIST->getColorizationMode()) {
     case BuddyList::COLOR_BY_STATUS:
       buddy = purple_contact_get_priority_buddy(contact);
-      new_scheme = Utils::getColorSchemeString("buddylistcontact", buddy);
-      setColorScheme(new_scheme);
-      g_free(new_scheme);
+      setColorScheme(Utils::getColorSchemeString("buddylistcontact",
+            buddy));
       break;
     default:
       // note: COLOR_BY_ACCOUNT case is handled by BuddyListContact::draw()
@@ -138,6 +138,7 @@ protected:
     BuddyListBuddy *parent_buddy;
 
     void onInformation(Button& activator);
+    void onSendFile(Button& activator);
 
     void changeAliasResponseHandler(CppConsUI::InputDialog& activator,
         CppConsUI::AbstractDialog::ResponseType response);
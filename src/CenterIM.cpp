@@ -23,13 +23,16 @@
 
 #include "Accounts.h"
 #include "BuddyList.h"
+#include "ConfigCache.h"
 #include "Connections.h"
 #include "Conversations.h"
+#include "EventLoop.h"
 #include "Footer.h"
 #include "Header.h"
 #include "Log.h"
 #include "Notify.h"
 #include "Request.h"
+#include "Search.h"
 #include "Transfers.h"
 
 #include "AccountStatusMenu.h"
@@ -118,6 +121,9 @@ int CenterIM::run(const char *config_path, bool ascii, bool offline)
   Connections::init();
   Notify::init();
   Request::init();
+  Transfers::init();
+  // conversations notify the search about written messages
+  Search::init();
 
   // initialize UI
   Conversations::init();
@@ -147,10 +153,24 @@ int CenterIM::run(const char *config_path, bool ascii, bool offline)
   Accounts::finalize();
   Connections::finalize();
   Notify::finalize();
+  Transfers::finalize();
+  Search::finalize();
   Request::finalize();
 
   Footer::finalize();
 
+  if (purple_prefs_get_bool(CONF_PREFIX "/log/debug")) {
+    saveInputStats();
+
+    const EventLoop::Stats *stats = EVENTLOOP->getStats();
+    LOG->debug("event loop: max %u fds, %lu dispatches, "
+        "max %u dispatches/s", stats->max_fds, stats->dispatches,
+        stats->max_dispatch_rate);
+    LOG->debug("event loop: %lu timeouts in %lu wakeups, "
+        "max %u wakeups/s", stats->timeout_dispatches, stats->wakeups,
+        stats->max_wakeup_rate);
+  }
+
   Log::finalize();
 
   purpleFinalize();
@@ -158,6 +178,34 @@ int CenterIM::run(const char *config_path, bool ascii, bool offline)
   return 0;
 }
 
+void CenterIM::saveInputStats()
+{
+  const CppConsUI::CoreManager::InputLatencyStats *stats
+    = mngr->getInputLatencyStats();
+  if (!stats->samples)
+    return;
+
+  LOG->debug("input latency: %u keys, average %" G_GINT64_FORMAT
+      "us, max %" G_GINT64_FORMAT "us", stats->samples,
+      stats->total / stats->samples, stats->max);
+
+  const CppConsUI::CoreManager::InputBatchStats *batch_stats
+    = mngr->getInputBatchStats();
+  LOG->debug("input batches: %u batches, %u keys, max %u keys, %u reads",
+      batch_stats->batches, batch_stats->keys, batch_stats->max_keys,
+      batch_stats->reads);
+
+  char *filename = g_build_filename(purple_user_dir(), "input-latency.log",
+      NULL);
+  GError *err = NULL;
+  if (!mngr->saveInputStats(filename, &err)) {
+    LOG->error(_("Error saving input statistics to '%s' (%s)."),
+        filename, err->message);
+    g_clear_error(&err);
+  }
+  g_free(filename);
+}
+
 void CenterIM::quit()
 {
   mngr->quitMainLoop();
@@ -179,6 +227,10 @@ CppConsUI::Rect CenterIM::getScreenAreaCentered(ScreenArea area)
 
 bool CenterIM::loadColorSchemeConfig()
 {
+  // skip parsing if the compiled cache still matches the file
+  if (ConfigCache::loadColorSchemes("colorschemes.xml"))
+    return true;
+
   xmlnode *root = purple_util_read_xml_from_file("colorschemes.xml",
       _("color schemes"));
 
@@ -245,6 +297,7 @@ bool CenterIM::loadColorSchemeConfig()
   }
 
   res = true;
+  ConfigCache::saveColorSchemes("colorschemes.xml");
 
 out:
   if (!res) {
@@ -260,6 +313,9 @@ out:
 
 bool CenterIM::loadKeyConfig()
 {
+  if (ConfigCache::loadKeyBinds("binds.xml"))
+    return true;
+
   xmlnode *root = purple_util_read_xml_from_file("binds.xml",
       _("key bindings"));
 
@@ -299,6 +355,7 @@ bool CenterIM::loadKeyConfig()
   }
 
   res = true;
+  ConfigCache::saveKeyBinds("binds.xml");
 
 out:
   if (!res) {
@@ -363,10 +420,12 @@ int CenterIM::purpleInit(const char *config_path)
   purple_core_set_ui_ops(&centerim_core_ui_ops);
 
   // set the uiops for the eventloop
+  EventLoop::init();
   centerim_glib_eventloops.timeout_add = timeout_add;
   centerim_glib_eventloops.timeout_remove = timeout_remove;
   centerim_glib_eventloops.input_add = input_add;
   centerim_glib_eventloops.input_remove = input_remove;
+  centerim_glib_eventloops.timeout_add_seconds = timeout_add_seconds;
   purple_eventloop_set_ui_ops(&centerim_glib_eventloops);
 
   // search user-specific plugins
@@ -400,6 +459,8 @@ void CenterIM::purpleFinalize()
   purple_core_set_ui_ops(NULL);
   //purple_eventloop_set_ui_ops(NULL);
   purple_core_quit();
+
+  EventLoop::finalize();
 }
 
 void CenterIM::prefsInit()
@@ -417,6 +478,14 @@ void CenterIM::prefsInit()
   purple_prefs_connect_callback(this, CONF_PREFIX "/dimensions",
       dimensions_change_, this);
 
+  /* Mouse reporting takes over the terminal's own selection and copy&paste
+   * so it has to be turned on explicitly. */
+  purple_prefs_add_none(CONF_PREFIX "/mouse");
+  purple_prefs_add_bool(CONF_PREFIX "/mouse/enabled", false);
+  purple_prefs_connect_callback(this, CONF_PREFIX "/mouse/enabled",
+      mouse_change_, this);
+  mngr->setMouseEnabled(purple_prefs_get_bool(CONF_PREFIX "/mouse/enabled"));
+
   purple_prefs_connect_callback(this, "/purple/away/idle_reporting",
       idle_reporting_change_, this);
   /* Proceed the callback. Note: This potentially triggers other callbacks
@@ -540,66 +609,29 @@ GHashTable *CenterIM::get_ui_info()
 guint CenterIM::timeout_add(guint interval, GSourceFunc function,
     gpointer data)
 {
-  return g_timeout_add(interval, function, data);
+  return EVENTLOOP->timeoutAdd(interval, function, data);
 }
 
-gboolean CenterIM::timeout_remove(guint handle)
+guint CenterIM::timeout_add_seconds(guint interval, GSourceFunc function,
+    gpointer data)
 {
-  return g_source_remove(handle);
+  return EVENTLOOP->timeoutAddSeconds(interval, function, data);
 }
 
-#define PURPLE_GLIB_READ_COND  (G_IO_IN | G_IO_HUP | G_IO_ERR)
-#define PURPLE_GLIB_WRITE_COND (G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL)
+gboolean CenterIM::timeout_remove(guint handle)
+{
+  return EVENTLOOP->timeoutRemove(handle);
+}
 
 guint CenterIM::input_add(int fd, PurpleInputCondition condition,
   PurpleInputFunction function, gpointer data)
 {
-  IOClosure *closure = new IOClosure;
-  GIOChannel *channel;
-  int cond = 0;
-
-  closure->function = function;
-  closure->data = data;
-
-  if (condition & PURPLE_INPUT_READ)
-    cond |= PURPLE_GLIB_READ_COND;
-  if (condition & PURPLE_INPUT_WRITE)
-    cond |= PURPLE_GLIB_WRITE_COND;
-
-  channel = g_io_channel_unix_new(fd);
-  closure->result = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
-      static_cast<GIOCondition>(cond), purple_glib_io_input, closure,
-      purple_glib_io_destroy);
-
-  g_io_channel_unref(channel);
-  return closure->result;
+  return EVENTLOOP->inputAdd(fd, condition, function, data);
 }
 
 gboolean CenterIM::input_remove(guint handle)
 {
-  return g_source_remove(handle);
-}
-
-gboolean CenterIM::purple_glib_io_input(GIOChannel *source,
-    GIOCondition condition, gpointer data)
-{
-  IOClosure *closure = static_cast<IOClosure*>(data);
-  int purple_cond = 0;
-
-  if (condition & PURPLE_GLIB_READ_COND)
-    purple_cond |= PURPLE_INPUT_READ;
-  if (condition & PURPLE_GLIB_WRITE_COND)
-    purple_cond |= PURPLE_INPUT_WRITE;
-
-  closure->function(closure->data, g_io_channel_unix_get_fd(source),
-      static_cast<PurpleInputCondition>(purple_cond));
-
-  return TRUE;
-}
-
-void CenterIM::purple_glib_io_destroy(gpointer data)
-{
-  delete static_cast<IOClosure*>(data);
+  return EVENTLOOP->inputRemove(handle);
 }
 
 void CenterIM::tmp_purple_print(PurpleDebugLevel level, const char *category,
@@ -621,6 +653,14 @@ void CenterIM::dimensions_change(const char * /*name*/,
   mngr->onScreenResized();
 }
 
+void CenterIM::mouse_change(const char * /*name*/, PurplePrefType type,
+    gconstpointer val)
+{
+  g_return_if_fail(type == PURPLE_PREF_BOOLEAN);
+
+  mngr->setMouseEnabled(GPOINTER_TO_INT(val));
+}
+
 void CenterIM::idle_reporting_change(const char * /*name*/,
     PurplePrefType type, gconstpointer val)
 {
@@ -679,6 +719,8 @@ void CenterIM::loadDefaultColorSchemeConfig()
       CppConsUI::Curses::Color::CYAN, CppConsUI::Curses::Color::DEFAULT);
   COLORSCHEME->setColorPair("conversation", "textview", "color2",
       CppConsUI::Curses::Color::MAGENTA, CppConsUI::Curses::Color::DEFAULT);
+  COLORSCHEME->setColorPair("conversation", "textview", "highlight",
+      CppConsUI::Curses::Color::YELLOW, CppConsUI::Curses::Color::DEFAULT);
   COLORSCHEME->setColorPair("conversation", "panel", "line",
       CppConsUI::Curses::Color::BLUE, CppConsUI::Curses::Color::DEFAULT,
       CppConsUI::Curses::Attr::BOLD);
@@ -782,6 +824,8 @@ bool CenterIM::saveColorSchemeConfig()
     LOG->error(_("Error saving 'colorschemes.xml'."));
     res = false;
   }
+  else
+    ConfigCache::saveColorSchemes("colorschemes.xml");
   g_free(data);
   xmlnode_free(root);
   return res;
@@ -909,6 +953,7 @@ void CenterIM::loadDefaultKeyConfig()
 
   KEYCONFIG->bindKey("centerim", "conversation-prev", "Ctrl-p");
   KEYCONFIG->bindKey("centerim", "conversation-next", "Ctrl-n");
+  KEYCONFIG->bindKey("centerim", "conversation-next-new", "Alt-a");
   KEYCONFIG->bindKey("centerim", "conversation-number1", "Alt-1");
   KEYCONFIG->bindKey("centerim", "conversation-number2", "Alt-2");
   KEYCONFIG->bindKey("centerim", "conversation-number3", "Alt-3");
@@ -934,6 +979,12 @@ void CenterIM::loadDefaultKeyConfig()
   KEYCONFIG->bindKey("buddylist", "filter", "/");
 
   KEYCONFIG->bindKey("conversation", "send", "Ctrl-x");
+  KEYCONFIG->bindKey("conversation", "find", "Ctrl-f");
+  KEYCONFIG->bindKey("conversation", "find-prev", "Up");
+  KEYCONFIG->bindKey("conversation", "find-next", "Down");
+  KEYCONFIG->bindKey("conversation", "history-prev", "Ctrl-Up");
+  KEYCONFIG->bindKey("conversation", "history-next", "Ctrl-Down");
+  KEYCONFIG->bindKey("conversation", "history-search", "Ctrl-r");
 }
 
 bool CenterIM::saveKeyConfig()
@@ -974,6 +1025,8 @@ bool CenterIM::saveKeyConfig()
     LOG->error(_("Error saving 'binds.xml'."));
     res = false;
   }
+  else
+    ConfigCache::saveKeyBinds("binds.xml");
   g_free(data);
   xmlnode_free(root);
   return res;
@@ -1038,6 +1091,11 @@ void CenterIM::actionFocusNextConversation()
   CONVERSATIONS->focusNextConversation();
 }
 
+void CenterIM::actionFocusNextNewConversation()
+{
+  CONVERSATIONS->focusNextNewConversation();
+}
+
 void CenterIM::actionFocusConversation(int i)
 {
   CONVERSATIONS->focusConversation(i);
@@ -1087,6 +1145,9 @@ void CenterIM::declareBindables()
   declareBindable("centerim", "conversation-next",
       sigc::mem_fun(this, &CenterIM::actionFocusNextConversation),
       InputProcessor::BINDABLE_OVERRIDE);
+  declareBindable("centerim", "conversation-next-new",
+      sigc::mem_fun(this, &CenterIM::actionFocusNextNewConversation),
+      InputProcessor::BINDABLE_OVERRIDE);
   char action[] = "conversation-numberXX";
   for (int i = 1; i <= 20; i++) {
     g_sprintf(action + sizeof(action) - 3, "%d", i);
@@ -74,15 +74,6 @@ public:
 protected:
 
 private:
-  struct IOClosure
-  {
-    PurpleInputFunction function;
-    guint result;
-    gpointer data;
-
-    IOClosure() : function(NULL), result(0), data(NULL) {}
-  };
-
   struct LogBufferItem
   {
     PurpleDebugLevel level;
@@ -135,23 +126,19 @@ private:
   static GHashTable *get_ui_info();
 
   // PurpleEventLoopUiOps callbacks
-  // adds timeout to glib main loop context
+  // adds timeout to the event loop
   static guint timeout_add(guint interval, GSourceFunc function, gpointer data);
-  // removes timeout from glib main loop context
+  // adds timeout with a whole-second precision to the event loop
+  static guint timeout_add_seconds(guint interval, GSourceFunc function,
+      gpointer data);
+  // removes timeout from the event loop
   static gboolean timeout_remove(guint handle);
-  // adds IO watch to glib main loop context
+  // adds IO watch to the event loop
   static guint input_add(int fd, PurpleInputCondition condition,
       PurpleInputFunction function, gpointer data);
-  // removes input from glib main loop context
+  // removes input from the event loop
   static gboolean input_remove(guint handle);
 
-  // helper function for input_add
-  // process IO input to purple callback
-  static gboolean purple_glib_io_input(GIOChannel *source,
-      GIOCondition condition, gpointer data);
-  // destroyes libpurple io input callback internal data
-  static void purple_glib_io_destroy(gpointer data);
-
   // PurpleDebugUiOps callbacks
   // helper function to catch debug messages during libpurple initialization
   /* Catches and buffers libpurple debug messages until the Log object can be
@@ -168,6 +155,13 @@ private:
   void dimensions_change(const char *name, PurplePrefType type,
       gconstpointer val);
 
+  // called when CONF_PREFIX/mouse/enabled pref is changed
+  static void mouse_change_(const char *name, PurplePrefType type,
+      gconstpointer val, gpointer data)
+    { reinterpret_cast<CenterIM*>(data)->mouse_change(name, type, val); }
+  void mouse_change(const char *name, PurplePrefType type,
+      gconstpointer val);
+
   // called when /libpurple/away/idle_reporting pref is changed
   static void idle_reporting_change_(const char *name, PurplePrefType type,
       gconstpointer val, gpointer data)
@@ -186,6 +180,8 @@ private:
   void loadDefaultKeyConfig();
   bool saveKeyConfig();
 
+  void saveInputStats();
+
   void actionFocusBuddyList();
   void actionFocusActiveConversation();
   void actionOpenAccountStatusMenu();
@@ -193,6 +189,7 @@ private:
   void actionBuddyListToggleOffline();
   void actionFocusPrevConversation();
   void actionFocusNextConversation();
+  void actionFocusNextNewConversation();
   void actionFocusConversation(int i);
   void actionExpandConversation();
 
@@ -48,6 +48,11 @@ static void print_version(FILE *out)
 
 int main(int argc, char *argv[])
 {
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+  // conversation history and the debug log are handled by worker threads
+  g_thread_init(NULL);
+#endif // !GLIB_CHECK_VERSION(2, 32, 0)
+
   g_set_prgname(PACKAGE_NAME);
 
   setlocale(LC_ALL, "");
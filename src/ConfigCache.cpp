@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ConfigCache.h"
+
+#include "CenterIM.h"
+#include "Log.h"
+
+#include <cppconsui/ColorScheme.h>
+#include <cppconsui/KeyConfig.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <map>
+#include <string>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <vector>
+#include "gettext.h"
+
+#define CACHE_MAGIC "CIMCONF1"
+
+/* Layout of a cache file, all numbers are in the host byte order:
+ *
+ * CacheHeader
+ * ColorEntry[entries_num] or BindEntry[entries_num]
+ * strings referenced by the entries, each one terminated by a zero byte */
+struct CacheHeader
+{
+  char magic[8];
+  guint32 kind;
+  // size of one entry, it changes with the size of TermKeyKey
+  guint32 entry_size;
+  // hash of the CenterIM version, key symbols can differ between versions
+  guint32 version;
+  guint32 entries_num;
+  guint32 strings_size;
+  guint32 reserved;
+  // modification time, size and hash of the source file
+  gint64 source_mtime;
+  gint64 source_size;
+  guint64 source_hash;
+  // time when the cache was written
+  gint64 created;
+};
+
+enum CacheKind {
+  KIND_COLORS = 1,
+  KIND_BINDS
+};
+
+// entries refer to strings by their offsets
+struct ColorEntry
+{
+  guint32 scheme;
+  guint32 widget;
+  guint32 property;
+  gint32 foreground;
+  gint32 background;
+  gint32 attrs;
+};
+
+struct BindEntry
+{
+  guint32 context;
+  guint32 action;
+  TermKeyKey key;
+};
+
+struct SourceInfo
+{
+  gint64 mtime;
+  gint64 size;
+  guint64 hash;
+};
+
+// FNV-1a, it only has to detect changes of a file
+static guint64 hash_data(const char *data, size_t size)
+{
+  guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= G_GUINT64_CONSTANT(1099511628211);
+  }
+  return hash;
+}
+
+static guint32 get_version()
+{
+  return g_str_hash(CenterIM::version);
+}
+
+static bool read_source_info(const char *path, SourceInfo *info)
+{
+  struct stat st;
+  if (g_stat(path, &st))
+    return false;
+
+  char *contents;
+  gsize length;
+  if (!g_file_get_contents(path, &contents, &length, NULL))
+    return false;
+
+  info->mtime = st.st_mtime;
+  info->size = length;
+  info->hash = hash_data(contents, length);
+  g_free(contents);
+  return true;
+}
+
+/* Mapped cache file. The cache is valid only if its source file has the
+ * recorded content. The modification time and size of the source file are
+ * checked first, the source file has to be read and hashed only if they
+ * differ or if the cache was written in the same second as the source file
+ * (it could have been modified once more in that second). */
+struct MappedCache
+{
+  GMappedFile *file;
+  const CacheHeader *header;
+  const char *entries;
+  const char *strings;
+  /* The recorded modification time matched, the cache doesn't have to be
+   * written again. */
+  bool fresh;
+
+  MappedCache();
+  ~MappedCache();
+
+  bool open(const char *source, CacheKind kind, size_t entry_size);
+
+  bool isString(guint32 offset) const
+    { return offset < header->strings_size; }
+  const char *getString(guint32 offset) const { return strings + offset; }
+
+private:
+  MappedCache(const MappedCache&);
+  MappedCache& operator=(const MappedCache&);
+};
+
+MappedCache::MappedCache()
+: file(NULL), header(NULL), entries(NULL), strings(NULL), fresh(false)
+{
+}
+
+MappedCache::~MappedCache()
+{
+  if (file) {
+#if GLIB_CHECK_VERSION(2, 22, 0)
+    g_mapped_file_unref(file);
+#else
+    g_mapped_file_free(file);
+#endif // GLIB_CHECK_VERSION(2, 22, 0)
+  }
+}
+
+bool MappedCache::open(const char *source, CacheKind kind,
+    size_t entry_size)
+{
+  char *path = g_build_filename(purple_user_dir(), source, NULL);
+  char *cache_path = g_strconcat(path, ".cache", NULL);
+
+  struct stat st;
+  bool valid = !g_stat(path, &st)
+    && (file = g_mapped_file_new(cache_path, FALSE, NULL)) != NULL;
+
+  if (valid) {
+    size_t size = g_mapped_file_get_length(file);
+    const char *data = g_mapped_file_get_contents(file);
+    header = reinterpret_cast<const CacheHeader*>(data);
+    entries = data + sizeof(CacheHeader);
+
+    valid = size >= sizeof(CacheHeader)
+      && !memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic))
+      && header->kind == static_cast<guint32>(kind)
+      && header->entry_size == entry_size
+      && header->version == get_version()
+      && size == sizeof(CacheHeader) + header->entries_num * entry_size
+        + header->strings_size
+      && (!header->strings_size || !data[size - 1]);
+    strings = entries + header->entries_num * entry_size;
+  }
+
+  if (valid) {
+    fresh = st.st_mtime == header->source_mtime
+      && st.st_size == header->source_size
+      && header->source_mtime < header->created;
+
+    SourceInfo info;
+    if (!fresh)
+      valid = read_source_info(path, &info)
+        && info.size == header->source_size
+        && info.hash == header->source_hash;
+  }
+
+  g_free(cache_path);
+  g_free(path);
+  return valid;
+}
+
+/* Strings of a cache that is being written, every distinct string is stored
+ * only once. */
+class StringTable
+{
+public:
+  guint32 add(const std::string& str);
+  const std::string& getData() const { return data; }
+
+private:
+  typedef std::map<std::string, guint32> Offsets;
+
+  std::string data;
+  Offsets offsets;
+};
+
+guint32 StringTable::add(const std::string& str)
+{
+  Offsets::iterator i = offsets.find(str);
+  if (i != offsets.end())
+    return i->second;
+
+  guint32 offset = data.size();
+  data.append(str.c_str(), str.size() + 1);
+  offsets[str] = offset;
+  return offset;
+}
+
+static bool write_cache(const char *source, CacheKind kind,
+    const void *entries, size_t entry_size, size_t entries_num,
+    const StringTable& strings)
+{
+  char *path = g_build_filename(purple_user_dir(), source, NULL);
+  char *cache_path = g_strconcat(path, ".cache", NULL);
+  char *tmp_path = g_strconcat(cache_path, ".tmp", NULL);
+
+  SourceInfo info;
+  FILE *f = NULL;
+  int errsv = 0;
+  bool res = read_source_info(path, &info);
+  if (!res)
+    errsv = errno;
+  else if (!(f = g_fopen(tmp_path, "wb"))) {
+    errsv = errno;
+    res = false;
+  }
+
+  if (f) {
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.kind = kind;
+    header.entry_size = entry_size;
+    header.version = get_version();
+    header.entries_num = entries_num;
+    header.strings_size = strings.getData().size();
+    header.reserved = 0;
+    header.source_mtime = info.mtime;
+    header.source_size = info.size;
+    header.source_hash = info.hash;
+    header.created = time(NULL);
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(entries, entry_size, entries_num, f);
+    fwrite(strings.getData().data(), 1, header.strings_size, f);
+
+    errsv = errno;
+    res = !ferror(f);
+    if (fclose(f)) {
+      errsv = errno;
+      res = false;
+    }
+    if (res && g_rename(tmp_path, cache_path)) {
+      errsv = errno;
+      res = false;
+    }
+    if (!res)
+      g_unlink(tmp_path);
+  }
+
+  if (!res)
+    LOG->error(_("Error writing configuration cache '%s' (%s)."),
+        cache_path, g_strerror(errsv));
+
+  g_free(tmp_path);
+  g_free(cache_path);
+  g_free(path);
+  return res;
+}
+
+namespace ConfigCache
+{
+
+bool loadColorSchemes(const char *source)
+{
+  MappedCache cache;
+  if (!cache.open(source, KIND_COLORS, sizeof(ColorEntry)))
+    return false;
+
+  const ColorEntry *entries
+    = reinterpret_cast<const ColorEntry*>(cache.entries);
+  guint32 entries_num = cache.header->entries_num;
+  for (guint32 i = 0; i < entries_num; i++)
+    if (!cache.isString(entries[i].scheme)
+        || !cache.isString(entries[i].widget)
+        || !cache.isString(entries[i].property))
+      return false;
+
+  COLORSCHEME->clear();
+  for (guint32 i = 0; i < entries_num; i++)
+    COLORSCHEME->setColorPair(cache.getString(entries[i].scheme),
+        cache.getString(entries[i].widget),
+        cache.getString(entries[i].property), entries[i].foreground,
+        entries[i].background, entries[i].attrs);
+
+  if (!cache.fresh)
+    saveColorSchemes(source);
+  return true;
+}
+
+bool saveColorSchemes(const char *source)
+{
+  StringTable strings;
+  std::vector<ColorEntry> entries;
+
+  const CppConsUI::ColorScheme::Schemes& schemes
+    = COLORSCHEME->getSchemes();
+  for (CppConsUI::ColorScheme::Schemes::const_iterator si = schemes.begin();
+      si != schemes.end(); si++)
+    for (CppConsUI::ColorScheme::Widgets::const_iterator
+        wi = si->second.begin();
+        wi != si->second.end(); wi++)
+      for (CppConsUI::ColorScheme::Properties::const_iterator
+          pi = wi->second.begin();
+          pi != wi->second.end(); pi++) {
+        ColorEntry entry;
+        entry.scheme = strings.add(si->first);
+        entry.widget = strings.add(wi->first);
+        entry.property = strings.add(pi->first);
+        entry.foreground = pi->second.foreground;
+        entry.background = pi->second.background;
+        entry.attrs = pi->second.attrs;
+        entries.push_back(entry);
+      }
+
+  return write_cache(source, KIND_COLORS,
+      entries.empty() ? NULL : &entries[0], sizeof(ColorEntry),
+      entries.size(), strings);
+}
+
+bool loadKeyBinds(const char *source)
+{
+  MappedCache cache;
+  if (!cache.open(source, KIND_BINDS, sizeof(BindEntry)))
+    return false;
+
+  const BindEntry *entries
+    = reinterpret_cast<const BindEntry*>(cache.entries);
+  guint32 entries_num = cache.header->entries_num;
+  for (guint32 i = 0; i < entries_num; i++)
+    if (!cache.isString(entries[i].context)
+        || !cache.isString(entries[i].action))
+      return false;
+
+  KEYCONFIG->clear();
+  for (guint32 i = 0; i < entries_num; i++)
+    KEYCONFIG->bindKey(cache.getString(entries[i].context),
+        cache.getString(entries[i].action), entries[i].key);
+
+  if (!cache.fresh)
+    saveKeyBinds(source);
+  return true;
+}
+
+bool saveKeyBinds(const char *source)
+{
+  StringTable strings;
+  std::vector<BindEntry> entries;
+
+  const CppConsUI::KeyConfig::KeyBinds *binds = KEYCONFIG->getKeyBinds();
+  for (CppConsUI::KeyConfig::KeyBinds::const_iterator bi = binds->begin();
+      bi != binds->end(); bi++)
+    for (CppConsUI::KeyConfig::KeyBindContext::const_iterator
+        ci = bi->second.begin();
+        ci != bi->second.end(); ci++) {
+      BindEntry entry;
+      entry.context = strings.add(bi->first);
+      entry.action = strings.add(ci->second);
+      entry.key = ci->first;
+      entries.push_back(entry);
+    }
+
+  return write_cache(source, KIND_BINDS,
+      entries.empty() ? NULL : &entries[0], sizeof(BindEntry),
+      entries.size(), strings);
+}
+
+} // namespace ConfigCache
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
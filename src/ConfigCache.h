@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __CONFIGCACHE_H__
+#define __CONFIGCACHE_H__
+
+/**
+ * Compiled form of the XML configuration files. The cache of a source file
+ * holds the color pairs or key binds exactly as they are resolved from the
+ * source so loading it only means mapping the file and passing the entries
+ * to ColorScheme or KeyConfig. It is stored next to the source file with
+ * a ".cache" suffix.
+ *
+ * The cache records modification time, size and hash of the source file it
+ * was built from. It's used only when the source file still has the same
+ * content, otherwise the caller has to parse the XML file and save the
+ * cache again.
+ */
+namespace ConfigCache
+{
+
+/**
+ * Loads color pairs from the cache of a given source file (relative to the
+ * libpurple user directory). Returns false if the cache is missing or
+ * stale, the current color schemes are left untouched in such a case.
+ */
+bool loadColorSchemes(const char *source);
+/**
+ * Saves the current color schemes as the cache of a given source file. It
+ * has to be called after the source file is written or parsed.
+ */
+bool saveColorSchemes(const char *source);
+
+// key binds counterparts of loadColorSchemes() and saveColorSchemes()
+bool loadKeyBinds(const char *source);
+bool saveKeyBinds(const char *source);
+
+} // namespace ConfigCache
+
+#endif // __CONFIGCACHE_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -24,16 +24,93 @@
 #include "BuddyList.h"
 #include "Conversations.h"
 #include "Footer.h"
+#include "Markup.h"
+#include "Search.h"
 
+#include <glib/gstdio.h>
 #include <sys/stat.h>
+#include <vector>
 #include "gettext.h"
 
+// number of messages that the history loader passes to the main loop at once
+#define HISTORY_BATCH_SIZE 256
+// number of sent inputs that are remembered for every conversation
+#define INPUT_HISTORY_SIZE 500
+
+struct Conversation::HistoryBatch
+{
+  struct Message
+  {
+    char *text;
+    int color;
+    // offset of the message in the logfile
+    gint64 offset;
+  };
+  typedef std::vector<Message> Messages;
+  typedef std::vector<char*> Errors;
+
+  Messages messages;
+  Errors errors;
+  // set in the last batch of the history
+  bool last;
+
+  HistoryBatch() : last(false) {}
+  ~HistoryBatch();
+
+private:
+  HistoryBatch(const HistoryBatch&);
+  HistoryBatch& operator=(const HistoryBatch&);
+};
+
+/* State shared between a conversation and its history loader thread. The
+ * conversation can be destroyed before the thread finishes so the state is
+ * reference counted. */
+struct Conversation::HistoryLoad
+{
+  volatile gint ref_count;
+  volatile gint cancelled;
+
+  char *filename;
+  // number of bytes to load, or -1 to load the whole file
+  gint64 size;
+  gint64 consumed;
+
+  // finished batches waiting for the main loop
+  GAsyncQueue *batches;
+
+  // accessed only from the main thread, NULL when the conversation is gone
+  Conversation *conv;
+
+  HistoryLoad(Conversation *conv_, const char *filename_, gint64 size_);
+  ~HistoryLoad();
+
+  void ref() { g_atomic_int_inc(&ref_count); }
+  void unref();
+
+  void run();
+
+private:
+  HistoryLoad(const HistoryLoad&);
+  HistoryLoad& operator=(const HistoryLoad&);
+
+  GIOStatus readLine(GIOChannel *chan, char **line, gsize *length,
+      GError **err);
+  void post(HistoryBatch *batch);
+};
+
 Conversation::Conversation(PurpleConversation *conv_)
 : Window(0, 0, 80, 24), conv(conv_), filename(NULL), logfile(NULL)
-, input_text_length(0), room_list(NULL), room_list_line(NULL)
+, input_text_length(0), history_draft(NULL), history_pos(0)
+, history_search_pos(0), history_setting(false), history_load(NULL)
+, history_lines(0)
+, scroll_offset(-1)
+, hibernated(false), hidden_time(time(NULL))
+, room_list(NULL), room_list_line(NULL)
 {
   g_assert(conv);
 
+  text_buffer = g_string_new(NULL);
+
   setColorScheme("conversation");
 
   view = new CppConsUI::TextView(width - 2, height, true, true);
@@ -49,6 +126,36 @@ Conversation::Conversation(PurpleConversation *conv_)
   addWidget(*input, 1, 1);
   addWidget(*line, 0, height);
 
+  view->signal_find_update.connect(sigc::mem_fun(this,
+        &Conversation::onFindUpdate));
+  find_bar = new CppConsUI::HorizontalListBox(width, 1);
+  const char *prompt = _("Find: ");
+  CppConsUI::Label *find_label = new CppConsUI::Label(0, 1, prompt);
+  find_label->setWidth(find_label->getTextRun().getWidth());
+  find_bar->appendWidget(*find_label);
+  find_entry = new FindEntry(this);
+  find_entry->signal_text_change.connect(sigc::mem_fun(this,
+        &Conversation::onFindTextChange));
+  find_bar->appendWidget(*find_entry);
+  find_status = new CppConsUI::Label(0, 1);
+  find_bar->appendWidget(*find_status);
+  find_bar->setVisibility(false);
+  addWidget(*find_bar, 0, height);
+
+  history_bar = new CppConsUI::HorizontalListBox(width, 1);
+  prompt = _("History search: ");
+  CppConsUI::Label *history_label = new CppConsUI::Label(0, 1, prompt);
+  history_label->setWidth(history_label->getTextRun().getWidth());
+  history_bar->appendWidget(*history_label);
+  history_entry = new HistoryEntry(this);
+  history_entry->signal_text_change.connect(sigc::mem_fun(this,
+        &Conversation::onHistorySearchTextChange));
+  history_bar->appendWidget(*history_entry);
+  history_status = new CppConsUI::Label(0, 1);
+  history_bar->appendWidget(*history_status);
+  history_bar->setVisibility(false);
+  addWidget(*history_bar, 0, height);
+
   PurpleConversationType type = purple_conversation_get_type(conv_);
   if (type == PURPLE_CONV_TYPE_CHAT) {
       room_list = new ConversationRoomList(1, 1, conv_);
@@ -62,13 +169,12 @@ Conversation::Conversation(PurpleConversation *conv_)
 
   // open logfile
   buildLogFilename();
+  openLogfile();
 
-  GError *err = NULL;
-  if (!(logfile = g_io_channel_new_file(filename, "a", &err))) {
-    LOG->error(_("Error opening conversation logfile '%s' (%s)."), filename,
-        err->message);
-    g_clear_error(&err);
-  }
+  // the history file is read when it's used for the first time
+  char *history_filename = buildFilename("chistory");
+  history = new InputHistory(history_filename, INPUT_HISTORY_SIZE);
+  g_free(history_filename);
 
   loadHistory();
 
@@ -77,9 +183,24 @@ Conversation::Conversation(PurpleConversation *conv_)
 
 Conversation::~Conversation()
 {
+  cancelHistoryLoad();
+
+  CppConsUI::TextEdit::BufferStats stats = input->getBufferStats();
+  LOG->debug("conversation input buffer: %" G_GSIZE_FORMAT " of %"
+      G_GSIZE_FORMAT " bytes used, max %" G_GSIZE_FORMAT " bytes, "
+      "%u allocations, %u trims", stats.used, stats.capacity,
+      stats.max_capacity, stats.reallocs, stats.trims);
+
+  for (PendingMessages::iterator i = pending_messages.begin();
+      i != pending_messages.end(); i++)
+    g_free(i->text);
+
+  g_string_free(text_buffer, TRUE);
   g_free(filename);
-  if (logfile)
-    g_io_channel_unref(logfile);
+  closeLogfile();
+
+  delete history;
+  g_free(history_draft);
 }
 
 bool Conversation::processInput(const TermKeyKey& key)
@@ -117,6 +238,8 @@ void Conversation::moveResize(int newx, int newy, int neww, int newh)
 
   input->moveResize(1, view_height + 1, width - 2, input_height);
   line->moveResize(0, view_height, width, 1);
+  find_bar->moveResize(0, view_height, width, 1);
+  history_bar->moveResize(0, view_height, width, 1);
 
   // place the room list if a conversation window
   if(room_list) {
@@ -147,6 +270,10 @@ void Conversation::ungrabFocus()
 
 void Conversation::show()
 {
+  if (hibernated)
+    wakeUp();
+  hidden_time = 0;
+
   /* Update the scrollbar setting. It is delayed until the conversation window
    * is actually displayed, so screen lines recalculations in TextView (caused
    * by changing the scrollbar setting) aren't triggered if it isn't really
@@ -156,8 +283,26 @@ void Conversation::show()
   Window::show();
 }
 
+void Conversation::hide()
+{
+  if (!hidden_time)
+    hidden_time = time(NULL);
+
+  Window::hide();
+}
+
 void Conversation::close()
 {
+  // close the find or the history search input first if it's active
+  if (find_bar->isVisible()) {
+    closeFind();
+    return;
+  }
+  if (history_bar->isVisible()) {
+    closeHistorySearch(false);
+    return;
+  }
+
   signal_close(*this);
 
   /* Next line deletes this object. Don't touch any member variable after this
@@ -174,6 +319,41 @@ void Conversation::onScreenResized()
   moveResizeRect(r);
 }
 
+void Conversation::showLogRecord(gint64 offset)
+{
+  scroll_offset = offset;
+
+  // a hibernated conversation loads the history when it is woken up
+  if (hibernated)
+    return;
+
+  cancelHistoryLoad();
+  view->clear();
+  history_lines = 0;
+  loadHistory();
+}
+
+void Conversation::hibernate()
+{
+  if (hibernated || isVisible())
+    return;
+
+  /* Without the logfile the messages in the view couldn't be restored from
+   * the history, keep them. */
+  if (!logfile)
+    return;
+
+  cancelHistoryLoad();
+
+  view->clear();
+  history_lines = 0;
+
+  closeLogfile();
+  releaseArea();
+
+  hibernated = true;
+}
+
 void Conversation::write(const char *name, const char * /*alias*/,
     const char *message, PurpleMessageFlags flags, time_t mtime)
 {
@@ -220,6 +400,7 @@ void Conversation::write(const char *name, const char * /*alias*/,
   }
 
   // write text into logfile
+  bool logged = false;
   if (!(flags & PURPLE_MESSAGE_NO_LOG)) {
     char *log_msg;
     if (type == PURPLE_CONV_TYPE_CHAT)
@@ -228,51 +409,104 @@ void Conversation::write(const char *name, const char * /*alias*/,
     else
       log_msg = g_strdup_printf("\f\n%s\n%s\n%lu\n%lu\n%s\n", dir, mtype,
           mtime, cur_time, message);
+    // a hibernated conversation opens the logfile only for the write
+    if (hibernated)
+      openLogfile();
     if (logfile) {
       GError *err = NULL;
+      logged = true;
       if (g_io_channel_write_chars(logfile, log_msg, -1, NULL, &err)
           != G_IO_STATUS_NORMAL) {
         LOG->error(_("Error writing to conversation logfile (%s)."),
             err->message);
         g_clear_error(&err);
+        logged = false;
       }
       if (g_io_channel_flush(logfile, &err) != G_IO_STATUS_NORMAL) {
         LOG->error(_("Error flushing conversation logfile (%s)."),
             err->message);
         g_clear_error(&err);
+        logged = false;
+      }
+      else {
+        // let the search index the new message
+        struct stat st;
+        if (!fstat(g_io_channel_unix_get_fd(logfile), &st))
+          SEARCH->logAppended(filename, st.st_size);
       }
     }
     g_free(log_msg);
+    if (hibernated)
+      closeLogfile();
   }
 
-  // we currently don't support displaying HTML in any way
-  char *nohtml = stripHTML(message);
+  /* A hibernated conversation doesn't have any view content, logged messages
+   * are shown from the history when the conversation is woken up. Messages
+   * that didn't make it to the logfile are kept until then. */
+  if (hibernated && logged)
+    return;
 
-  // write text to the window
+  // write text to the window, the message is built in a reused buffer
   char *time = extractTime(mtime, cur_time);
-  char *msg;
-  if (type == PURPLE_CONV_TYPE_CHAT)
-    msg = g_strdup_printf("%s %s: %s", time, name, nohtml);
-  else
-    msg = g_strdup_printf("%s %s", time, nohtml);
-  view->append(msg, color);
-  g_free(nohtml);
+  g_string_assign(text_buffer, time);
   g_free(time);
-  g_free(msg);
+  g_string_append_c(text_buffer, ' ');
+  if (type == PURPLE_CONV_TYPE_CHAT) {
+    g_string_append(text_buffer, name);
+    g_string_append(text_buffer, ": ");
+  }
+  // we currently don't support displaying HTML in any way
+  Markup::stripHTML(message, text_buffer);
+
+  if (hibernated) {
+    PendingMessage msg;
+    msg.text = g_strdup(text_buffer->str);
+    msg.color = color;
+    pending_messages.push_back(msg);
+    return;
+  }
+
+  view->append(text_buffer->str, color);
 }
 
-Conversation::ConversationLine::ConversationLine(const char *text_)
-: AbstractLine(AUTOSIZE, 1)
+Conversation::FindEntry::FindEntry(Conversation *parent_)
+: TextEntry(AUTOSIZE, 1), parent(parent_)
 {
-  g_assert(text_);
+  declareBindables();
+}
+
+void Conversation::FindEntry::declareBindables()
+{
+  declareBindable("conversation", "find-prev", sigc::bind(sigc::mem_fun(
+          parent, &Conversation::findNext), -1),
+      InputProcessor::BINDABLE_OVERRIDE);
+  declareBindable("conversation", "find-next", sigc::bind(sigc::mem_fun(
+          parent, &Conversation::findNext), 1),
+      InputProcessor::BINDABLE_OVERRIDE);
+  // Enter searches backwards in the history instead of moving the focus
+  declareBindable("textentry", "activate", sigc::bind(sigc::mem_fun(
+          parent, &Conversation::findNext), -1),
+      InputProcessor::BINDABLE_NORMAL);
+}
 
-  text = g_strdup(text_);
-  text_width = CppConsUI::Curses::onscreen_width(text);
+Conversation::HistoryEntry::HistoryEntry(Conversation *parent_)
+: TextEntry(AUTOSIZE, 1), parent(parent_)
+{
+  declareBindables();
 }
 
-Conversation::ConversationLine::~ConversationLine()
+void Conversation::HistoryEntry::declareBindables()
 {
-  g_free(text);
+  // Enter keeps the found entry in the input
+  declareBindable("textentry", "activate", sigc::bind(sigc::mem_fun(
+          parent, &Conversation::closeHistorySearch), true),
+      InputProcessor::BINDABLE_NORMAL);
+}
+
+Conversation::ConversationLine::ConversationLine(const char *text_)
+: AbstractLine(AUTOSIZE, 1), text(text_)
+{
+  g_assert(text_);
 }
 
 void Conversation::ConversationLine::draw()
@@ -285,7 +519,8 @@ void Conversation::ConversationLine::draw()
     return;
 
   int l;
-  if (text_width + 5 >= static_cast<unsigned>(realw))
+  int text_width = text.getWidth();
+  if (text_width + 5 >= realw)
     l = 0;
   else
     l = realw - text_width - 5;
@@ -297,181 +532,29 @@ void Conversation::ConversationLine::draw()
   int i;
   for (i = 0; i < l; i++)
     area->mvaddlinechar(i, 0, CppConsUI::Curses::LINE_HLINE);
-  i += area->mvaddstring(i, 0, text);
+  i += text.draw(*area, i, 0, realw - i);
   for (; i < realw; i++)
     area->mvaddlinechar(i, 0, CppConsUI::Curses::LINE_HLINE);
 
   area->attroff(attrs);
 }
 
-char *Conversation::stripHTML(const char *str) const
+void Conversation::buildLogFilename()
 {
-  /* Almost copy&paste from libpurple/util.c:purple_markup_strip_html(), but
-   * this version doesn't convert tab character to a space. */
-
-  int i, j, k, entlen;
-  bool visible = true;
-  bool closing_td_p = false;
-  gchar *str2;
-  const gchar *cdata_close_tag = NULL, *ent;
-  gchar *href = NULL;
-  int href_st = 0;
-
-  if (!str)
-    return NULL;
-
-  str2 = g_strdup(str);
-
-  for (i = 0, j = 0; str2[i]; i++) {
-    if (str2[i] == '<') {
-      if (cdata_close_tag) {
-        // note: don't even assume any other tag is a tag in CDATA
-        if (g_ascii_strncasecmp(str2 + i, cdata_close_tag,
-              !strlen(cdata_close_tag))) {
-          i += strlen(cdata_close_tag) - 1;
-          cdata_close_tag = NULL;
-        }
-        continue;
-      }
-      else if (!g_ascii_strncasecmp(str2 + i, "<td", 3) && closing_td_p) {
-        str2[j++] = '\t';
-        visible = true;
-      }
-      else if (!g_ascii_strncasecmp(str2 + i, "</td>", 5)) {
-        closing_td_p = true;
-        visible = false;
-      }
-      else {
-        closing_td_p = false;
-        visible = true;
-      }
-
-      k = i + 1;
-
-      if (g_ascii_isspace(str2[k]))
-        visible = true;
-      else if (str2[k]) {
-        /* Scan until we end the tag either implicitly (closed start tag) or
-         * explicitly, using a sloppy method (i.e., < or > inside quoted
-         * attributes will screw us up). */
-        while (str2[k] && str2[k] != '<' && str2[k] != '>')
-          k++;
-
-        /* If we've got an <a> tag with an href, save the address to print
-         * later. */
-        if (!g_ascii_strncasecmp(str2 + i, "<a", 2)
-            && g_ascii_isspace(str2[i + 2])) {
-          int st; // start of href, inclusive [
-          int end; // end of href, exclusive )
-          char delim = ' ';
-          // find start of href
-          for (st = i + 3; st < k; st++) {
-            if (!g_ascii_strncasecmp(str2 + st, "href=", 5)) {
-              st += 5;
-              if (str2[st] == '"' || str2[st] == '\'') {
-                delim = str2[st];
-                st++;
-              }
-              break;
-            }
-          }
-          // find end of address
-          for (end = st; end < k && str2[end] != delim; end++) {
-            // all the work is done in the loop construct above
-          }
-
-          /* If there's an address, save it. If there was already one saved,
-           * kill it. */
-          if (st < k) {
-            char *tmp;
-            g_free(href);
-            tmp = g_strndup(str2 + st, end - st);
-            href = purple_unescape_html(tmp);
-            g_free(tmp);
-            href_st = j;
-          }
-        }
-
-        /* Replace </a> with an ascii representation of the address the link
-         * was pointing to. */
-        else if (href && !g_ascii_strncasecmp(str2 + i, "</a>", 4)) {
-          size_t hrlen = strlen(href);
-
-          /* Only insert the href if it's different from the CDATA.
-           *  7 == strlen("http://") */
-          if ((hrlen != (unsigned)(j - href_st) ||
-                strncmp(str2 + href_st, href, hrlen)) &&
-              (hrlen != (unsigned)(j - href_st + 7) ||
-               strncmp(str2 + href_st, href + 7, hrlen - 7)))
-          {
-            str2[j++] = ' ';
-            str2[j++] = '(';
-            g_memmove(str2 + j, href, hrlen);
-            j += hrlen;
-            str2[j++] = ')';
-            g_free(href);
-            href = NULL;
-          }
-        }
-
-        /* Check for tags which should be mapped to newline (but ignore some
-         * of the tags at the beginning of the text) */
-        else if ((j && (!g_ascii_strncasecmp(str2 + i, "<p>", 3)
-                || !g_ascii_strncasecmp(str2 + i, "<tr", 3)
-                || !g_ascii_strncasecmp(str2 + i, "<hr", 3)
-                || !g_ascii_strncasecmp(str2 + i, "<li", 3)
-                || !g_ascii_strncasecmp(str2 + i, "<div", 4)))
-            || !g_ascii_strncasecmp(str2 + i, "<br", 3)
-            || !g_ascii_strncasecmp(str2 + i, "</table>", 8))
-          str2[j++] = '\n';
-        // check for tags which begin CDATA and need to be closed
-#if 0 // FIXME.. option is end tag optional, we can't handle this right now
-        else if (!g_ascii_strncasecmp(str2 + i, "<option", 7))
-        {
-          // FIXME we should not do this if the OPTION is SELECT'd
-          cdata_close_tag = "</option>";
-        }
-#endif
-        else if (!g_ascii_strncasecmp(str2 + i, "<script", 7))
-          cdata_close_tag = "</script>";
-        else if (!g_ascii_strncasecmp(str2 + i, "<style", 6))
-          cdata_close_tag = "</style>";
-        // update the index and continue checking after the tag
-        i = (str2[k] == '<' || str2[k] == '\0') ? k - 1: k;
-        continue;
-      }
-    }
-    else if (cdata_close_tag)
-      continue;
-    else if (!g_ascii_isspace(str2[i]))
-      visible = true;
-
-    if (str2[i] == '&' && (ent = purple_markup_unescape_entity(str2 + i,
-            &entlen))) {
-      while (*ent)
-        str2[j++] = *ent++;
-      i += entlen - 1;
-      continue;
-    }
-
-    if (visible)
-      str2[j++] = g_ascii_isspace(str2[i]) && str[i] != '\t' ? ' ': str2[i];
-  }
-
-  g_free(href);
-
-  str2[j] = '\0';
+  filename = buildFilename("clogs");
 
-  return str2;
+  char *dir = g_path_get_dirname(filename);
+  if (g_mkdir_with_parents(dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1)
+    LOG->error(_("Error creating directory '%s'."), dir);
+  g_free(dir);
 }
 
-void Conversation::buildLogFilename()
+char *Conversation::buildFilename(const char *dir) const
 {
   PurpleAccount *account;
   PurplePlugin *prpl;
   const char *proto_name;
   char *acct_name;
-  char *dir;
   const char *name;
 
   account = purple_conversation_get_account(conv);
@@ -485,19 +568,49 @@ void Conversation::buildLogFilename()
 
   name = purple_conversation_get_name(conv);
 
-  filename = g_build_filename(purple_user_dir(), "clogs", proto_name,
+  char *path = g_build_filename(purple_user_dir(), dir, proto_name,
       acct_name, purple_escape_filename(purple_normalize(account, name)),
       NULL);
 
-  dir = g_path_get_dirname(filename);
-  if (g_mkdir_with_parents(dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1)
-    LOG->error(_("Error creating directory '%s'."), dir);
-  g_free(dir);
-
   g_free(acct_name);
+  return path;
+}
+
+void Conversation::openLogfile()
+{
+  if (logfile)
+    return;
+
+  GError *err = NULL;
+  if (!(logfile = g_io_channel_new_file(filename, "a", &err))) {
+    LOG->error(_("Error opening conversation logfile '%s' (%s)."), filename,
+        err->message);
+    g_clear_error(&err);
+  }
+}
+
+void Conversation::closeLogfile()
+{
+  if (!logfile)
+    return;
+
+  g_io_channel_unref(logfile);
+  logfile = NULL;
+}
+
+/* Thread-safe version of purple_date_format_long(), it doesn't use libpurple
+ * translation of the format string, but that is "%x %X" anyway. */
+static char *format_date_long(const struct tm *tm)
+{
+  char buf[128];
+  if (!strftime(buf, sizeof(buf), "%x %X", tm))
+    return g_strdup("");
+
+  char *utf8 = g_locale_to_utf8(buf, -1, NULL, NULL, NULL);
+  return utf8 ? utf8 : g_strdup(buf);
 }
 
-char *Conversation::extractTime(time_t sent_time, time_t show_time) const
+char *Conversation::extractTime(time_t sent_time, time_t show_time)
 {
   // based on the extracttime() function from cim4
 
@@ -510,8 +623,8 @@ char *Conversation::extractTime(time_t sent_time, time_t show_time) const
     memset(&sent_time_local, 0, sizeof(sent_time_local));
 
   // format the times
-  char *t1 = g_strdup(purple_date_format_long(&show_time_local));
-  char *t2 = g_strdup(purple_date_format_long(&sent_time_local));
+  char *t1 = format_date_long(&show_time_local);
+  char *t2 = format_date_long(&sent_time_local);
 
   int tdiff = abs(sent_time - show_time);
 
@@ -528,14 +641,170 @@ char *Conversation::extractTime(time_t sent_time, time_t show_time) const
 
 void Conversation::loadHistory()
 {
+  /* Load only what is in the logfile now, messages written while the history
+   * is being loaded are shown by write(). */
+  gint64 size = -1;
+  struct stat st;
+  if (!g_stat(filename, &st))
+    size = st.st_size;
+
+  history_load = new HistoryLoad(this, filename, size);
+
+  // the thread holds its own reference
+  history_load->ref();
+
+  GError *err = NULL;
+#if GLIB_CHECK_VERSION(2, 34, 0)
+  GThread *thread = g_thread_try_new("history", history_load_thread_,
+      history_load, &err);
+  if (thread)
+    g_thread_unref(thread);
+#else
+  GThread *thread = g_thread_create(history_load_thread_, history_load,
+      FALSE, &err);
+#endif // GLIB_CHECK_VERSION(2, 34, 0)
+
+  if (!thread) {
+    LOG->error(_("Error creating history loader thread (%s)."),
+        err->message);
+    g_clear_error(&err);
+
+    // load the history synchronously, batches are still shown from idle
+    history_load_thread_(history_load);
+  }
+}
+
+void Conversation::cancelHistoryLoad()
+{
+  if (!history_load)
+    return;
+
+  // stop the loader thread, it releases its own reference when it exits
+  g_atomic_int_set(&history_load->cancelled, 1);
+  history_load->conv = NULL;
+  history_load->unref();
+  history_load = NULL;
+}
+
+void Conversation::appendHistory()
+{
+  g_assert(history_load);
+
+  HistoryBatch *batch;
+  bool last = false;
+  while (!last && (batch = static_cast<HistoryBatch*>(
+          g_async_queue_try_pop(history_load->batches)))) {
+    for (HistoryBatch::Messages::iterator i = batch->messages.begin();
+        i != batch->messages.end(); i++) {
+      // insert the history in front of messages written in the meantime
+      size_t lines = view->getLinesNumber();
+      view->insert(history_lines, i->text, i->color);
+      if (i->offset == scroll_offset && view->getLinesNumber() > lines)
+        view->scrollToLine(history_lines);
+      history_lines += view->getLinesNumber() - lines;
+    }
+
+    for (HistoryBatch::Errors::iterator i = batch->errors.begin();
+        i != batch->errors.end(); i++)
+      LOG->error("%s", *i);
+
+    last = batch->last;
+    delete batch;
+  }
+
+  if (last) {
+    history_load->unref();
+    history_load = NULL;
+    scroll_offset = -1;
+  }
+}
+
+void Conversation::wakeUp()
+{
+  g_assert(hibernated);
+
+  hibernated = false;
+
+  openLogfile();
+  loadHistory();
+
+  // the history is inserted in front of these messages
+  for (PendingMessages::iterator i = pending_messages.begin();
+      i != pending_messages.end(); i++) {
+    view->append(i->text, i->color);
+    g_free(i->text);
+  }
+  PendingMessages().swap(pending_messages);
+}
+
+gpointer Conversation::history_load_thread_(gpointer data)
+{
+  HistoryLoad *load = static_cast<HistoryLoad*>(data);
+  load->run();
+  load->unref();
+  return NULL;
+}
+
+gboolean Conversation::history_load_batch_(gpointer data)
+{
+  HistoryLoad *load = static_cast<HistoryLoad*>(data);
+  if (load->conv)
+    load->conv->appendHistory();
+  load->unref();
+  return FALSE;
+}
+
+Conversation::HistoryBatch::~HistoryBatch()
+{
+  for (Messages::iterator i = messages.begin(); i != messages.end(); i++)
+    g_free(i->text);
+  for (Errors::iterator i = errors.begin(); i != errors.end(); i++)
+    g_free(*i);
+}
+
+Conversation::HistoryLoad::HistoryLoad(Conversation *conv_,
+    const char *filename_, gint64 size_)
+: ref_count(1), cancelled(0), size(size_), consumed(0), conv(conv_)
+{
+  filename = g_strdup(filename_);
+  batches = g_async_queue_new();
+}
+
+Conversation::HistoryLoad::~HistoryLoad()
+{
+  gpointer batch;
+  while ((batch = g_async_queue_try_pop(batches)))
+    delete static_cast<HistoryBatch*>(batch);
+  g_async_queue_unref(batches);
+
+  g_free(filename);
+}
+
+void Conversation::HistoryLoad::unref()
+{
+  if (g_atomic_int_dec_and_test(&ref_count))
+    delete this;
+}
+
+void Conversation::HistoryLoad::run()
+{
+  // note: this method runs in the history loader thread
+  HistoryBatch *batch = new HistoryBatch;
+  // buffer reused for all messages
+  GString *text_buffer = g_string_new(NULL);
+
   // open logfile
   GError *err = NULL;
   GIOChannel *chan;
 
   if ((chan = g_io_channel_new_file(filename, "r", &err)) == NULL) {
-    LOG->error(_("Error opening conversation logfile '%s' (%s)."), filename,
-        err->message);
+    batch->errors.push_back(g_strdup_printf(
+          _("Error opening conversation logfile '%s' (%s)."), filename,
+          err->message));
     g_clear_error(&err);
+    batch->last = true;
+    post(batch);
+    g_string_free(text_buffer, TRUE);
     return;
   }
   // this should never fail
@@ -543,22 +812,34 @@ void Conversation::loadHistory()
 
   GIOStatus st;
   char *line;
+  gsize length;
   bool new_msg = false;
   // read conversation logfile line by line
-  while (new_msg || (st = g_io_channel_read_line(chan, &line, NULL, NULL,
-          &err)) == G_IO_STATUS_NORMAL) {
+  while (new_msg || (st = readLine(chan, &line, &length, &err))
+      == G_IO_STATUS_NORMAL) {
     new_msg = false;
 
+    if (g_atomic_int_get(&cancelled)) {
+      g_free(line);
+      st = G_IO_STATUS_EOF;
+      break;
+    }
+
+    if (batch->messages.size() >= HISTORY_BATCH_SIZE) {
+      post(batch);
+      batch = new HistoryBatch;
+    }
+
     // start flag
     if (strcmp(line, "\f\n")) {
       g_free(line);
       continue;
     }
     g_free(line);
+    gint64 offset = consumed - length;
 
     // parse direction (in/out)
-    if ((st = g_io_channel_read_line(chan, &line, NULL, NULL, &err))
-        != G_IO_STATUS_NORMAL)
+    if ((st = readLine(chan, &line, &length, &err)) != G_IO_STATUS_NORMAL)
       break;
     int color = 0;
     if (!strcmp(line, "OUT\n"))
@@ -568,8 +849,7 @@ void Conversation::loadHistory()
     g_free(line);
 
     // type
-    if ((st = g_io_channel_read_line(chan, &line, NULL, NULL, &err))
-        != G_IO_STATUS_NORMAL)
+    if ((st = readLine(chan, &line, &length, &err)) != G_IO_STATUS_NORMAL)
       break;
     bool cim4 = true;
     if (!strcmp(line, "MSG2\n"))
@@ -581,48 +861,48 @@ void Conversation::loadHistory()
     g_free(line);
 
     // sent time
-    if ((st = g_io_channel_read_line(chan, &line, NULL, NULL, &err))
-        != G_IO_STATUS_NORMAL)
+    if ((st = readLine(chan, &line, &length, &err)) != G_IO_STATUS_NORMAL)
       break;
     time_t sent_time = atol(line);
     g_free(line);
 
     // show time
-    if ((st = g_io_channel_read_line(chan, &line, NULL, NULL, &err))
-        != G_IO_STATUS_NORMAL)
+    if ((st = readLine(chan, &line, &length, &err)) != G_IO_STATUS_NORMAL)
       break;
     time_t show_time = atol(line);
     g_free(line);
 
+    HistoryBatch::Message msg;
+    msg.color = color;
+    msg.offset = offset;
+
     if (!cim4) {
       // cim5, read only one line and strip it off HTML
-      if ((st = g_io_channel_read_line(chan, &line, NULL, NULL, &err))
-          != G_IO_STATUS_NORMAL)
+      if ((st = readLine(chan, &line, &length, &err)) != G_IO_STATUS_NORMAL)
         break;
 
       // validate UTF-8
       if (!g_utf8_validate(line, -1, NULL)) {
         g_free(line);
-        LOG->error(_("Invalid message detected in conversation logfile"
-              " '%s'. The message was skipped."), filename);
+        batch->errors.push_back(g_strdup_printf(
+              _("Invalid message detected in conversation logfile"
+                " '%s'. The message was skipped."), filename));
         continue;
       }
 
-      // write text to the window
-      char *nohtml = stripHTML(line);
+      // prepare text for the window
       char *time = extractTime(sent_time, show_time);
-      char *msg = g_strdup_printf("%s %s", time, nohtml);
-      view->append(msg, color);
-      g_free(nohtml);
+      g_string_assign(text_buffer, time);
       g_free(time);
-      g_free(msg);
+      g_string_append_c(text_buffer, ' ');
+      Markup::stripHTML(line, text_buffer);
+      msg.text = g_strndup(text_buffer->str, text_buffer->len);
       g_free(line);
     }
     else {
       // cim4, read multiple raw lines
-      gsize length;
-      std::string msg;
-      while ((st = g_io_channel_read_line(chan, &line, &length, NULL, &err))
+      std::string text;
+      while ((st = readLine(chan, &line, &length, &err))
           == G_IO_STATUS_NORMAL && line != NULL) {
         if (!strcmp(line, "\f\n")) {
           new_msg = true;
@@ -634,7 +914,7 @@ void Conversation::loadHistory()
           line[length - 2] = '\n';
           line[length - 1] = '\0';
         }
-        msg.append(line);
+        text.append(line);
         g_free(line);
       }
 
@@ -644,27 +924,55 @@ void Conversation::loadHistory()
       }
 
       // validate UTF-8
-      if (!g_utf8_validate(msg.c_str(), -1, NULL)) {
-        LOG->error(_("Invalid message detected in conversation logfile"
-              " '%s'. The message was skipped."), filename);
+      if (!g_utf8_validate(text.c_str(), -1, NULL)) {
+        batch->errors.push_back(g_strdup_printf(
+              _("Invalid message detected in conversation logfile"
+                " '%s'. The message was skipped."), filename));
         continue;
       }
 
-      // add the message to the window
+      // prepare text for the window
       char *time = extractTime(sent_time, show_time);
-      char *final_msg = g_strdup_printf("%s %s", time, msg.c_str());
-      view->append(final_msg, color);
+      msg.text = g_strdup_printf("%s %s", time, text.c_str());
       g_free(time);
-      g_free(final_msg);
     }
+
+    batch->messages.push_back(msg);
   }
 
   if (st != G_IO_STATUS_EOF) {
-    LOG->error(_("Error reading from conversation logfile '%s' (%s)."),
-        filename, err->message);
+    batch->errors.push_back(g_strdup_printf(
+          _("Error reading from conversation logfile '%s' (%s)."), filename,
+          err ? err->message : ""));
     g_clear_error(&err);
   }
   g_io_channel_unref(chan);
+  g_string_free(text_buffer, TRUE);
+
+  batch->last = true;
+  post(batch);
+}
+
+GIOStatus Conversation::HistoryLoad::readLine(GIOChannel *chan, char **line,
+    gsize *length, GError **err)
+{
+  // don't read messages appended to the logfile after the loading started
+  if (size >= 0 && consumed >= size)
+    return G_IO_STATUS_EOF;
+
+  GIOStatus st = g_io_channel_read_line(chan, line, length, NULL, err);
+  if (st == G_IO_STATUS_NORMAL)
+    consumed += *length;
+  return st;
+}
+
+void Conversation::HistoryLoad::post(HistoryBatch *batch)
+{
+  g_async_queue_push(batches, batch);
+
+  // the idle callback holds a reference until it is dispatched
+  ref();
+  g_idle_add(history_load_batch_, this);
 }
 
 bool Conversation::processCommand(const char *raw, const char *html)
@@ -723,6 +1031,10 @@ bool Conversation::processCommand(const char *raw, const char *html)
 
 void Conversation::onInputTextChange(CppConsUI::TextEdit& activator)
 {
+  // an edit of the input makes it the prefix of the browsed history again
+  if (!history_setting)
+    stopBrowsingHistory();
+
   PurpleConvIm *im = PURPLE_CONV_IM(conv);
   if (!im)
     return;
@@ -758,14 +1070,156 @@ void Conversation::onInputTextChange(CppConsUI::TextEdit& activator)
   }
 }
 
+void Conversation::findNext(int direction)
+{
+  if (!view->findNext(direction))
+    CppConsUI::Curses::beep();
+}
+
+void Conversation::closeFind()
+{
+  view->setFindText(NULL);
+  find_entry->clear();
+  find_bar->setVisibility(false);
+  line->setVisibility(true);
+  input->grabFocus();
+  restoreFocus();
+}
+
+void Conversation::onFindTextChange(CppConsUI::TextEdit& activator)
+{
+  view->setFindText(activator.getText());
+}
+
+void Conversation::onFindUpdate(CppConsUI::TextView& activator)
+{
+  if (!find_bar->isVisible())
+    return;
+
+  char *status;
+  unsigned matches = activator.getFindMatchesNumber();
+  if (activator.isFindRunning())
+    status = g_strdup_printf(ngettext(" %u match, searching...",
+          " %u matches, searching...", matches), matches);
+  else
+    status = g_strdup_printf(ngettext(" %u match", " %u matches", matches),
+        matches);
+  find_status->setText(status);
+  find_status->setWidth(find_status->getTextRun().getWidth());
+  g_free(status);
+}
+
+void Conversation::setInputText(const char *text)
+{
+  history_setting = true;
+  input->setText(text);
+  history_setting = false;
+}
+
+void Conversation::browseHistory(bool forward)
+{
+  // the history search has the focus
+  if (history_bar->isVisible())
+    return;
+
+  if (!history_draft) {
+    if (forward) {
+      // there is nothing newer than the current input
+      CppConsUI::Curses::beep();
+      return;
+    }
+    history_draft = g_strdup(input->getText());
+    history_pos = history->getEnd();
+  }
+
+  size_t pos = history_pos;
+  if (history->findPrefix(history_draft, pos, forward)) {
+    history_pos = pos;
+    setInputText(history->getEntry(pos));
+    return;
+  }
+
+  if (forward) {
+    // moved past the newest entry, bring the draft back
+    setInputText(history_draft);
+    stopBrowsingHistory();
+    return;
+  }
+
+  if (history_pos == history->getEnd())
+    stopBrowsingHistory();
+  CppConsUI::Curses::beep();
+}
+
+void Conversation::stopBrowsingHistory()
+{
+  g_free(history_draft);
+  history_draft = NULL;
+}
+
+void Conversation::searchHistory()
+{
+  const char *text = history_entry->getText();
+  InputHistory *global = CONVERSATIONS->getInputHistory();
+  size_t pos = history_search_pos;
+  if (text[0] && global->findText(text, pos)) {
+    history_search_pos = pos;
+    setInputText(global->getEntry(pos));
+    history_status->setText(NULL);
+  }
+  else {
+    history_status->setText(_(" no match"));
+    CppConsUI::Curses::beep();
+  }
+  history_status->setWidth(history_status->getTextRun().getWidth());
+}
+
+void Conversation::closeHistorySearch(bool accept)
+{
+  if (!accept)
+    setInputText(history_draft);
+  stopBrowsingHistory();
+
+  history_bar->setVisibility(false);
+  history_entry->clear();
+  history_status->setText(NULL);
+  history_status->setWidth(0);
+  line->setVisibility(true);
+  input->grabFocus();
+  restoreFocus();
+}
+
+void Conversation::onHistorySearchTextChange(CppConsUI::TextEdit& activator)
+{
+  if (!history_bar->isVisible())
+    return;
+
+  // every change of the text starts the search from the newest entry
+  history_search_pos = CONVERSATIONS->getInputHistory()->getEnd();
+  if (!activator.getTextLength()) {
+    setInputText(history_draft);
+    history_status->setText(NULL);
+    history_status->setWidth(0);
+    return;
+  }
+  searchHistory();
+}
+
 void Conversation::actionSend()
 {
+  // send the found entry of the history search
+  if (history_bar->isVisible())
+    closeHistorySearch(true);
+
   const char *str = input->getText();
   if (!str || !str[0])
     return;
 
   purple_idle_touch();
 
+  history->add(str);
+  CONVERSATIONS->getInputHistory()->add(str);
+
   char *escaped = purple_markup_escape_text(str, strlen(str));
   char *html = purple_strdup_withhtml(escaped);
   if (processCommand(str, html)) {
@@ -783,11 +1237,65 @@ void Conversation::actionSend()
   input->clear();
 }
 
+void Conversation::actionFind()
+{
+  if (find_bar->isVisible()) {
+    findNext(-1);
+    return;
+  }
+
+  if (history_bar->isVisible())
+    closeHistorySearch(true);
+
+  line->setVisibility(false);
+  find_bar->setVisibility(true);
+  find_entry->grabFocus();
+
+  FOOTER->setText(_("%s/%s previous/next match, %s close find"),
+      "conversation|find-prev", "conversation|find-next",
+      "window|close-window");
+}
+
+void Conversation::actionHistorySearch()
+{
+  if (history_bar->isVisible()) {
+    searchHistory();
+    return;
+  }
+
+  if (find_bar->isVisible())
+    closeFind();
+
+  stopBrowsingHistory();
+  history_draft = g_strdup(input->getText());
+  history_search_pos = CONVERSATIONS->getInputHistory()->getEnd();
+
+  line->setVisibility(false);
+  history_bar->setVisibility(true);
+  history_entry->grabFocus();
+
+  FOOTER->setText(_("%s older match, %s accept, %s cancel"),
+      "conversation|history-search", "textentry|activate",
+      "window|close-window");
+}
+
 void Conversation::declareBindables()
 {
   declareBindable("conversation", "send",
       sigc::mem_fun(this, &Conversation::actionSend),
       InputProcessor::BINDABLE_OVERRIDE);
+  declareBindable("conversation", "find",
+      sigc::mem_fun(this, &Conversation::actionFind),
+      InputProcessor::BINDABLE_OVERRIDE);
+  declareBindable("conversation", "history-prev", sigc::bind(sigc::mem_fun(
+          this, &Conversation::browseHistory), false),
+      InputProcessor::BINDABLE_OVERRIDE);
+  declareBindable("conversation", "history-next", sigc::bind(sigc::mem_fun(
+          this, &Conversation::browseHistory), true),
+      InputProcessor::BINDABLE_OVERRIDE);
+  declareBindable("conversation", "history-search",
+      sigc::mem_fun(this, &Conversation::actionHistorySearch),
+      InputProcessor::BINDABLE_OVERRIDE);
 }
 
 /* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -24,13 +24,19 @@
 
 #include "Log.h"
 #include "ConversationRoomList.h"
+#include "InputHistory.h"
 
 #include <cppconsui/AbstractLine.h>
+#include <cppconsui/HorizontalListBox.h>
+#include <cppconsui/Label.h>
+#include <cppconsui/TextEntry.h>
+#include <cppconsui/TextRun.h>
 #include <cppconsui/VerticalLine.h>
 #include <cppconsui/TextEdit.h>
 #include <cppconsui/TextView.h>
 #include <cppconsui/Window.h>
 #include <libpurple/purple.h>
+#include <vector>
 
 class Conversation
 : public CppConsUI::Window
@@ -49,6 +55,7 @@ public:
 
   // FreeWindow
   virtual void show();
+  virtual void hide();
   virtual void close();
   virtual void onScreenResized();
 
@@ -57,6 +64,24 @@ public:
 
   PurpleConversation *getPurpleConversation() const { return conv; };
 
+  /**
+   * Reloads the history and scrolls the view to a message at a given offset
+   * in the logfile. Messages that weren't logged are dropped from the view.
+   */
+  void showLogRecord(gint64 offset);
+
+  /**
+   * Releases the content of the view, curses pads and the logfile handle of
+   * a hidden conversation. Everything is restored from the logfile when the
+   * conversation is shown again, only the input text is kept.
+   */
+  void hibernate();
+  bool isHibernated() const { return hibernated; }
+  /**
+   * Returns the time when the conversation was hidden, or 0 if it is shown.
+   */
+  time_t getHiddenTime() const { return hidden_time; }
+
   ConversationRoomList *getRoomList() const { return room_list; };
 
 protected:
@@ -65,24 +90,73 @@ protected:
   {
   public:
     ConversationLine(const char *text_);
-    virtual ~ConversationLine();
+    virtual ~ConversationLine() {}
 
     // Widget
     virtual void draw();
 
   protected:
-    char *text;
-    size_t text_width;
+    CppConsUI::TextRun text;
 
   private:
     ConversationLine(const ConversationLine&);
     ConversationLine& operator=(const ConversationLine&);
   };
 
+  /**
+   * Input of the incremental find, it replaces the conversation line while
+   * the find is active.
+   */
+  class FindEntry
+  : public CppConsUI::TextEntry
+  {
+  public:
+    FindEntry(Conversation *parent_);
+    virtual ~FindEntry() {}
+
+  protected:
+    Conversation *parent;
+
+  private:
+    FindEntry(const FindEntry&);
+    FindEntry& operator=(const FindEntry&);
+
+    void declareBindables();
+  };
+
+  /**
+   * Input of the incremental search in the history of sent inputs, it
+   * replaces the conversation line while the search is active.
+   */
+  class HistoryEntry
+  : public CppConsUI::TextEntry
+  {
+  public:
+    HistoryEntry(Conversation *parent_);
+    virtual ~HistoryEntry() {}
+
+  protected:
+    Conversation *parent;
+
+  private:
+    HistoryEntry(const HistoryEntry&);
+    HistoryEntry& operator=(const HistoryEntry&);
+
+    void declareBindables();
+  };
+
   CppConsUI::TextView *view;
   CppConsUI::TextEdit *input;
   ConversationLine *line;
 
+  CppConsUI::HorizontalListBox *find_bar;
+  FindEntry *find_entry;
+  CppConsUI::Label *find_status;
+
+  CppConsUI::HorizontalListBox *history_bar;
+  HistoryEntry *history_entry;
+  CppConsUI::Label *history_status;
+
   // Only PURPLE_CONV_TYPE_CHAT have a room list
   ConversationRoomList *room_list;
   CppConsUI::VerticalLine *room_list_line;
@@ -94,21 +168,107 @@ protected:
 
   size_t input_text_length;
 
-  char *stripHTML(const char *str) const;
+  /**
+   * Inputs sent in this conversation. While the history is browsed or
+   * searched, history_draft holds the text that was in the input before.
+   * Browsed entries have to start with the draft.
+   */
+  InputHistory *history;
+  char *history_draft;
+  // browsed entry of the conversation history
+  size_t history_pos;
+  // the last match of the search in the global history
+  size_t history_search_pos;
+  // the input text is being replaced by an entry of the history
+  bool history_setting;
+
+  /**
+   * Buffer for building messages before they are shown in the view.
+   */
+  GString *text_buffer;
+
+  /**
+   * History is parsed by a worker thread and passed back to the main loop in
+   * batches.
+   */
+  struct HistoryBatch;
+  struct HistoryLoad;
+  HistoryLoad *history_load;
+  /**
+   * Number of lines in the view that belong to the history, new messages
+   * can be written before all history is loaded.
+   */
+  size_t history_lines;
+  /**
+   * Logfile offset of a history message that the view should be scrolled
+   * to, or -1.
+   */
+  gint64 scroll_offset;
+
+  struct PendingMessage
+  {
+    char *text;
+    int color;
+  };
+  typedef std::vector<PendingMessage> PendingMessages;
+
+  bool hibernated;
+  time_t hidden_time;
+  /**
+   * Messages that aren't logged (PURPLE_MESSAGE_NO_LOG) or couldn't be
+   * written to the logfile and were received while the conversation was
+   * hibernated, they can't be restored from the logfile.
+   */
+  PendingMessages pending_messages;
+
   void destroyPurpleConversation(PurpleConversation *conv);
   void buildLogFilename();
-  char *extractTime(time_t sent_time, time_t show_time) const;
+  /**
+   * Returns the path of a file that belongs to the conversation in a given
+   * directory of the libpurple user directory.
+   */
+  char *buildFilename(const char *dir) const;
+  void openLogfile();
+  void closeLogfile();
+  static char *extractTime(time_t sent_time, time_t show_time);
   void loadHistory();
+  void cancelHistoryLoad();
+  void appendHistory();
+  /**
+   * Restores the view of a hibernated conversation.
+   */
+  void wakeUp();
   bool processCommand(const char *raw, const char *html);
   void onInputTextChange(CppConsUI::TextEdit& activator);
 
+  void findNext(int direction);
+  void closeFind();
+  void onFindTextChange(CppConsUI::TextEdit& activator);
+  void onFindUpdate(CppConsUI::TextView& activator);
+
+  void setInputText(const char *text);
+  void browseHistory(bool forward);
+  void stopBrowsingHistory();
+  /**
+   * Finds the next older entry of the global history that contains the
+   * text of the history search.
+   */
+  void searchHistory();
+  void closeHistorySearch(bool accept);
+  void onHistorySearchTextChange(CppConsUI::TextEdit& activator);
+
   void actionSend();
+  void actionFind();
+  void actionHistorySearch();
 
 private:
   Conversation();
   Conversation(const Conversation&);
   Conversation& operator=(const Conversation&);
 
+  static gpointer history_load_thread_(gpointer data);
+  static gboolean history_load_batch_(gpointer data);
+
   void declareBindables();
 };
 
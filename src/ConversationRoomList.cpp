@@ -21,103 +21,122 @@
 
 #include "ConversationRoomList.h"
 
-// Move the widget to a position according to sorting function
-void ConversationRoomList::moveToSortedPosition(Buddy *new_buddy)
+#include <algorithm>
+
+ConversationRoomList::ConversationRoomList(int w, int h,
+  PurpleConversation *conv)
+  : CppConsUI::Widget(w, h)
+  , conv_(conv)
+  , view_top_(0)
+  , selected_(NULL)
 {
-  Buddy * buddy = NULL;
-  Children::iterator iter;
+  can_focus = true;
+  declareBindables();
+}
 
-  g_assert(new_buddy);
+ConversationRoomList::~ConversationRoomList()
+{
+  for (Members::iterator i = members_.begin(); i != members_.end(); ++i)
+    delete *i;
+}
 
-  for(iter = children.begin(); iter != children.end(); ++iter) {
+void ConversationRoomList::draw()
+{
+  proceedUpdateArea();
 
-    buddy = dynamic_cast<Buddy*>(iter->widget);
+  if(!area)
+    return;
 
-    // Should never happen...
-    g_assert(buddy);
+  area->erase();
 
-    // Since new_buddy is in list already, must skip
-    if(*buddy == *new_buddy)
-      continue;
+  int realw = area->getmaxx();
+  int realh = area->getmaxy();
 
-    // Break once insertion point is found
-    if(!Buddy::less_than_op_away_name(*buddy, *new_buddy))
-      break;
-  }
+  // Keep the view inside the list and the selected member visible
+  size_t rows = realh;
+  if(members_.size() <= rows)
+    view_top_ = 0;
+  else if(view_top_ > members_.size() - rows)
+    view_top_ = members_.size() - rows;
 
-  // Don't change anything if wanting to put into the same position
-  // (also returns on single node case)
-  if(*buddy == *new_buddy) {
-    return;
+  if(selected_) {
+    size_t pos = findMember(selected_) - members_.begin();
+    if(pos < view_top_)
+      view_top_ = pos;
+    else if(rows && pos >= view_top_ + rows)
+      view_top_ = pos - rows + 1;
   }
 
-  // TODO: HACK? Seems to be required to have the ListBox
-  //   reorder the widgets after calling moveWidget*
-  //   Doesn't seem right...
-  reposition_widgets = true;
+  // Only the visible rows are drawn, they use button colors so the list
+  // looks the same as other lists of items
+  int normal_attrs = getColorPair("button", "normal");
+  int focus_attrs = getColorPair("button", "focus")
+    | CppConsUI::Curses::Attr::REVERSE;
 
-  // Insert after if at end
-  if(iter == children.end()) {
-    moveWidgetAfter(*new_buddy, *buddy);
-  }
-  else {
-    moveWidgetBefore(*new_buddy, *buddy);
-  }
+  for (int y = 0; y < realh && view_top_ + y < members_.size(); ++y) {
+    Member *member = members_[view_top_ + y];
+
+    int attrs = normal_attrs;
+    if(has_focus && member == selected_)
+      attrs = focus_attrs;
 
+    area->attron(attrs);
+    int printed = area->mvaddstring(0, y, realw, member->text.c_str());
+    area->fill(attrs, printed, y, realw - printed, 1);
+    area->attroff(attrs);
+  }
 }
 
 void ConversationRoomList::add_users(GList *cbuddies, gboolean new_arrivals)
 {
+  size_t sorted_size = members_.size();
+
   GList *l;
   PurpleConvChatBuddy *pbuddy;
   for (l = cbuddies; l != NULL; l = l->next) {
 
     pbuddy = static_cast<PurpleConvChatBuddy*>(l->data);
 
-    Buddy * buddy = new Buddy(pbuddy);
-    buddy->setButtonText();
-    buddy_map_[pbuddy->name] = buddy;
-
-    appendWidget(*buddy);
+    // Should not happen, but be safe about duplicate joins
+    if(member_map_.find(pbuddy->name) != member_map_.end())
+      continue;
 
-    moveToSortedPosition(buddy);
+    Member *member = new Member;
+    member->read(pbuddy);
+    member_map_[member->name] = member;
+    members_.push_back(member);
   }
-}
-
-void ConversationRoomList::rename_user(const char *old_name,
-  const char *new_name, const char *new_alias)
-{
-  // The old PurpleConvChatBuddy is still valid while
-  // this function is executing
-  //PurpleConvChatBuddy * old_pbuddy = purple_conv_chat_cb_find(
-  //  conv_->u.chat, old_name);
 
-  PurpleConvChat * conv = PURPLE_CONV_CHAT(conv_);
+  if(members_.size() == sorted_size)
+    return;
 
-  g_assert(conv);
+  // Sort the newcomers once and merge them with the already sorted list,
+  // this keeps joining large rooms O(n log n)
+  Members::iterator middle = members_.begin() + sorted_size;
+  std::sort(middle, members_.end(), Member::less_than_op_away_name);
+  std::inplace_merge(members_.begin(), middle, members_.end(),
+    Member::less_than_op_away_name);
 
-  PurpleConvChatBuddy * new_pbuddy = purple_conv_chat_cb_find(
-    conv, new_name);
+  if(!selected_)
+    selected_ = members_.front();
 
-  //g_assert(old_pbuddy);
-  g_assert(new_pbuddy);
+  redraw();
+}
 
-  // NOTE: PurpleConvChatBuddy::ui_data is pidgin 2.9!!
-  //Buddy * buddy = static_cast<Buddy *>(old_pbuddy->ui_data);
-  Buddy * buddy = buddy_map_[old_name];
+void ConversationRoomList::rename_user(const char *old_name,
+  const char *new_name, const char *new_alias)
+{
+  MemberMapIter iter = member_map_.find(old_name);
 
-  g_assert(buddy);
+  g_assert(iter != member_map_.end());
 
-  // Update buddy
-  buddy->setPurpleBuddy(new_pbuddy);
+  Member *member = iter->second;
 
-  // Update buddy map
-  buddy_map_.erase(old_name);
-  buddy_map_[new_name] = buddy;
+  // Update member map
+  member_map_.erase(iter);
+  member_map_[new_name] = member;
 
-  // Move and then update
-  moveToSortedPosition(buddy);
-  buddy->setButtonText();
+  updateMember(member, new_name);
 }
 
 void ConversationRoomList::remove_users(GList *users)
@@ -131,132 +150,209 @@ void ConversationRoomList::remove_users(GList *users)
     // NOTE: can't remove purple_conv_chat_cb_find, because the user
     //   and PurpleConvChatBuddy has already been removed
 
-    BuddyMapIter iter = buddy_map_.find(name);
+    MemberMapIter iter = member_map_.find(name);
 
-    if(buddy_map_.end() != iter) {
+    if(member_map_.end() != iter) {
 
-        buddy_map_.erase(iter);
-        // NOTE: this deletes the buddy object
-        removeWidget(*iter->second);
+        Member *member = iter->second;
+        member_map_.erase(iter);
+        eraseMember(member);
+        delete member;
     }
   }
+
+  redraw();
 }
 
 void ConversationRoomList::update_user(const char *user)
 {
-  PurpleConvChat * conv = PURPLE_CONV_CHAT(conv_);
+  MemberMapIter iter = member_map_.find(user);
 
-  g_assert(conv);
-
-  PurpleConvChatBuddy * pbuddy = purple_conv_chat_cb_find(conv, user);
+  g_assert(iter != member_map_.end());
 
-  g_assert(pbuddy);
+  updateMember(iter->second, user);
+}
 
-  // NOTE: PurpleConvChatBuddy::ui_data is pidgin 2.9!!
-  //Buddy * buddy = static_cast<Buddy *>(pbuddy->ui_data);
-  Buddy * buddy = buddy_map_[user];
+ConversationRoomList::Members::iterator ConversationRoomList::findMember(
+  const Member *member)
+{
+  // Binary search for the first equal member, then look for the exact one
+  Members::iterator iter = std::lower_bound(members_.begin(), members_.end(),
+    member, Member::less_than_op_away_name);
+  while(iter != members_.end() && *iter != member)
+    ++iter;
 
-  g_assert(buddy);
+  g_assert(iter != members_.end());
 
-  // Move and then update
-  moveToSortedPosition(buddy);
-  buddy->setButtonText();
+  return iter;
 }
 
-ConversationRoomList::Buddy::Buddy(PurpleConvChatBuddy *pbuddy)
-  : CppConsUI::Button(AUTOSIZE, 1, "")
-  , pbuddy_(pbuddy)
+void ConversationRoomList::insertSorted(Member *member)
 {
-  // Set ui data
-  // NOTE: PurpleConvChatBuddy::ui_data is pidgin 2.9!!
-  //pbuddy_->ui_data = static_cast<void*>(this);
+  members_.insert(std::upper_bound(members_.begin(), members_.end(), member,
+    Member::less_than_op_away_name), member);
 }
 
-ConversationRoomList::Buddy::~Buddy()
+void ConversationRoomList::eraseMember(Member *member)
 {
+  Members::iterator iter = members_.erase(findMember(member));
+
+  // Select the following member (or the last one) instead
+  if(member == selected_) {
+    if(iter != members_.end())
+      selected_ = *iter;
+    else if(!members_.empty())
+      selected_ = members_.back();
+    else
+      selected_ = NULL;
+  }
 }
 
-void ConversationRoomList::Buddy::readFlags(bool &is_op, bool &is_typing,
-  bool &is_away) const
+void ConversationRoomList::updateMember(Member *member, const char *name)
 {
-  g_assert(pbuddy_);
+  PurpleConvChat * conv = PURPLE_CONV_CHAT(conv_);
 
-  PurpleConvChatBuddyFlags flags = pbuddy_->flags;
+  g_assert(conv);
 
-  // TODO: how about founder?  Does that matter?
+  PurpleConvChatBuddy * pbuddy = purple_conv_chat_cb_find(conv, name);
 
-  is_op = (
-    ((flags & PURPLE_CBFLAGS_OP)      != 0)
-    );
+  g_assert(pbuddy);
 
-  is_typing = (
-    ((flags & PURPLE_CBFLAGS_TYPING)  != 0)
-    );
+  // Take the member out while its sort key changes and put it back
+  Member *selected = selected_;
+  eraseMember(member);
+  member->read(pbuddy);
+  insertSorted(member);
+  selected_ = selected;
 
-#if PURPLE_VERSION_CHECK(2, 8, 0)
-  is_away = (
-    ((flags & PURPLE_CBFLAGS_AWAY)    != 0)
-    );
-#else
-  is_away = false;
-#endif
+  redraw();
 }
 
-void ConversationRoomList::Buddy::setButtonText()
+void ConversationRoomList::actionMoveCursor(int direction)
 {
-  char * text = displayText();
-  setText(text);
-  g_free(text);
+  if(!selected_)
+    return;
+
+  Members::iterator iter = findMember(selected_);
+  if(direction < 0) {
+    if(iter == members_.begin())
+      return;
+    --iter;
+  }
+  else {
+    if(iter + 1 == members_.end())
+      return;
+    ++iter;
+  }
+
+  selected_ = *iter;
+  redraw();
 }
 
-char * ConversationRoomList::Buddy::displayText() const
+void ConversationRoomList::actionMoveCursorPage(int direction)
 {
-  char * ret;
+  if(!selected_ || !area)
+    return;
 
-  bool is_op(false);
-  bool is_typing(false);
-  bool is_away(false);
+  size_t pos = findMember(selected_) - members_.begin();
+  size_t page = area->getmaxy();
 
-  readFlags(is_op, is_typing, is_away);
+  if(direction < 0)
+    pos = pos > page ? pos - page : 0;
+  else
+    pos = std::min(pos + page, members_.size() - 1);
 
-  ret = g_strdup_printf("[%s] %s%s%s",
-    (is_away     ? "a" : "o"),
-    (is_op       ? "@" : ""),
-    displayName(),
-    (is_typing   ? "*" : "")
-    );
+  selected_ = members_[pos];
+  redraw();
+}
 
-  // TODO: elide long names?
+void ConversationRoomList::actionMoveCursorBegin()
+{
+  if(members_.empty())
+    return;
 
-  return ret;
+  selected_ = members_.front();
+  redraw();
 }
 
-const char * ConversationRoomList::Buddy::displayName() const
+void ConversationRoomList::actionMoveCursorEnd()
 {
-  g_assert(pbuddy_);
+  if(members_.empty())
+    return;
 
-  // prefer alias
-  // NOTE: pbuddy_->alias_key isn't used yet... (according to docs)
-  if(pbuddy_->alias != NULL)
-    return pbuddy_->alias;
-  else
-    return pbuddy_->name;
+  selected_ = members_.back();
+  redraw();
 }
 
-bool ConversationRoomList::Buddy::operator==(const Buddy &rhs)
+void ConversationRoomList::declareBindables()
 {
-  return pbuddy_ == rhs.pbuddy_;
+  /* The cursor moves with the focus keys of containers, the list used to be
+   * a ListBox and existing key configurations bind only these. */
+  declareBindable("container", "focus-up",
+      sigc::bind(sigc::mem_fun(this,
+          &ConversationRoomList::actionMoveCursor), -1),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("container", "focus-down",
+      sigc::bind(sigc::mem_fun(this,
+          &ConversationRoomList::actionMoveCursor), 1),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("container", "focus-page-up",
+      sigc::bind(sigc::mem_fun(this,
+          &ConversationRoomList::actionMoveCursorPage), -1),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("container", "focus-page-down",
+      sigc::bind(sigc::mem_fun(this,
+          &ConversationRoomList::actionMoveCursorPage), 1),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("container", "focus-begin",
+      sigc::mem_fun(this, &ConversationRoomList::actionMoveCursorBegin),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("container", "focus-end",
+      sigc::mem_fun(this, &ConversationRoomList::actionMoveCursorEnd),
+      InputProcessor::BINDABLE_NORMAL);
 }
 
-void ConversationRoomList::Buddy::setPurpleBuddy(PurpleConvChatBuddy *pbuddy)
+void ConversationRoomList::Member::read(PurpleConvChatBuddy *pbuddy)
 {
-  pbuddy_ = pbuddy;
-  // NOTE: PurpleConvChatBuddy::ui_data is pidgin 2.9!!
-  //pbuddy_->ui_data = static_cast<void*>(this);
+  g_assert(pbuddy);
+
+  PurpleConvChatBuddyFlags flags = pbuddy->flags;
+
+  // TODO: how about founder?  Does that matter?
+
+  is_op = (flags & PURPLE_CBFLAGS_OP) != 0;
+  bool is_typing = (flags & PURPLE_CBFLAGS_TYPING) != 0;
+
+#if PURPLE_VERSION_CHECK(2, 8, 0)
+  is_away = (flags & PURPLE_CBFLAGS_AWAY) != 0;
+#else
+  is_away = false;
+#endif
+
+  name = pbuddy->name;
+
+  // prefer alias
+  // NOTE: pbuddy->alias_key isn't used yet... (according to docs)
+  const char *display_name = pbuddy->alias ? pbuddy->alias : pbuddy->name;
+
+  char *str = g_strdup_printf("[%s] %s%s%s",
+    (is_away     ? "a" : "o"),
+    (is_op       ? "@" : ""),
+    display_name,
+    (is_typing   ? "*" : "")
+    );
+  text = str;
+  g_free(str);
+
+  // TODO: elide long names?
+
+  str = g_utf8_collate_key(display_name, -1);
+  collate_key = str;
+  g_free(str);
 }
 
-bool ConversationRoomList::Buddy::less_than_op_away_name(const Buddy &lhs,
-  const Buddy &rhs)
+bool ConversationRoomList::Member::less_than_op_away_name(const Member *lhs,
+  const Member *rhs)
 {
   // Sort order:
   //
@@ -264,33 +360,14 @@ bool ConversationRoomList::Buddy::less_than_op_away_name(const Buddy &lhs,
   // 2. online (vs away)
   // 3. name/alias
 
-  bool lhs_is_op, lhs_is_typing, lhs_is_away;
-  bool rhs_is_op, rhs_is_typing, rhs_is_away;
+  if(lhs->is_op != rhs->is_op)
+    return lhs->is_op;
 
-  lhs.readFlags(lhs_is_op, lhs_is_typing, lhs_is_away);
-  rhs.readFlags(rhs_is_op, rhs_is_typing, rhs_is_away);
+  if(lhs->is_away != rhs->is_away)
+    return !lhs->is_away;
 
-  // Probably a more elegant way to do this
-  if(lhs_is_op && !rhs_is_op) {
-    return true;
-  }
-  else if(!lhs_is_op && rhs_is_op) {
-    return false;
-  }
-  // equal op or non-op status
-  else {
-    if(lhs_is_away && !rhs_is_away) {
-      return false;
-    }
-    else if(!lhs_is_away && rhs_is_away) {
-      return true;
-    }
-    // on equal online/away status
-    else {
-      // utf8 comparison
-      return g_utf8_collate(lhs.displayName(), rhs.displayName()) < 0;
-    }
-  }
+  // utf8 comparison
+  return lhs->collate_key < rhs->collate_key;
 }
 
 /* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
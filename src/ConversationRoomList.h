@@ -22,21 +22,24 @@
 #ifndef __CONVERSATION_ROOM_LIST_H__
 #define __CONVERSATION_ROOM_LIST_H__
 
-#include <cppconsui/ListBox.h>
-#include <cppconsui/Button.h>
+#include <cppconsui/Widget.h>
 #include <libpurple/purple.h>
 
-#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+// Room member list, keeps a sorted array of plain member records and draws
+// only the rows that fit in the widget
 class ConversationRoomList
-: public CppConsUI::ListBox
+: public CppConsUI::Widget
 {
 public:
-  ConversationRoomList(int w, int h, PurpleConversation *conv)
-      : CppConsUI::ListBox(w, h)
-      , conv_(conv)
-  {}
-  virtual ~ConversationRoomList() {}
+  ConversationRoomList(int w, int h, PurpleConversation *conv);
+  virtual ~ConversationRoomList();
+
+  // Widget
+  virtual void draw();
 
   // Purple chatroom interfaces
   void add_users(GList *cbuddies, gboolean new_arrivals);
@@ -49,70 +52,76 @@ protected:
 
   PurpleConversation * conv_;
 
-  // Represents a widget as well as pointer to libpurple data
-  class Buddy : public CppConsUI::Button
+  // Copy of libpurple data needed to sort and display one member
+  // NOTE: PurpleConvChatBuddy can't be referenced because it is already
+  // gone when remove_users op is called
+  struct Member
   {
-  public:
-
-    Buddy(PurpleConvChatBuddy *pbuddy);
-
-    virtual ~Buddy();
-
-    // set button text with displayName
-    void setButtonText();
+    std::string name;
 
-    // Use pbuddy info to generate button displayText
-    // NOTE: returns newly allocated string, caller must free
-    char * displayText() const;
+    // displayed text
+    std::string text;
 
-    // Prefer alias if it exists, and fall back on name
-    const char * displayName() const;
+    // collation key of the alias (or name), g_utf8_collate() is too slow
+    // to be called for every comparison when sorting large rooms
+    std::string collate_key;
 
-    // TODO
-    //void onActivate(Button &);
+    bool is_op;
+    bool is_away;
 
-    // Update purple buddy (for rename case)
-    void setPurpleBuddy(PurpleConvChatBuddy *pbuddy);
+    // Update all data from libpurple
+    void read(PurpleConvChatBuddy *pbuddy);
 
     // Sorting method for: op/away/display_name
     // if less than: give priority
     // The idea that if more sorting methods are desired,
     // they can be swapped out at runtime based on config
-    static bool less_than_op_away_name(const Buddy &lhs, const Buddy &rhs);
+    static bool less_than_op_away_name(const Member *lhs,
+      const Member *rhs);
+  };
+
+  typedef std::vector<Member*> Members;
+  typedef std::unordered_map<std::string, Member*> MemberMap;
+  typedef MemberMap::iterator MemberMapIter;
 
-    bool operator==(const Buddy &rhs);
+  // Sorted members
+  Members members_;
 
-  private:
+  // Have to keep this mapping to remove users
+  // because when libpurple calls remove_user, the user is already
+  // gone, along with the "ui_data"
+  MemberMap member_map_;
 
-    void readFlags(bool &is_op, bool &is_typing, bool &is_away) const;
+  // Index of the first displayed member
+  size_t view_top_;
 
-    // NOTE: when remove_users op is called, this pointer is invalidated!
-    PurpleConvChatBuddy *pbuddy_;
+  // Member highlighted when the list has focus
+  Member *selected_;
 
-    // Force public constructor
-    Buddy();
+  // Position of a member in members_
+  Members::iterator findMember(const Member *member);
 
-    Buddy(const Buddy&);
-    Buddy& operator=(const Buddy&);
-  };
+  // Insert member to sorted position
+  // NOTE: all other members must be sorted already
+  void insertSorted(Member *member);
 
-  // Move buddy to sorted position
-  void moveToSortedPosition(Buddy *buddy);
+  // Remove member from members_, member itself is not deleted
+  void eraseMember(Member *member);
 
-  // Have to keep this mapping to remove users
-  // because when libpurple calls remove_user, the user is already
-  // gone, along with the "ui_data"
-  // Otherwise could store "name" in Buddy and iterate through "children"
-  // NOTE: turns out that ui_data is new in libpurple 2.9, so for previous
-  // versions this map is required anyways... :/
-  std::map<std::string, Buddy*> buddy_map_;
-  typedef std::map<std::string, Buddy*>::iterator BuddyMapIter;
+  // Re-read member from libpurple and move it to its new place
+  void updateMember(Member *member, const char *name);
 
 private:
 
   ConversationRoomList(const ConversationRoomList&);
   ConversationRoomList& operator=(const ConversationRoomList&);
 
+  void actionMoveCursor(int direction);
+  void actionMoveCursorPage(int direction);
+  void actionMoveCursorBegin();
+  void actionMoveCursorEnd();
+
+  void declareBindables();
 };
 
 #endif
@@ -21,8 +21,14 @@
 
 #include "Conversations.h"
 
+#include <algorithm>
 #include "gettext.h"
 
+// how often hidden conversations are checked for hibernation (in ms)
+#define HIBERNATE_CHECK_INTERVAL 60000
+// number of sent inputs that are remembered for all conversations together
+#define GLOBAL_INPUT_HISTORY_SIZE 2000
+
 Conversations *Conversations::my_instance = NULL;
 
 Conversations *Conversations::instance()
@@ -77,6 +83,20 @@ void Conversations::focusNextConversation()
     activateConversation(i);
 }
 
+void Conversations::focusNextNewConversation()
+{
+  while (!activity.empty()) {
+    PurpleConversation *conv = activity.front();
+    activity.pop_front();
+
+    int i = findConversation(conv);
+    if (i != -1 && conversations[i].unread) {
+      activateConversation(i);
+      return;
+    }
+  }
+}
+
 void Conversations::setExpandedConversations(bool expanded)
 {
   if (expanded) {
@@ -94,12 +114,99 @@ void Conversations::setExpandedConversations(bool expanded)
   activateConversation(active);
 }
 
+void Conversations::showLogRecord(const char *path, gint64 offset)
+{
+  g_assert(path);
+
+  // see Conversation::buildLogFilename() for the format of the path
+  char **parts = g_strsplit(path, G_DIR_SEPARATOR_S, 0);
+  if (g_strv_length(parts) != 3) {
+    g_strfreev(parts);
+    return;
+  }
+
+  PurpleAccount *account = NULL;
+  for (GList *l = purple_accounts_get_all(); l; l = l->next) {
+    PurpleAccount *a = static_cast<PurpleAccount*>(l->data);
+    if (strcmp(purple_account_get_protocol_name(a), parts[0]))
+      continue;
+    if (!strcmp(purple_escape_filename(purple_normalize(a,
+              purple_account_get_username(a))), parts[1])) {
+      account = a;
+      break;
+    }
+  }
+  if (!account) {
+    LOG->error(_("Account of conversation logfile '%s' was not found."),
+        path);
+    g_strfreev(parts);
+    return;
+  }
+
+  char *name = g_strdup(purple_unescape_filename(parts[2]));
+  g_strfreev(parts);
+
+  PurpleConversation *conv = purple_find_conversation_with_account(
+      PURPLE_CONV_TYPE_ANY, name, account);
+  if (!conv) {
+    /* The path doesn't tell if the logfile belongs to an IM or a chat,
+     * decide by the buddy list. */
+    PurpleChat *chat;
+    if (purple_find_buddy(account, name))
+      conv = purple_conversation_new(PURPLE_CONV_TYPE_IM, account, name);
+    else if ((chat = purple_blist_find_chat(account, name)))
+      joinChatForLogRecord(chat, name, offset);
+    else
+      LOG->error(_("Conversation of logfile '%s' was not found in the "
+            "buddy list."), path);
+  }
+  g_free(name);
+
+  if (!conv)
+    return;
+
+  int i = findConversation(conv);
+  if (i == -1)
+    return;
+
+  conversations[i].conv->showLogRecord(offset);
+  activateConversation(i);
+}
+
+void Conversations::joinChatForLogRecord(PurpleChat *chat,
+    const char *name, gint64 offset)
+{
+  PurpleAccount *account = purple_chat_get_account(chat);
+  PurpleConnection *gc = purple_account_get_connection(account);
+  if (!gc || !purple_account_is_connected(account)) {
+    LOG->error(_("Chat '%s' can't be joined because account '%s' is not "
+          "connected."), name, purple_account_get_username(account));
+    return;
+  }
+
+  // the record is shown when the chat conversation is created
+  g_free(pending_record_name);
+  pending_record_account = account;
+  pending_record_name = g_strdup(name);
+  pending_record_offset = offset;
+
+  serv_join_chat(gc, purple_chat_get_components(chat));
+}
+
 Conversations::Conversations()
 : FreeWindow(0, 0, 80, 1, TYPE_NON_FOCUSABLE)
-, active(-1)
+, active(-1), pending_record_account(NULL), pending_record_name(NULL)
+, pending_record_offset(-1)
 {
   setColorScheme("conversation");
 
+  conversations_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  char *path = g_build_filename(purple_user_dir(), "chistory", "global",
+      NULL);
+  input_history = new InputHistory(path, GLOBAL_INPUT_HISTORY_SIZE);
+  g_free(path);
+
   outer_list = new CppConsUI::HorizontalListBox(AUTOSIZE, 1);
   addWidget(*outer_list, 0, 0);
 
@@ -116,6 +223,8 @@ Conversations::Conversations()
   purple_prefs_add_int(CONF_PREFIX "/chat/partitioning", 80);
   purple_prefs_add_int(CONF_PREFIX "/chat/roomlist_partitioning", 80);
   purple_prefs_add_bool(CONF_PREFIX "/chat/beep_on_msg", false);
+  // in minutes, 0 disables hibernation
+  purple_prefs_add_int(CONF_PREFIX "/chat/hibernate_timeout", 30);
 
   // send_typing caching
   send_typing = purple_prefs_get_bool("/purple/conversations/im/send_typing");
@@ -148,10 +257,17 @@ Conversations::Conversations()
       PURPLE_CALLBACK(buddy_typing_), this);
   purple_signal_connect(handle, "buddy-typing-stopped", this,
       PURPLE_CALLBACK(buddy_typing_), this);
+  purple_signal_connect(handle, "conversation-updated", this,
+      PURPLE_CALLBACK(conversation_updated_), this);
+
+  hibernate_conn = COREMANAGER->timeoutConnect(sigc::mem_fun(this,
+        &Conversations::hibernateConversations), HIBERNATE_CHECK_INTERVAL);
 }
 
 Conversations::~Conversations()
 {
+  hibernate_conn.disconnect();
+
   // close all opened conversations
   while (conversations.size())
     purple_conversation_destroy(conversations.front().conv->getPurpleConversation());
@@ -159,6 +275,10 @@ Conversations::~Conversations()
   purple_conversations_set_ui_ops(NULL);
   purple_prefs_disconnect_by_handle(this);
   purple_signals_disconnect_by_handle(this);
+
+  g_hash_table_destroy(conversations_index);
+  delete input_history;
+  g_free(pending_record_name);
 }
 
 void Conversations::init()
@@ -179,11 +299,8 @@ void Conversations::finalize()
 
 int Conversations::findConversation(PurpleConversation *conv)
 {
-  for (int i = 0; i < static_cast<int>(conversations.size()); i++)
-    if (conversations[i].conv->getPurpleConversation() == conv)
-      return i;
-
-  return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(conversations_index, conv))
+    - 1;
 }
 
 int Conversations::prevActiveConversation(int current)
@@ -235,6 +352,14 @@ void Conversations::activateConversation(int i)
     // show a new active conversation
     conversations[i].label->setVisibility(true);
     conversations[i].label->setColorScheme("conversation-active");
+    if (conversations[i].unread) {
+      // the conversation was read, it doesn't wait in the queue anymore
+      PurpleConversation *conv =
+        conversations[i].conv->getPurpleConversation();
+      activity.erase(std::remove(activity.begin(), activity.end(), conv),
+          activity.end());
+      conversations[i].unread = false;
+    }
     conversations[i].conv->show();
   }
 
@@ -247,6 +372,26 @@ void Conversations::activateConversation(int i)
   active = i;
 }
 
+bool Conversations::hibernateConversations()
+{
+  int timeout = purple_prefs_get_int(CONF_PREFIX "/chat/hibernate_timeout");
+  if (timeout <= 0)
+    return true;
+
+  time_t limit = time(NULL) - timeout * 60;
+  for (int i = 0; i < static_cast<int>(conversations.size()); i++) {
+    Conversation *conv = conversations[i].conv;
+    if (i == active || conv->isHibernated())
+      continue;
+
+    time_t hidden_time = conv->getHiddenTime();
+    if (hidden_time && hidden_time <= limit)
+      conv->hibernate();
+  }
+
+  return true;
+}
+
 void Conversations::updateLabel(int i)
 {
   g_assert(i >= 0);
@@ -259,11 +404,11 @@ void Conversations::updateLabel(int i)
   g_free(name);
 }
 
-void Conversations::updateLabels()
+void Conversations::updateLabels(int i)
 {
-  /* Note: This can be a little slow if there are too many opened
-   * conversations. */
-  for (int i = 0; i < static_cast<int>(conversations.size()); i++)
+  g_assert(i >= 0);
+
+  for (; i < static_cast<int>(conversations.size()); i++)
     updateLabel(i);
 }
 
@@ -287,9 +432,26 @@ void Conversations::create_conversation(PurpleConversation *conv)
   c.conv = conversation;
   c.label = new CppConsUI::Label(AUTOSIZE, 1);
   c.typing_status = ' ';
+  c.unread = false;
   conv_list->appendWidget(*c.label);
   conversations.push_back(c);
-  updateLabels();
+  g_hash_table_insert(conversations_index, conv,
+      GINT_TO_POINTER(conversations.size()));
+
+  // numbers of other conversations don't change
+  updateLabel(conversations.size() - 1);
+
+  // a chat that was joined to show a logfile record
+  if (pending_record_name && type == PURPLE_CONV_TYPE_CHAT
+      && purple_conversation_get_account(conv) == pending_record_account
+      && !strcmp(purple_normalize(pending_record_account,
+          purple_conversation_get_name(conv)), pending_record_name)) {
+    conversation->showLogRecord(pending_record_offset);
+    g_free(pending_record_name);
+    pending_record_name = NULL;
+    activateConversation(conversations.size() - 1);
+    return;
+  }
 
   // show the first conversation if there isn't any already
   if (active == -1)
@@ -319,16 +481,28 @@ void Conversations::destroy_conversation(PurpleConversation *conv)
     }
   }
 
+  /* Forget the conversation in the activity queue, a new conversation can
+   * later be allocated at the same address. */
+  activity.erase(std::remove(activity.begin(), activity.end(), conv),
+      activity.end());
+
   delete conversations[i].conv;
   conv_list->removeWidget(*conversations[i].label);
   conversations.erase(conversations.begin() + i);
 
+  // conversations after the removed one move by one position
+  g_hash_table_remove(conversations_index, conv);
+  for (int j = i; j < static_cast<int>(conversations.size()); j++)
+    g_hash_table_insert(conversations_index,
+        conversations[j].conv->getPurpleConversation(),
+        GINT_TO_POINTER(j + 1));
+
   if (active > i) {
     // fix up the number of the active conversation
     active--;
   }
 
-  updateLabels();
+  updateLabels(i);
 }
 
 void Conversations::write_conv(PurpleConversation *conv, const char *name,
@@ -343,8 +517,11 @@ void Conversations::write_conv(PurpleConversation *conv, const char *name,
   if (i == -1)
     return;
 
-  if (i != active)
+  if (i != active && !conversations[i].unread) {
     conversations[i].label->setColorScheme("conversation-new");
+    conversations[i].unread = true;
+    activity.push_back(conv);
+  }
 
   // delegate it to Conversation object
   conversations[i].conv->write(name, alias, message, flags, mtime);
@@ -432,6 +609,17 @@ void Conversations::buddy_typing(PurpleAccount *account, const char *who)
   updateLabel(i);
 }
 
+void Conversations::conversation_updated(PurpleConversation *conv,
+    PurpleConvUpdateType type)
+{
+  if (type != PURPLE_CONV_UPDATE_TITLE)
+    return;
+
+  int i = findConversation(conv);
+  if (i != -1)
+    updateLabel(i);
+}
+
 void Conversations::send_typing_pref_change(const char *name,
     PurplePrefType /*type*/, gconstpointer /*val*/)
 {
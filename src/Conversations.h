@@ -23,12 +23,14 @@
 #define __CONVERSATIONS_H__
 
 #include "Conversation.h"
+#include "InputHistory.h"
 
 #include <cppconsui/FreeWindow.h>
 #include <cppconsui/HorizontalListBox.h>
 #include <cppconsui/Label.h>
 #include <cppconsui/Spacer.h>
 #include <libpurple/purple.h>
+#include <deque>
 #include <vector>
 
 #define CONVERSATIONS (Conversations::instance())
@@ -46,11 +48,28 @@ public:
   void focusConversation(int i);
   void focusPrevConversation();
   void focusNextConversation();
+  /**
+   * Focuses the conversation that received a new message first among all
+   * conversations with unread messages.
+   */
+  void focusNextNewConversation();
 
   void setExpandedConversations(bool expanded);
 
+  /**
+   * Opens the conversation that belongs to a logfile and scrolls it to
+   * a message at a given offset in the logfile. The path is relative to the
+   * logs directory.
+   */
+  void showLogRecord(const char *path, gint64 offset);
+
   bool getSendTypingPref() const { return send_typing; }
 
+  /**
+   * Returns the history of inputs sent in all conversations.
+   */
+  InputHistory *getInputHistory() const { return input_history; }
+
 protected:
 
 private:
@@ -59,12 +78,25 @@ private:
     Conversation *conv;
     CppConsUI::Label *label;
     char typing_status;
+    // the conversation has messages that weren't seen yet
+    bool unread;
   };
 
   typedef std::vector<ConvChild> ConversationsVector;
+  typedef std::deque<PurpleConversation*> ActivityQueue;
 
   ConversationsVector conversations;
 
+  // maps a PurpleConversation to its position in conversations + 1
+  GHashTable *conversations_index;
+
+  /**
+   * Conversations in the order they received unread messages. A
+   * conversation is in the queue exactly while its unread flag is set, it is
+   * removed when it is activated or destroyed.
+   */
+  ActivityQueue activity;
+
   // active conversation, -1 if none
   int active;
 
@@ -76,6 +108,16 @@ private:
   // cached value of the "/purple/conversations/im/send_typing" pref
   bool send_typing;
 
+  sigc::connection hibernate_conn;
+
+  InputHistory *input_history;
+
+  /* Logfile record that is shown when a chat that was joined because of it
+   * opens its conversation. */
+  PurpleAccount *pending_record_account;
+  char *pending_record_name;
+  gint64 pending_record_offset;
+
   PurpleConversationUiOps centerim_conv_ui_ops;
 
   static Conversations *my_instance;
@@ -97,10 +139,23 @@ private:
 
   void activateConversation(int i);
 
+  /**
+   * Joins a chat from the buddy list so a logfile record of it can be
+   * shown once its conversation is opened.
+   */
+  void joinChatForLogRecord(PurpleChat *chat, const char *name,
+      gint64 offset);
+
+  /**
+   * Hibernates conversations that have been hidden for longer than the
+   * "/chat/hibernate_timeout" pref.
+   */
+  bool hibernateConversations();
+
   // update a single conversation label
   void updateLabel(int i);
-  // update all conversation labels
-  void updateLabels();
+  // update labels of conversations from i to the end
+  void updateLabels(int i);
 
   static void create_conversation_(PurpleConversation *conv)
     { CONVERSATIONS->create_conversation(conv); }
@@ -146,6 +201,13 @@ private:
     { reinterpret_cast<Conversations*>(data)->buddy_typing(account, who); }
   void buddy_typing(PurpleAccount *account, const char *who);
 
+  static void conversation_updated_(PurpleConversation *conv,
+      PurpleConvUpdateType type, gpointer data)
+    { reinterpret_cast<Conversations*>(data)->conversation_updated(conv,
+        type); }
+  void conversation_updated(PurpleConversation *conv,
+      PurpleConvUpdateType type);
+
   // called when "/purple/conversations/im/send_typing" pref is changed
   static void send_typing_pref_change_(const char *name, PurplePrefType type,
       gconstpointer val, gpointer data)
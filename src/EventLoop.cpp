@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "EventLoop.h"
+
+#include <cppconsui/CoreManager.h>
+
+#include <algorithm>
+
+#define PURPLE_GLIB_READ_COND  (G_IO_IN | G_IO_HUP | G_IO_ERR)
+#define PURPLE_GLIB_WRITE_COND (G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL)
+
+GSourceFuncs EventLoop::source_funcs = {
+  prepare_,
+  check_,
+  dispatch_,
+  NULL,
+  NULL,
+  NULL
+};
+
+EventLoop *EventLoop::my_instance = NULL;
+
+EventLoop *EventLoop::instance()
+{
+  return my_instance;
+}
+
+guint EventLoop::inputAdd(int fd, PurpleInputCondition condition,
+    PurpleInputFunction function, gpointer data)
+{
+  g_assert(fd >= 0);
+  g_assert(function);
+
+  // handles are never 0 and never reused while a watch is alive
+  do
+    last_handle++;
+  while (!last_handle || watches.find(last_handle) != watches.end());
+
+  Watch& watch = watches[last_handle];
+  watch.fd = fd;
+  watch.condition = condition;
+  watch.function = function;
+  watch.data = data;
+  stats.watches++;
+
+  Registration *reg;
+  Registrations::iterator i = registrations.find(fd);
+  if (i != registrations.end())
+    reg = i->second;
+  else {
+    reg = new Registration;
+    reg->pollfd.fd = fd;
+    reg->pollfd.events = 0;
+    reg->pollfd.revents = 0;
+    reg->polled = false;
+    registrations[fd] = reg;
+  }
+  reg->handles.push_back(last_handle);
+  updateRegistration(*reg);
+
+  return last_handle;
+}
+
+bool EventLoop::inputRemove(guint handle)
+{
+  Watches::iterator i = watches.find(handle);
+  if (i == watches.end())
+    return false;
+
+  Registration *reg = registrations[i->second.fd];
+  reg->handles.erase(std::find(reg->handles.begin(), reg->handles.end(),
+        handle));
+  watches.erase(i);
+  stats.watches--;
+
+  updateRegistration(*reg);
+  return true;
+}
+
+guint EventLoop::timeoutAdd(guint interval, GSourceFunc function,
+    gpointer data)
+{
+  return addTimeout(interval, false, function, data);
+}
+
+guint EventLoop::timeoutAddSeconds(guint interval, GSourceFunc function,
+    gpointer data)
+{
+  return addTimeout(interval, true, function, data);
+}
+
+bool EventLoop::timeoutRemove(guint handle)
+{
+  Timeouts::iterator i = timeouts.find(handle);
+  if (i == timeouts.end())
+    return false;
+
+  Timeout *timeout = i->second;
+  timeouts.erase(i);
+  stats.timeouts--;
+
+  if (timeout->linked) {
+    unlinkTimeout(*timeout);
+    delete timeout;
+  }
+  else {
+    // the timeout is expired and waiting in dispatch() which frees it
+    timeout->removed = true;
+  }
+  return true;
+}
+
+EventLoop::EventLoop()
+: last_handle(0), last_timeout_handle(0), due(NULL), wheel_time(0),
+  next_expiry(G_MAXINT64), rate_start(0), rate_dispatches(0),
+  wakeup_rate_start(0), rate_wakeups(0)
+{
+  stats.fds = 0;
+  stats.max_fds = 0;
+  stats.watches = 0;
+  stats.dispatches = 0;
+  stats.dispatch_rate = 0;
+  stats.max_dispatch_rate = 0;
+  stats.timeouts = 0;
+  stats.timeout_dispatches = 0;
+  stats.wakeups = 0;
+  stats.wakeup_rate = 0;
+  stats.max_wakeup_rate = 0;
+
+  for (int i = 0; i < WHEEL_LEVELS; i++) {
+    for (int j = 0; j < WHEEL_FIRST_SIZE; j++)
+      wheel[i][j] = NULL;
+    wheel_counts[i] = 0;
+  }
+
+  start_time = CppConsUI::CoreManager::getMonotonicTime();
+  seconds_offset = g_random_int_range(0, G_USEC_PER_SEC);
+
+  source = reinterpret_cast<Source*>(g_source_new(&source_funcs,
+        sizeof(Source)));
+  source->loop = this;
+  g_source_attach(&source->source, NULL);
+}
+
+EventLoop::~EventLoop()
+{
+  g_source_destroy(&source->source);
+  g_source_unref(&source->source);
+
+  for (Registrations::iterator i = registrations.begin();
+      i != registrations.end(); i++)
+    delete i->second;
+  for (Timeouts::iterator i = timeouts.begin(); i != timeouts.end(); i++)
+    delete i->second;
+}
+
+void EventLoop::init()
+{
+  g_assert(!my_instance);
+
+  my_instance = new EventLoop;
+}
+
+void EventLoop::finalize()
+{
+  g_assert(my_instance);
+
+  delete my_instance;
+  my_instance = NULL;
+}
+
+void EventLoop::updateRegistration(Registration& reg)
+{
+  gushort events = 0;
+  for (Handles::iterator i = reg.handles.begin(); i != reg.handles.end();
+      i++) {
+    const Watch& watch = watches[*i];
+    if (watch.condition & PURPLE_INPUT_READ)
+      events |= PURPLE_GLIB_READ_COND;
+    if (watch.condition & PURPLE_INPUT_WRITE)
+      events |= PURPLE_GLIB_WRITE_COND;
+  }
+  reg.pollfd.events = events;
+
+  /* Only descriptors with some watches are polled, the descriptor can be
+   * closed once its watches are removed. */
+  if (events && !reg.polled) {
+    g_source_add_poll(&source->source, &reg.pollfd);
+    reg.polled = true;
+    stats.fds++;
+    stats.max_fds = MAX(stats.max_fds, stats.fds);
+  }
+  else if (!events && reg.polled) {
+    g_source_remove_poll(&source->source, &reg.pollfd);
+    reg.pollfd.revents = 0;
+    reg.polled = false;
+    stats.fds--;
+  }
+}
+
+guint EventLoop::addTimeout(guint interval, bool seconds,
+    GSourceFunc function, gpointer data)
+{
+  g_assert(function);
+
+  do
+    last_timeout_handle++;
+  while (!last_timeout_handle
+      || timeouts.find(last_timeout_handle) != timeouts.end());
+
+  Timeout *timeout = new Timeout;
+  timeout->handle = last_timeout_handle;
+  timeout->interval = interval;
+  timeout->seconds = seconds;
+  timeout->function = function;
+  timeout->data = data;
+  timeout->prev = NULL;
+  timeout->next = NULL;
+  timeout->level = 0;
+  timeout->slot = 0;
+  timeout->linked = false;
+  timeout->removed = false;
+  timeouts[last_timeout_handle] = timeout;
+  stats.timeouts++;
+
+  scheduleTimeout(*timeout, getTime());
+  return last_timeout_handle;
+}
+
+void EventLoop::scheduleTimeout(Timeout& timeout, gint64 now)
+{
+  gint64 expiration;
+  if (timeout.seconds) {
+    /* Round the expiration to a whole-second boundary the same way
+     * g_timeout_add_seconds() does. Rounding down is allowed by a quarter of
+     * a second. */
+    expiration = now + static_cast<gint64>(timeout.interval) * G_USEC_PER_SEC
+      - seconds_offset;
+    gint64 remainder = expiration % G_USEC_PER_SEC;
+    if (remainder >= G_USEC_PER_SEC / 4)
+      expiration += G_USEC_PER_SEC;
+    expiration += seconds_offset - remainder;
+  }
+  else
+    expiration = now + static_cast<gint64>(timeout.interval) * 1000;
+
+  // the wheel works with whole milliseconds, never expire too early
+  timeout.expires = (expiration + 999) / 1000;
+  linkTimeout(timeout);
+
+  if (next_expiry >= 0)
+    next_expiry = MIN(next_expiry, timeout.wheel_expires);
+}
+
+void EventLoop::linkTimeout(Timeout& timeout)
+{
+  timeout.prev = NULL;
+  timeout.linked = true;
+
+  // the wheel has already passed the expiration time
+  if (timeout.expires < wheel_time) {
+    timeout.wheel_expires = timeout.expires;
+    timeout.level = -1;
+    timeout.next = due;
+    if (due)
+      due->prev = &timeout;
+    due = &timeout;
+    return;
+  }
+
+  gint64 expires = timeout.expires;
+  gint64 delta = expires - wheel_time;
+
+  /* Timeouts beyond the range of the wheel are put into the last slot that
+   * is in the range. They are linked again when that slot expires. */
+  int range_bits = WHEEL_FIRST_BITS + (WHEEL_LEVELS - 1) * WHEEL_BITS;
+  if (delta >= G_GINT64_CONSTANT(1) << range_bits) {
+    delta = (G_GINT64_CONSTANT(1) << range_bits) - 1;
+    expires = wheel_time + delta;
+  }
+
+  int level = 0;
+  int slot = expires & (WHEEL_FIRST_SIZE - 1);
+  int bits = WHEEL_FIRST_BITS;
+  while (delta >= G_GINT64_CONSTANT(1) << bits) {
+    level++;
+    slot = (expires >> bits) & (WHEEL_SIZE - 1);
+    bits += WHEEL_BITS;
+  }
+
+  timeout.wheel_expires = expires;
+  timeout.level = level;
+  timeout.slot = slot;
+  timeout.next = wheel[level][slot];
+  if (timeout.next)
+    timeout.next->prev = &timeout;
+  wheel[level][slot] = &timeout;
+  wheel_counts[level]++;
+}
+
+void EventLoop::unlinkTimeout(Timeout& timeout)
+{
+  g_assert(timeout.linked);
+
+  if (timeout.prev)
+    timeout.prev->next = timeout.next;
+  else if (timeout.level < 0)
+    due = timeout.next;
+  else
+    wheel[timeout.level][timeout.slot] = timeout.next;
+  if (timeout.next)
+    timeout.next->prev = timeout.prev;
+  if (timeout.level >= 0)
+    wheel_counts[timeout.level]--;
+  timeout.linked = false;
+
+  if (timeout.wheel_expires <= next_expiry)
+    next_expiry = -1;
+}
+
+void EventLoop::cascade(int level, int slot)
+{
+  Timeout *timeout = wheel[level][slot];
+  wheel[level][slot] = NULL;
+  while (timeout) {
+    Timeout *next = timeout->next;
+    wheel_counts[level]--;
+    linkTimeout(*timeout);
+    timeout = next;
+  }
+}
+
+void EventLoop::advanceWheel(gint64 now)
+{
+  for (Timeout *timeout = due; timeout; timeout = timeout->next) {
+    timeout->linked = false;
+    expired.push_back(timeout);
+  }
+  due = NULL;
+
+  while (wheel_time <= now) {
+    int slot = wheel_time & (WHEEL_FIRST_SIZE - 1);
+
+    /* A revolution of the first level is complete, move timeouts from the
+     * next slot of the second level down, and so on. */
+    if (!slot) {
+      int bits = WHEEL_FIRST_BITS;
+      for (int level = 1; level < WHEEL_LEVELS; level++) {
+        int index = (wheel_time >> bits) & (WHEEL_SIZE - 1);
+        cascade(level, index);
+        if (index)
+          break;
+        bits += WHEEL_BITS;
+      }
+    }
+
+    Timeout *timeout = wheel[0][slot];
+    wheel[0][slot] = NULL;
+    while (timeout) {
+      Timeout *next = timeout->next;
+      wheel_counts[0]--;
+      timeout->linked = false;
+      if (timeout->expires > wheel_time) {
+        // the timeout was beyond the range of the wheel
+        linkTimeout(*timeout);
+      }
+      else
+        expired.push_back(timeout);
+      timeout = next;
+    }
+    wheel_time++;
+
+    /* Skip empty slots up to the next revolution of the lowest level that
+     * contains some timeouts. */
+    if (!wheel_counts[0]) {
+      int level = 1;
+      int bits = WHEEL_FIRST_BITS;
+      while (level < WHEEL_LEVELS && !wheel_counts[level]) {
+        level++;
+        bits += WHEEL_BITS;
+      }
+      if (level == WHEEL_LEVELS) {
+        wheel_time = now + 1;
+        break;
+      }
+      gint64 boundary = ((wheel_time + (G_GINT64_CONSTANT(1) << bits) - 1)
+          >> bits) << bits;
+      wheel_time = MIN(boundary, now + 1);
+    }
+  }
+
+  next_expiry = -1;
+}
+
+gint64 EventLoop::getNextExpiry()
+{
+  if (next_expiry >= 0)
+    return next_expiry;
+
+  gint64 min = G_MAXINT64;
+  for (Timeout *timeout = due; timeout; timeout = timeout->next)
+    min = MIN(min, timeout->wheel_expires);
+
+  /* The first non-empty slot of every level contains the earliest timeouts of
+   * that level. */
+  if (wheel_counts[0])
+    for (int i = 0; i < WHEEL_FIRST_SIZE; i++) {
+      Timeout *timeout = wheel[0][(wheel_time + i) & (WHEEL_FIRST_SIZE - 1)];
+      if (!timeout)
+        continue;
+      for (; timeout; timeout = timeout->next)
+        min = MIN(min, timeout->wheel_expires);
+      break;
+    }
+
+  int bits = WHEEL_FIRST_BITS;
+  for (int level = 1; level < WHEEL_LEVELS; level++) {
+    if (wheel_counts[level]) {
+      int current = (wheel_time >> bits) & (WHEEL_SIZE - 1);
+      /* The current slot is cascaded at the start of its period, after that
+       * it's cascaded again only after a whole revolution. */
+      int first = wheel_time & ((G_GINT64_CONSTANT(1) << bits) - 1) ? 1 : 0;
+      for (int i = first; i < first + WHEEL_SIZE; i++) {
+        Timeout *timeout = wheel[level][(current + i) & (WHEEL_SIZE - 1)];
+        if (!timeout)
+          continue;
+        for (; timeout; timeout = timeout->next)
+          min = MIN(min, timeout->wheel_expires);
+        break;
+      }
+    }
+    bits += WHEEL_BITS;
+  }
+
+  next_expiry = min;
+  return next_expiry;
+}
+
+gint64 EventLoop::getTime() const
+{
+  return CppConsUI::CoreManager::getMonotonicTime() - start_time;
+}
+
+void EventLoop::updateRate(gint64 now, gint64& start, unsigned& count,
+    unsigned& rate, unsigned& max_rate)
+{
+  if (!start)
+    start = now;
+  else if (now - start >= G_USEC_PER_SEC) {
+    rate = count * G_USEC_PER_SEC / (now - start);
+    max_rate = MAX(max_rate, rate);
+    start = now;
+    count = 0;
+  }
+}
+
+bool EventLoop::prepare(gint *timeout)
+{
+  gint64 next = getNextExpiry();
+  if (next == G_MAXINT64) {
+    *timeout = -1;
+    return false;
+  }
+
+  gint64 now = getTime() / 1000;
+  if (next <= now) {
+    *timeout = 0;
+    return true;
+  }
+
+  *timeout = MIN(next - now, G_MAXINT);
+  return false;
+}
+
+bool EventLoop::check()
+{
+  for (Registrations::iterator i = registrations.begin();
+      i != registrations.end(); i++)
+    if (i->second->polled
+        && (i->second->pollfd.revents & i->second->pollfd.events))
+      return true;
+
+  return getNextExpiry() <= getTime() / 1000;
+}
+
+void EventLoop::dispatch()
+{
+  /* Collect the ready watches first, the callbacks can add and remove watches
+   * and registrations. */
+  ready.clear();
+  for (Registrations::iterator i = registrations.begin();
+      i != registrations.end(); i++) {
+    Registration *reg = i->second;
+    if (!reg->polled || !(reg->pollfd.revents & reg->pollfd.events))
+      continue;
+
+    int cond = 0;
+    if (reg->pollfd.revents & PURPLE_GLIB_READ_COND)
+      cond |= PURPLE_INPUT_READ;
+    if (reg->pollfd.revents & PURPLE_GLIB_WRITE_COND)
+      cond |= PURPLE_INPUT_WRITE;
+    reg->pollfd.revents = 0;
+
+    for (Handles::iterator j = reg->handles.begin(); j != reg->handles.end();
+        j++) {
+      int watch_cond = cond & watches[*j].condition;
+      if (watch_cond)
+        ready.push_back(std::make_pair(*j,
+              static_cast<PurpleInputCondition>(watch_cond)));
+    }
+  }
+
+  for (ReadyWatches::iterator i = ready.begin(); i != ready.end(); i++) {
+    // skip watches removed by previous callbacks
+    Watches::iterator w = watches.find(i->first);
+    if (w == watches.end())
+      continue;
+
+    Watch watch = w->second;
+    watch.function(watch.data, watch.fd, i->second);
+    stats.dispatches++;
+    rate_dispatches++;
+  }
+
+  gint64 now = getTime();
+  if (!ready.empty())
+    updateRate(now, rate_start, rate_dispatches, stats.dispatch_rate,
+        stats.max_dispatch_rate);
+
+  if (getNextExpiry() > now / 1000)
+    return;
+
+  /* Unlink all expired timeouts before any of them runs, the callbacks can
+   * add and remove timeouts. */
+  expired.clear();
+  advanceWheel(now / 1000);
+  if (expired.empty())
+    return;
+
+  stats.wakeups++;
+  rate_wakeups++;
+  updateRate(now, wakeup_rate_start, rate_wakeups, stats.wakeup_rate,
+      stats.max_wakeup_rate);
+
+  for (ExpiredTimeouts::iterator i = expired.begin(); i != expired.end();
+      i++) {
+    Timeout *timeout = *i;
+    if (!timeout->removed) {
+      bool again = timeout->function(timeout->data);
+      stats.timeout_dispatches++;
+
+      if (!timeout->removed) {
+        if (again) {
+          scheduleTimeout(*timeout, now);
+          continue;
+        }
+        timeouts.erase(timeout->handle);
+        stats.timeouts--;
+      }
+    }
+    delete timeout;
+  }
+  expired.clear();
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include <libpurple/purple.h>
+
+#include <map>
+#include <vector>
+
+#define EVENTLOOP (EventLoop::instance())
+
+/**
+ * Backend of the libpurple event loop. All file descriptors and timeouts of
+ * libpurple are handled by a single GSource. The read and write watches of
+ * one file descriptor share its poll registration and timeouts are kept in
+ * a hierarchical timer wheel.
+ */
+class EventLoop
+{
+public:
+  struct Stats
+  {
+    // number of currently polled file descriptors
+    unsigned fds;
+    unsigned max_fds;
+    // number of watches
+    unsigned watches;
+    // number of invoked watch callbacks
+    unsigned long dispatches;
+    /**
+     * Dispatches per second, averaged over the last period of at least one
+     * second in which there was some activity.
+     */
+    unsigned dispatch_rate;
+    unsigned max_dispatch_rate;
+
+    // number of pending timeouts
+    unsigned timeouts;
+    // number of invoked timeout callbacks
+    unsigned long timeout_dispatches;
+    /**
+     * Number of times the main loop woke up to run expired timeouts, each
+     * wakeup can run several timeouts.
+     */
+    unsigned long wakeups;
+    // wakeups per second, averaged the same way as dispatch_rate
+    unsigned wakeup_rate;
+    unsigned max_wakeup_rate;
+  };
+
+  static EventLoop *instance();
+
+  /**
+   * Watches a file descriptor for a given condition, the function is called
+   * every time the condition is met. Returns a handle of the watch.
+   */
+  guint inputAdd(int fd, PurpleInputCondition condition,
+      PurpleInputFunction function, gpointer data);
+  /**
+   * Removes a watch. Returns false if there isn't any watch with a given
+   * handle.
+   */
+  bool inputRemove(guint handle);
+
+  /**
+   * Calls a function every interval milliseconds until it returns FALSE.
+   * Returns a handle of the timeout.
+   */
+  guint timeoutAdd(guint interval, GSourceFunc function, gpointer data);
+  /**
+   * Same as timeoutAdd() but the interval is in seconds. Such timeouts
+   * expire only at whole-second boundaries so all of them wake the program
+   * at once, the same as g_timeout_add_seconds().
+   */
+  guint timeoutAddSeconds(guint interval, GSourceFunc function,
+      gpointer data);
+  /**
+   * Removes a timeout. Returns false if there isn't any timeout with a given
+   * handle.
+   */
+  bool timeoutRemove(guint handle);
+
+  const Stats *getStats() const { return &stats; }
+
+protected:
+
+private:
+  struct Watch
+  {
+    int fd;
+    PurpleInputCondition condition;
+    PurpleInputFunction function;
+    gpointer data;
+  };
+
+  typedef std::vector<guint> Handles;
+
+  /**
+   * Poll registration of one file descriptor. It isn't freed when the last
+   * watch is removed because libpurple keeps adding and removing write
+   * watches on the same socket while it sends data.
+   */
+  struct Registration
+  {
+    GPollFD pollfd;
+    Handles handles;
+    bool polled;
+  };
+
+  /**
+   * A timeout is linked into a slot of the timer wheel. Times are measured in
+   * milliseconds since the start of the event loop.
+   */
+  struct Timeout
+  {
+    guint handle;
+    gint64 expires;
+    /**
+     * Time of the slot that the timeout is linked into. It's earlier than
+     * the expiration time if the timeout is beyond the range of the wheel.
+     */
+    gint64 wheel_expires;
+    guint interval;
+    bool seconds;
+    GSourceFunc function;
+    gpointer data;
+
+    // the timeout is linked into a slot, or it's expired
+    Timeout *prev;
+    Timeout *next;
+    int level;
+    int slot;
+    bool linked;
+    // the timeout was removed while it was expired
+    bool removed;
+  };
+
+  /**
+   * The first level of the wheel has one slot for every millisecond, each
+   * slot of the next levels covers a whole revolution of the previous level.
+   * Timeouts are moved (cascaded) to lower levels as the time advances.
+   */
+  enum {
+    WHEEL_LEVELS = 4,
+    WHEEL_FIRST_BITS = 8,
+    WHEEL_BITS = 6,
+    WHEEL_FIRST_SIZE = 1 << WHEEL_FIRST_BITS,
+    WHEEL_SIZE = 1 << WHEEL_BITS
+  };
+
+  struct Source
+  {
+    GSource source;
+    EventLoop *loop;
+  };
+
+  typedef std::map<guint, Watch> Watches;
+  typedef std::map<int, Registration*> Registrations;
+  typedef std::vector<std::pair<guint, PurpleInputCondition> > ReadyWatches;
+  typedef std::map<guint, Timeout*> Timeouts;
+  typedef std::vector<Timeout*> ExpiredTimeouts;
+
+  Source *source;
+  Watches watches;
+  Registrations registrations;
+  guint last_handle;
+  // buffer for watches that are ready to be dispatched, reused
+  ReadyWatches ready;
+
+  Timeouts timeouts;
+  guint last_timeout_handle;
+  // slots of all levels, the first level uses WHEEL_FIRST_SIZE slots
+  Timeout *wheel[WHEEL_LEVELS][WHEEL_FIRST_SIZE];
+  unsigned wheel_counts[WHEEL_LEVELS];
+  // timeouts that expire before the wheel time, they have the level -1
+  Timeout *due;
+  // start of the event loop in microseconds of the monotonic time
+  gint64 start_time;
+  // the next millisecond that the wheel processes
+  gint64 wheel_time;
+  /**
+   * Cached time of the earliest timeout, G_MAXINT64 if there is no timeout
+   * and -1 if the time has to be computed again.
+   */
+  gint64 next_expiry;
+  // offset of whole-second boundaries, randomized as in glib
+  gint64 seconds_offset;
+  // buffer for expired timeouts, reused
+  ExpiredTimeouts expired;
+
+  Stats stats;
+  gint64 rate_start;
+  unsigned rate_dispatches;
+  gint64 wakeup_rate_start;
+  unsigned rate_wakeups;
+
+  static GSourceFuncs source_funcs;
+
+  static EventLoop *my_instance;
+
+  EventLoop();
+  EventLoop(const EventLoop&);
+  EventLoop& operator=(const EventLoop&);
+  ~EventLoop();
+
+  static void init();
+  static void finalize();
+  friend class CenterIM;
+
+  void updateRegistration(Registration& reg);
+
+  guint addTimeout(guint interval, bool seconds, GSourceFunc function,
+      gpointer data);
+  void scheduleTimeout(Timeout& timeout, gint64 now);
+  void linkTimeout(Timeout& timeout);
+  void unlinkTimeout(Timeout& timeout);
+  void cascade(int level, int slot);
+  void advanceWheel(gint64 now);
+  gint64 getNextExpiry();
+  gint64 getTime() const;
+
+  static void updateRate(gint64 now, gint64& start, unsigned& count,
+      unsigned& rate, unsigned& max_rate);
+
+  bool prepare(gint *timeout);
+  bool check();
+  void dispatch();
+
+  static gboolean prepare_(GSource *source, gint *timeout)
+    { return reinterpret_cast<Source*>(source)->loop->prepare(timeout); }
+  static gboolean check_(GSource *source)
+    { return reinterpret_cast<Source*>(source)->loop->check(); }
+  static gboolean dispatch_(GSource *source, GSourceFunc /*callback*/,
+      gpointer /*user_data*/)
+    { reinterpret_cast<Source*>(source)->loop->dispatch(); return TRUE; }
+};
+
+#endif // __EVENTLOOP_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
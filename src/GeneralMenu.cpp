@@ -27,6 +27,8 @@
 #include "Log.h"
 #include "OptionWindow.h"
 #include "PluginWindow.h"
+#include "Search.h"
+#include "Transfers.h"
 
 #include "gettext.h"
 
@@ -47,10 +49,16 @@ GeneralMenu::GeneralMenu()
         &GeneralMenu::openAddGroupRequest));
   appendItem(_("Pending requests..."), sigc::mem_fun(this,
         &GeneralMenu::openPendingRequests));
+  appendItem(_("File transfers..."), sigc::mem_fun(this,
+        &GeneralMenu::openTransferWindow));
+  appendItem(_("Search conversations..."), sigc::mem_fun(this,
+        &GeneralMenu::openSearchWindow));
   appendItem(_("Config options..."), sigc::mem_fun(this,
         &GeneralMenu::openOptionWindow));
   appendItem(_("Plugins..."), sigc::mem_fun(this,
         &GeneralMenu::openPluginWindow));
+  appendItem(_("Debug log filter..."), sigc::mem_fun(this,
+        &GeneralMenu::openLogFilterWindow));
   appendSeparator();
 #ifdef DEBUG
   MenuWindow *submenu = new MenuWindow(0, 0, AUTOSIZE, AUTOSIZE);
@@ -114,6 +122,18 @@ void GeneralMenu::openPendingRequests(CppConsUI::Button& /*activator*/)
   close();
 }
 
+void GeneralMenu::openTransferWindow(CppConsUI::Button& /*activator*/)
+{
+  TRANSFERS->openTransferWindow();
+  close();
+}
+
+void GeneralMenu::openSearchWindow(CppConsUI::Button& /*activator*/)
+{
+  SEARCH->openSearchWindow();
+  close();
+}
+
 void GeneralMenu::openOptionWindow(CppConsUI::Button& /*activator*/)
 {
   OptionWindow *win = new OptionWindow;
@@ -128,6 +148,12 @@ void GeneralMenu::openPluginWindow(CppConsUI::Button& /*activator*/)
   close();
 }
 
+void GeneralMenu::openLogFilterWindow(CppConsUI::Button& /*activator*/)
+{
+  LOG->openFilterWindow();
+  close();
+}
+
 #ifdef DEBUG
 void GeneralMenu::openRequestInputTest(CppConsUI::Button& /*activator*/)
 {
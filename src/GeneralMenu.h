@@ -48,8 +48,11 @@ private:
   void openAddChatRequest(CppConsUI::Button& activator);
   void openAddGroupRequest(CppConsUI::Button& activator);
   void openPendingRequests(CppConsUI::Button& activator);
+  void openTransferWindow(CppConsUI::Button& activator);
+  void openSearchWindow(CppConsUI::Button& activator);
   void openOptionWindow(CppConsUI::Button& activator);
   void openPluginWindow(CppConsUI::Button& activator);
+  void openLogFilterWindow(CppConsUI::Button& activator);
 
 #ifdef DEBUG
   void openRequestInputTest(CppConsUI::Button& activator);
@@ -165,7 +165,7 @@ void Header::account_status_changed(PurpleAccount *account,
         purple_account_get_protocol_name(account),
         purple_account_get_username(account));
   label->setText(text);
-  label->setWidth(CppConsUI::Curses::onscreen_width(text));
+  label->setWidth(label->getTextRun().getWidth());
   g_free(text);
 }
 
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "InputHistory.h"
+
+#include "Log.h"
+
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "gettext.h"
+
+// creates the directory of a given file
+static void create_dir(const char *filename)
+{
+  char *dir = g_path_get_dirname(filename);
+  if (g_mkdir_with_parents(dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1)
+    LOG->error(_("Error creating directory '%s'."), dir);
+  g_free(dir);
+}
+
+bool InputHistory::IndexLess::operator()(size_t a, size_t b) const
+{
+  int res = strcmp(history->entries[a - history->first],
+      history->entries[b - history->first]);
+  return res < 0 || (!res && a < b);
+}
+
+bool InputHistory::IndexLess::operator()(size_t a, const char *prefix) const
+{
+  return strcmp(history->entries[a - history->first], prefix) < 0;
+}
+
+InputHistory::InputHistory(const char *filename_, size_t capacity_)
+: capacity(capacity_), loaded(false), first(0), file_entries(0)
+{
+  g_assert(filename_);
+  g_assert(capacity > 0);
+
+  filename = g_strdup(filename_);
+}
+
+InputHistory::~InputHistory()
+{
+  for (Entries::iterator i = entries.begin(); i != entries.end(); i++)
+    g_free(*i);
+  g_free(filename);
+}
+
+void InputHistory::add(const char *text)
+{
+  g_assert(text);
+
+  load();
+
+  if (!entries.empty() && !strcmp(entries.back(), text))
+    return;
+
+  push(g_strdup(text));
+
+  // drop the old entries from the file once in a while
+  if (file_entries + 1 >= 2 * capacity)
+    save();
+  else
+    append(text);
+}
+
+size_t InputHistory::getBegin()
+{
+  load();
+  return first;
+}
+
+size_t InputHistory::getEnd()
+{
+  load();
+  return first + entries.size();
+}
+
+const char *InputHistory::getEntry(size_t pos)
+{
+  load();
+
+  if (pos < first || pos >= first + entries.size())
+    return NULL;
+  return entries[pos - first];
+}
+
+bool InputHistory::findPrefix(const char *prefix, size_t& pos, bool forward)
+{
+  g_assert(prefix);
+
+  load();
+
+  size_t end = first + entries.size();
+  size_t len = strlen(prefix);
+  if (!len) {
+    // every entry matches
+    if (forward) {
+      size_t next = MAX(pos + 1, first);
+      if (next >= end)
+        return false;
+      pos = next;
+    }
+    else {
+      size_t prev = MIN(pos, end);
+      if (prev <= first)
+        return false;
+      pos = prev - 1;
+    }
+    return true;
+  }
+
+  /* All entries with the prefix are next to each other in the index, pick
+   * the closest one to the current position. */
+  bool found = false;
+  size_t best = 0;
+  for (Index::iterator i = std::lower_bound(index.begin(), index.end(),
+        prefix, IndexLess(this)); i != index.end()
+      && !strncmp(entries[*i - first], prefix, len); i++) {
+    if (forward ? *i > pos && (!found || *i < best)
+        : *i < pos && (!found || *i > best)) {
+      best = *i;
+      found = true;
+    }
+  }
+
+  if (found)
+    pos = best;
+  return found;
+}
+
+bool InputHistory::findText(const char *text, size_t& pos)
+{
+  g_assert(text);
+
+  load();
+
+  for (size_t i = MIN(pos, first + entries.size()); i > first; i--)
+    if (strstr(entries[i - 1 - first], text)) {
+      pos = i - 1;
+      return true;
+    }
+  return false;
+}
+
+void InputHistory::load()
+{
+  if (loaded)
+    return;
+  loaded = true;
+
+  char *contents;
+  gsize length;
+  GError *err = NULL;
+  if (!g_file_get_contents(filename, &contents, &length, &err)) {
+    // the history doesn't exist until the first input is sent
+    if (!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      LOG->error(_("Error reading input history '%s' (%s)."), filename,
+          err->message);
+    g_clear_error(&err);
+    return;
+  }
+
+  const char *p = contents;
+  const char *end = contents + length;
+  while (p < end) {
+    const char *nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (!nl)
+      nl = end;
+    if (nl > p) {
+      entries.push_back(unescape(p, nl - p));
+      file_entries++;
+      if (entries.size() > capacity) {
+        g_free(entries.front());
+        entries.pop_front();
+        first++;
+      }
+    }
+    p = nl + 1;
+  }
+  g_free(contents);
+
+  index.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); i++)
+    index.push_back(first + i);
+  std::sort(index.begin(), index.end(), IndexLess(this));
+
+  if (file_entries >= 2 * capacity)
+    save();
+}
+
+void InputHistory::push(char *text)
+{
+  entries.push_back(text);
+  size_t pos = first + entries.size() - 1;
+  index.insert(std::upper_bound(index.begin(), index.end(), pos,
+        IndexLess(this)), pos);
+
+  if (entries.size() <= capacity)
+    return;
+
+  // drop the oldest entry
+  Index::iterator i = std::lower_bound(index.begin(), index.end(), first,
+      IndexLess(this));
+  g_assert(i != index.end() && *i == first);
+  index.erase(i);
+  g_free(entries.front());
+  entries.pop_front();
+  first++;
+}
+
+void InputHistory::save()
+{
+  GString *out = g_string_new(NULL);
+  for (Entries::iterator i = entries.begin(); i != entries.end(); i++) {
+    escape(*i, out);
+    g_string_append_c(out, '\n');
+  }
+
+  create_dir(filename);
+  GError *err = NULL;
+  if (g_file_set_contents(filename, out->str, out->len, &err))
+    file_entries = entries.size();
+  else {
+    LOG->error(_("Error writing input history '%s' (%s)."), filename,
+        err->message);
+    g_clear_error(&err);
+  }
+  g_string_free(out, TRUE);
+}
+
+void InputHistory::append(const char *text)
+{
+  GString *line = g_string_new(NULL);
+  escape(text, line);
+  g_string_append_c(line, '\n');
+
+  create_dir(filename);
+  int errsv = 0;
+  bool res = false;
+  FILE *f = g_fopen(filename, "a");
+  if (!f)
+    errsv = errno;
+  else {
+    res = fwrite(line->str, 1, line->len, f) == line->len;
+    errsv = errno;
+    if (fclose(f)) {
+      errsv = errno;
+      res = false;
+    }
+  }
+
+  if (res)
+    file_entries++;
+  else
+    LOG->error(_("Error writing input history '%s' (%s)."), filename,
+        g_strerror(errsv));
+  g_string_free(line, TRUE);
+}
+
+void InputHistory::escape(const char *text, GString *out)
+{
+  for (const char *p = text; *p; p++) {
+    if (*p == '\\')
+      g_string_append(out, "\\\\");
+    else if (*p == '\n')
+      g_string_append(out, "\\n");
+    else
+      g_string_append_c(out, *p);
+  }
+}
+
+char *InputHistory::unescape(const char *line, size_t len)
+{
+  GString *text = g_string_sized_new(len);
+  for (size_t i = 0; i < len; i++) {
+    if (line[i] == '\\' && i + 1 < len) {
+      i++;
+      g_string_append_c(text, line[i] == 'n' ? '\n' : line[i]);
+    }
+    else
+      g_string_append_c(text, line[i]);
+  }
+  return g_string_free(text, FALSE);
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
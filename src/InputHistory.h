@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __INPUTHISTORY_H__
+#define __INPUTHISTORY_H__
+
+#include <glib.h>
+
+#include <deque>
+#include <vector>
+
+/**
+ * Bounded history of sent inputs that is kept in a file. The file holds one
+ * entry per line, a newline in the entry is written as "\n" and a backslash
+ * as "\\". New entries are appended to the file and it is rewritten with
+ * only the kept entries when it grows to twice the capacity, so it works as
+ * a ring of at most the given number of entries.
+ *
+ * The file is read only when the history is used for the first time. Then
+ * all entries are kept in memory together with an index that has them
+ * sorted by their text for prefix searches.
+ *
+ * Entries are identified by sequence numbers that don't change when the
+ * oldest entries are dropped.
+ */
+class InputHistory
+{
+public:
+  InputHistory(const char *filename_, size_t capacity_);
+  ~InputHistory();
+
+  /**
+   * Appends an entry, it's ignored if it's the same as the newest one.
+   */
+  void add(const char *text);
+
+  /**
+   * Returns the sequence number of the oldest entry.
+   */
+  size_t getBegin();
+  /**
+   * Returns the sequence number that the next entry will get.
+   */
+  size_t getEnd();
+  /**
+   * Returns the text of an entry, or NULL if the entry doesn't exist.
+   */
+  const char *getEntry(size_t pos);
+
+  /**
+   * Finds the newest entry before pos (or the oldest entry after pos if
+   * forward is true) that starts with a given prefix. Returns false if
+   * there isn't any such entry, pos is left untouched in such a case.
+   */
+  bool findPrefix(const char *prefix, size_t& pos, bool forward = false);
+  /**
+   * Finds the newest entry before pos that contains a given text.
+   */
+  bool findText(const char *text, size_t& pos);
+
+protected:
+
+private:
+  /**
+   * Orders sequence numbers of entries by the text of the entries, entries
+   * with the same text are ordered by their age.
+   */
+  struct IndexLess
+  {
+    const InputHistory *history;
+
+    IndexLess(const InputHistory *history_) : history(history_) {}
+    bool operator()(size_t a, size_t b) const;
+    bool operator()(size_t a, const char *prefix) const;
+  };
+
+  typedef std::deque<char*> Entries;
+  typedef std::vector<size_t> Index;
+
+  char *filename;
+  size_t capacity;
+  bool loaded;
+  // entries from the oldest one
+  Entries entries;
+  // sequence number of the first entry
+  size_t first;
+  // sequence numbers of all entries sorted by IndexLess
+  Index index;
+  // number of entries in the file, including the dropped ones
+  size_t file_entries;
+
+  InputHistory(const InputHistory&);
+  InputHistory& operator=(const InputHistory&);
+
+  void load();
+  void push(char *text);
+  void save();
+  void append(const char *text);
+
+  static void escape(const char *text, GString *out);
+  static char *unescape(const char *line, size_t len);
+};
+
+#endif // __INPUTHISTORY_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
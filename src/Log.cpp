@@ -22,9 +22,28 @@
 #include "Log.h"
 
 #include <cppconsui/HorizontalListBox.h>
+#include <cppconsui/ListBox.h>
 #include <cppconsui/Spacer.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "gettext.h"
 
+// size of the queue drained by the main thread, has to be a power of two
+#define QUEUE_SIZE 1024
+
+// number of records in the ring, has to be a power of two
+#define RING_SIZE 4096
+#define RING_MASK (RING_SIZE - 1)
+
+// number of records shown in the log window
+#define WINDOW_LINES 200
+
+// size of a chunk written to the logfile at once
+#define WRITER_BUFFER_SIZE (64 * 1024)
+
 Log *Log::my_instance = NULL;
 
 Log *Log::instance()
@@ -43,15 +62,15 @@ void Log::name(const char *fmt, ...)                    \
   va_list args;                                         \
   char *text;                                           \
                                                         \
-  if (getLogLevel("cim") < level)                       \
+  int category = type_categories[TYPE_CIM];             \
+  if (!isEnabled(category, level))                      \
     return; /* we don't want to see this log message */ \
                                                         \
   va_start(args, fmt);                                  \
   text = g_strdup_vprintf(fmt, args);                   \
   va_end(args);                                         \
                                                         \
-  write(text);                                          \
-  g_free(text);                                         \
+  write(category, level, text);                         \
 }
 
 WRITE_METHOD(error, LEVEL_ERROR)
@@ -65,10 +84,37 @@ WRITE_METHOD(debug, LEVEL_DEBUG)
 
 Log::Log()
 : Window(0, 0, 80, 24, NULL, TYPE_NON_FOCUSABLE)
-, logfile(NULL)
+, queue(QUEUE_SIZE), drain_pending(0), ring_head(0), ring_tail(0)
+, dropped(0), dropped_total(0), window_pos(0), filter_level(LEVEL_DEBUG)
+, filter_category(-1), categories_num(0), debug_enabled(false), writer(NULL)
+, writer_sleeping(0), writer_stop(0), writer_error(0), logfd(-1)
 {
   setColorScheme("log");
 
+  ring = g_new0(Record*, RING_SIZE);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  writer_mutex = g_new(GMutex, 1);
+  g_mutex_init(writer_mutex);
+  writer_cond = g_new(GCond, 1);
+  g_cond_init(writer_cond);
+  category_mutex = g_new(GMutex, 1);
+  g_mutex_init(category_mutex);
+#else
+  writer_mutex = g_mutex_new();
+  writer_cond = g_cond_new();
+  category_mutex = g_mutex_new();
+#endif // GLIB_CHECK_VERSION(2, 32, 0)
+
+  // intern default categories, everything is disabled until prefs are read
+  memset(category_slots, 0, sizeof(category_slots));
+  for (int i = 0; i < TYPE_NUM; i++)
+    type_levels[i] = LEVEL_NONE;
+  type_categories[TYPE_CIM] = getCategory(TYPE_CIM, "centerim");
+  type_categories[TYPE_GLIB] = getCategory(TYPE_GLIB, "g_log");
+  type_categories[TYPE_PURPLE] = getCategory(TYPE_PURPLE, "misc");
+  type_categories[TYPE_CPPCONSUI] = getCategory(TYPE_CPPCONSUI,
+      "cppconsui");
+
   memset(&centerim_debug_ui_ops, 0, sizeof(centerim_debug_ui_ops));
 
   CppConsUI::HorizontalListBox *lbox = new CppConsUI::HorizontalListBox(
@@ -101,10 +147,16 @@ Log::Log()
   purple_prefs_add_string(CONF_PREFIX "/log/log_level_cppconsui", "warning");
   purple_prefs_add_string(CONF_PREFIX "/log/log_level_purple", "critical");
   purple_prefs_add_string(CONF_PREFIX "/log/log_level_glib", "warning");
+  purple_prefs_add_string(CONF_PREFIX "/log/log_level_categories", "");
+
+  // cache the prefs, they are checked for every message
+  updateLogLevels();
+  debug_enabled = purple_prefs_get_bool(CONF_PREFIX "/log/debug");
+  if (debug_enabled)
+    startWriter();
 
   // connect callbacks
-  purple_prefs_connect_callback(this, CONF_PREFIX "/log/debug", debug_change_,
-      this);
+  purple_prefs_connect_callback(this, CONF_PREFIX "/log", log_change_, this);
 
   // set the purple debug callbacks
   centerim_debug_ui_ops.print = purple_print_;
@@ -125,8 +177,32 @@ Log::~Log()
 
   purple_prefs_disconnect_by_handle(this);
 
-  if (logfile)
-    g_io_channel_unref(logfile);
+  // move the last records to the logfile
+  g_idle_remove_by_data(this);
+  gpointer record;
+  while ((record = queue.pop()))
+    store(static_cast<Record*>(record));
+  stopWriter();
+
+  for (int i = 0; i < RING_SIZE; i++)
+    freeRecord(ring[i]);
+  g_free(ring);
+
+  for (int i = 0; i < categories_num; i++)
+    g_free(categories[i].name);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  g_mutex_clear(writer_mutex);
+  g_free(writer_mutex);
+  g_cond_clear(writer_cond);
+  g_free(writer_cond);
+  g_mutex_clear(category_mutex);
+  g_free(category_mutex);
+#else
+  g_mutex_free(writer_mutex);
+  g_cond_free(writer_cond);
+  g_mutex_free(category_mutex);
+#endif // GLIB_CHECK_VERSION(2, 32, 0)
 }
 
 void Log::init()
@@ -145,10 +221,67 @@ void Log::finalize()
   my_instance = NULL;
 }
 
+void Log::openFilterWindow()
+{
+  FilterWindow *win = new FilterWindow;
+  win->show();
+}
+
+Log::FilterWindow::FilterWindow()
+: SplitDialog(0, 0, 80, 24, _("Debug log filter"))
+{
+  setColorScheme("generalwindow");
+
+  CppConsUI::ListBox *list = new CppConsUI::ListBox(AUTOSIZE, AUTOSIZE);
+  setContainer(*list);
+
+  level_combo = new CppConsUI::ComboBox(_("Show messages up to level"));
+  level_combo->addOption(_("Error"), LEVEL_ERROR);
+  level_combo->addOption(_("Critical"), LEVEL_CRITICAL);
+  level_combo->addOption(_("Warning"), LEVEL_WARNING);
+  level_combo->addOption(_("Message"), LEVEL_MESSAGE);
+  level_combo->addOption(_("Info"), LEVEL_INFO);
+  level_combo->addOption(_("Debug"), LEVEL_DEBUG);
+  level_combo->setSelectedByData(LOG->filter_level);
+  level_combo->signal_selection_changed.connect(sigc::mem_fun(this,
+        &FilterWindow::onFilterChanged));
+  list->appendWidget(*level_combo);
+
+  // categories seen so far
+  category_combo = new CppConsUI::ComboBox(_("Category"));
+  category_combo->addOption(_("All"), -1);
+  int num = g_atomic_int_get(&LOG->categories_num);
+  for (int i = 0; i < num; i++)
+    category_combo->addOption(LOG->categories[i].name, i);
+  category_combo->setSelectedByData(LOG->filter_category);
+  category_combo->signal_selection_changed.connect(sigc::mem_fun(this,
+        &FilterWindow::onFilterChanged));
+  list->appendWidget(*category_combo);
+
+  buttons->appendItem(_("Done"), sigc::hide(sigc::mem_fun(this,
+          &FilterWindow::close)));
+}
+
+void Log::FilterWindow::onScreenResized()
+{
+  moveResizeRect(CENTERIM->getScreenArea(CenterIM::CHAT_AREA));
+}
+
+void Log::FilterWindow::onFilterChanged(
+    CppConsUI::ComboBox& /*activator*/, int /*new_entry*/,
+    const char * /*title*/, intptr_t /*data*/)
+{
+  LOG->setFilter(static_cast<Level>(level_combo->getSelectedData()),
+      category_combo->getSelectedData());
+}
+
 void Log::purple_print(PurpleDebugLevel purplelevel, const char *category,
     const char *arg_s)
 {
-  if (getLogLevel("purple") < convertPurpleDebugLevel(purplelevel))
+  Level level = convertPurpleDebugLevel(purplelevel);
+  int id = category ? getCategory(TYPE_PURPLE, category)
+    : type_categories[TYPE_PURPLE];
+  if (!isEnabled(id, level))
     return; // we don't want to see this log message
 
   if (!category) {
@@ -157,91 +290,405 @@ void Log::purple_print(PurpleDebugLevel purplelevel, const char *category,
          "not defined."));
   }
 
-  char *text = g_strdup_printf("libpurple/%s: %s", category, arg_s);
-  write(text);
-  g_free(text);
+  write(id, level, g_strdup_printf("libpurple/%s: %s", category, arg_s));
 }
 
 gboolean Log::is_enabled(PurpleDebugLevel purplelevel,
-    const char * /*category*/)
+    const char *category)
 {
-  Level level = convertPurpleDebugLevel(purplelevel);
-
-  if (getLogLevel("purple") < level)
-    return FALSE;
+  int id = category ? getCategory(TYPE_PURPLE, category)
+    : type_categories[TYPE_PURPLE];
 
-  return TRUE;
+  return isEnabled(id, convertPurpleDebugLevel(purplelevel));
 }
 
 void Log::default_log_handler(const char *domain, GLogLevelFlags flags,
   const char *msg)
 {
-  if (getLogLevel("glib") < convertGlibDebugLevel(flags))
+  if (!domain)
+    domain = "g_log";
+
+  Level level = convertGlibDebugLevel(flags);
+  int category = getCategory(TYPE_GLIB, domain);
+  if (!isEnabled(category, level))
     return; // we don't want to see this log message
 
   if (!msg)
     return;
 
-  char *text = g_strdup_printf("%s: %s", domain ? domain : "g_log", msg);
-  write(text);
-  g_free(text);
+  write(category, level, g_strdup_printf("%s: %s", domain, msg));
 }
 
 void Log::glib_log_handler(const char *domain, GLogLevelFlags flags,
   const char *msg)
 {
-  if (getLogLevel("glib") < convertGlibDebugLevel(flags))
+  if (!domain)
+    domain = "g_log";
+
+  Level level = convertGlibDebugLevel(flags);
+  int category = getCategory(TYPE_GLIB, domain);
+  if (!isEnabled(category, level))
     return; // we don't want to see this log message
 
   if (!msg)
     return;
 
-  char *text = g_strdup_printf("%s: %s", domain ? domain : "g_log", msg);
-  write(text);
-  g_free(text);
+  write(category, level, g_strdup_printf("%s: %s", domain, msg));
 }
 
 void Log::cppconsui_log_handler(const char *domain, GLogLevelFlags flags,
   const char *msg)
 {
-  if (getLogLevel("cppconsui") < convertGlibDebugLevel(flags))
+  if (!domain)
+    domain = "g_log";
+
+  Level level = convertGlibDebugLevel(flags);
+  int category = getCategory(TYPE_CPPCONSUI, domain);
+  if (!isEnabled(category, level))
     return; // we don't want to see this log message
 
   if (!msg)
     return;
 
-  char *text = g_strdup_printf("%s: %s", domain ? domain : "g_log", msg);
-  write(text);
-  g_free(text);
+  write(category, level, g_strdup_printf("%s: %s", domain, msg));
+}
+
+void Log::log_change(const char *name, PurplePrefType /*type*/,
+    gconstpointer /*val*/)
+{
+  if (!strcmp(name, CONF_PREFIX "/log/debug")) {
+    debug_enabled = purple_prefs_get_bool(CONF_PREFIX "/log/debug");
+    if (debug_enabled)
+      startWriter();
+    else
+      stopWriter();
+  }
+  else if (!strcmp(name, CONF_PREFIX "/log/filename")) {
+    // reopen the logfile
+    if (debug_enabled) {
+      stopWriter();
+      startWriter();
+    }
+  }
+  else
+    updateLogLevels();
 }
 
-void Log::debug_change(const char * /*name*/, PurplePrefType type,
-    gconstpointer val)
+void Log::writerRun()
 {
-  g_assert(type == PURPLE_PREF_BOOLEAN);
+  // note: this method runs in the file writer thread
+  GString *buffer = g_string_sized_new(WRITER_BUFFER_SIZE);
+  time_t stamp_time = 0;
+  char stamp[32] = "";
+
+  while (true) {
+    guint tail = g_atomic_int_get(&ring_tail);
+    guint head = g_atomic_int_get(&ring_head);
+
+    if (tail == head) {
+      if (g_atomic_int_get(&writer_stop))
+        break;
+
+      /* Sleep until a record is added. The producer signals the condition
+       * only if it sees the sleeping flag so the flag has to be set before
+       * the ring is checked again. */
+      g_mutex_lock(writer_mutex);
+      g_atomic_int_set(&writer_sleeping, 1);
+      while (static_cast<guint>(g_atomic_int_get(&ring_head)) == tail
+          && !g_atomic_int_get(&writer_stop))
+        g_cond_wait(writer_cond, writer_mutex);
+      g_atomic_int_set(&writer_sleeping, 0);
+      g_mutex_unlock(writer_mutex);
+      continue;
+    }
+
+    // collect as many records as possible to a single write
+    while (tail != head && buffer->len < WRITER_BUFFER_SIZE) {
+      const Record *record = ring[tail & RING_MASK];
+      if (record->written) {
+        tail++;
+        continue;
+      }
+
+      // the timestamp is formatted only once per second
+      if (record->time != stamp_time) {
+        struct tm local;
+        stamp_time = record->time;
+        if (localtime_r(&stamp_time, &local))
+          strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S ", &local);
+      }
+      g_string_append(buffer, stamp);
 
-  // debug was disabled so close logfile if it's opened
-  if (!*static_cast<const gboolean*>(val) && logfile) {
-    g_io_channel_unref(logfile);
-    logfile = NULL;
+      g_string_append(buffer, record->text);
+      // if necessary write missing EOL character
+      if (!buffer->len || buffer->str[buffer->len - 1] != '\n')
+        g_string_append_c(buffer, '\n');
+      tail++;
+    }
+
+    // the records are copied, their slots can be reused
+    g_atomic_int_set(&ring_tail, tail);
+
+    writeToFile(buffer->str, buffer->len);
+    g_string_truncate(buffer, 0);
+  }
+
+  g_string_free(buffer, TRUE);
+}
+
+bool Log::writeToFile(const char *data, size_t len)
+{
+  // note: this method runs in the file writer thread or with the writer mutex
+  size_t pos = 0;
+  while (pos < len) {
+    ssize_t res = ::write(logfd, data + pos, len - pos);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      g_atomic_int_set(&writer_error, errno);
+      return false;
+    }
+    pos += res;
   }
+  return true;
+}
+
+void Log::startWriter()
+{
+  if (writer)
+    return;
+
+  char *filename = g_build_filename(purple_user_dir(),
+      purple_prefs_get_string(CONF_PREFIX "/log/filename"), NULL);
+  int fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0666);
+  if (fd < 0) {
+    writeErrorToWindow(_("centerim/log: Error opening logfile '%s' (%s)."),
+        filename, g_strerror(errno));
+    g_free(filename);
+    return;
+  }
+  g_free(filename);
+
+  g_mutex_lock(writer_mutex);
+  logfd = fd;
+  g_mutex_unlock(writer_mutex);
+
+  // only messages logged from now on go to the file
+  g_atomic_int_set(&ring_tail, g_atomic_int_get(&ring_head));
+  g_atomic_int_set(&writer_stop, 0);
+
+  GError *err = NULL;
+#if GLIB_CHECK_VERSION(2, 34, 0)
+  writer = g_thread_try_new("log", writer_thread_, this, &err);
+#else
+  writer = g_thread_create(writer_thread_, this, TRUE, &err);
+#endif // GLIB_CHECK_VERSION(2, 34, 0)
+
+  if (!writer) {
+    writeErrorToWindow(_("centerim/log: Error creating logfile writer "
+          "thread (%s)."), err->message);
+    g_clear_error(&err);
+    g_mutex_lock(writer_mutex);
+    close(logfd);
+    logfd = -1;
+    g_mutex_unlock(writer_mutex);
+  }
+}
+
+void Log::stopWriter()
+{
+  if (!writer)
+    return;
+
+  // the writer flushes all remaining records before it exits
+  g_mutex_lock(writer_mutex);
+  g_atomic_int_set(&writer_stop, 1);
+  g_cond_signal(writer_cond);
+  g_mutex_unlock(writer_mutex);
+
+  g_thread_join(writer);
+  writer = NULL;
+
+  g_mutex_lock(writer_mutex);
+  close(logfd);
+  logfd = -1;
+  g_mutex_unlock(writer_mutex);
+}
+
+bool Log::push(Record *record)
+{
+  guint head = ring_head;
+
+  if (writer) {
+    if (!getRingSpace())
+      return false;
+  }
+  else {
+    // nobody consumes the records, the oldest ones are simply overwritten
+    g_atomic_int_set(&ring_tail, head);
+  }
+
+  // the slot isn't used by the writer anymore
+  freeRecord(ring[head & RING_MASK]);
+  ring[head & RING_MASK] = record;
+  g_atomic_int_set(&ring_head, head + 1);
+
+  // wake up the writer if it waits for records
+  if (g_atomic_int_get(&writer_sleeping)) {
+    g_mutex_lock(writer_mutex);
+    g_cond_signal(writer_cond);
+    g_mutex_unlock(writer_mutex);
+  }
+
+  return true;
+}
+
+guint Log::getRingSpace() const
+{
+  guint used = static_cast<guint>(ring_head)
+    - static_cast<guint>(g_atomic_int_get(&ring_tail));
+  return RING_SIZE - used;
+}
+
+void Log::render()
+{
+  int err = g_atomic_int_get(&writer_error);
+  if (err && g_atomic_int_compare_and_exchange(&writer_error, err, 0))
+    writeErrorToWindow(_("centerim/log: Error writing to logfile (%s)."),
+        g_strerror(err));
+
+  guint head = ring_head;
+  appendRecords(window_pos, head);
+  window_pos = head;
+
+  shortenWindowText();
+}
+
+void Log::appendRecords(guint start, guint end)
+{
+  // older records were overwritten already
+  if (end - start > RING_SIZE)
+    start = end - RING_SIZE;
+
+  /* Only the records that fit in the window are appended, older ones would
+   * be removed right away. Slots that weren't used yet are empty. */
+  guint first = end;
+  int lines = 0;
+  while (first != start && lines < WINDOW_LINES) {
+    first--;
+    const Record *record = ring[first & RING_MASK];
+    if (record && matchesFilter(*record))
+      lines++;
+  }
+
+  for (guint i = first; i != end; i++) {
+    const Record *record = ring[i & RING_MASK];
+    if (record && matchesFilter(*record))
+      textview->append(record->text);
+  }
+}
+
+bool Log::matchesFilter(const Record& record) const
+{
+  if (record.level > filter_level)
+    return false;
+  return filter_category < 0 || record.category == filter_category;
+}
+
+void Log::setFilter(Level level, int category)
+{
+  filter_level = level;
+  filter_category = category;
+
+  // rebuild the window from the whole ring, the texts are already formatted
+  textview->clear();
+  guint head = ring_head;
+  appendRecords(head - RING_SIZE, head);
+  window_pos = head;
 }
 
 void Log::shortenWindowText()
 {
   size_t lines_num = textview->getLinesNumber();
 
-  if (lines_num > 200) {
+  if (lines_num > WINDOW_LINES) {
     // remove 40 extra lines
-    textview->erase(0, lines_num - 200 + 40);
+    textview->erase(0, lines_num - WINDOW_LINES + 40);
   }
 }
 
-void Log::write(const char *text)
+void Log::drain()
 {
-  writeToFile(text);
-  textview->append(text);
-  shortenWindowText();
+  /* Clear the flag before the queue is emptied so a record added after the
+   * last pop() schedules a new drain. */
+  g_atomic_int_set(&drain_pending, 0);
+
+  // report lost messages as soon as there is a room for the report
+  int lost = g_atomic_int_get(&dropped);
+  if (lost && getRingSpace()
+      && g_atomic_int_compare_and_exchange(&dropped, lost, 0))
+    push(createRecord(type_categories[TYPE_CIM], LEVEL_WARNING,
+          g_strdup_printf(_("centerim/log: %d messages were dropped because "
+              "the log buffer was full."), lost)));
+
+  gpointer record;
+  while ((record = queue.pop()))
+    store(static_cast<Record*>(record));
+
+  render();
+}
+
+void Log::store(Record *record)
+{
+  if (!push(record)) {
+    freeRecord(record);
+    g_atomic_int_inc(&dropped);
+    g_atomic_int_inc(&dropped_total);
+  }
+}
+
+void Log::write(int category, Level level, char *text)
+{
+  // note: this method can run in any thread
+  Record *record = createRecord(category, level, text);
+
+  /* Fatal messages are written to the file right away, GLib and libpurple
+   * abort the program as soon as the log handler returns. */
+  if (level == LEVEL_ERROR)
+    writeRecordToFile(record);
+
+  if (!queue.push(record)) {
+    freeRecord(record);
+    g_atomic_int_inc(&dropped);
+    g_atomic_int_inc(&dropped_total);
+  }
+
+  // g_idle_add() is thread-safe, the drain runs in the main thread
+  if (g_atomic_int_compare_and_exchange(&drain_pending, 0, 1))
+    g_idle_add_full(G_PRIORITY_DEFAULT, drain_, this, NULL);
+}
+
+void Log::writeRecordToFile(Record *record)
+{
+  // note: this method can run in any thread
+  char stamp[32] = "";
+  struct tm local;
+  if (localtime_r(&record->time, &local))
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S ", &local);
+
+  size_t len = strlen(record->text);
+  bool eol = len && record->text[len - 1] == '\n';
+  char *line = g_strconcat(stamp, record->text, eol ? "" : "\n", NULL);
+
+  // the mutex keeps the logfile open while the line is written
+  g_mutex_lock(writer_mutex);
+  if (logfd >= 0) {
+    writeToFile(line, strlen(line));
+    // the file writer skips the record so it isn't written twice
+    record->written = true;
+  }
+  g_mutex_unlock(writer_mutex);
+  g_free(line);
 }
 
 void Log::writeErrorToWindow(const char *fmt, ...)
@@ -249,7 +696,7 @@ void Log::writeErrorToWindow(const char *fmt, ...)
   va_list args;
   char *text;
 
-  if (getLogLevel("cim") < LEVEL_ERROR)
+  if (!isEnabled(type_categories[TYPE_CIM], LEVEL_ERROR))
     return; // we don't want to see this log message
 
   va_start(args, fmt);
@@ -262,50 +709,24 @@ void Log::writeErrorToWindow(const char *fmt, ...)
   g_free(text);
 }
 
-void Log::writeToFile(const char *text)
+Log::Record *Log::createRecord(int category, Level level, char *text)
 {
-  g_return_if_fail(text);
-
-  GError *err = NULL;
-
-  if (purple_prefs_get_bool(CONF_PREFIX "/log/debug")) {
-    // open logfile if it isn't already opened
-    if (!logfile) {
-      char *filename = g_build_filename(purple_user_dir(),
-          purple_prefs_get_string(CONF_PREFIX "/log/filename"), NULL);
-      if (!(logfile = g_io_channel_new_file(filename, "a", &err))) {
-        writeErrorToWindow(
-            _("centerim/log: Error opening logfile '%s' (%s)."), filename,
-            err->message);
-        g_clear_error(&err);
-      }
-      g_free(filename);
-    }
+  Record *record = g_new(Record, 1);
+  record->time = time(NULL);
+  record->category = category;
+  record->level = level;
+  record->text = text;
+  record->written = false;
+  return record;
+}
 
-    // write text into logfile
-    if (logfile) {
-      if (g_io_channel_write_chars(logfile, text, -1, NULL, &err)
-          != G_IO_STATUS_NORMAL) {
-        writeErrorToWindow(_("centerim/log: Error writing to logfile (%s)."),
-            err->message);
-        g_clear_error(&err);
-      }
-      else {
-        // if necessary write missing EOL character
-        size_t len = strlen(text);
-        if (len && text[len - 1] != '\n') {
-          // ignore all errors
-          g_io_channel_write_chars(logfile, "\n", -1, NULL, NULL);
-        }
-      }
+void Log::freeRecord(Record *record)
+{
+  if (!record)
+    return;
 
-      if (g_io_channel_flush(logfile, &err) != G_IO_STATUS_NORMAL) {
-        writeErrorToWindow(_("centerim/log: Error flushing logfile (%s)."),
-            err->message);
-        g_clear_error(&err);
-      }
-    }
-  }
+  g_free(record->text);
+  g_free(record);
 }
 
 Log::Level Log::convertPurpleDebugLevel(PurpleDebugLevel purplelevel)
@@ -352,7 +773,118 @@ Log::Level Log::convertGlibDebugLevel(GLogLevelFlags gliblevel)
   return LEVEL_DEBUG;
 }
 
-Log::Level Log::getLogLevel(const char *type)
+int Log::getCategory(Type type, const char *name)
+{
+  // note: this method can run in any thread
+
+  // known categories are found without locking
+  int id = findCategory(type, name, NULL);
+  if (id >= 0)
+    return id;
+
+  g_mutex_lock(category_mutex);
+
+  // another thread could have added the category in the meantime
+  guint slot;
+  id = findCategory(type, name, &slot);
+  if (id < 0 && categories_num < CATEGORIES_MAX) {
+    id = categories_num;
+    Category *category = &categories[id];
+    if (type == TYPE_PURPLE) {
+      category->name = g_strdup_printf("libpurple/%s", name);
+      category->raw_name = category->name + strlen("libpurple/");
+    }
+    else {
+      category->name = g_strdup(name);
+      category->raw_name = category->name;
+    }
+    category->type = type;
+    category->level_mask = getLevelMask(*category);
+    g_atomic_int_set(&categories_num, id + 1);
+    // publish the category only after it is set up
+    g_atomic_int_set(&category_slots[slot], id + 1);
+  }
+  else if (id < 0) {
+    // too many categories, use the default one
+    id = type_categories[type];
+  }
+
+  g_mutex_unlock(category_mutex);
+
+  return id;
+}
+
+int Log::findCategory(Type type, const char *name, guint *slot) const
+{
+  /* The table has twice as many slots as there can be categories so there
+   * is always a free slot that ends the probing. */
+  guint i = (g_str_hash(name) + type) & (CATEGORY_SLOTS - 1);
+  gint value;
+  while ((value = g_atomic_int_get(&category_slots[i]))) {
+    const Category *category = &categories[value - 1];
+    if (category->type == type && !strcmp(category->raw_name, name))
+      return value - 1;
+    i = (i + 1) & (CATEGORY_SLOTS - 1);
+  }
+
+  if (slot)
+    *slot = i;
+  return -1;
+}
+
+gint Log::getLevelMask(const Category& category) const
+{
+  Level level = type_levels[category.type];
+  LevelOverrides::const_iterator i = level_overrides.find(category.name);
+  if (i != level_overrides.end())
+    level = i->second;
+
+  // all levels up to the selected one, LEVEL_NONE gives an empty mask
+  return (1 << (level + 1)) - 2;
+}
+
+void Log::updateLogLevels()
+{
+  /* Read the prefs before the mutex is locked, libpurple logs an error if
+   * a pref doesn't exist. */
+  Level levels[TYPE_NUM];
+  levels[TYPE_CIM] = readLogLevel("cim");
+  levels[TYPE_GLIB] = readLogLevel("glib");
+  levels[TYPE_PURPLE] = readLogLevel("purple");
+  levels[TYPE_CPPCONSUI] = readLogLevel("cppconsui");
+
+  // per-category levels in the "category=level, ..." form
+  LevelOverrides overrides;
+  const char *pref = CONF_PREFIX "/log/log_level_categories";
+  if (purple_prefs_exists(pref)) {
+    char **entries = g_strsplit(purple_prefs_get_string(pref), ",", 0);
+    for (char **entry = entries; *entry; entry++) {
+      char *eq = strchr(*entry, '=');
+      if (!eq)
+        continue;
+      *eq = '\0';
+      char *name = g_strstrip(*entry);
+      if (*name)
+        overrides[name] = parseLogLevel(g_strstrip(eq + 1));
+    }
+    g_strfreev(entries);
+  }
+
+  g_mutex_lock(category_mutex);
+
+  for (int i = 0; i < TYPE_NUM; i++)
+    type_levels[i] = levels[i];
+  level_overrides.swap(overrides);
+
+  // precompute the masks so the level check is a single bit test
+  for (int i = 0; i < categories_num; i++)
+    g_atomic_int_set(&categories[i].level_mask,
+        getLevelMask(categories[i]));
+
+  g_mutex_unlock(category_mutex);
+}
+
+Log::Level Log::readLogLevel(const char *type)
 {
   char *pref = g_strconcat(CONF_PREFIX "/log/log_level_", type, NULL);
   const char *slevel = "none";
@@ -360,6 +892,11 @@ Log::Level Log::getLogLevel(const char *type)
     slevel = purple_prefs_get_string(pref);
   g_free(pref);
 
+  return parseLogLevel(slevel);
+}
+
+Log::Level Log::parseLogLevel(const char *slevel) const
+{
   Level level;
   if (!g_ascii_strcasecmp(slevel, "none"))
     level = LEVEL_NONE;
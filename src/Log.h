@@ -23,11 +23,17 @@
 #define __LOG_H__
 
 #include "CenterIM.h"
+#include "LogQueue.h"
 
+#include <cppconsui/ComboBox.h>
+#include <cppconsui/SplitDialog.h>
 #include <cppconsui/TextView.h>
 #include <cppconsui/Window.h>
 #include <libpurple/purple.h>
 
+#include <map>
+#include <string>
+
 #define LOG (Log::instance())
 
 class Log
@@ -57,18 +63,89 @@ public:
   void info(const char *fmt, ...) _attribute((format(printf, 2, 3)));
   void debug(const char *fmt, ...) _attribute((format(printf, 2, 3)));
 
+  /**
+   * Opens a window that selects which records are shown in the log window.
+   */
+  void openFilterWindow();
+
+  /**
+   * Returns the number of messages that were lost because the log queue or
+   * the log ring was full.
+   */
+  unsigned getDroppedCount() const
+    { return g_atomic_int_get(&dropped_total); }
+
 protected:
 
 private:
   enum Type {
     TYPE_CIM,
     TYPE_GLIB,
-    TYPE_PURPLE
+    TYPE_PURPLE,
+    TYPE_CPPCONSUI,
+    TYPE_NUM
   };
 
-  PurpleDebugUiOps centerim_debug_ui_ops;
+  /**
+   * Single log message. The text is formatted once when the record is
+   * created.
+   */
+  struct Record
+  {
+    time_t time;
+    int category;
+    Level level;
+    char *text;
+    // the record was already written to the logfile
+    bool written;
+  };
+
+  /**
+   * Interned log category, for example a libpurple debug category or a GLib
+   * log domain. Categories are never removed so a category ID is an index
+   * into the categories array.
+   */
+  struct Category
+  {
+    // name shown to the user, e.g. "libpurple/jabber"
+    char *name;
+    // name as passed by the caller, e.g. "jabber", points into name
+    const char *raw_name;
+    Type type;
+    // bit (1 << level) is set for every enabled level
+    volatile gint level_mask;
+  };
+
+  class FilterWindow
+  : public CppConsUI::SplitDialog
+  {
+  public:
+    FilterWindow();
+    virtual ~FilterWindow() {}
+
+    // FreeWindow
+    virtual void onScreenResized();
+
+  protected:
+
+  private:
+    CppConsUI::ComboBox *level_combo;
+    CppConsUI::ComboBox *category_combo;
+
+    FilterWindow(const FilterWindow&);
+    FilterWindow& operator=(const FilterWindow&);
+
+    void onFilterChanged(CppConsUI::ComboBox& activator, int new_entry,
+        const char *title, intptr_t data);
+  };
 
-  GIOChannel *logfile;
+  typedef std::map<std::string, Level> LevelOverrides;
+
+  static const int CATEGORIES_MAX = 256;
+  // size of the category lookup table, a power of two
+  static const int CATEGORY_SLOTS = 2 * CATEGORIES_MAX;
+
+  PurpleDebugUiOps centerim_debug_ui_ops;
 
   CppConsUI::TextView *textview;
 
@@ -79,6 +156,65 @@ private:
   guint gthread_handler;
   guint cppconsui_handler;
 
+  /**
+   * Records logged by any thread, drained by the main thread once per main
+   * loop iteration.
+   */
+  LogQueue queue;
+  volatile gint drain_pending;
+
+  /**
+   * Lock-free ring of log records. Records are added only by the main thread
+   * and consumed by the file writer thread. The main thread owns the records,
+   * a record is freed when its slot is reused so the ring keeps the recent
+   * history for the log window. Counters only grow, a slot index is the
+   * counter modulo the ring size.
+   */
+  Record **ring;
+  // number of records added to the ring
+  volatile gint ring_head;
+  // number of records consumed by the file writer
+  volatile gint ring_tail;
+  // records that didn't fit in the queue or the ring and weren't reported
+  volatile gint dropped;
+  volatile gint dropped_total;
+
+  // first record that isn't displayed in the window yet
+  guint window_pos;
+  // the window shows records up to this level from one or all categories
+  Level filter_level;
+  int filter_category;
+
+  /**
+   * Interned categories. New categories can be added by any thread, the
+   * mutex serializes the additions and protects the overrides. A category
+   * is set up completely before its ID is published in category_slots so
+   * lookups and the level masks don't need the lock.
+   */
+  Category categories[CATEGORIES_MAX];
+  volatile gint categories_num;
+  /* Open addressing table of category IDs + 1 hashed by the type and the
+   * raw name, zero marks an empty slot. Slots are only ever filled. */
+  volatile gint category_slots[CATEGORY_SLOTS];
+  GMutex *category_mutex;
+  // default category of every type
+  int type_categories[TYPE_NUM];
+
+  // cached prefs
+  bool debug_enabled;
+  Level type_levels[TYPE_NUM];
+  LevelOverrides level_overrides;
+
+  // file writer thread
+  GThread *writer;
+  GMutex *writer_mutex;
+  GCond *writer_cond;
+  volatile gint writer_sleeping;
+  volatile gint writer_stop;
+  // errno of the last failed write, reported by the main thread
+  volatile gint writer_error;
+  int logfd;
+
   static Log *my_instance;
 
   Log();
@@ -125,20 +261,77 @@ private:
   void cppconsui_log_handler(const char *domain, GLogLevelFlags flags,
       const char *msg);
 
-  // called when log/debug pref is changed
-  static void debug_change_(const char *name, PurplePrefType type,
+  // called when any of CONF_PREFIX/log prefs is changed
+  static void log_change_(const char *name, PurplePrefType type,
       gconstpointer val, gpointer data)
-    { reinterpret_cast<Log*>(data)->debug_change(name, type, val); }
-  void debug_change(const char *name, PurplePrefType type,
+    { reinterpret_cast<Log*>(data)->log_change(name, type, val); }
+  void log_change(const char *name, PurplePrefType type,
       gconstpointer val);
 
+  static gpointer writer_thread_(gpointer data)
+    { reinterpret_cast<Log*>(data)->writerRun(); return NULL; }
+  void writerRun();
+  bool writeToFile(const char *data, size_t len);
+  void startWriter();
+  void stopWriter();
+
+  /**
+   * Adds a record to the ring and takes ownership of it. Returns false if
+   * the ring is full.
+   */
+  bool push(Record *record);
+  guint getRingSpace() const;
+  void render();
+  /**
+   * Appends records from the <start, end) range of the ring that pass the
+   * filter to the window, at most WINDOW_LINES of the newest ones.
+   */
+  void appendRecords(guint start, guint end);
+  bool matchesFilter(const Record& record) const;
+  void setFilter(Level level, int category);
+
+  /**
+   * Moves all records from the queue to the ring and updates the window.
+   */
+  static gboolean drain_(gpointer data)
+    { reinterpret_cast<Log*>(data)->drain(); return FALSE; }
+  void drain();
+  void store(Record *record);
+
   void shortenWindowText();
-  void write(const char *text);
+  /**
+   * Logs a given text, the Log takes ownership of the text. This method can
+   * be called from any thread.
+   */
+  void write(int category, Level level, char *text);
+  /**
+   * Writes a record to the logfile immediately, without the file writer
+   * thread. This method can be called from any thread.
+   */
+  void writeRecordToFile(Record *record);
   void writeErrorToWindow(const char *fmt, ...);
-  void writeToFile(const char *text);
+  static Record *createRecord(int category, Level level, char *text);
+  static void freeRecord(Record *record);
   Level convertPurpleDebugLevel(PurpleDebugLevel purplelevel);
   Level convertGlibDebugLevel(GLogLevelFlags gliblevel);
-  Level getLogLevel(const char *type);
+
+  /**
+   * Returns an ID of a given category, the category is interned if it is
+   * seen for the first time. This method can be called from any thread.
+   */
+  int getCategory(Type type, const char *name);
+  /**
+   * Looks up an interned category without locking. Returns -1 if the
+   * category isn't known yet and sets slot to the first free slot where it
+   * belongs.
+   */
+  int findCategory(Type type, const char *name, guint *slot) const;
+  bool isEnabled(int category, Level level) const
+    { return categories[category].level_mask & (1 << level); }
+  gint getLevelMask(const Category& category) const;
+  Level parseLogLevel(const char *slevel) const;
+  Level readLogLevel(const char *type);
+  void updateLogLevels();
 };
 
 #endif // __LOG_H__
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "LogQueue.h"
+
+LogQueue::LogQueue(unsigned size)
+: mask(size - 1), push_pos(0), pop_pos(0)
+{
+  g_assert(size && !(size & (size - 1)));
+
+  cells = g_new(Cell, size);
+  for (guint i = 0; i < size; i++) {
+    // cell i is free for a producer at position i
+    cells[i].sequence = i;
+    cells[i].record = NULL;
+  }
+}
+
+LogQueue::~LogQueue()
+{
+  gpointer record;
+  while ((record = pop()))
+    g_free(record);
+  g_free(cells);
+}
+
+bool LogQueue::push(gpointer record)
+{
+  guint pos = g_atomic_int_get(&push_pos);
+  Cell *cell;
+
+  while (true) {
+    cell = &cells[pos & mask];
+    guint seq = g_atomic_int_get(&cell->sequence);
+    gint diff = static_cast<gint>(seq - pos);
+
+    if (!diff) {
+      // the cell is free, try to claim it
+      if (g_atomic_int_compare_and_exchange(&push_pos, pos, pos + 1))
+        break;
+      pos = g_atomic_int_get(&push_pos);
+    }
+    else if (diff < 0) {
+      // the cell still holds a record from the previous round
+      return false;
+    }
+    else {
+      // another producer claimed the cell first
+      pos = g_atomic_int_get(&push_pos);
+    }
+  }
+
+  cell->record = record;
+  // publish the record to the consumer
+  g_atomic_int_set(&cell->sequence, pos + 1);
+  return true;
+}
+
+gpointer LogQueue::pop()
+{
+  Cell *cell = &cells[pop_pos & mask];
+  guint seq = g_atomic_int_get(&cell->sequence);
+
+  /* The queue is empty or the producer that claimed this cell hasn't stored
+   * its record yet. */
+  if (seq != pop_pos + 1)
+    return NULL;
+
+  gpointer record = cell->record;
+  cell->record = NULL;
+  // make the cell free for a producer in the next round
+  g_atomic_int_set(&cell->sequence, pop_pos + mask + 1);
+  pop_pos++;
+  return record;
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
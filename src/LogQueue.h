@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __LOGQUEUE_H__
+#define __LOGQUEUE_H__
+
+#include <glib.h>
+
+/**
+ * Bounded lock-free queue of log records with multiple producers and
+ * a single consumer. Any thread can add a record without blocking, only one
+ * thread at a time can take records out.
+ *
+ * Every cell carries a sequence number that tells whether the cell is free
+ * for a producer or ready for the consumer (the algorithm by Dmitry Vyukov).
+ * Producers only compete for the push position, the consumer never touches
+ * it.
+ */
+class LogQueue
+{
+public:
+  /**
+   * Creates a queue for a given number of records, the size has to be
+   * a power of two.
+   */
+  LogQueue(unsigned size);
+  /**
+   * Records that are still in the queue are freed with g_free().
+   */
+  ~LogQueue();
+
+  /**
+   * Adds a record to the queue and takes ownership of it. Returns false if
+   * the queue is full, the record stays owned by the caller in this case.
+   */
+  bool push(gpointer record);
+  /**
+   * Takes the oldest record out of the queue and passes its ownership to the
+   * caller. Returns NULL if the queue is empty.
+   */
+  gpointer pop();
+
+  unsigned getSize() const { return mask + 1; }
+
+protected:
+
+private:
+  struct Cell
+  {
+    volatile gint sequence;
+    gpointer record;
+  };
+
+  Cell *cells;
+  guint mask;
+
+  // keep the producer and consumer positions on separate cache lines
+  char pad0[64];
+  volatile gint push_pos;
+  char pad1[64];
+  guint pop_pos;
+  char pad2[64];
+
+  LogQueue(const LogQueue&);
+  LogQueue& operator=(const LogQueue&);
+};
+
+#endif // __LOGQUEUE_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
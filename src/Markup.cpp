@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Markup.h"
+
+#include <string.h>
+
+namespace Markup
+{
+
+enum TagAction {
+  TAG_NONE,
+  // insert a newline
+  TAG_NEWLINE,
+  // insert a newline unless it is at the beginning of the text
+  TAG_NEWLINE_INNER,
+  // start of a link, remember its address
+  TAG_LINK,
+  // end of a link, print its address if it differs from the link text
+  TAG_LINK_END,
+  // table cell, cells are separated by tab characters
+  TAG_CELL,
+  TAG_CELL_END,
+  // skip everything up to the closing tag
+  TAG_CDATA
+};
+
+struct TagInfo
+{
+  const char *name;
+  // action for <name>
+  TagAction open;
+  // action for </name>
+  TagAction close;
+};
+
+static const TagInfo tags[] = {
+  {"a", TAG_LINK, TAG_LINK_END},
+  {"br", TAG_NEWLINE, TAG_NONE},
+  {"div", TAG_NEWLINE_INNER, TAG_NONE},
+  {"hr", TAG_NEWLINE_INNER, TAG_NONE},
+  {"li", TAG_NEWLINE_INNER, TAG_NONE},
+  {"p", TAG_NEWLINE_INNER, TAG_NONE},
+  {"script", TAG_CDATA, TAG_NONE},
+  {"style", TAG_CDATA, TAG_NONE},
+  {"table", TAG_NONE, TAG_NEWLINE},
+  {"td", TAG_CELL, TAG_CELL_END},
+  {"tr", TAG_NEWLINE_INNER, TAG_NONE},
+};
+
+// length of the longest name in the tags table
+#define TAG_NAME_MAX 6
+
+struct EntityInfo
+{
+  // name including the terminating semicolon
+  const char *name;
+  size_t length;
+  const char *text;
+};
+
+#define ENTITY(name, text) { name, sizeof(name) - 1, text }
+
+static const EntityInfo entities[] = {
+  ENTITY("amp;", "&"),
+  ENTITY("lt;", "<"),
+  ENTITY("gt;", ">"),
+  ENTITY("nbsp;", " "),
+  ENTITY("copy;", "\302\251"),
+  ENTITY("quot;", "\""),
+  ENTITY("reg;", "\302\256"),
+  ENTITY("apos;", "'"),
+};
+
+#undef ENTITY
+
+// size of a buffer that can hold any decoded numeric entity
+#define ENTITY_BUF_SIZE 7
+
+static const TagInfo *findTag(const char *name, size_t length)
+{
+  if (!length || length > TAG_NAME_MAX)
+    return NULL;
+
+  for (size_t i = 0; i < G_N_ELEMENTS(tags); i++)
+    if (!g_ascii_strncasecmp(name, tags[i].name, length)
+        && !tags[i].name[length])
+      return &tags[i];
+  return NULL;
+}
+
+/* Decodes an entity that starts at text (which has to point to '&'
+ * character). Returns NULL if there isn't any known entity, otherwise the
+ * decoded text is returned and length is set to the length of the entity.
+ * Numeric entities are decoded into buf. */
+static const char *findEntity(const char *text, const char *end,
+    size_t *length, char *buf)
+{
+  const char *p = text + 1;
+
+  if (p < end && *p == '#') {
+    // numeric character reference
+    p++;
+    int base = 10;
+    if (p < end && *p == 'x') {
+      base = 16;
+      p++;
+    }
+    else if (p >= end || !g_ascii_isxdigit(*p))
+      return NULL;
+
+    char *num_end;
+    guint64 pound = g_ascii_strtoull(p, &num_end, base);
+    if (!pound || pound > G_MAXUINT || num_end >= end || *num_end != ';')
+      return NULL;
+
+    *length = num_end - text + 1;
+    buf[g_unichar_to_utf8(static_cast<gunichar>(pound), buf)] = '\0';
+    return buf;
+  }
+
+  size_t left = end - p;
+  for (size_t i = 0; i < G_N_ELEMENTS(entities); i++)
+    if (entities[i].length <= left
+        && !g_ascii_strncasecmp(p, entities[i].name, entities[i].length)) {
+      *length = entities[i].length + 1;
+      return entities[i].text;
+    }
+  return NULL;
+}
+
+// appends <start, end) text with decoded entities
+static void appendUnescaped(GString *out, const char *start, const char *end,
+    char *buf)
+{
+  const char *p = start;
+  while (p < end) {
+    const char *amp = static_cast<const char*>(memchr(p, '&', end - p));
+    if (!amp) {
+      g_string_append_len(out, p, end - p);
+      return;
+    }
+
+    g_string_append_len(out, p, amp - p);
+    p = amp;
+
+    size_t length;
+    const char *ent = findEntity(p, end, &length, buf);
+    if (ent) {
+      g_string_append(out, ent);
+      p += length;
+    }
+    else {
+      g_string_append_c(out, '&');
+      p++;
+    }
+  }
+}
+
+/* Appends an address of a link that has its text at text_start position in
+ * the output. */
+static void appendLink(GString *out, gsize text_start, const char *href,
+    const char *href_end, char *buf)
+{
+  gsize link_start = out->len;
+  g_string_append(out, " (");
+  gsize addr_start = out->len;
+  appendUnescaped(out, href, href_end, buf);
+
+  // note: the appends above can move the buffer
+  const char *text = out->str + text_start;
+  gsize text_len = link_start - text_start;
+  const char *addr = out->str + addr_start;
+  gsize addr_len = out->len - addr_start;
+
+  /* Only insert the href if it's different from the CDATA.
+   * 7 == strlen("http://") */
+  if ((addr_len == text_len && !memcmp(text, addr, addr_len))
+      || (addr_len == text_len + 7 && !memcmp(text, addr + 7, text_len)))
+    g_string_truncate(out, link_start);
+  else
+    g_string_append_c(out, ')');
+}
+
+void stripHTML(const char *str, GString *out)
+{
+  g_assert(out);
+
+  if (!str)
+    return;
+
+  const char *end = str + strlen(str);
+  gsize out_start = out->len;
+  char buf[ENTITY_BUF_SIZE];
+
+  bool visible = true;
+  bool closing_td = false;
+  // name of a tag that ends CDATA
+  const char *cdata_close = NULL;
+  // address of the current link and position of its text in the output
+  const char *href = NULL;
+  const char *href_end = NULL;
+  gsize href_start = 0;
+
+  const char *p = str;
+  while (p < end) {
+    if (cdata_close) {
+      /* Skip everything up to the closing tag, don't even assume any other
+       * tag is a tag in CDATA. */
+      size_t len = strlen(cdata_close);
+      const char *q = p;
+      while ((q = static_cast<const char*>(memchr(q, '<', end - q)))) {
+        if (q[1] == '/' && !g_ascii_strncasecmp(q + 2, cdata_close, len)
+            && !g_ascii_isalnum(q[2 + len]))
+          break;
+        q++;
+      }
+      if (!q) {
+        // unterminated CDATA, drop the rest of the text
+        break;
+      }
+
+      const char *gt = static_cast<const char*>(memchr(q, '>', end - q));
+      p = gt ? gt + 1 : end;
+      cdata_close = NULL;
+      continue;
+    }
+
+    if (visible) {
+      // copy a run of plain text at once
+      size_t n = strcspn(p, "<&\n\r\v\f");
+      if (n) {
+        g_string_append_len(out, p, n);
+        p += n;
+        continue;
+      }
+    }
+
+    if (*p == '<' && p + 1 < end && !g_ascii_isspace(p[1])) {
+      const char *q = p + 1;
+      bool closing = *q == '/';
+      if (closing)
+        q++;
+      const char *name = q;
+      while (q < end && g_ascii_isalnum(*q))
+        q++;
+
+      TagAction action = TAG_NONE;
+      const TagInfo *tag = findTag(name, q - name);
+      if (tag)
+        action = closing ? tag->close : tag->open;
+
+      /* Find the end of the tag either implicitly (closed start tag) or
+       * explicitly, using a sloppy method (i.e., < or > inside quoted
+       * attributes will screw us up). */
+      const char *k = q + strcspn(q, "<>");
+
+      if (action == TAG_CELL && closing_td) {
+        g_string_append_c(out, '\t');
+        visible = true;
+      }
+      else if (action == TAG_CELL_END) {
+        closing_td = true;
+        visible = false;
+      }
+      else {
+        closing_td = false;
+        visible = true;
+      }
+
+      switch (action) {
+        case TAG_LINK:
+          // save the address to print it after the link text
+          for (const char *st = q; k - st >= 5; st++) {
+            if (g_ascii_strncasecmp(st, "href=", 5))
+              continue;
+
+            st += 5;
+            char delim = ' ';
+            if (st < k && (*st == '"' || *st == '\'')) {
+              delim = *st;
+              st++;
+            }
+            const char *st_end = st;
+            while (st_end < k && *st_end != delim)
+              st_end++;
+
+            if (st < k) {
+              href = st;
+              href_end = st_end;
+              href_start = out->len;
+            }
+            break;
+          }
+          break;
+        case TAG_LINK_END:
+          if (href) {
+            appendLink(out, href_start, href, href_end, buf);
+            href = NULL;
+          }
+          break;
+        case TAG_NEWLINE:
+          g_string_append_c(out, '\n');
+          break;
+        case TAG_NEWLINE_INNER:
+          if (out->len > out_start)
+            g_string_append_c(out, '\n');
+          break;
+        case TAG_CDATA:
+          cdata_close = tag->name;
+          break;
+        default:
+          break;
+      }
+
+      // continue checking after the tag
+      p = (k < end && *k == '>') ? k + 1 : k;
+      continue;
+    }
+
+    if (*p == '<') {
+      // not a tag, it is printed as a text
+      closing_td = false;
+      visible = true;
+    }
+    else if (!g_ascii_isspace(*p))
+      visible = true;
+
+    if (*p == '&') {
+      size_t length;
+      const char *ent = findEntity(p, end, &length, buf);
+      if (ent) {
+        g_string_append(out, ent);
+        p += length;
+        continue;
+      }
+    }
+
+    if (visible)
+      g_string_append_c(out, g_ascii_isspace(*p) && *p != '\t' ? ' ' : *p);
+    p++;
+  }
+}
+
+char *stripHTML(const char *str)
+{
+  if (!str)
+    return NULL;
+
+  GString *out = g_string_sized_new(strlen(str));
+  stripHTML(str, out);
+  return g_string_free(out, FALSE);
+}
+
+} // namespace Markup
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __MARKUP_H__
+#define __MARKUP_H__
+
+#include <glib.h>
+
+namespace Markup
+{
+
+/**
+ * Converts IM HTML markup to plain text and appends the result to a given
+ * buffer. The input is processed in a single pass, runs of plain text are
+ * copied at once. The conversion follows purple_markup_strip_html() except
+ * that tab characters are preserved.
+ *
+ * The function doesn't use any static data so it can be called from any
+ * thread as long as every thread uses its own buffer.
+ */
+void stripHTML(const char *str, GString *out);
+
+/**
+ * Convenience variant of stripHTML() that returns a newly allocated string,
+ * the caller has to free it with g_free().
+ */
+char *stripHTML(const char *str);
+
+} // namespace Markup
+
+#endif // __MARKUP_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
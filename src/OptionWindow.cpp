@@ -80,6 +80,12 @@ OptionWindow::OptionWindow()
   treeview->appendNode(parent, *(new BooleanOption(_("Show footer"),
           CONF_PREFIX "/dimensions/show_footer")));
 
+  parent = treeview->appendNode(treeview->getRootNode(),
+      *(new CppConsUI::TreeView::ToggleCollapseButton(_("Mouse"))));
+  treeview->setCollapsed(parent, true);
+  treeview->appendNode(parent, *(new BooleanOption(_("Enable mouse"),
+          CONF_PREFIX "/mouse/enabled")));
+
   parent = treeview->appendNode(treeview->getRootNode(),
       *(new CppConsUI::TreeView::ToggleCollapseButton(
           _("Idle settings"))));
@@ -106,6 +112,17 @@ OptionWindow::OptionWindow()
   treeview->appendNode(parent, *(new BooleanOption(
           _("Send typing notification"),
           "/purple/conversations/im/send_typing")));
+  treeview->appendNode(parent, *(new IntegerOption(
+          _("Hibernate hidden conversations after (0 = never)"),
+          CONF_PREFIX "/chat/hibernate_timeout",
+          sigc::mem_fun(this, &OptionWindow::getMinUnit))));
+
+  parent = treeview->appendNode(treeview->getRootNode(),
+      *(new CppConsUI::TreeView::ToggleCollapseButton(_("File transfers"))));
+  treeview->setCollapsed(parent, true);
+  treeview->appendNode(parent, *(new IntegerOption(
+          _("Maximum concurrent transfers (0 = unlimited)"),
+          CONF_PREFIX "/transfers/max_concurrent")));
 
   parent = treeview->appendNode(treeview->getRootNode(),
       *(new CppConsUI::TreeView::ToggleCollapseButton(_("System logging"))));
@@ -141,6 +158,10 @@ do {                                       \
   treeview->appendNode(parent, *c);
 #undef ADD_DEBUG_OPTIONS
 
+  treeview->appendNode(parent, *(new StringOption(
+          _("Category log levels (category=level, ...)"),
+          CONF_PREFIX "/log/log_level_categories")));
+
   parent = treeview->appendNode(treeview->getRootNode(),
       *(new CppConsUI::TreeView::ToggleCollapseButton(
           _("Libpurple logging"))));
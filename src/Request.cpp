@@ -21,6 +21,7 @@
 #include "Request.h"
 
 #include "Log.h"
+#include "Transfers.h"
 
 #include <cppconsui/InputDialog.h>
 #include <cppconsui/Spacer.h>
@@ -105,6 +106,64 @@ void Request::InputTextDialog::responseHandler(SplitDialog& /*activator*/,
   }
 }
 
+Request::FileDialog::FileDialog(const char *title, const char *filename,
+    bool savedialog, GCallback ok_cb, GCallback cancel_cb, void *user_data)
+: RequestDialog(title, savedialog ? _("Save file as:") : _("Select a file:"),
+    NULL, _("Ok"), ok_cb, _("Cancel"), cancel_cb, user_data)
+{
+  char *path;
+  if (filename && g_path_is_absolute(filename))
+    path = g_strdup(filename);
+  else if (filename)
+    path = g_build_filename(purple_home_dir(), filename, NULL);
+  else
+    path = g_strconcat(purple_home_dir(), G_DIR_SEPARATOR_S, NULL);
+
+  entry = new CppConsUI::TextEntry(AUTOSIZE, AUTOSIZE, path);
+  g_free(path);
+  lbox->appendWidget(*entry);
+  entry->grabFocus();
+}
+
+PurpleRequestType Request::FileDialog::getRequestType()
+{
+  return PURPLE_REQUEST_FILE;
+}
+
+void Request::FileDialog::responseHandler(SplitDialog& /*activator*/,
+    ResponseType response)
+{
+  char *filename = NULL;
+
+  switch (response) {
+    case AbstractDialog::RESPONSE_OK:
+      if (!ok_cb)
+        break;
+
+      // expand the home directory
+      if (g_str_has_prefix(entry->getText(), "~" G_DIR_SEPARATOR_S))
+        filename = g_build_filename(purple_home_dir(), entry->getText() + 2,
+            NULL);
+      else
+        filename = g_strdup(entry->getText());
+
+      /* File transfers are accepted by Transfers so it can limit the number
+       * of concurrent transfers. */
+      if (!TRANSFERS->acceptRequest(user_data, ok_cb, cancel_cb, filename))
+        reinterpret_cast<PurpleRequestFileCb>(ok_cb)(user_data, filename);
+      break;
+    case AbstractDialog::RESPONSE_CANCEL:
+      if (cancel_cb)
+        reinterpret_cast<PurpleRequestFileCb>(cancel_cb)(user_data, NULL);
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+  }
+
+  g_free(filename);
+}
+
 Request::ChoiceDialog::ChoiceDialog(const char *title, const char *primary,
     const char *secondary, int default_value, const char *ok_text,
     GCallback ok_cb, const char *cancel_text, GCallback cancel_cb,
@@ -716,12 +775,21 @@ void *Request::request_fields(const char *title, const char *primary,
   return dialog;
 }
 
-void *Request::request_file(const char * /*title*/, const char * /*filename*/,
-    gboolean /*savedialog*/, GCallback /*ok_cb*/, GCallback /*cancel_cb*/,
+void *Request::request_file(const char *title, const char *filename,
+    gboolean savedialog, GCallback ok_cb, GCallback cancel_cb,
     PurpleAccount * /*account*/, const char * /*who*/,
-    PurpleConversation * /*conv*/, void * /*user_data*/)
+    PurpleConversation * /*conv*/, void *user_data)
 {
-  return NULL;
+  LOG->debug("request_file");
+
+  FileDialog *dialog = new FileDialog(title, filename, savedialog, ok_cb,
+      cancel_cb, user_data);
+  dialog->signal_response.connect(sigc::mem_fun(this,
+        &Request::onDialogResponse));
+  dialog->show();
+
+  requests.insert(dialog);
+  return dialog;
 }
 
 void Request::close_request(PurpleRequestType /*type*/, void *ui_handle)
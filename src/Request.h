@@ -93,6 +93,27 @@ private:
     InputTextDialog& operator=(const InputTextDialog&);
   };
 
+  class FileDialog
+  : public RequestDialog
+  {
+  public:
+    FileDialog(const char *title, const char *filename, bool savedialog,
+        GCallback ok_cb, GCallback cancel_cb, void *user_data);
+    virtual ~FileDialog() {}
+
+    virtual PurpleRequestType getRequestType();
+
+  protected:
+    CppConsUI::TextEntry *entry;
+
+    virtual void responseHandler(SplitDialog& activator,
+        ResponseType response);
+
+  private:
+    FileDialog(const FileDialog&);
+    FileDialog& operator=(const FileDialog&);
+  };
+
   class ChoiceDialog
   : public RequestDialog
   {
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Search.h"
+
+#include "CenterIM.h"
+#include "Conversations.h"
+#include "Log.h"
+
+#include <libpurple/purple.h>
+#include <string.h>
+#include "gettext.h"
+
+// maximum number of results shown in the search window
+#define SEARCH_MAX_RESULTS 200
+
+Search *Search::my_instance = NULL;
+
+Search *Search::instance()
+{
+  return my_instance;
+}
+
+void Search::openSearchWindow()
+{
+  SearchWindow *win = new SearchWindow;
+  win->show();
+}
+
+void Search::logAppended(const char *filename, gint64 size)
+{
+  g_assert(filename);
+
+  if (!thread)
+    return;
+
+  // the index uses paths relative to the logs directory
+  size_t len = strlen(logs_dir);
+  if (strncmp(filename, logs_dir, len) || filename[len] != G_DIR_SEPARATOR)
+    return;
+
+  Job *job = new Job;
+  job->type = Job::TYPE_UPDATE;
+  job->text = filename + len + 1;
+  job->size = size;
+  job->id = 0;
+  g_async_queue_push(jobs, job);
+}
+
+Search::Search()
+: index(NULL), thread(NULL), last_query(0)
+{
+  logs_dir = g_build_filename(purple_user_dir(), "clogs", NULL);
+  char *index_dir = g_build_filename(purple_user_dir(), "search", NULL);
+  index = new SearchIndex(index_dir, logs_dir);
+  g_free(index_dir);
+
+  jobs = g_async_queue_new();
+  answers = g_async_queue_new();
+
+  GError *err = NULL;
+#if GLIB_CHECK_VERSION(2, 34, 0)
+  thread = g_thread_try_new("search", search_thread_, this, &err);
+#else
+  thread = g_thread_create(search_thread_, this, TRUE, &err);
+#endif // GLIB_CHECK_VERSION(2, 34, 0)
+
+  if (!thread) {
+    LOG->error(_("Error creating search thread (%s)."), err->message);
+    g_clear_error(&err);
+  }
+}
+
+Search::~Search()
+{
+  if (thread) {
+    // let the worker finish pending updates so the index stays current
+    Job *job = new Job;
+    job->type = Job::TYPE_QUIT;
+    job->size = 0;
+    job->id = 0;
+    g_async_queue_push(jobs, job);
+    g_thread_join(thread);
+  }
+
+  // drop answers that weren't processed by the main loop
+  while (g_idle_remove_by_data(this))
+    ;
+  gpointer data;
+  while ((data = g_async_queue_try_pop(answers)))
+    delete static_cast<Answer*>(data);
+  while ((data = g_async_queue_try_pop(jobs)))
+    delete static_cast<Job*>(data);
+  g_async_queue_unref(answers);
+  g_async_queue_unref(jobs);
+
+  delete index;
+  g_free(logs_dir);
+}
+
+void Search::init()
+{
+  g_assert(!my_instance);
+
+  my_instance = new Search;
+}
+
+void Search::finalize()
+{
+  g_assert(my_instance);
+
+  delete my_instance;
+  my_instance = NULL;
+}
+
+guint Search::query(const char *text)
+{
+  g_assert(text);
+
+  // every new query makes the previous ones obsolete
+  g_atomic_int_inc(&last_query);
+  guint id = g_atomic_int_get(&last_query);
+
+  std::vector<std::string> tokens;
+  SearchIndex::tokenize(text, tokens);
+  if (!thread || tokens.empty() || !id)
+    return 0;
+
+  Job *job = new Job;
+  job->type = Job::TYPE_QUERY;
+  job->text = text;
+  job->size = 0;
+  job->id = id;
+  g_async_queue_push(jobs, job);
+
+  return id;
+}
+
+void Search::processAnswers()
+{
+  gpointer data;
+  while ((data = g_async_queue_try_pop(answers))) {
+    Answer *answer = static_cast<Answer*>(data);
+    signal_answer(*answer);
+    delete answer;
+  }
+}
+
+void Search::run()
+{
+  // note: this method runs in the search thread
+  GError *err = NULL;
+  if (!index->open(&err)) {
+    LOG->error(_("Error opening search index, conversation logs will be "
+          "indexed again (%s)."), err->message);
+    g_clear_error(&err);
+  }
+
+  // index logfiles written while CenterIM wasn't running
+  index->scan();
+  bool scanning = true;
+
+  while (true) {
+    Job *job;
+    if (scanning) {
+      // jobs have priority over the scan
+      if (!(job = static_cast<Job*>(g_async_queue_try_pop(jobs)))) {
+        scanning = index->scanStep(&err);
+        if (err) {
+          LOG->error(_("Error indexing conversation logs (%s)."),
+              err->message);
+          g_clear_error(&err);
+        }
+        continue;
+      }
+    }
+    else
+      job = static_cast<Job*>(g_async_queue_pop(jobs));
+
+    if (job->type == Job::TYPE_QUIT) {
+      delete job;
+      break;
+    }
+
+    if (job->type == Job::TYPE_UPDATE) {
+      if (!index->update(job->text.c_str(), job->size, &err)) {
+        LOG->error(_("Error indexing conversation logs (%s)."),
+            err ? err->message : "");
+        g_clear_error(&err);
+      }
+    }
+    else if (job->id == static_cast<guint>(g_atomic_int_get(&last_query))) {
+      Answer *answer = new Answer;
+      answer->id = job->id;
+      gint64 start = CppConsUI::CoreManager::getMonotonicTime();
+      index->query(job->text.c_str(), SEARCH_MAX_RESULTS, answer->results);
+      answer->time = CppConsUI::CoreManager::getMonotonicTime() - start;
+
+      g_async_queue_push(answers, answer);
+      g_idle_add(answer_, this);
+    }
+
+    delete job;
+  }
+}
+
+gpointer Search::search_thread_(gpointer data)
+{
+  reinterpret_cast<Search*>(data)->run();
+  return NULL;
+}
+
+Search::SearchWindow::SearchWindow()
+: SplitDialog(0, 0, 80, 24, _("Search conversations")), query_id(0)
+{
+  setColorScheme("generalwindow");
+
+  list = new CppConsUI::ListBox(AUTOSIZE, AUTOSIZE);
+  setContainer(*list);
+
+  entry = new CppConsUI::TextEntry(AUTOSIZE, 1);
+  entry->signal_text_change.connect(sigc::mem_fun(this,
+        &SearchWindow::onQueryChange));
+  list->appendWidget(*entry);
+
+  status = new CppConsUI::Label(AUTOSIZE, 1,
+      _("Type the words to search for."));
+  list->appendWidget(*status);
+
+  buttons->appendItem(_("Done"), sigc::hide(sigc::mem_fun(this,
+          &SearchWindow::close)));
+
+  answer_conn = SEARCH->signal_answer.connect(sigc::mem_fun(this,
+        &SearchWindow::onAnswer));
+
+  entry->grabFocus();
+}
+
+Search::SearchWindow::~SearchWindow()
+{
+  answer_conn.disconnect();
+}
+
+void Search::SearchWindow::onScreenResized()
+{
+  moveResizeRect(CENTERIM->getScreenArea(CenterIM::CHAT_AREA));
+}
+
+void Search::SearchWindow::onQueryChange(CppConsUI::TextEdit& activator)
+{
+  query_id = SEARCH->query(activator.getText());
+  if (!query_id) {
+    clearRows();
+    status->setText(_("Type the words to search for."));
+  }
+}
+
+void Search::SearchWindow::onAnswer(const Answer& answer)
+{
+  // ignore answers to queries that were changed meanwhile
+  if (answer.id != query_id)
+    return;
+
+  clearRows();
+  results = answer.results;
+
+  for (SearchIndex::Results::const_iterator i = results.begin();
+      i != results.end(); i++) {
+    // the path is "protocol/account/name"
+    const char *name = strrchr(i->path.c_str(), G_DIR_SEPARATOR);
+    name = name ? name + 1 : i->path.c_str();
+    const char *date = "";
+    struct tm local;
+    if (localtime_r(&i->time, &local))
+      date = purple_date_format_long(&local);
+    char *text = g_strdup_printf("%s %s", date,
+        purple_unescape_filename(name));
+
+    CppConsUI::Button *button = new CppConsUI::Button(
+        CppConsUI::Button::FLAG_VALUE, text, i->text.c_str());
+    g_free(text);
+    button->signal_activate.connect(sigc::bind(sigc::mem_fun(this,
+            &SearchWindow::onResultActivate), &*i));
+    list->appendWidget(*button);
+    rows.push_back(button);
+  }
+
+  char *text = g_strdup_printf(ngettext("%u result (%.1f ms)",
+        "%u results (%.1f ms)", results.size()),
+      static_cast<unsigned>(results.size()), answer.time / 1000.0);
+  status->setText(text);
+  g_free(text);
+}
+
+void Search::SearchWindow::onResultActivate(CppConsUI::Button& /*activator*/,
+    const SearchIndex::Result *result)
+{
+  CONVERSATIONS->showLogRecord(result->path.c_str(), result->offset);
+  close();
+}
+
+void Search::SearchWindow::clearRows()
+{
+  for (Rows::iterator i = rows.begin(); i != rows.end(); i++)
+    list->removeWidget(**i);
+  rows.clear();
+  results.clear();
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+#include "SearchIndex.h"
+
+#include <cppconsui/Button.h>
+#include <cppconsui/Label.h>
+#include <cppconsui/ListBox.h>
+#include <cppconsui/SplitDialog.h>
+#include <cppconsui/TextEntry.h>
+
+#include <string>
+#include <vector>
+
+#define SEARCH (Search::instance())
+
+/**
+ * Full-text search of conversation logfiles. The search index is owned by
+ * a worker thread that keeps it up to date and answers queries, so neither
+ * indexing nor searching blocks the main loop.
+ */
+class Search
+{
+public:
+  static Search *instance();
+
+  /**
+   * Opens a window for searching the conversation logs.
+   */
+  void openSearchWindow();
+
+  /**
+   * Tells the index that a conversation logfile was written and has a given
+   * size now.
+   */
+  void logAppended(const char *filename, gint64 size);
+
+protected:
+
+private:
+  struct Job
+  {
+    enum Type
+    {
+      TYPE_UPDATE,
+      TYPE_QUERY,
+      TYPE_QUIT
+    };
+
+    Type type;
+    // logfile path or query text
+    std::string text;
+    gint64 size;
+    guint id;
+  };
+
+  struct Answer
+  {
+    guint id;
+    SearchIndex::Results results;
+    // time spent by the query in microseconds
+    gint64 time;
+  };
+
+  class SearchWindow
+  : public CppConsUI::SplitDialog
+  {
+  public:
+    SearchWindow();
+    virtual ~SearchWindow();
+
+    // FreeWindow
+    virtual void onScreenResized();
+
+  protected:
+    CppConsUI::ListBox *list;
+    CppConsUI::TextEntry *entry;
+    CppConsUI::Label *status;
+
+  private:
+    typedef std::vector<CppConsUI::Button*> Rows;
+
+    Rows rows;
+    SearchIndex::Results results;
+    // id of the query whose results are awaited
+    guint query_id;
+    sigc::connection answer_conn;
+
+    SearchWindow(const SearchWindow&);
+    SearchWindow& operator=(const SearchWindow&);
+
+    void onQueryChange(CppConsUI::TextEdit& activator);
+    void onAnswer(const Answer& answer);
+    void onResultActivate(CppConsUI::Button& activator,
+        const SearchIndex::Result *result);
+    void clearRows();
+  };
+
+  char *logs_dir;
+  SearchIndex *index;
+
+  GThread *thread;
+  // jobs for the worker thread
+  GAsyncQueue *jobs;
+  // answers waiting for the main loop
+  GAsyncQueue *answers;
+  /**
+   * Id of the newest query, the worker skips queries that were superseded
+   * before it got to them.
+   */
+  volatile gint last_query;
+
+  sigc::signal<void, const Answer&> signal_answer;
+
+  static Search *my_instance;
+
+  Search();
+  Search(const Search&);
+  Search& operator=(const Search&);
+  ~Search();
+
+  static void init();
+  static void finalize();
+  friend class CenterIM;
+
+  /**
+   * Passes a query to the worker thread and returns its id, the results are
+   * emitted by signal_answer. Returns 0 if there is nothing to search.
+   */
+  guint query(const char *text);
+  void processAnswers();
+
+  void run();
+
+  static gpointer search_thread_(gpointer data);
+  static gboolean answer_(gpointer data)
+    { reinterpret_cast<Search*>(data)->processAnswers(); return FALSE; }
+};
+
+#endif // __SEARCH_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -0,0 +1,1186 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SearchIndex.h"
+
+#include "Markup.h"
+
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <errno.h>
+#include <iterator>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gettext.h"
+
+#define STATE_MAGIC "centerim-search 2"
+#define SEGMENT_MAGIC "CIMSIDX2"
+
+// number of postings kept in memory before they are written as a segment
+#define DELTA_MAX_POSTINGS (1 << 20)
+// number of bytes of a logfile indexed by one scan step
+#define SCAN_STEP_SIZE (1 << 20)
+
+#define TOKEN_MIN_CHARS 2
+#define TOKEN_MAX_CHARS 32
+
+// maximum number of characters of a message text in a result
+#define RESULT_TEXT_CHARS 160
+
+/* Layout of a segment file, all numbers are in the host byte order:
+ *
+ * SegmentHeader
+ * SegmentToken[tokens_num], sorted by token names
+ * token names, not terminated, padded to a multiple of 8 bytes
+ * Posting[postings_num] */
+struct SegmentHeader
+{
+  char magic[8];
+  guint32 tokens_num;
+  guint32 names_size;
+  guint64 postings_num;
+};
+
+struct SegmentToken
+{
+  // offset and length of the name
+  guint32 name;
+  guint32 name_len;
+  guint32 postings_num;
+  guint32 reserved;
+  // index of the first posting
+  guint64 postings;
+};
+
+static size_t pad8(size_t size)
+{
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+static bool result_newer(const SearchIndex::Result& a,
+    const SearchIndex::Result& b)
+{
+  return a.time > b.time;
+}
+
+static int compare_names(const char *a, size_t a_len, const char *b,
+    size_t b_len)
+{
+  int res = memcmp(a, b, MIN(a_len, b_len));
+  if (res)
+    return res;
+  if (a_len == b_len)
+    return 0;
+  return a_len < b_len ? -1 : 1;
+}
+
+struct SearchIndex::Segment
+{
+  std::string name;
+  GMappedFile *file;
+  const SegmentHeader *header;
+  const SegmentToken *tokens;
+  const char *names;
+  const Posting *postings;
+
+  Segment(const char *name_);
+  ~Segment();
+
+  bool load(const char *path, GError **err);
+
+  const char *getName(size_t i) const { return names + tokens[i].name; }
+  /**
+   * Returns the index of the first token that isn't less than a given
+   * name.
+   */
+  size_t lowerBound(const char *name, size_t len) const;
+
+private:
+  Segment(const Segment&);
+  Segment& operator=(const Segment&);
+};
+
+/* Token of a segment that is being written. Postings come from up to two
+ * sources, either from the delta or from two merged segments. */
+struct SearchIndex::MergeToken
+{
+  const char *name;
+  size_t len;
+  const Posting *a;
+  size_t a_num;
+  const Posting *b;
+  size_t b_num;
+
+  bool operator<(const MergeToken& other) const
+    { return compare_names(name, len, other.name, other.len) < 0; }
+};
+
+SearchIndex::Segment::Segment(const char *name_)
+: name(name_), file(NULL), header(NULL), tokens(NULL), names(NULL)
+, postings(NULL)
+{
+}
+
+SearchIndex::Segment::~Segment()
+{
+  if (file) {
+#if GLIB_CHECK_VERSION(2, 22, 0)
+    g_mapped_file_unref(file);
+#else
+    g_mapped_file_free(file);
+#endif // GLIB_CHECK_VERSION(2, 22, 0)
+  }
+}
+
+bool SearchIndex::Segment::load(const char *path, GError **err)
+{
+  if (!(file = g_mapped_file_new(path, FALSE, err)))
+    return false;
+
+  size_t size = g_mapped_file_get_length(file);
+  const char *data = g_mapped_file_get_contents(file);
+  header = reinterpret_cast<const SegmentHeader*>(data);
+
+  bool valid = size >= sizeof(SegmentHeader)
+    && !memcmp(header->magic, SEGMENT_MAGIC, sizeof(header->magic))
+    && size == sizeof(SegmentHeader)
+      + header->tokens_num * sizeof(SegmentToken)
+      + pad8(header->names_size) + header->postings_num * sizeof(Posting);
+
+  if (valid) {
+    tokens = reinterpret_cast<const SegmentToken*>(data
+        + sizeof(SegmentHeader));
+    names = reinterpret_cast<const char*>(tokens + header->tokens_num);
+    postings = reinterpret_cast<const Posting*>(names
+        + pad8(header->names_size));
+
+    for (guint32 i = 0; valid && i < header->tokens_num; i++)
+      valid = tokens[i].name + tokens[i].name_len <= header->names_size
+        && tokens[i].postings + tokens[i].postings_num
+          <= header->postings_num;
+  }
+
+  if (!valid) {
+    g_set_error(err, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+        _("Search index segment '%s' is damaged."), path);
+    return false;
+  }
+
+  return true;
+}
+
+size_t SearchIndex::Segment::lowerBound(const char *name, size_t len) const
+{
+  size_t low = 0;
+  size_t high = header->tokens_num;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (compare_names(getName(mid), tokens[mid].name_len, name, len) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+SearchIndex::SearchIndex(const char *index_dir_, const char *logs_dir_)
+: next_segment(0), delta_postings(0), delta_limit(DELTA_MAX_POSTINGS)
+, journal(NULL)
+{
+  index_dir = g_strdup(index_dir_);
+  logs_dir = g_strdup(logs_dir_);
+
+  delta = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+      free_postings_);
+
+  raw_buffer = g_string_new(NULL);
+  text_buffer = g_string_new(NULL);
+}
+
+SearchIndex::~SearchIndex()
+{
+  if (journal)
+    fclose(journal);
+
+  for (Segments::iterator i = segments.begin(); i != segments.end(); i++)
+    delete *i;
+
+  g_hash_table_destroy(delta);
+  g_string_free(raw_buffer, TRUE);
+  g_string_free(text_buffer, TRUE);
+  g_free(index_dir);
+  g_free(logs_dir);
+}
+
+bool SearchIndex::open(GError **err)
+{
+  if (g_mkdir_with_parents(index_dir, S_IRUSR | S_IWUSR | S_IXUSR) == -1) {
+    int errsv = errno;
+    g_set_error(err, G_FILE_ERROR, g_file_error_from_errno(errsv),
+        _("Error creating directory '%s' (%s)."), index_dir,
+        g_strerror(errsv));
+    return false;
+  }
+
+  if (!loadState(err) || !replayJournal(err)) {
+    // start from scratch, all logfiles are indexed again
+    reset();
+    openJournal(true, NULL);
+    return false;
+  }
+
+  removeStaleSegments();
+  return openJournal(false, err);
+}
+
+void SearchIndex::scan()
+{
+  scanDir("");
+}
+
+bool SearchIndex::scanStep(GError **err)
+{
+  while (!scan_queue.empty()) {
+    guint32 id = scan_queue.front().first;
+    guint64 limit = scan_queue.front().second;
+    if (files[id].size >= limit) {
+      // already indexed by update()
+      scan_queue.pop_front();
+      continue;
+    }
+
+    // give up on the logfile if an error stops the progress
+    guint64 size = files[id].size;
+    indexFile(id, limit, SCAN_STEP_SIZE, err);
+    if (files[id].size >= limit || files[id].size == size)
+      scan_queue.pop_front();
+    break;
+  }
+
+  return !scan_queue.empty();
+}
+
+bool SearchIndex::update(const char *path, gint64 size, GError **err)
+{
+  guint32 id = getFile(path);
+  guint64 limit = MAX(size, 0);
+
+  if (limit < files[id].size) {
+    // the logfile was truncated, index it again
+    files[id].size = 0;
+    if (journal)
+      fprintf(journal, "S %u 0\n", id);
+  }
+
+  return indexFile(id, limit, G_MAXSIZE, err);
+}
+
+void SearchIndex::query(const char *text, size_t max, Results& results)
+{
+  std::vector<std::string> tokens;
+  tokenize(text, tokens);
+  if (tokens.empty())
+    return;
+
+  // the last word is still being typed if the query doesn't end with a space
+  std::string last = tokens.back();
+  const char *end = text + strlen(text);
+  const std::string *prefix = NULL;
+  if (g_unichar_isalnum(g_utf8_get_char(g_utf8_prev_char(end))))
+    prefix = &last;
+
+  std::sort(tokens.begin(), tokens.end());
+  tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+  // find messages that contain all words
+  Postings hits;
+  for (std::vector<std::string>::iterator i = tokens.begin();
+      i != tokens.end(); i++) {
+    Postings postings;
+    collect(*i, prefix && *i == *prefix, postings);
+    std::sort(postings.begin(), postings.end());
+    postings.erase(std::unique(postings.begin(), postings.end()),
+        postings.end());
+
+    if (i == tokens.begin())
+      hits.swap(postings);
+    else {
+      Postings both;
+      std::set_intersection(hits.begin(), hits.end(), postings.begin(),
+          postings.end(), std::back_inserter(both));
+      hits.swap(both);
+    }
+
+    if (hits.empty())
+      return;
+  }
+
+  /* Postings are sorted by the file and the offset. Messages are appended
+   * to logfiles so every file is read from its end, and the newest max
+   * messages of all files are kept in a heap with the oldest one on top.
+   * Postings can be stale if a logfile was modified outside of CenterIM so
+   * every message is checked again and the number of failed attempts in one
+   * file is limited. */
+  Results heap;
+  Postings::iterator file_end = hits.end();
+  while (file_end != hits.begin() && max) {
+    guint32 file = (file_end - 1)->file;
+    Postings::iterator file_begin = file_end - 1;
+    while (file_begin != hits.begin() && (file_begin - 1)->file == file)
+      file_begin--;
+
+    char *path = g_build_filename(logs_dir, files[file].path.c_str(), NULL);
+    GIOChannel *chan = g_io_channel_new_file(path, "r", NULL);
+    g_free(path);
+    if (chan) {
+      g_io_channel_set_encoding(chan, NULL, NULL);
+
+      size_t failed = 0;
+      for (Postings::iterator i = file_end;
+          i != file_begin && failed < 4 * max;) {
+        i--;
+        Result result;
+        if (!readResult(chan, *i, tokens, prefix, result)) {
+          failed++;
+          continue;
+        }
+
+        if (heap.size() == max) {
+          // older messages of this file can't get in either
+          if (result_newer(heap.front(), result))
+            break;
+          if (!result_newer(result, heap.front()))
+            continue;
+          std::pop_heap(heap.begin(), heap.end(), result_newer);
+          heap.pop_back();
+        }
+        heap.push_back(result);
+        std::push_heap(heap.begin(), heap.end(), result_newer);
+      }
+      g_io_channel_unref(chan);
+    }
+
+    file_end = file_begin;
+  }
+
+  // the newest result first
+  std::sort_heap(heap.begin(), heap.end(), result_newer);
+  results.insert(results.end(), heap.begin(), heap.end());
+}
+
+void SearchIndex::tokenize(const char *text, std::vector<std::string>& tokens)
+{
+  std::string token;
+  int chars = 0;
+  const char *p = text;
+  while (true) {
+    gunichar uc = g_utf8_get_char(p);
+    if (uc && g_unichar_isalnum(uc)) {
+      if (chars < TOKEN_MAX_CHARS) {
+        char buf[6];
+        token.append(buf, g_unichar_to_utf8(g_unichar_tolower(uc), buf));
+        chars++;
+      }
+      p = g_utf8_next_char(p);
+      continue;
+    }
+
+    if (chars >= TOKEN_MIN_CHARS)
+      tokens.push_back(token);
+    token.clear();
+    chars = 0;
+
+    if (!uc)
+      break;
+    p = g_utf8_next_char(p);
+  }
+}
+
+void SearchIndex::reset()
+{
+  for (Segments::iterator i = segments.begin(); i != segments.end(); i++)
+    delete *i;
+  segments.clear();
+  obsolete_segments.clear();
+  next_segment = 0;
+
+  files.clear();
+  file_ids.clear();
+  scan_queue.clear();
+
+  g_hash_table_remove_all(delta);
+  delta_postings = 0;
+
+  if (journal) {
+    fclose(journal);
+    journal = NULL;
+  }
+
+  char *path = g_build_filename(index_dir, "state", NULL);
+  g_unlink(path);
+  g_free(path);
+
+  removeStaleSegments();
+}
+
+bool SearchIndex::loadState(GError **err)
+{
+  char *path = g_build_filename(index_dir, "state", NULL);
+  if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+    // a new index
+    g_free(path);
+    return true;
+  }
+
+  char *contents;
+  if (!g_file_get_contents(path, &contents, NULL, err)) {
+    g_free(path);
+    return false;
+  }
+
+  char **lines = g_strsplit(contents, "\n", -1);
+  g_free(contents);
+
+  bool valid = lines[0] && !strcmp(lines[0], STATE_MAGIC);
+  bool loaded = true;
+  if (!valid && lines[0] && g_str_has_prefix(lines[0], "centerim-search ")) {
+    // an index written by a different version, don't report it as damaged
+    g_set_error(err, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+        _("Search index state '%s' has an unsupported format."), path);
+    loaded = false;
+  }
+  for (char **line = lines + 1; valid && *line; line++) {
+    char *end;
+    if (g_str_has_prefix(*line, "next "))
+      next_segment = strtoul(*line + 5, NULL, 10);
+    else if (g_str_has_prefix(*line, "segment ")) {
+      Segment *segment = new Segment(*line + 8);
+      char *segment_path = g_build_filename(index_dir, *line + 8, NULL);
+      loaded = segment->load(segment_path, err);
+      g_free(segment_path);
+      if (!loaded) {
+        delete segment;
+        valid = false;
+        break;
+      }
+      segments.push_back(segment);
+    }
+    else if (g_str_has_prefix(*line, "file ")) {
+      File file;
+      file.size = g_ascii_strtoull(*line + 5, &end, 10);
+      if (*end != ' ') {
+        valid = false;
+        break;
+      }
+      file.path = end + 1;
+      file_ids[file.path] = files.size();
+      files.push_back(file);
+    }
+    else if (**line)
+      valid = false;
+  }
+  g_strfreev(lines);
+
+  if (!valid && loaded)
+    g_set_error(err, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+        _("Search index state '%s' is damaged."), path);
+  g_free(path);
+
+  return valid;
+}
+
+bool SearchIndex::saveState(GError **err)
+{
+  GString *state = g_string_new(STATE_MAGIC "\n");
+  g_string_append_printf(state, "next %u\n", next_segment);
+  for (Segments::iterator i = segments.begin(); i != segments.end(); i++)
+    g_string_append_printf(state, "segment %s\n", (*i)->name.c_str());
+  for (Files::iterator i = files.begin(); i != files.end(); i++)
+    g_string_append_printf(state, "file %" G_GUINT64_FORMAT " %s\n", i->size,
+        i->path.c_str());
+
+  char *path = g_build_filename(index_dir, "state", NULL);
+  bool res = g_file_set_contents(path, state->str, state->len, err);
+  g_free(path);
+  g_string_free(state, TRUE);
+
+  if (!res)
+    return false;
+
+  // merged segments aren't referenced by the state anymore
+  for (std::vector<std::string>::iterator i = obsolete_segments.begin();
+      i != obsolete_segments.end(); i++) {
+    path = g_build_filename(index_dir, i->c_str(), NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  obsolete_segments.clear();
+
+  return true;
+}
+
+bool SearchIndex::replayJournal(GError **err)
+{
+  char *path = g_build_filename(index_dir, "journal", NULL);
+  char *contents;
+  gsize length;
+  if (!g_file_test(path, G_FILE_TEST_EXISTS)
+      || !g_file_get_contents(path, &contents, &length, NULL)) {
+    g_free(path);
+    return true;
+  }
+
+  /* Postings of a message are committed by the next "S" line of the same
+   * logfile. Anything after the last commit was written by an interrupted
+   * indexing and is cut off. */
+  std::vector<char*> pending;
+  gsize committed = 0;
+  bool valid = true;
+  char *line = contents;
+  char *end;
+  while (valid && (end = static_cast<char*>(memchr(line, '\n',
+            contents + length - line)))) {
+    *end = '\0';
+
+    if (line[0] == 'F' && line[1] == ' ') {
+      File file;
+      file.path = line + 2;
+      file.size = 0;
+      if (file_ids.find(file.path) != file_ids.end()) {
+        valid = false;
+        break;
+      }
+      file_ids[file.path] = files.size();
+      files.push_back(file);
+      pending.clear();
+      committed = end + 1 - contents;
+    }
+    else if (line[0] == 'R' && line[1] == ' ')
+      pending.push_back(line + 2);
+    else if (line[0] == 'S' && line[1] == ' ') {
+      char *p;
+      guint32 id = strtoul(line + 2, &p, 10);
+      guint64 size = g_ascii_strtoull(p, NULL, 10);
+      if (id >= files.size()) {
+        valid = false;
+        break;
+      }
+
+      for (std::vector<char*>::iterator i = pending.begin();
+          i != pending.end(); i++) {
+        guint32 file = strtoul(*i, &p, 10);
+        guint64 offset = g_ascii_strtoull(p, &p, 10);
+        if (file != id)
+          continue;
+
+        char **tokens = g_strsplit(p, " ", -1);
+        for (char **token = tokens; *token; token++)
+          if (**token)
+            addPosting(*token, file, offset);
+        g_strfreev(tokens);
+      }
+      pending.clear();
+
+      files[id].size = size;
+      committed = end + 1 - contents;
+    }
+    else
+      valid = false;
+
+    line = end + 1;
+  }
+  g_free(contents);
+
+  if (!valid)
+    g_set_error(err, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+        _("Search index journal '%s' is damaged."), path);
+  else if (committed < length && truncate(path, committed) == -1) {
+    int errsv = errno;
+    g_set_error(err, G_FILE_ERROR, g_file_error_from_errno(errsv),
+        _("Error truncating search index journal '%s' (%s)."), path,
+        g_strerror(errsv));
+    valid = false;
+  }
+  g_free(path);
+
+  return valid;
+}
+
+bool SearchIndex::openJournal(bool truncate, GError **err)
+{
+  if (journal)
+    fclose(journal);
+
+  char *path = g_build_filename(index_dir, "journal", NULL);
+  if (!(journal = g_fopen(path, truncate ? "w" : "a"))) {
+    int errsv = errno;
+    g_set_error(err, G_FILE_ERROR, g_file_error_from_errno(errsv),
+        _("Error opening search index journal '%s' (%s)."), path,
+        g_strerror(errsv));
+  }
+  g_free(path);
+
+  return journal;
+}
+
+void SearchIndex::removeStaleSegments()
+{
+  GDir *dir = g_dir_open(index_dir, 0, NULL);
+  if (!dir)
+    return;
+
+  const char *name;
+  while ((name = g_dir_read_name(dir))) {
+    if (!g_str_has_prefix(name, "segment-"))
+      continue;
+
+    bool used = false;
+    for (Segments::iterator i = segments.begin(); i != segments.end(); i++)
+      if ((*i)->name == name) {
+        used = true;
+        break;
+      }
+    if (used)
+      continue;
+
+    char *path = g_build_filename(index_dir, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  g_dir_close(dir);
+}
+
+void SearchIndex::scanDir(const std::string& dir)
+{
+  char *dir_path = g_build_filename(logs_dir, dir.c_str(), NULL);
+  GDir *gdir = g_dir_open(dir_path, 0, NULL);
+  g_free(dir_path);
+  if (!gdir)
+    return;
+
+  const char *name;
+  while ((name = g_dir_read_name(gdir))) {
+    if (name[0] == '.')
+      continue;
+
+    std::string rel = dir.empty() ? name : dir + G_DIR_SEPARATOR_S + name;
+    char *path = g_build_filename(logs_dir, rel.c_str(), NULL);
+    struct stat st;
+    int res = g_stat(path, &st);
+    g_free(path);
+    if (res)
+      continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      scanDir(rel);
+      continue;
+    }
+    if (!S_ISREG(st.st_mode))
+      continue;
+
+    guint64 size = st.st_size;
+    FileIds::iterator i = file_ids.find(rel);
+    if (i == file_ids.end() ? !size : files[i->second].size == size)
+      continue;
+
+    guint32 id = getFile(rel.c_str());
+    if (size < files[id].size) {
+      // the logfile was truncated, index it again
+      files[id].size = 0;
+      if (journal)
+        fprintf(journal, "S %u 0\n", id);
+    }
+    scan_queue.push_back(std::make_pair(id, size));
+  }
+  g_dir_close(gdir);
+}
+
+guint32 SearchIndex::getFile(const char *path)
+{
+  FileIds::iterator i = file_ids.find(path);
+  if (i != file_ids.end())
+    return i->second;
+
+  guint32 id = files.size();
+  File file;
+  file.path = path;
+  file.size = 0;
+  files.push_back(file);
+  file_ids[file.path] = id;
+
+  if (journal)
+    fprintf(journal, "F %s\n", path);
+
+  return id;
+}
+
+bool SearchIndex::indexFile(guint32 id, guint64 limit, gsize budget,
+    GError **err)
+{
+  guint64 start = files[id].size;
+  if (start >= limit)
+    return true;
+
+  char *path = g_build_filename(logs_dir, files[id].path.c_str(), NULL);
+  GIOChannel *chan = g_io_channel_new_file(path, "r", err);
+  g_free(path);
+  if (!chan)
+    return false;
+  // this should never fail
+  g_io_channel_set_encoding(chan, NULL, NULL);
+
+  if (start && g_io_channel_seek_position(chan, start, G_SEEK_SET, err)
+      != G_IO_STATUS_NORMAL) {
+    g_io_channel_unref(chan);
+    return false;
+  }
+
+  /* Messages start with a "\f" line followed by four header lines
+   * (direction, type, sent time and show time) and the text. */
+  guint64 pos = start;
+  gint64 record = -1;
+  int header = 0;
+  GIOStatus st = G_IO_STATUS_NORMAL;
+  while (pos < limit) {
+    char *line;
+    gsize length;
+    if ((st = g_io_channel_read_line(chan, &line, &length, NULL, err))
+        != G_IO_STATUS_NORMAL)
+      break;
+
+    if (!strcmp(line, "\f\n")) {
+      if (record != -1)
+        indexRecord(id, record, raw_buffer->str);
+      record = -1;
+
+      if (pos - start >= budget) {
+        // continue with this message in the next step
+        g_free(line);
+        break;
+      }
+
+      record = pos;
+      header = 0;
+      g_string_truncate(raw_buffer, 0);
+    }
+    else if (record != -1) {
+      if (header < 4)
+        header++;
+      else
+        g_string_append_len(raw_buffer, line, length);
+    }
+
+    pos += length;
+    g_free(line);
+  }
+  g_io_channel_unref(chan);
+
+  bool res = st == G_IO_STATUS_NORMAL || st == G_IO_STATUS_EOF;
+  if (record != -1) {
+    if (res)
+      indexRecord(id, record, raw_buffer->str);
+    else {
+      // index the unfinished message again next time
+      pos = record;
+    }
+  }
+
+  // commit the postings
+  files[id].size = pos;
+  if (journal) {
+    fprintf(journal, "S %u %" G_GUINT64_FORMAT "\n", id, pos);
+    fflush(journal);
+  }
+
+  if (delta_postings >= delta_limit) {
+    GError *flush_err = NULL;
+    if (!flush(&flush_err)) {
+      // try it again when the delta doubles
+      delta_limit *= 2;
+      if (res)
+        g_propagate_error(err, flush_err);
+      else
+        g_clear_error(&flush_err);
+      return false;
+    }
+    delta_limit = DELTA_MAX_POSTINGS;
+  }
+
+  return res;
+}
+
+void SearchIndex::indexRecord(guint32 id, guint64 offset, const char *text)
+{
+  if (!g_utf8_validate(text, -1, NULL))
+    return;
+
+  g_string_truncate(text_buffer, 0);
+  Markup::stripHTML(text, text_buffer);
+
+  std::vector<std::string> tokens;
+  tokenize(text_buffer->str, tokens);
+  if (tokens.empty())
+    return;
+
+  std::sort(tokens.begin(), tokens.end());
+  tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+  if (journal)
+    fprintf(journal, "R %u %" G_GUINT64_FORMAT, id, offset);
+  for (std::vector<std::string>::iterator i = tokens.begin();
+      i != tokens.end(); i++) {
+    if (journal)
+      fprintf(journal, " %s", i->c_str());
+    addPosting(*i, id, offset);
+  }
+  if (journal)
+    fputc('\n', journal);
+}
+
+void SearchIndex::addPosting(const std::string& token, guint32 file,
+    guint64 offset)
+{
+  Postings *postings = static_cast<Postings*>(g_hash_table_lookup(delta,
+        token.c_str()));
+  if (!postings) {
+    postings = new Postings;
+    g_hash_table_insert(delta, g_strdup(token.c_str()), postings);
+  }
+
+  Posting posting;
+  posting.file = file;
+  posting.reserved = 0;
+  posting.offset = offset;
+  postings->push_back(posting);
+  delta_postings++;
+}
+
+bool SearchIndex::flush(GError **err)
+{
+  if (!delta_postings)
+    return true;
+
+  MergeTokens tokens;
+  tokens.reserve(g_hash_table_size(delta));
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, delta);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    Postings *postings = static_cast<Postings*>(value);
+    MergeToken token;
+    token.name = static_cast<const char*>(key);
+    token.len = strlen(token.name);
+    token.a = &(*postings)[0];
+    token.a_num = postings->size();
+    token.b = NULL;
+    token.b_num = 0;
+    tokens.push_back(token);
+  }
+  std::sort(tokens.begin(), tokens.end());
+
+  char *name = g_strdup_printf("segment-%u", next_segment++);
+  char *path = g_build_filename(index_dir, name, NULL);
+  Segment *segment = new Segment(name);
+  bool res = writeSegment(name, tokens, err) && segment->load(path, err);
+  g_free(path);
+  g_free(name);
+  if (!res) {
+    delete segment;
+    return false;
+  }
+  segments.push_back(segment);
+
+  /* Merge the last two segments while the newer one is at least half of the
+   * older one. A failed merge doesn't matter, the segments are still
+   * valid. */
+  while (segments.size() >= 2) {
+    const SegmentHeader *older = segments[segments.size() - 2]->header;
+    const SegmentHeader *newer = segments.back()->header;
+    if (older->postings_num > 2 * newer->postings_num || !merge(NULL))
+      break;
+  }
+
+  if (!saveState(err))
+    return false;
+
+  // everything from the journal is in the segments now
+  g_hash_table_remove_all(delta);
+  delta_postings = 0;
+  return openJournal(true, err);
+}
+
+bool SearchIndex::merge(GError **err)
+{
+  g_assert(segments.size() >= 2);
+
+  Segment *older = segments[segments.size() - 2];
+  Segment *newer = segments.back();
+  guint32 older_num = older->header->tokens_num;
+  guint32 newer_num = newer->header->tokens_num;
+
+  MergeTokens tokens;
+  tokens.reserve(MAX(older_num, newer_num));
+  guint32 i = 0, j = 0;
+  while (i < older_num || j < newer_num) {
+    int cmp;
+    if (i == older_num)
+      cmp = 1;
+    else if (j == newer_num)
+      cmp = -1;
+    else
+      cmp = compare_names(older->getName(i), older->tokens[i].name_len,
+          newer->getName(j), newer->tokens[j].name_len);
+
+    MergeToken token;
+    token.a = token.b = NULL;
+    token.a_num = token.b_num = 0;
+    if (cmp <= 0) {
+      const SegmentToken *t = &older->tokens[i++];
+      token.name = older->names + t->name;
+      token.len = t->name_len;
+      token.a = older->postings + t->postings;
+      token.a_num = t->postings_num;
+    }
+    if (cmp >= 0) {
+      const SegmentToken *t = &newer->tokens[j++];
+      token.name = newer->names + t->name;
+      token.len = t->name_len;
+      token.b = newer->postings + t->postings;
+      token.b_num = t->postings_num;
+    }
+    tokens.push_back(token);
+  }
+
+  char *name = g_strdup_printf("segment-%u", next_segment++);
+  char *path = g_build_filename(index_dir, name, NULL);
+  Segment *segment = new Segment(name);
+  bool res = writeSegment(name, tokens, err) && segment->load(path, err);
+  g_free(path);
+  g_free(name);
+  if (!res) {
+    delete segment;
+    return false;
+  }
+
+  obsolete_segments.push_back(older->name);
+  obsolete_segments.push_back(newer->name);
+  delete older;
+  delete newer;
+  segments.pop_back();
+  segments.back() = segment;
+
+  return true;
+}
+
+bool SearchIndex::writeSegment(const char *name, const MergeTokens& tokens,
+    GError **err)
+{
+  char *path = g_build_filename(index_dir, name, NULL);
+  char *tmp_path = g_strconcat(path, ".tmp", NULL);
+
+  SegmentHeader header;
+  memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+  header.tokens_num = tokens.size();
+  header.names_size = 0;
+  header.postings_num = 0;
+  for (MergeTokens::const_iterator i = tokens.begin(); i != tokens.end();
+      i++) {
+    header.names_size += i->len;
+    header.postings_num += i->a_num + i->b_num;
+  }
+
+  FILE *f = g_fopen(tmp_path, "wb");
+  if (f) {
+    fwrite(&header, sizeof(header), 1, f);
+
+    guint32 name_pos = 0;
+    guint64 postings_pos = 0;
+    for (MergeTokens::const_iterator i = tokens.begin(); i != tokens.end();
+        i++) {
+      SegmentToken token;
+      token.name = name_pos;
+      token.name_len = i->len;
+      token.postings_num = i->a_num + i->b_num;
+      token.reserved = 0;
+      token.postings = postings_pos;
+      fwrite(&token, sizeof(token), 1, f);
+      name_pos += token.name_len;
+      postings_pos += token.postings_num;
+    }
+
+    for (MergeTokens::const_iterator i = tokens.begin(); i != tokens.end();
+        i++)
+      fwrite(i->name, 1, i->len, f);
+    static const char zeros[8] = {0};
+    fwrite(zeros, 1, pad8(header.names_size) - header.names_size, f);
+
+    for (MergeTokens::const_iterator i = tokens.begin(); i != tokens.end();
+        i++) {
+      fwrite(i->a, sizeof(Posting), i->a_num, f);
+      fwrite(i->b, sizeof(Posting), i->b_num, f);
+    }
+  }
+
+  int errsv = errno;
+  bool res = f && !ferror(f);
+  if (f && fclose(f)) {
+    errsv = errno;
+    res = false;
+  }
+  if (res && g_rename(tmp_path, path)) {
+    errsv = errno;
+    res = false;
+  }
+
+  if (!res) {
+    g_set_error(err, G_FILE_ERROR, g_file_error_from_errno(errsv),
+        _("Error writing search index segment '%s' (%s)."), path,
+        g_strerror(errsv));
+    g_unlink(tmp_path);
+  }
+
+  g_free(tmp_path);
+  g_free(path);
+  return res;
+}
+
+void SearchIndex::collect(const std::string& token, bool prefix,
+    Postings& postings)
+{
+  const char *name = token.c_str();
+  size_t len = token.size();
+
+  for (Segments::iterator i = segments.begin(); i != segments.end(); i++) {
+    const Segment *segment = *i;
+    for (size_t j = segment->lowerBound(name, len);
+        j < segment->header->tokens_num; j++) {
+      const SegmentToken *t = &segment->tokens[j];
+      if (t->name_len < len || memcmp(segment->getName(j), name, len)
+          || (!prefix && t->name_len != len))
+        break;
+
+      postings.insert(postings.end(), segment->postings + t->postings,
+          segment->postings + t->postings + t->postings_num);
+      if (!prefix)
+        break;
+    }
+  }
+
+  if (!prefix) {
+    Postings *p = static_cast<Postings*>(g_hash_table_lookup(delta, name));
+    if (p)
+      postings.insert(postings.end(), p->begin(), p->end());
+    return;
+  }
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, delta);
+  while (g_hash_table_iter_next(&iter, &key, &value))
+    if (g_str_has_prefix(static_cast<const char*>(key), name)) {
+      Postings *p = static_cast<Postings*>(value);
+      postings.insert(postings.end(), p->begin(), p->end());
+    }
+}
+
+bool SearchIndex::readResult(GIOChannel *chan, const Posting& posting,
+    const std::vector<std::string>& tokens, const std::string *prefix,
+    Result& result)
+{
+  if (g_io_channel_seek_position(chan, posting.offset, G_SEEK_SET, NULL)
+      != G_IO_STATUS_NORMAL)
+    return false;
+
+  char *line;
+  gsize length;
+  /* The whole message is read so words anywhere in it are matched, only the
+   * text shown in the result is shortened. */
+  g_string_truncate(raw_buffer, 0);
+  result.time = 0;
+  for (int i = 0; ; i++) {
+    if (g_io_channel_read_line(chan, &line, &length, NULL, NULL)
+        != G_IO_STATUS_NORMAL)
+      break;
+
+    bool start = !strcmp(line, "\f\n");
+    if (i == 0 ? !start : start) {
+      // not a message or the start of the next one
+      g_free(line);
+      break;
+    }
+
+    if (i == 3)
+      result.time = strtol(line, NULL, 10);
+    else if (i > 4)
+      g_string_append_len(raw_buffer, line, length);
+    g_free(line);
+  }
+
+  if (!g_utf8_validate(raw_buffer->str, -1, NULL))
+    return false;
+  g_string_truncate(text_buffer, 0);
+  Markup::stripHTML(raw_buffer->str, text_buffer);
+
+  // check that the message really contains all words
+  std::vector<std::string> words;
+  tokenize(text_buffer->str, words);
+  std::sort(words.begin(), words.end());
+  for (std::vector<std::string>::const_iterator i = tokens.begin();
+      i != tokens.end(); i++) {
+    std::vector<std::string>::iterator j = std::lower_bound(words.begin(),
+        words.end(), *i);
+    if (j == words.end())
+      return false;
+    if (prefix && *i == *prefix ? j->compare(0, i->size(), *i) : *j != *i)
+      return false;
+  }
+
+  // put the text on a single line and shorten it
+  result.text.clear();
+  bool space = false;
+  int chars = 0;
+  for (const char *p = text_buffer->str; *p && chars < RESULT_TEXT_CHARS;
+      p = g_utf8_next_char(p)) {
+    if (g_unichar_isspace(g_utf8_get_char(p))) {
+      space = true;
+      continue;
+    }
+    if (space && !result.text.empty()) {
+      result.text += ' ';
+      chars++;
+    }
+    space = false;
+    result.text.append(p, g_utf8_next_char(p) - p);
+    chars++;
+  }
+
+  result.path = files[posting.file].path;
+  result.offset = posting.offset;
+  return true;
+}
+
+void SearchIndex::free_postings_(gpointer data)
+{
+  delete static_cast<Postings*>(data);
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
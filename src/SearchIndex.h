@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2010-2013 by CenterIM developers
+ *
+ * This file is part of CenterIM.
+ *
+ * CenterIM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CenterIM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __SEARCHINDEX_H__
+#define __SEARCHINDEX_H__
+
+#include <glib.h>
+#include <stdio.h>
+#include <time.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Persistent inverted index of conversation logfiles. Every word of a logged
+ * message is mapped to the logfile and the offset of the message in it.
+ *
+ * The index is made of immutable segment files and a journal. Postings of
+ * newly indexed messages are kept in memory and appended to the journal.
+ * When there are enough of them they are written out as a new segment and
+ * the journal is truncated. Segments of a similar size are merged, so the
+ * number of segments grows only logarithmically. The list of segments and
+ * the indexed size of every logfile are kept in a state file.
+ *
+ * The class isn't thread-safe, all methods have to be called from one
+ * thread.
+ */
+class SearchIndex
+{
+public:
+  struct Result
+  {
+    /**
+     * Path of the logfile relative to the logs directory.
+     */
+    std::string path;
+    /**
+     * Offset of the message in the logfile.
+     */
+    gint64 offset;
+    time_t time;
+    /**
+     * Plain text of the message, shortened and put on a single line.
+     */
+    std::string text;
+  };
+  typedef std::vector<Result> Results;
+
+  SearchIndex(const char *index_dir_, const char *logs_dir_);
+  ~SearchIndex();
+
+  /**
+   * Loads the state, maps all segments and replays the journal. If the
+   * index is damaged it is discarded and false is returned, the index is
+   * rebuilt by scanning all logfiles in this case.
+   */
+  bool open(GError **err);
+
+  /**
+   * Finds logfiles that have grown since they were indexed last time. They
+   * are indexed in small steps by scanStep().
+   */
+  void scan();
+  /**
+   * Indexes a part of one logfile found by scan(). Returns false if there is
+   * nothing more to index.
+   */
+  bool scanStep(GError **err);
+
+  /**
+   * Indexes messages appended to a logfile up to a given size.
+   */
+  bool update(const char *path, gint64 size, GError **err);
+
+  /**
+   * Finds messages that contain all words of a query, the last word can be
+   * only a prefix if the query doesn't end with a space. At most max newest
+   * results of all logfiles are returned, the newest one first.
+   */
+  void query(const char *text, size_t max, Results& results);
+
+  /**
+   * Splits text into lowercase words.
+   */
+  static void tokenize(const char *text, std::vector<std::string>& tokens);
+
+protected:
+
+private:
+  struct File
+  {
+    std::string path;
+    // number of bytes already indexed
+    guint64 size;
+  };
+
+  struct Posting
+  {
+    guint32 file;
+    // keeps the layout free of padding, postings are written to segments
+    guint32 reserved;
+    guint64 offset;
+
+    bool operator<(const Posting& other) const
+      { return file < other.file
+        || (file == other.file && offset < other.offset); }
+    bool operator==(const Posting& other) const
+      { return file == other.file && offset == other.offset; }
+  };
+  typedef std::vector<Posting> Postings;
+
+  struct Segment;
+  struct MergeToken;
+  typedef std::vector<File> Files;
+  typedef std::map<std::string, guint32> FileIds;
+  typedef std::vector<Segment*> Segments;
+  typedef std::vector<MergeToken> MergeTokens;
+  // file ids and sizes waiting for the scan
+  typedef std::deque<std::pair<guint32, guint64> > ScanQueue;
+
+  char *index_dir;
+  char *logs_dir;
+
+  Files files;
+  FileIds file_ids;
+
+  Segments segments;
+  // number used in the name of the next segment file
+  unsigned next_segment;
+  // merged segments that can be removed once the state is saved
+  std::vector<std::string> obsolete_segments;
+
+  /**
+   * Postings that aren't in any segment yet, maps a token to a Postings
+   * vector.
+   */
+  GHashTable *delta;
+  size_t delta_postings;
+  size_t delta_limit;
+
+  FILE *journal;
+  ScanQueue scan_queue;
+
+  // buffers reused for parsing of messages
+  GString *raw_buffer;
+  GString *text_buffer;
+
+  void reset();
+  bool loadState(GError **err);
+  bool saveState(GError **err);
+  bool replayJournal(GError **err);
+  bool openJournal(bool truncate, GError **err);
+  void removeStaleSegments();
+  void scanDir(const std::string& dir);
+
+  guint32 getFile(const char *path);
+  bool indexFile(guint32 id, guint64 limit, gsize budget, GError **err);
+  void indexRecord(guint32 id, guint64 offset, const char *text);
+  void addPosting(const std::string& token, guint32 file, guint64 offset);
+
+  bool flush(GError **err);
+  bool merge(GError **err);
+  bool writeSegment(const char *name, const MergeTokens& tokens,
+      GError **err);
+
+  void collect(const std::string& token, bool prefix, Postings& postings);
+  bool readResult(GIOChannel *chan, const Posting& posting,
+      const std::vector<std::string>& tokens, const std::string *prefix,
+      Result& result);
+
+  static void free_postings_(gpointer data);
+
+  SearchIndex(const SearchIndex&);
+  SearchIndex& operator=(const SearchIndex&);
+};
+
+#endif // __SEARCHINDEX_H__
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -1,6 +1,5 @@
 /*
- * Copyright (C) 2007 by Mark Pustjens <pustjens@dds.nl>
- * Copyright (C) 2012-2013 by CenterIM developers
+ * Copyright (C) 2010-2013 by CenterIM developers
  *
  * This file is part of CenterIM.
  *
@@ -21,12 +20,848 @@
 
 #include "Transfers.h"
 
+#include "Log.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h> // memset
+#include <unistd.h>
+#include "gettext.h"
+
+/* Progress of transfers is shown at most this often (in ms), libpurple calls
+ * update_progress() for every received or sent chunk of data. */
+#define PROGRESS_REFRESH_INTERVAL 250
+
+// size of the local read-ahead and write-behind buffer of every transfer
+#define TRANSFER_BUFFER_SIZE (256 * 1024)
+
+// weight of the latest sample in the smoothed throughput
+#define RATE_SMOOTHING 0.3
+
+Transfers *Transfers::my_instance = NULL;
+
+Transfers *Transfers::instance()
+{
+  return my_instance;
+}
+
+void Transfers::openTransferWindow()
+{
+  TransferWindow *win = new TransferWindow;
+  win->show();
+}
+
+bool Transfers::acceptRequest(void *user_data, GCallback ok_cb,
+    GCallback cancel_cb, const char *filename)
+{
+  g_assert(ok_cb);
+
+  Transfer *transfer = findTransfer(static_cast<PurpleXfer*>(user_data));
+  if (!transfer)
+    return false;
+
+  if (!canStart()) {
+    /* Libpurple holds a reference to the transfer until one of the request
+     * callbacks is called so it can't go away while it is queued. */
+    transfer->queued = true;
+    transfer->accept_cb = ok_cb;
+    transfer->cancel_cb = cancel_cb;
+    transfer->accept_filename = filename ? filename : "";
+    queue.push_back(transfer);
+
+    LOG->message(_("File transfer of '%s' is queued."),
+        transfer->filename.c_str());
+    scheduleRefresh();
+    return true;
+  }
+
+  transfer->running = true;
+  reinterpret_cast<PurpleRequestFileCb>(ok_cb)(user_data, filename);
+  return true;
+}
+
+Transfers::Transfer::Transfer(PurpleXfer *xfer_)
+: xfer(xfer_), size(0), bytes(0), start_time(0), end_time(0), sample_time(0)
+, sample_bytes(0), rate(0), running(false), queued(false), failed(false)
+, accept_cb(NULL), cancel_cb(NULL), fd(-1), buffer(NULL), buffer_len(0)
+, buffer_pos(0)
+{
+  g_assert(xfer);
+
+  type = purple_xfer_get_type(xfer);
+  status = purple_xfer_get_status(xfer);
+  const char *remote = purple_xfer_get_remote_user(xfer);
+  if (remote)
+    who = remote;
+  update(0);
+}
+
+Transfers::Transfer::~Transfer()
+{
+  closeFile();
+}
+
+void Transfers::Transfer::update(gint64 now)
+{
+  if (!xfer)
+    return;
+
+  status = purple_xfer_get_status(xfer);
+  if (failed && status == PURPLE_XFER_STATUS_DONE)
+    status = PURPLE_XFER_STATUS_CANCEL_LOCAL;
+  const char *name = purple_xfer_get_filename(xfer);
+  if (name)
+    filename = name;
+  size = purple_xfer_get_size(xfer);
+  bytes = purple_xfer_get_bytes_sent(xfer);
+
+  if (!now)
+    return;
+
+  if (status == PURPLE_XFER_STATUS_STARTED && !start_time) {
+    start_time = sample_time = now;
+    sample_bytes = bytes;
+  }
+  else if (start_time && !end_time && now > sample_time
+      && bytes >= sample_bytes) {
+    double current = static_cast<double>(bytes - sample_bytes)
+      * G_USEC_PER_SEC / (now - sample_time);
+    if (rate)
+      rate = RATE_SMOOTHING * current + (1 - RATE_SMOOTHING) * rate;
+    else
+      rate = current;
+    sample_time = now;
+    sample_bytes = bytes;
+  }
+
+  if (isFinished() && !end_time)
+    end_time = now;
+}
+
+double Transfers::Transfer::getAverageRate(gint64 now) const
+{
+  if (!start_time)
+    return 0;
+
+  gint64 end = end_time ? end_time : now;
+  if (end <= start_time)
+    return 0;
+  return static_cast<double>(bytes) * G_USEC_PER_SEC / (end - start_time);
+}
+
+bool Transfers::Transfer::isFinished() const
+{
+  return status == PURPLE_XFER_STATUS_DONE
+    || status == PURPLE_XFER_STATUS_CANCEL_LOCAL
+    || status == PURPLE_XFER_STATUS_CANCEL_REMOTE;
+}
+
+void Transfers::Transfer::start()
+{
+  /* Report readiness even if the file can't be opened, the first read() or
+   * write() then fails and libpurple cancels the transfer. */
+  openFile();
+  purple_xfer_ui_ready(xfer);
+}
+
+gssize Transfers::Transfer::write(const guchar *data, gssize len)
+{
+  if (!openFile())
+    return -1;
+
+  gssize total = len;
+  while (len > 0) {
+    if (buffer_len == TRANSFER_BUFFER_SIZE && !flush())
+      return -1;
+
+    size_t n = MIN(static_cast<size_t>(len),
+        TRANSFER_BUFFER_SIZE - buffer_len);
+    memcpy(buffer + buffer_len, data, n);
+    buffer_len += n;
+    data += n;
+    len -= n;
+  }
+
+  /* Libpurple reports the transfer as completed right after the last chunk
+   * is written, listeners of the completion can open the file at once. The
+   * file has to be complete by then, if the size isn't known the end can't
+   * be foreseen so the data are written through. A failure makes libpurple
+   * cancel the transfer. */
+  size_t xfer_size = purple_xfer_get_size(xfer);
+  if (!xfer_size
+      || purple_xfer_get_bytes_sent(xfer) + total >= xfer_size) {
+    if (!flush())
+      return -1;
+    if (xfer_size && !closeFile())
+      return -1;
+  }
+
+  // ask libpurple for the next chunk
+  purple_xfer_ui_ready(xfer);
+  return total;
+}
+
+gssize Transfers::Transfer::read(guchar **data, gssize len)
+{
+  if (!openFile())
+    return -1;
+
+  if (buffer_pos == buffer_len) {
+    // read ahead as much as the buffer can hold
+    ssize_t res;
+    do
+      res = ::read(fd, buffer, TRANSFER_BUFFER_SIZE);
+    while (res < 0 && errno == EINTR);
+
+    if (res <= 0) {
+      LOG->error(_("Error reading file '%s' (%s)."),
+          purple_xfer_get_local_filename(xfer),
+          res ? g_strerror(errno) : _("Unexpected end of file"));
+      return -1;
+    }
+    buffer_len = res;
+    buffer_pos = 0;
+  }
+
+  size_t n = MIN(static_cast<size_t>(len), buffer_len - buffer_pos);
+  *data = static_cast<guchar*>(g_memdup(buffer + buffer_pos, n));
+  buffer_pos += n;
+
+  // the next chunk can be read when libpurple is able to send more
+  purple_xfer_ui_ready(xfer);
+  return n;
+}
+
+void Transfers::Transfer::unread(gsize len)
+{
+  /* Data that libpurple couldn't send are always from the last read() which
+   * didn't refill the buffer afterwards. */
+  g_assert(len <= buffer_pos);
+
+  buffer_pos -= len;
+}
+
+bool Transfers::Transfer::closeFile()
+{
+  if (fd < 0)
+    return true;
+
+  bool res = true;
+  if (type == PURPLE_XFER_RECEIVE)
+    res = flush();
+
+  if (close(fd) && res) {
+    LOG->error(_("Error closing file '%s' (%s)."),
+        xfer ? purple_xfer_get_local_filename(xfer) : filename.c_str(),
+        g_strerror(errno));
+    res = false;
+  }
+  fd = -1;
+
+  g_free(buffer);
+  buffer = NULL;
+  buffer_len = buffer_pos = 0;
+
+  return res;
+}
+
+bool Transfers::Transfer::openFile()
+{
+  if (fd >= 0)
+    return true;
+
+  if (!xfer)
+    return false;
+
+  const char *path = purple_xfer_get_local_filename(xfer);
+  if (!path)
+    return false;
+
+  // continue at the position where a resumed transfer starts
+  off_t offset = purple_xfer_get_bytes_sent(xfer);
+  int flags = O_RDONLY;
+  if (type == PURPLE_XFER_RECEIVE) {
+    flags = O_WRONLY | O_CREAT;
+    if (!offset)
+      flags |= O_TRUNC;
+  }
+
+  fd = open(path, flags, 0644);
+  if (fd < 0) {
+    LOG->error(_("Error opening file '%s' (%s)."), path, g_strerror(errno));
+    return false;
+  }
+
+  if (offset && lseek(fd, offset, SEEK_SET) == static_cast<off_t>(-1)) {
+    LOG->error(_("Error seeking in file '%s' (%s)."), path,
+        g_strerror(errno));
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif // POSIX_FADV_SEQUENTIAL
+
+  buffer = static_cast<char*>(g_malloc(TRANSFER_BUFFER_SIZE));
+  buffer_len = buffer_pos = 0;
+  return true;
+}
+
+bool Transfers::Transfer::flush()
+{
+  size_t pos = 0;
+  while (pos < buffer_len) {
+    ssize_t res = ::write(fd, buffer + pos, buffer_len - pos);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG->error(_("Error writing file '%s' (%s)."),
+          xfer ? purple_xfer_get_local_filename(xfer) : filename.c_str(),
+          g_strerror(errno));
+      return false;
+    }
+    pos += res;
+  }
+  buffer_len = 0;
+  return true;
+}
+
+Transfers::TransferWindow::TransferWindow()
+: SplitDialog(0, 0, 80, 24, _("File transfers"))
+{
+  setColorScheme("generalwindow");
+
+  list = new CppConsUI::ListBox(AUTOSIZE, AUTOSIZE);
+  setContainer(*list);
+
+  buttons->appendItem(_("Clear finished"), sigc::mem_fun(this,
+        &TransferWindow::onClearFinished));
+  buttons->appendSeparator();
+  buttons->appendItem(_("Done"), sigc::hide(sigc::mem_fun(this,
+          &TransferWindow::close)));
+
+  update_conn = TRANSFERS->signal_update.connect(sigc::mem_fun(this,
+        &TransferWindow::update));
+  update();
+}
+
+Transfers::TransferWindow::~TransferWindow()
+{
+  update_conn.disconnect();
+}
+
+void Transfers::TransferWindow::onScreenResized()
+{
+  moveResizeRect(CENTERIM->getScreenArea(CenterIM::CHAT_AREA));
+}
+
+void Transfers::TransferWindow::update()
+{
+  const TransferList& transfers = TRANSFERS->transfers;
+
+  // remove rows of cleared transfers
+  for (Rows::iterator i = rows.begin(); i != rows.end(); ) {
+    if (std::find(transfers.begin(), transfers.end(), i->first)
+        == transfers.end()) {
+      list->removeWidget(*i->second);
+      rows.erase(i++);
+    }
+    else
+      i++;
+  }
+
+  for (TransferList::const_iterator i = transfers.begin();
+      i != transfers.end(); i++) {
+    CppConsUI::Button *button;
+    Rows::iterator row = rows.find(*i);
+    if (row == rows.end()) {
+      button = new CppConsUI::Button(CppConsUI::Button::FLAG_VALUE
+          | CppConsUI::Button::FLAG_RIGHT);
+      button->signal_activate.connect(sigc::bind(sigc::mem_fun(this,
+              &TransferWindow::onRowActivate), *i));
+      list->appendWidget(*button);
+      rows[*i] = button;
+    }
+    else
+      button = row->second;
+
+    updateRow(*button, **i);
+  }
+}
+
+void Transfers::TransferWindow::updateRow(CppConsUI::Button& button,
+    const Transfer& transfer)
+{
+  const char *name = transfer.filename.empty() ? _("Unknown file")
+    : transfer.filename.c_str();
+  char *text;
+  if (transfer.type == PURPLE_XFER_SEND)
+    text = g_strdup_printf(_("%s to %s"), name, transfer.who.c_str());
+  else
+    text = g_strdup_printf(_("%s from %s"), name, transfer.who.c_str());
+  button.setText(text);
+  g_free(text);
+
+  gint64 now = CppConsUI::CoreManager::getMonotonicTime();
+  char *size = purple_str_size_to_units(transfer.size);
+  char *value = NULL;
+  char *right = NULL;
+
+  if (transfer.queued)
+    value = g_strdup(_("Queued"));
+  else {
+    switch (transfer.status) {
+      case PURPLE_XFER_STATUS_STARTED:
+        {
+          char *bytes = purple_str_size_to_units(transfer.bytes);
+          int percent = transfer.size
+            ? static_cast<int>(transfer.bytes * 100.0 / transfer.size) : 0;
+          value = g_strdup_printf(_("%d%% (%s of %s)"), percent, bytes,
+              size);
+          g_free(bytes);
+
+          if (transfer.rate >= 1) {
+            char *rate = purple_str_size_to_units(
+                static_cast<size_t>(transfer.rate));
+            if (transfer.size > transfer.bytes) {
+              unsigned left = static_cast<unsigned>(
+                  (transfer.size - transfer.bytes) / transfer.rate);
+              right = g_strdup_printf(_("%s/s, %u:%02u:%02u left"), rate,
+                  left / 3600, left / 60 % 60, left % 60);
+            }
+            else
+              right = g_strdup_printf(_("%s/s"), rate);
+            g_free(rate);
+          }
+        }
+        break;
+      case PURPLE_XFER_STATUS_DONE:
+        {
+          char *rate = purple_str_size_to_units(
+              static_cast<size_t>(transfer.getAverageRate(now)));
+          value = g_strdup_printf(_("Completed (%s)"), size);
+          right = g_strdup_printf(_("average %s/s"), rate);
+          g_free(rate);
+        }
+        break;
+      case PURPLE_XFER_STATUS_CANCEL_LOCAL:
+        value = g_strdup(_("Cancelled"));
+        break;
+      case PURPLE_XFER_STATUS_CANCEL_REMOTE:
+        value = g_strdup(_("Cancelled by remote"));
+        break;
+      default:
+        value = g_strdup(_("Waiting"));
+        break;
+    }
+  }
+
+  button.setValue(value);
+  button.setRight(right);
+  g_free(value);
+  g_free(right);
+  g_free(size);
+}
+
+void Transfers::TransferWindow::onRowActivate(
+    CppConsUI::Button& /*activator*/, const Transfer *transfer)
+{
+  if (transfer->isFinished())
+    return;
+
+  char *msg = g_strdup_printf(
+      _("Are you sure you want to cancel transfer of %s?"),
+      transfer->filename.c_str());
+  CppConsUI::MessageDialog *dialog = new CppConsUI::MessageDialog(
+      _("Cancel transfer"), msg);
+  g_free(msg);
+  dialog->signal_response.connect(sigc::bind(sigc::mem_fun(this,
+          &TransferWindow::onCancelResponse), transfer));
+  dialog->show();
+}
+
+void Transfers::TransferWindow::onCancelResponse(
+    CppConsUI::MessageDialog& /*activator*/,
+    CppConsUI::AbstractDialog::ResponseType response,
+    const Transfer *transfer)
+{
+  if (response != CppConsUI::AbstractDialog::RESPONSE_OK)
+    return;
+
+  TRANSFERS->cancelTransfer(transfer);
+}
+
+void Transfers::TransferWindow::onClearFinished(
+    CppConsUI::Button& /*activator*/)
+{
+  TRANSFERS->clearFinished();
+}
+
 Transfers::Transfers()
+: refresh_pending(false)
 {
+  // init prefs
+  purple_prefs_add_none(CONF_PREFIX "/transfers");
+  purple_prefs_add_int(CONF_PREFIX "/transfers/max_concurrent", 3);
+
+  memset(&centerim_xfer_ui_ops, 0, sizeof(centerim_xfer_ui_ops));
+
+  // set the purple file transfer callbacks
+  centerim_xfer_ui_ops.new_xfer = new_xfer_;
+  centerim_xfer_ui_ops.destroy = destroy_;
+  centerim_xfer_ui_ops.add_xfer = add_xfer_;
+  centerim_xfer_ui_ops.update_progress = update_progress_;
+  centerim_xfer_ui_ops.cancel_local = cancel_local_;
+  centerim_xfer_ui_ops.cancel_remote = cancel_remote_;
+  centerim_xfer_ui_ops.ui_write = ui_write_;
+  centerim_xfer_ui_ops.ui_read = ui_read_;
+  centerim_xfer_ui_ops.data_not_sent = data_not_sent_;
+  purple_xfers_set_ui_ops(&centerim_xfer_ui_ops);
+
+  void *handle = purple_xfers_get_handle();
+  purple_signal_connect(handle, "file-send-start", this,
+      PURPLE_CALLBACK(file_start_), this);
+  purple_signal_connect(handle, "file-recv-start", this,
+      PURPLE_CALLBACK(file_start_), this);
 }
 
 Transfers::~Transfers()
 {
+  refresh_conn.disconnect();
+  start_conn.disconnect();
+
+  // reject all queued transfers, this releases the request references
+  while (!queue.empty()) {
+    Transfer *transfer = queue.front();
+    queue.pop_front();
+    transfer->queued = false;
+    if (purple_xfer_is_canceled(transfer->xfer))
+      purple_xfer_unref(transfer->xfer);
+    else if (transfer->cancel_cb)
+      reinterpret_cast<PurpleRequestFileCb>(transfer->cancel_cb)(
+          transfer->xfer, NULL);
+  }
+
+  /* Cancel all unfinished transfers. The ui_ops structure is going away
+   * so detach it from transfers that are still referenced by libpurple. */
+  XferMap live = xfers;
+  for (XferMap::iterator i = live.begin(); i != live.end(); i++) {
+    PurpleXfer *xfer = i->first;
+    purple_xfer_ref(xfer);
+
+    if (!purple_xfer_is_completed(xfer) && !purple_xfer_is_canceled(xfer))
+      purple_xfer_cancel_local(xfer);
+
+    Transfer *transfer = findTransfer(xfer);
+    if (transfer) {
+      transfer->closeFile();
+      transfer->xfer = NULL;
+      xfers.erase(xfer);
+    }
+    xfer->ui_ops = NULL;
+
+    purple_xfer_unref(xfer);
+  }
+
+  for (TransferList::iterator i = transfers.begin(); i != transfers.end();
+      i++)
+    delete *i;
+
+  purple_xfers_set_ui_ops(NULL);
+  purple_signals_disconnect_by_handle(this);
+}
+
+void Transfers::init()
+{
+  g_assert(!my_instance);
+
+  my_instance = new Transfers;
+}
+
+void Transfers::finalize()
+{
+  g_assert(my_instance);
+
+  delete my_instance;
+  my_instance = NULL;
+}
+
+Transfers::Transfer *Transfers::findTransfer(PurpleXfer *xfer)
+{
+  XferMap::iterator i = xfers.find(xfer);
+  if (i == xfers.end())
+    return NULL;
+  return i->second;
+}
+
+int Transfers::getRunningCount() const
+{
+  int running = 0;
+  for (XferMap::const_iterator i = xfers.begin(); i != xfers.end(); i++)
+    if (i->second->running)
+      running++;
+  return running;
+}
+
+bool Transfers::canStart() const
+{
+  int max = purple_prefs_get_int(CONF_PREFIX "/transfers/max_concurrent");
+  return max <= 0 || getRunningCount() < max;
+}
+
+void Transfers::scheduleRefresh()
+{
+  if (refresh_pending)
+    return;
+
+  refresh_pending = true;
+  refresh_conn = COREMANAGER->timeoutOnceConnect(sigc::mem_fun(this,
+        &Transfers::refresh), PROGRESS_REFRESH_INTERVAL);
+}
+
+void Transfers::refresh()
+{
+  refresh_pending = false;
+
+  gint64 now = CppConsUI::CoreManager::getMonotonicTime();
+  bool running = false;
+  for (XferMap::iterator i = xfers.begin(); i != xfers.end(); i++) {
+    i->second->update(now);
+    if (i->second->running)
+      running = true;
+  }
+
+  signal_update();
+
+  /* Keep the throughput and remaining time shown in the transfer window
+   * current even if a transfer stalls. */
+  if (running && !signal_update.empty())
+    scheduleRefresh();
+}
+
+void Transfers::scheduleStartQueued()
+{
+  if (queue.empty() || start_conn.connected())
+    return;
+
+  /* Don't accept the next transfer from inside of a libpurple callback that
+   * is finishing another transfer. */
+  start_conn = COREMANAGER->timeoutOnceConnect(sigc::mem_fun(this,
+        &Transfers::startQueued), 0);
+}
+
+void Transfers::startQueued()
+{
+  start_conn.disconnect();
+
+  while (!queue.empty() && canStart()) {
+    Transfer *transfer = queue.front();
+    queue.pop_front();
+    transfer->queued = false;
+
+    PurpleXfer *xfer = transfer->xfer;
+    if (purple_xfer_is_canceled(xfer)) {
+      // only release the reference held for the file request
+      purple_xfer_unref(xfer);
+      continue;
+    }
+
+    transfer->running = true;
+    reinterpret_cast<PurpleRequestFileCb>(transfer->accept_cb)(xfer,
+        transfer->accept_filename.c_str());
+  }
+
+  scheduleRefresh();
+}
+
+void Transfers::stopTransfer(Transfer *transfer)
+{
+  /* The file of a transfer with a known size is closed with the last chunk,
+   * otherwise the data were written through and only closing can fail. */
+  if (!transfer->closeFile() && transfer->xfer
+      && purple_xfer_get_status(transfer->xfer) == PURPLE_XFER_STATUS_DONE)
+    transfer->failed = true;
+  transfer->update(CppConsUI::CoreManager::getMonotonicTime());
+
+  if (!transfer->running)
+    return;
+
+  transfer->running = false;
+  if (transfer->failed)
+    LOG->error(_("File transfer of '%s' failed, the file couldn't be "
+          "closed."), transfer->filename.c_str());
+  else if (transfer->status == PURPLE_XFER_STATUS_DONE) {
+    char *size = purple_str_size_to_units(transfer->bytes);
+    char *rate = purple_str_size_to_units(static_cast<size_t>(
+          transfer->getAverageRate(transfer->end_time)));
+    LOG->message(_("File transfer of '%s' completed (%s, %s/s)."),
+        transfer->filename.c_str(), size, rate);
+    g_free(size);
+    g_free(rate);
+  }
+  else
+    LOG->message(_("File transfer of '%s' was cancelled."),
+        transfer->filename.c_str());
+
+  scheduleStartQueued();
+}
+
+void Transfers::cancelTransfer(const Transfer *transfer)
+{
+  // the transfer could be cleared while the confirmation dialog was opened
+  TransferList::iterator i = std::find(transfers.begin(), transfers.end(),
+      transfer);
+  if (i == transfers.end() || !(*i)->xfer || (*i)->isFinished())
+    return;
+
+  Transfer *t = *i;
+  if (t->queued) {
+    queue.erase(std::find(queue.begin(), queue.end(), t));
+    t->queued = false;
+    if (t->cancel_cb)
+      reinterpret_cast<PurpleRequestFileCb>(t->cancel_cb)(t->xfer, NULL);
+    else
+      purple_xfer_unref(t->xfer);
+  }
+  else
+    purple_xfer_cancel_local(t->xfer);
+
+  scheduleRefresh();
+}
+
+void Transfers::clearFinished()
+{
+  TransferList::iterator end = transfers.begin();
+  for (TransferList::iterator i = transfers.begin(); i != transfers.end();
+      i++) {
+    Transfer *transfer = *i;
+    if (!transfer->isFinished() || transfer->queued) {
+      *end++ = transfer;
+      continue;
+    }
+
+    if (transfer->xfer) {
+      // libpurple doesn't need to tell us anything more about the transfer
+      transfer->xfer->ui_ops = NULL;
+      xfers.erase(transfer->xfer);
+    }
+    delete transfer;
+  }
+  transfers.erase(end, transfers.end());
+
+  signal_update();
+}
+
+void Transfers::new_xfer(PurpleXfer *xfer)
+{
+  Transfer *transfer = new Transfer(xfer);
+  transfers.push_back(transfer);
+  xfers[xfer] = transfer;
+
+  scheduleRefresh();
+}
+
+void Transfers::destroy(PurpleXfer *xfer)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  stopTransfer(transfer);
+  if (!transfer->isFinished())
+    transfer->status = PURPLE_XFER_STATUS_CANCEL_LOCAL;
+  transfer->xfer = NULL;
+  xfers.erase(xfer);
+
+  scheduleRefresh();
+}
+
+void Transfers::add_xfer(PurpleXfer *xfer)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  // the transfer was accepted
+  transfer->running = true;
+  scheduleRefresh();
+}
+
+void Transfers::update_progress(PurpleXfer *xfer, double /*percent*/)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  if (purple_xfer_is_completed(xfer))
+    stopTransfer(transfer);
+
+  /* Only remember that something changed, the progress is read and shown in
+   * refresh(). */
+  scheduleRefresh();
+}
+
+void Transfers::cancel_local(PurpleXfer *xfer)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  stopTransfer(transfer);
+  scheduleRefresh();
+}
+
+void Transfers::cancel_remote(PurpleXfer *xfer)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  stopTransfer(transfer);
+  scheduleRefresh();
+}
+
+void Transfers::file_start(PurpleXfer *xfer)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  /* Libpurple doesn't open the file itself because the UI reads and writes
+   * the data, it waits until the UI reports that it is ready. */
+  transfer->start();
+}
+
+gssize Transfers::ui_write(PurpleXfer *xfer, const guchar *buffer,
+    gssize size)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return -1;
+
+  return transfer->write(buffer, size);
+}
+
+gssize Transfers::ui_read(PurpleXfer *xfer, guchar **buffer, gssize size)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return -1;
+
+  return transfer->read(buffer, size);
+}
+
+void Transfers::data_not_sent(PurpleXfer *xfer, const guchar * /*buffer*/,
+    gsize size)
+{
+  Transfer *transfer = findTransfer(xfer);
+  if (!transfer)
+    return;
+
+  transfer->unread(size);
 }
 
 /* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -1,6 +1,5 @@
 /*
- * Copyright (C) 2007 by Mark Pustjens <pustjens@dds.nl>
- * Copyright (C) 2012-2013 by CenterIM developers
+ * Copyright (C) 2010-2013 by CenterIM developers
  *
  * This file is part of CenterIM.
  *
@@ -22,15 +21,240 @@
 #ifndef __TRANSFERS_H__
 #define __TRANSFERS_H__
 
+#include <cppconsui/ListBox.h>
+#include <cppconsui/MessageDialog.h>
+#include <cppconsui/SplitDialog.h>
+#include <libpurple/purple.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#define TRANSFERS (Transfers::instance())
+
 class Transfers
 {
 public:
-  Transfers();
-  ~Transfers();
+  static Transfers *instance();
+
+  /**
+   * Opens a window with a list of all file transfers.
+   */
+  void openTransferWindow();
+
+  /**
+   * Handles a positive answer to a file request. If the request belongs to
+   * a file transfer then the transfer is either accepted immediately or, if
+   * the maximum number of concurrent transfers is reached, it is queued and
+   * accepted later. Returns false if user_data isn't a file transfer so the
+   * caller should handle the request itself.
+   */
+  bool acceptRequest(void *user_data, GCallback ok_cb, GCallback cancel_cb,
+      const char *filename);
 
 protected:
 
 private:
+  /**
+   * Record of a single file transfer. Data are copied from the PurpleXfer so
+   * the transfer can be displayed even after libpurple destroys it.
+   */
+  class Transfer
+  {
+  public:
+    Transfer(PurpleXfer *xfer_);
+    ~Transfer();
+
+    PurpleXfer *xfer;
+    PurpleXferType type;
+    PurpleXferStatusType status;
+    std::string filename;
+    std::string who;
+
+    size_t size;
+    size_t bytes;
+
+    // throughput statistics, times are in microseconds
+    gint64 start_time;
+    gint64 end_time;
+    gint64 sample_time;
+    size_t sample_bytes;
+    // exponentially smoothed throughput in bytes per second
+    double rate;
+
+    // counted against the maximum number of concurrent transfers
+    bool running;
+    // accepted by the user and waiting for a free slot
+    bool queued;
+    // the local file couldn't be completed, the transfer isn't shown as done
+    bool failed;
+    GCallback accept_cb;
+    GCallback cancel_cb;
+    std::string accept_filename;
+
+    /**
+     * Reads the current state of the transfer from libpurple and updates
+     * the statistics.
+     */
+    void update(gint64 now);
+    /**
+     * Returns the average throughput in bytes per second.
+     */
+    double getAverageRate(gint64 now) const;
+    bool isFinished() const;
+
+    /**
+     * Opens the local file and tells libpurple that the UI is ready to
+     * transfer data.
+     */
+    void start();
+    /**
+     * Write-behind buffered output for received data.
+     */
+    gssize write(const guchar *data, gssize len);
+    /**
+     * Read-ahead buffered input for sent data, returns a newly allocated
+     * chunk of the file in data.
+     */
+    gssize read(guchar **data, gssize len);
+    /**
+     * Returns len bytes handed out by the last read() back to the buffer.
+     */
+    void unread(gsize len);
+    /**
+     * Flushes pending data and closes the local file.
+     */
+    bool closeFile();
+
+  protected:
+
+  private:
+    int fd;
+    char *buffer;
+    size_t buffer_len;
+    size_t buffer_pos;
+
+    bool openFile();
+    bool flush();
+
+    Transfer(const Transfer&);
+    Transfer& operator=(const Transfer&);
+  };
+
+  class TransferWindow
+  : public CppConsUI::SplitDialog
+  {
+  public:
+    TransferWindow();
+    virtual ~TransferWindow();
+
+    // FreeWindow
+    virtual void onScreenResized();
+
+  protected:
+    CppConsUI::ListBox *list;
+
+  private:
+    typedef std::map<const Transfer*, CppConsUI::Button*> Rows;
+
+    Rows rows;
+    sigc::connection update_conn;
+
+    TransferWindow(const TransferWindow&);
+    TransferWindow& operator=(const TransferWindow&);
+
+    void update();
+    void updateRow(CppConsUI::Button& button, const Transfer& transfer);
+
+    void onRowActivate(CppConsUI::Button& activator,
+        const Transfer *transfer);
+    void onCancelResponse(CppConsUI::MessageDialog& activator,
+        CppConsUI::AbstractDialog::ResponseType response,
+        const Transfer *transfer);
+    void onClearFinished(CppConsUI::Button& activator);
+  };
+
+  typedef std::vector<Transfer*> TransferList;
+  typedef std::map<PurpleXfer*, Transfer*> XferMap;
+  typedef std::deque<Transfer*> TransferQueue;
+
+  // all transfers in the order they were created, including finished ones
+  TransferList transfers;
+  // transfers that still have a PurpleXfer
+  XferMap xfers;
+  // accepted transfers waiting for a free slot
+  TransferQueue queue;
+
+  bool refresh_pending;
+  sigc::connection refresh_conn;
+  sigc::connection start_conn;
+
+  /**
+   * Emitted at most once per PROGRESS_REFRESH_INTERVAL when any transfer
+   * changed.
+   */
+  sigc::signal<void> signal_update;
+
+  PurpleXferUiOps centerim_xfer_ui_ops;
+
+  static Transfers *my_instance;
+
+  Transfers();
+  Transfers(const Transfers&);
+  Transfers& operator=(const Transfers&);
+  ~Transfers();
+
+  static void init();
+  static void finalize();
+  friend class CenterIM;
+
+  Transfer *findTransfer(PurpleXfer *xfer);
+  int getRunningCount() const;
+  bool canStart() const;
+
+  void scheduleRefresh();
+  void refresh();
+  void scheduleStartQueued();
+  void startQueued();
+  void stopTransfer(Transfer *transfer);
+
+  void cancelTransfer(const Transfer *transfer);
+  void clearFinished();
+
+  static void new_xfer_(PurpleXfer *xfer)
+    { TRANSFERS->new_xfer(xfer); }
+  static void destroy_(PurpleXfer *xfer)
+    { TRANSFERS->destroy(xfer); }
+  static void add_xfer_(PurpleXfer *xfer)
+    { TRANSFERS->add_xfer(xfer); }
+  static void update_progress_(PurpleXfer *xfer, double percent)
+    { TRANSFERS->update_progress(xfer, percent); }
+  static void cancel_local_(PurpleXfer *xfer)
+    { TRANSFERS->cancel_local(xfer); }
+  static void cancel_remote_(PurpleXfer *xfer)
+    { TRANSFERS->cancel_remote(xfer); }
+  static gssize ui_write_(PurpleXfer *xfer, const guchar *buffer,
+      gssize size)
+    { return TRANSFERS->ui_write(xfer, buffer, size); }
+  static gssize ui_read_(PurpleXfer *xfer, guchar **buffer, gssize size)
+    { return TRANSFERS->ui_read(xfer, buffer, size); }
+  static void data_not_sent_(PurpleXfer *xfer, const guchar *buffer,
+      gsize size)
+    { TRANSFERS->data_not_sent(xfer, buffer, size); }
+  static void file_start_(PurpleXfer *xfer, void *data)
+    { reinterpret_cast<Transfers*>(data)->file_start(xfer); }
+
+  void new_xfer(PurpleXfer *xfer);
+  void destroy(PurpleXfer *xfer);
+  void add_xfer(PurpleXfer *xfer);
+  void update_progress(PurpleXfer *xfer, double percent);
+  void cancel_local(PurpleXfer *xfer);
+  void cancel_remote(PurpleXfer *xfer);
+  gssize ui_write(PurpleXfer *xfer, const guchar *buffer, gssize size);
+  gssize ui_read(PurpleXfer *xfer, guchar **buffer, gssize size);
+  void data_not_sent(PurpleXfer *xfer, const guchar *buffer, gsize size);
+  void file_start(PurpleXfer *xfer);
 };
 
 #endif // __TRANSFERS_H__
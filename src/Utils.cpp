@@ -54,41 +54,45 @@ const char *getStatusIndicator(PurpleStatus *status)
   }
 }
 
-char *getColorSchemeString(const char *base_color_scheme, PurpleBuddy *buddy)
+const char *getColorSchemeString(const char *base_color_scheme,
+    PurpleBuddy *buddy)
 {
-  if (!purple_account_is_connected(purple_buddy_get_account(buddy))) {
-    return g_strdup_printf("%s_offline", base_color_scheme);
-  }
+  const char *suffix;
+  if (!purple_account_is_connected(purple_buddy_get_account(buddy)))
+    suffix = "offline";
+  else {
+    PurplePresence *presence = purple_buddy_get_presence(buddy);
+    PurpleStatus *status = purple_presence_get_active_status(presence);
+    PurpleStatusType *status_type = purple_status_get_type(status);
+    PurpleStatusPrimitive prim = purple_status_type_get_primitive(
+        status_type);
 
-  PurplePresence *presence = purple_buddy_get_presence(buddy);
-  PurpleStatus *status = purple_presence_get_active_status(presence);
-  PurpleStatusType *status_type = purple_status_get_type(status);
-  PurpleStatusPrimitive prim = purple_status_type_get_primitive(status_type);
-
-  switch (prim) {
-    case PURPLE_STATUS_UNSET:
-      return g_strdup_printf("%s_offline", base_color_scheme);
-    case PURPLE_STATUS_OFFLINE:
-      return g_strdup_printf("%s_offline", base_color_scheme);
-    case PURPLE_STATUS_AVAILABLE:
-      return g_strdup_printf("%s_online", base_color_scheme);
-    case PURPLE_STATUS_UNAVAILABLE:
-      return g_strdup_printf("%s_na", base_color_scheme);
-    case PURPLE_STATUS_INVISIBLE:
-      return g_strdup_printf("%s_na", base_color_scheme);
-    case PURPLE_STATUS_AWAY:
-      return g_strdup_printf("%s_away", base_color_scheme);
-    case PURPLE_STATUS_EXTENDED_AWAY:
-      return g_strdup_printf("%s_away", base_color_scheme);
-    case PURPLE_STATUS_MOBILE:
-      return g_strdup_printf("%s_online", base_color_scheme);
-    case PURPLE_STATUS_TUNE:
-      return g_strdup_printf("%s_online", base_color_scheme);
-    case PURPLE_STATUS_MOOD:
-      return g_strdup_printf("%s_online", base_color_scheme);
-    default:
-      return g_strdup_printf("%s_offline", base_color_scheme);
+    switch (prim) {
+      case PURPLE_STATUS_AVAILABLE:
+      case PURPLE_STATUS_MOBILE:
+      case PURPLE_STATUS_TUNE:
+      case PURPLE_STATUS_MOOD:
+        suffix = "online";
+        break;
+      case PURPLE_STATUS_UNAVAILABLE:
+      case PURPLE_STATUS_INVISIBLE:
+        suffix = "na";
+        break;
+      case PURPLE_STATUS_AWAY:
+      case PURPLE_STATUS_EXTENDED_AWAY:
+        suffix = "away";
+        break;
+      default:
+        suffix = "offline";
+        break;
+    }
   }
+
+  /* The name is only looked up in the table of interned strings, a status
+   * change doesn't allocate anything. */
+  char name[128];
+  g_snprintf(name, sizeof(name), "%s_%s", base_color_scheme, suffix);
+  return g_intern_string(name);
 }
 
 char *stripAccelerator(const char *label)
@@ -27,7 +27,9 @@ namespace Utils
 {
 
 const char *getStatusIndicator(PurpleStatus *status);
-char *getColorSchemeString(const char *base_color_scheme, PurpleBuddy *buddy);
+// returns an interned string, it must not be freed
+const char *getColorSchemeString(const char *base_color_scheme,
+    PurpleBuddy *buddy);
 char *stripAccelerator(const char *label);
 
 } // namespace Utils
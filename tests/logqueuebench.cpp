@@ -0,0 +1,189 @@
+#include <src/LogQueue.h>
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Producer threads log records as fast as they can while the main thread
+ * drains them in batches, the same way libpurple and plugin threads feed the
+ * debug log. The lock-free queue is compared with a GQueue protected by
+ * a mutex. */
+
+#define QUEUE_SIZE 1024
+
+struct Bench
+{
+  LogQueue *queue;
+
+  GQueue *locked_queue;
+  GMutex *mutex;
+
+  int records;
+  // number of retries because the queue was full
+  volatile gint full;
+};
+
+static gpointer lockfree_producer(gpointer data)
+{
+  Bench *bench = static_cast<Bench*>(data);
+  for (int i = 0; i < bench->records; i++) {
+    char *text = g_strdup_printf("worker/bench: record %d", i);
+    while (!bench->queue->push(text)) {
+      g_atomic_int_inc(&bench->full);
+      g_thread_yield();
+    }
+  }
+  return NULL;
+}
+
+static gpointer locked_producer(gpointer data)
+{
+  Bench *bench = static_cast<Bench*>(data);
+  for (int i = 0; i < bench->records; i++) {
+    char *text = g_strdup_printf("worker/bench: record %d", i);
+    while (true) {
+      g_mutex_lock(bench->mutex);
+      if (g_queue_get_length(bench->locked_queue) < QUEUE_SIZE) {
+        g_queue_push_tail(bench->locked_queue, text);
+        g_mutex_unlock(bench->mutex);
+        break;
+      }
+      g_mutex_unlock(bench->mutex);
+      g_atomic_int_inc(&bench->full);
+      g_thread_yield();
+    }
+  }
+  return NULL;
+}
+
+static char *lockfree_pop(Bench *bench)
+{
+  return static_cast<char*>(bench->queue->pop());
+}
+
+static char *locked_pop(Bench *bench)
+{
+  g_mutex_lock(bench->mutex);
+  char *text = static_cast<char*>(g_queue_pop_head(bench->locked_queue));
+  g_mutex_unlock(bench->mutex);
+  return text;
+}
+
+static double run(Bench *bench, int threads_num, GThreadFunc producer,
+    char *(*pop)(Bench*), unsigned *batches)
+{
+  GThread **threads = g_new(GThread*, threads_num);
+  long total = static_cast<long>(threads_num) * bench->records;
+  long received = 0;
+  bench->full = 0;
+  *batches = 0;
+
+  GTimer *timer = g_timer_new();
+  for (int i = 0; i < threads_num; i++) {
+    GError *err = NULL;
+#if GLIB_CHECK_VERSION(2, 34, 0)
+    threads[i] = g_thread_try_new("producer", producer, bench, &err);
+#else
+    threads[i] = g_thread_create(producer, bench, TRUE, &err);
+#endif // GLIB_CHECK_VERSION(2, 34, 0)
+    if (!threads[i]) {
+      fprintf(stderr, "Error creating thread (%s).\n", err->message);
+      exit(1);
+    }
+  }
+
+  // drain everything that is available at once, like the main loop does
+  while (received < total) {
+    char *text;
+    bool any = false;
+    while ((text = pop(bench))) {
+      g_free(text);
+      received++;
+      any = true;
+    }
+    if (any)
+      (*batches)++;
+    else
+      g_thread_yield();
+  }
+  double time = g_timer_elapsed(timer, NULL);
+
+  for (int i = 0; i < threads_num; i++)
+    g_thread_join(threads[i]);
+  g_timer_destroy(timer);
+  g_free(threads);
+
+  return time;
+}
+
+static void report(const char *name, double time, long total,
+    unsigned batches, int full)
+{
+  printf("%s %.3f s, %.0f records/s, %.0f ns/record, %.1f records/batch, "
+      "%d retries\n", name, time, total / time, time * 1e9 / total,
+      batches ? static_cast<double>(total) / batches : 0.0, full);
+}
+
+static void usage(const char *prg_name)
+{
+  fprintf(stderr, "Usage: %s [threads] [records]\n"
+      "Logs records from the given number of threads, every thread logs the "
+      "given number of records.\n", prg_name);
+}
+
+int main(int argc, char *argv[])
+{
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+  g_thread_init(NULL);
+#endif // !GLIB_CHECK_VERSION(2, 32, 0)
+
+  if (argc > 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int threads_num = 4;
+  if (argc > 1 && (threads_num = atoi(argv[1])) <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Bench bench;
+  bench.records = 100000;
+  if (argc > 2 && (bench.records = atoi(argv[2])) <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  long total = static_cast<long>(threads_num) * bench.records;
+  unsigned batches;
+  printf("threads: %d, records: %ld, queue size: %d\n", threads_num, total,
+      QUEUE_SIZE);
+
+  bench.queue = new LogQueue(QUEUE_SIZE);
+  double time = run(&bench, threads_num, lockfree_producer, lockfree_pop,
+      &batches);
+  report("lock-free:", time, total, batches, bench.full);
+  delete bench.queue;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  bench.mutex = g_new(GMutex, 1);
+  g_mutex_init(bench.mutex);
+#else
+  bench.mutex = g_mutex_new();
+#endif // GLIB_CHECK_VERSION(2, 32, 0)
+  bench.locked_queue = g_queue_new();
+  time = run(&bench, threads_num, locked_producer, locked_pop, &batches);
+  report("mutex:    ", time, total, batches, bench.full);
+  g_queue_free(bench.locked_queue);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+  g_mutex_clear(bench.mutex);
+  g_free(bench.mutex);
+#else
+  g_mutex_free(bench.mutex);
+#endif // GLIB_CHECK_VERSION(2, 32, 0)
+
+  return 0;
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
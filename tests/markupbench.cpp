@@ -0,0 +1,171 @@
+#include <src/Markup.h>
+
+#include <glib.h>
+#include <libpurple/purple.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/* Messages as they are received from various protocols. XMPP sends XHTML-IM,
+ * AIM/ICQ sends HTML with font tags, IRC and most of other protocols send
+ * plain text with escaped entities. */
+static const char *corpus[] = {
+  "hi",
+  "are you coming to the meeting today?",
+  "ok, see you there &amp; don't forget the slides",
+  "<span style=\"font-weight: bold;\">important:</span> the build is broken",
+  "<body xmlns=\"http://www.w3.org/1999/xhtml\"><p><span style=\"color: "
+    "#ff0000;\">red</span> and <em>emphasis</em></p></body>",
+  "<HTML><BODY BGCOLOR=\"#ffffff\"><FONT FACE=\"Arial\" SIZE=\"2\" "
+    "COLOR=\"#000080\">how are you?</FONT></BODY></HTML>",
+  "<FONT COLOR=\"#0000ff\"><B>lunch?</B></FONT><BR>at noon<BR>",
+  "look at this: <a href=\"http://www.example.com/some/long/path?query=1"
+    "&amp;other=2\">http://www.example.com/some/long/path?query=1&amp;"
+    "other=2</a>",
+  "<a href='http://www.example.org/'>the project page</a> has the details",
+  "x &lt; y &amp;&amp; y &gt; z, &quot;quoted&quot; &#8364;42 &#x263A;",
+  "line one<br/>line two<br/>line three",
+  "<ul><li>first item</li><li>second item</li><li>third item</li></ul>",
+  "<table><tr><td>name</td><td>value</td></tr><tr><td>cpu</td>"
+    "<td>42%</td></tr></table>",
+  "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Duis dui dui, "
+    "interdum eget tempor auctor, viverra suscipit velit. Phasellus vel "
+    "magna odio. Duis rutrum tortor at nisi auctor tincidunt.",
+};
+
+static void usage(const char *prg_name)
+{
+  fprintf(stderr, "Usage: %s [iterations] [file]\n"
+      "Strips markup from built-in sample messages, or from lines of the "
+      "given file.\n", prg_name);
+}
+
+/* Compares the output with purple_markup_strip_html() which was used before
+ * Markup::stripHTML(). Tabs are turned into spaces first because the
+ * libpurple version does not preserve them. Returns the number of messages
+ * with a different output and prints the first few of them. */
+static int compare(const std::vector<const char*>& messages)
+{
+  int differ = 0;
+  GString *out = g_string_new(NULL);
+  for (std::vector<const char*>::const_iterator i = messages.begin();
+      i != messages.end(); i++) {
+    g_string_truncate(out, 0);
+    Markup::stripHTML(*i, out);
+    for (gsize j = 0; j < out->len; j++)
+      if (out->str[j] == '\t')
+        out->str[j] = ' ';
+
+    char *expected = purple_markup_strip_html(*i);
+    if (strcmp(out->str, expected)) {
+      if (differ < 5)
+        printf("output differs:\n  input:     %s\n  libpurple: %s\n"
+            "  current:   %s\n", *i, expected, out->str);
+      differ++;
+    }
+    g_free(expected);
+  }
+  g_string_free(out, TRUE);
+
+  return differ;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int iterations = 10000;
+  if (argc > 1 && (iterations = atoi(argv[1])) <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<const char*> messages;
+  char *contents = NULL;
+  if (argc > 2) {
+    GError *err = NULL;
+    if (!g_file_get_contents(argv[2], &contents, NULL, &err)) {
+      fprintf(stderr, "Error reading file '%s' (%s).\n", argv[2],
+          err->message);
+      g_clear_error(&err);
+      return 1;
+    }
+    for (char *line = strtok(contents, "\n"); line;
+        line = strtok(NULL, "\n"))
+      messages.push_back(line);
+  }
+  else
+    messages.assign(corpus, corpus + G_N_ELEMENTS(corpus));
+
+  if (messages.empty()) {
+    fprintf(stderr, "No messages to process.\n");
+    g_free(contents);
+    return 1;
+  }
+
+  size_t bytes = 0;
+  for (std::vector<const char*>::iterator i = messages.begin();
+      i != messages.end(); i++)
+    bytes += strlen(*i);
+
+  int differ = compare(messages);
+
+  // the previous implementation
+  GTimer *timer = g_timer_new();
+  for (int i = 0; i < iterations; i++)
+    for (std::vector<const char*>::iterator j = messages.begin();
+        j != messages.end(); j++)
+      g_free(purple_markup_strip_html(*j));
+  double purple_time = g_timer_elapsed(timer, NULL);
+
+  // reused buffer
+  GString *out = g_string_new(NULL);
+  size_t out_bytes = 0;
+
+  g_timer_start(timer);
+  for (int i = 0; i < iterations; i++)
+    for (std::vector<const char*>::iterator j = messages.begin();
+        j != messages.end(); j++) {
+      g_string_truncate(out, 0);
+      Markup::stripHTML(*j, out);
+      out_bytes += out->len;
+    }
+  double buffer_time = g_timer_elapsed(timer, NULL);
+
+  // allocating variant for comparison
+  g_timer_start(timer);
+  for (int i = 0; i < iterations; i++)
+    for (std::vector<const char*>::iterator j = messages.begin();
+        j != messages.end(); j++)
+      g_free(Markup::stripHTML(*j));
+  double alloc_time = g_timer_elapsed(timer, NULL);
+
+  g_timer_destroy(timer);
+  g_string_free(out, TRUE);
+
+  double total_messages = static_cast<double>(messages.size()) * iterations;
+  double total_mb = static_cast<double>(bytes) * iterations / 1e6;
+
+  printf("messages: %lu x %d, input: %lu bytes, output: %lu bytes\n",
+      static_cast<unsigned long>(messages.size()), iterations,
+      static_cast<unsigned long>(bytes),
+      static_cast<unsigned long>(out_bytes / iterations));
+  printf("libpurple:     %.3f s, %.1f MB/s, %.0f ns/message\n", purple_time,
+      total_mb / purple_time, purple_time * 1e9 / total_messages);
+  printf("reused buffer: %.3f s, %.1f MB/s, %.0f ns/message\n", buffer_time,
+      total_mb / buffer_time, buffer_time * 1e9 / total_messages);
+  printf("allocating:    %.3f s, %.1f MB/s, %.0f ns/message\n", alloc_time,
+      total_mb / alloc_time, alloc_time * 1e9 / total_messages);
+  printf("output differs from libpurple in %d of %lu messages\n", differ,
+      static_cast<unsigned long>(messages.size()));
+
+  g_free(contents);
+
+  return 0;
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
@@ -0,0 +1,261 @@
+#include <src/SearchIndex.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Writes conversation logfiles with random messages into a given directory,
+ * indexes them, runs a few queries and checks their results against a linear
+ * scan of the messages. Then more messages are appended and the index is
+ * opened again to check that it is maintained incrementally. */
+
+#define FILES_NUM 20
+#define WORDS_NUM 5000
+#define MAX_RESULTS 100
+
+struct Message
+{
+  int file;
+  time_t time;
+  std::vector<std::string> tokens;
+};
+
+static std::vector<std::string> words;
+static std::vector<Message> messages;
+// every message is a second newer than the previous one
+static time_t clock_time = 1000000;
+static GTimer *timer;
+
+// returns the time since the start in microseconds
+static gint64 now()
+{
+  return static_cast<gint64>(g_timer_elapsed(timer, NULL) * 1000000);
+}
+
+static std::string make_word()
+{
+  std::string word;
+  int len = 3 + rand() % 6;
+  for (int i = 0; i < len; i++)
+    word += 'a' + rand() % 26;
+  return word;
+}
+
+static char *log_path(const char *dir, int file)
+{
+  char *name = g_strdup_printf("buddy%d", file);
+  char *path = g_build_filename(dir, "clogs", "XMPP", "user", name, NULL);
+  g_free(name);
+  return path;
+}
+
+static gint64 write_messages(const char *dir, int num, int file)
+{
+  char *path = log_path(dir, file);
+  FILE *f = fopen(path, "a");
+  g_free(path);
+  if (!f) {
+    perror("fopen");
+    exit(1);
+  }
+
+  for (int i = 0; i < num; i++) {
+    Message msg;
+    msg.file = file;
+    msg.time = clock_time++;
+    std::string text;
+    int len = 1 + rand() % 12;
+    for (int j = 0; j < len; j++) {
+      // make some words much more frequent than others
+      int w = rand() % WORDS_NUM;
+      if (rand() % 2)
+        w %= 50;
+      if (j)
+        text += ' ';
+      text += words[w];
+    }
+    SearchIndex::tokenize(text.c_str(), msg.tokens);
+    messages.push_back(msg);
+    fprintf(f, "\f\nIN\nMSG2\n%ld\n%ld\n%s\n", static_cast<long>(msg.time),
+        static_cast<long>(msg.time), text.c_str());
+  }
+
+  long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+// returns times of the matching messages, the newest first
+static std::vector<time_t> find_matches(
+    const std::vector<std::string>& query)
+{
+  std::vector<time_t> times;
+  for (std::vector<Message>::iterator i = messages.begin();
+      i != messages.end(); i++) {
+    const std::vector<std::string>& tokens = i->tokens;
+    bool all = true;
+    for (std::vector<std::string>::const_iterator j = query.begin();
+        all && j != query.end(); j++) {
+      bool found = false;
+      for (std::vector<std::string>::const_iterator k = tokens.begin();
+          !found && k != tokens.end(); k++)
+        found = *k == *j;
+      all = found;
+    }
+    if (all)
+      times.push_back(i->time);
+  }
+  std::sort(times.begin(), times.end(), std::greater<time_t>());
+  return times;
+}
+
+static bool run_queries(SearchIndex& index, const char *label)
+{
+  bool ok = true;
+  gint64 total = 0;
+  int queries = 0;
+  for (int i = 0; i < 200; i++) {
+    std::vector<std::string> query;
+    query.push_back(words[rand() % 50]);
+    if (i % 2)
+      query.push_back(words[rand() % WORDS_NUM]);
+
+    std::string text;
+    for (std::vector<std::string>::iterator j = query.begin();
+        j != query.end(); j++)
+      text += *j + ' ';
+
+    SearchIndex::Results results;
+    gint64 start = now();
+    index.query(text.c_str(), MAX_RESULTS, results);
+    total += now() - start;
+    queries++;
+
+    // the newest matches of all logfiles are expected in order
+    std::vector<time_t> expected = find_matches(query);
+    if (expected.size() > MAX_RESULTS)
+      expected.resize(MAX_RESULTS);
+    if (results.size() != expected.size()) {
+      fprintf(stderr, "%s: query '%s' returned %u results, expected %u\n",
+          label, text.c_str(), static_cast<unsigned>(results.size()),
+          static_cast<unsigned>(expected.size()));
+      ok = false;
+      continue;
+    }
+    for (size_t j = 0; j < expected.size(); j++)
+      if (results[j].time != expected[j]) {
+        fprintf(stderr, "%s: query '%s' result %u is from %ld, expected "
+            "%ld\n", label, text.c_str(), static_cast<unsigned>(j),
+            static_cast<long>(results[j].time),
+            static_cast<long>(expected[j]));
+        ok = false;
+        break;
+      }
+  }
+
+  printf("%s: %d queries, %.3f ms/query\n", label, queries,
+      total / 1000.0 / queries);
+  return ok;
+}
+
+static void usage(const char *prg_name)
+{
+  fprintf(stderr, "Usage: %s dir [messages]\n"
+      "Writes the given number of messages into logfiles in an empty "
+      "directory and searches them.\n", prg_name);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const char *dir = argv[1];
+  int num = 200000;
+  if (argc > 2 && (num = atoi(argv[2])) <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  timer = g_timer_new();
+  srand(1);
+  for (int i = 0; i < WORDS_NUM; i++)
+    words.push_back(make_word());
+
+  char *logs_dir = g_build_filename(dir, "clogs", NULL);
+  char *index_dir = g_build_filename(dir, "search", NULL);
+  char *account_dir = g_build_filename(logs_dir, "XMPP", "user", NULL);
+  g_mkdir_with_parents(account_dir, S_IRUSR | S_IWUSR | S_IXUSR);
+  g_free(account_dir);
+
+  for (int i = 0; i < FILES_NUM; i++)
+    write_messages(dir, num / FILES_NUM, i);
+
+  GError *err = NULL;
+  SearchIndex *index = new SearchIndex(index_dir, logs_dir);
+  if (!index->open(&err)) {
+    fprintf(stderr, "%s\n", err->message);
+    g_clear_error(&err);
+  }
+
+  gint64 start = now();
+  index->scan();
+  int steps = 0;
+  while (index->scanStep(&err))
+    steps++;
+  printf("indexed %d messages in %.3f s (%d steps)\n",
+      static_cast<int>(messages.size()), (now() - start) / 1000000.0, steps);
+
+  bool ok = run_queries(*index, "initial");
+
+  // append messages the way Conversation::write() does
+  start = now();
+  for (int i = 0; i < 1000; i++) {
+    int file = rand() % FILES_NUM;
+    gint64 size = write_messages(dir, 1, file);
+    char *path = g_strdup_printf("XMPP/user/buddy%d", file);
+    if (!index->update(path, size, &err)) {
+      fprintf(stderr, "%s\n", err->message);
+      g_clear_error(&err);
+      ok = false;
+    }
+    g_free(path);
+  }
+  printf("appended 1000 messages, %.3f ms/message\n",
+      (now() - start) / 1000.0 / 1000);
+  ok = run_queries(*index, "updated") && ok;
+
+  // open the index again, the journal has to be replayed
+  delete index;
+  start = now();
+  index = new SearchIndex(index_dir, logs_dir);
+  if (!index->open(&err)) {
+    fprintf(stderr, "%s\n", err->message);
+    g_clear_error(&err);
+    ok = false;
+  }
+  index->scan();
+  steps = 0;
+  while (index->scanStep(&err))
+    steps++;
+  printf("reopened in %.3f s (%d scan steps)\n",
+      (now() - start) / 1000000.0, steps);
+  ok = run_queries(*index, "reopened") && ok;
+
+  delete index;
+  g_free(logs_dir);
+  g_free(index_dir);
+  g_timer_destroy(timer);
+
+  printf(ok ? "all results correct\n" : "some results are wrong\n");
+  return !ok;
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
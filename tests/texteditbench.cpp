@@ -0,0 +1,199 @@
+#include <cppconsui/TextEdit.h>
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+/* Types a sequence of messages into TextEdit widgets, moves the cursor and
+ * deletes characters in them and clears them as if the messages were sent.
+ * The same sequence is run with the buffer policy of the widget and with
+ * the previous policy which expanded the gap by a fixed amount and
+ * reallocated the buffer on every clear(). */
+
+#define MESSAGES_NUM 2000
+#define GAP_SIZE_EXPAND 4096
+
+static GTimer *timer;
+
+// returns the time since the start in microseconds
+static gint64 now()
+{
+  return static_cast<gint64>(g_timer_elapsed(timer, NULL) * 1000000);
+}
+
+class BenchEdit
+: public CppConsUI::TextEdit
+{
+public:
+  BenchEdit() : CppConsUI::TextEdit(80, 5) {}
+  virtual ~BenchEdit() {}
+
+  void insert(const char *text, size_t bytes)
+    { insertTextAtCursor(text, bytes); }
+  void backspace() { deleteFromCursor(DELETE_CHARS, DIR_BACK); }
+  void left() { moveCursor(MOVE_LOGICAL_POSITIONS, DIR_BACK); }
+  void right() { moveCursor(MOVE_LOGICAL_POSITIONS, DIR_FORWARD); }
+
+protected:
+
+private:
+  BenchEdit(const BenchEdit&);
+  BenchEdit& operator=(const BenchEdit&);
+};
+
+// the buffer policy of TextEdit before it grew geometrically
+class LinearEdit
+: public BenchEdit
+{
+public:
+  LinearEdit() {}
+  virtual ~LinearEdit() {}
+
+  virtual void clear()
+  {
+    g_free(buffer);
+    buffer = bufend = NULL;
+    initBuffer(GAP_SIZE_EXPAND);
+  }
+  virtual void trimBuffer() {}
+
+protected:
+  virtual void expandGap(size_t size)
+  {
+    if (size <= getGapSize())
+      return;
+
+    size += GAP_SIZE_EXPAND;
+
+    const char *origbuffer = buffer;
+    buffer = g_renew(char, buffer, (bufend - buffer) + size);
+
+    point += buffer - origbuffer;
+    bufend += buffer - origbuffer;
+    gapstart += buffer - origbuffer;
+    gapend += buffer - origbuffer;
+
+    g_memmove(gapend + size, gapend, bufend - gapend);
+    gapend += size;
+    bufend += size;
+
+    buffer_stats.reallocs++;
+    if (static_cast<size_t>(bufend - buffer) > buffer_stats.max_capacity)
+      buffer_stats.max_capacity = bufend - buffer;
+  }
+
+private:
+  LinearEdit(const LinearEdit&);
+  LinearEdit& operator=(const LinearEdit&);
+};
+
+static char random_char()
+{
+  int r = rand() % 32;
+  if (r < 26)
+    return 'a' + r;
+  if (r == 26)
+    return '\n';
+  return ' ';
+}
+
+static void run(BenchEdit& edit, const char *label)
+{
+  srand(1);
+
+  gint64 insert = 0, del = 0, move = 0, start;
+  unsigned long inserts = 0, dels = 0, moves = 0;
+  std::string paste;
+  for (int i = 0; i < MESSAGES_NUM; i++) {
+    if (rand() % 20 == 0) {
+      // paste a long text at once
+      paste.clear();
+      size_t len = 8192 + rand() % 57344;
+      for (size_t j = 0; j < len; j++)
+        paste += random_char();
+
+      start = now();
+      edit.insert(paste.c_str(), paste.size());
+      insert += now() - start;
+      inserts++;
+    }
+    else {
+      // type a short message, fix a typo now and then
+      int len = 20 + rand() % 180;
+      for (int j = 0; j < len; j++) {
+        char c = random_char();
+        start = now();
+        edit.insert(&c, 1);
+        insert += now() - start;
+        inserts++;
+
+        if (rand() % 10 == 0) {
+          start = now();
+          edit.backspace();
+          del += now() - start;
+          dels++;
+        }
+      }
+    }
+
+    // edit the message in the middle
+    int steps = rand() % 100;
+    start = now();
+    for (int j = 0; j < steps; j++)
+      edit.left();
+    move += now() - start;
+    moves += steps;
+
+    start = now();
+    for (int j = 0; j < 10; j++)
+      edit.backspace();
+    del += now() - start;
+    dels += 10;
+
+    start = now();
+    edit.insert("fix", 3);
+    insert += now() - start;
+    inserts++;
+
+    start = now();
+    for (int j = 0; j < steps; j++)
+      edit.right();
+    move += now() - start;
+    moves += steps;
+
+    // send the message
+    edit.getText();
+    edit.clear();
+  }
+
+  CppConsUI::TextEdit::BufferStats stats = edit.getBufferStats();
+  printf("%s: insert %.3f us, delete %.3f us, move %.3f us\n", label,
+      static_cast<double>(insert) / inserts,
+      static_cast<double>(del) / dels, static_cast<double>(move) / moves);
+  printf("%s: %u allocations, max %lu bytes, %lu bytes after clear()",
+      label, stats.reallocs, static_cast<unsigned long>(stats.max_capacity),
+      static_cast<unsigned long>(stats.capacity));
+  edit.trimBuffer();
+  stats = edit.getBufferStats();
+  printf(", %lu bytes after trimBuffer()\n",
+      static_cast<unsigned long>(stats.capacity));
+}
+
+int main()
+{
+  timer = g_timer_new();
+
+  LinearEdit *linear = new LinearEdit;
+  run(*linear, "previous");
+  delete linear;
+
+  BenchEdit *edit = new BenchEdit;
+  run(*edit, "current");
+  delete edit;
+
+  g_timer_destroy(timer);
+  return 0;
+}
+
+/* vim: set tabstop=2 shiftwidth=2 textwidth=78 expandtab : */
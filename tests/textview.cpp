@@ -22,6 +22,8 @@ private:
   TestWindow& operator=(const TestWindow&);
 
   void actionToggleScrollbar();
+  void actionToggleFind();
+  void actionFind(int direction);
 };
 
 TestWindow::TestWindow()
@@ -67,6 +69,15 @@ TestWindow::TestWindow()
   declareBindable("textviewwindow", "toggle-scrollbar", sigc::mem_fun(this,
         &TestWindow::actionToggleScrollbar),
       InputProcessor::BINDABLE_NORMAL);
+  declareBindable("textviewwindow", "toggle-find", sigc::mem_fun(this,
+        &TestWindow::actionToggleFind),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("textviewwindow", "find-prev", sigc::bind(sigc::mem_fun(
+          this, &TestWindow::actionFind), -1),
+      InputProcessor::BINDABLE_NORMAL);
+  declareBindable("textviewwindow", "find-next", sigc::bind(sigc::mem_fun(
+          this, &TestWindow::actionFind), 1),
+      InputProcessor::BINDABLE_NORMAL);
 }
 
 void TestWindow::actionToggleScrollbar()
@@ -74,6 +85,18 @@ void TestWindow::actionToggleScrollbar()
   textview->setScrollBar(!textview->hasScrollBar());
 }
 
+void TestWindow::actionToggleFind()
+{
+  static bool find = false;
+  find = !find;
+  textview->setFindText(find ? "TORTOR" : NULL);
+}
+
+void TestWindow::actionFind(int direction)
+{
+  textview->findNext(direction);
+}
+
 // TestApp class
 class TestApp
 : public CppConsUI::InputProcessor
@@ -102,6 +125,9 @@ TestApp::TestApp()
   KEYCONFIG->loadDefaultKeyConfig();
   KEYCONFIG->bindKey("testapp", "quit", "F10");
   KEYCONFIG->bindKey("textviewwindow", "toggle-scrollbar", "F1");
+  KEYCONFIG->bindKey("textviewwindow", "toggle-find", "F2");
+  KEYCONFIG->bindKey("textviewwindow", "find-prev", "F3");
+  KEYCONFIG->bindKey("textviewwindow", "find-next", "F4");
 
   g_log_set_default_handler(g_log_func_, this);
 